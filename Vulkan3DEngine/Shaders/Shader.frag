@@ -1,4 +1,5 @@
 #version 450
+#extension GL_EXT_nonuniform_qualifier : require
 
 struct DirectionalLight {
     vec3 direction;
@@ -16,30 +17,55 @@ layout(set = 0, binding = 0) uniform GlobalUniformBufferObject {
     mat4 proj;
     vec3 cameraPosition;
     DirectionalLight directionalLight;
-    PointLight pointLights[64];
-    int activePointLights;
     float ka; // Ambient coefficient
+    uint rawTextureColor; // MSAA on: the texture color is used still sRGB encoded
 } global;
 
+struct LightClusterInfo {
+    uint tileSize; // pixels across a tile
+    uint gridX;
+    uint gridY;
+    uint gridZ; // depth slices
+    float nearPlane;
+    float sliceScale; // slice = log(depth / nearPlane) * sliceScale
+    float attenuationCutoff;
+    uint lightCount;
+    float minLightContribution;
+    uint padding;
+};
+
+// Point lights binned into screen tiles and exponential depth slices by the LightGrid
+layout(std430, set = 3, binding = 0) readonly buffer PointLightBuffer {
+    PointLight lights[];
+} pointLights;
+
+layout(std430, set = 3, binding = 1) readonly buffer ClusterBuffer {
+    LightClusterInfo info;
+    uvec2 ranges[]; // offset into the light indices and light count of every cluster
+} clusters;
 
-layout(set = 1, binding = 0) uniform ObjectUniformBufferObject {
-    mat4 model;
-    float shininess;
-    float kd; // Diffuse coefficient
-    float ks; // Specular coefficient
-} model;
+layout(std430, set = 3, binding = 2) readonly buffer ClusterLightIndexBuffer {
+    uint indices[];
+} clusterLights;
 
-layout(set = 2, binding = 0) uniform sampler2D texSampler;
+// Every loaded texture, indexed by the slot stored in the instance data
+layout(set = 2, binding = 0) uniform sampler2D textures[];
 
 layout(location = 0) in vec3 fragColor;
 layout(location = 1) in vec2 fragTexCoord;
 layout(location = 2) in vec3 fragNormal;
 layout(location = 3) in vec3 fragPos;
 layout(location = 4) in vec3 directionToCamera;
+layout(location = 5) flat in vec3 fragMaterial; // shininess, kd, ks
+layout(location = 6) flat in uint fragTextureIndex;
 
 layout(location = 0) out vec4 outColor;
 
 void main() {
+    float shininess = fragMaterial.x;
+    float kd = fragMaterial.y;
+    float ks = fragMaterial.z;
+
     vec3 normal = normalize(fragNormal);
     vec3 viewDir = normalize(directionToCamera);
 
@@ -48,42 +74,59 @@ void main() {
     vec3 lightDir = normalize(-global.directionalLight.direction);
     float diff = max(dot(normal, lightDir), 0.0);
     vec3 halfwayDir = normalize(lightDir + viewDir);
-    float spec = pow(max(dot(normal, halfwayDir), 0.0), model.shininess);
-    directional += global.directionalLight.color.w * (model.kd * diff + model.ks * spec) * global.directionalLight.color.xyz;
+    float spec = pow(max(dot(normal, halfwayDir), 0.0), shininess);
+    directional += global.directionalLight.color.w * (kd * diff + ks * spec) * global.directionalLight.color.xyz;
+
+    // Point lights reaching the fragment's cluster
+    LightClusterInfo info = clusters.info;
+    float depth = -(global.view * vec4(fragPos, 1.0)).z;
+    uint slice = uint(clamp(log(max(depth, info.nearPlane) / info.nearPlane) * info.sliceScale, 0.0, float(info.gridZ - 1)));
+    uvec2 tile = min(uvec2(gl_FragCoord.xy) / info.tileSize, uvec2(info.gridX - 1, info.gridY - 1));
+    uvec2 range = clusters.ranges[(slice * info.gridY + tile.y) * info.gridX + tile.x];
 
-    // Point light
     vec3 point = vec3(0.0, 0.0, 0.0);
-    for(int i = 0; i < global.activePointLights; ++i) {
-        vec3 L = global.pointLights[i].position - fragPos;
+    for(uint i = range.x; i < range.x + range.y; ++i) {
+        PointLight light = pointLights.lights[clusterLights.indices[i]];
+        vec3 L = light.position - fragPos;
         float distance = length(L);
         vec3 lightDir = normalize(L);
         float diff = max(dot(normal, lightDir), 0.0);
 
         vec3 halfwayDir = normalize(lightDir + viewDir);
-        float spec = pow(max(dot(normal, halfwayDir), 0.0), model.shininess);
+        float spec = pow(max(dot(normal, halfwayDir), 0.0), shininess);
 
-        float d = max(distance - global.pointLights[i].radius, 0.0) / global.pointLights[i].color.w;
+        float d = max(distance - light.radius, 0.0) / light.color.w;
         L /= distance;
 
         // Attenuation
         // calculate basic attenuation
-        float denom = d/global.pointLights[i].radius + 1;
+        float denom = d/light.radius + 1;
         float attenuation = 1 / (denom*denom);
          
         // scale and bias attenuation such that:
         //   attenuation == 0 at extent of max influence
         //   attenuation == 1 when d == 0
-        float cutoff = 0.0001;
+        // the light ends where its brightest channel adds less than minLightContribution, see LightGrid::getLightCutoff
+        float brightness = light.color.w * max(light.color.x, max(light.color.y, light.color.z));
+        float cutoff = clamp(info.attenuationCutoff + (1 - info.attenuationCutoff) * info.minLightContribution / max(brightness, 1e-6),
+            info.attenuationCutoff, 0.5);
         attenuation = (attenuation - cutoff) / (1 - cutoff);
         attenuation = max(attenuation, 0.0);
          
         //diff = max(dot(normal, L), 0.0);
 
-        point += global.pointLights[i].color.xyz * (model.kd * diff + model.ks * spec) * global.pointLights[i].color.w * attenuation;
+        point += light.color.xyz * (kd * diff + ks * spec) * light.color.w * attenuation;
     }
 
 
-    vec4 texColor = texture(texSampler, fragTexCoord);
+    vec4 texColor = texture(textures[nonuniformEXT(fragTextureIndex)], fragTexCoord);
+    // The images are always sRGB, so a sample count change needs no reload; with MSAA on the color is encoded
+    // again, as it was read through a UNORM format before
+    if (global.rawTextureColor != 0) {
+        vec3 low = texColor.rgb * 12.92;
+        vec3 high = 1.055 * pow(texColor.rgb, vec3(1.0 / 2.4)) - 0.055;
+        texColor.rgb = mix(high, low, lessThanEqual(texColor.rgb, vec3(0.0031308)));
+    }
     vec3 result = (global.ka + directional + point) * fragColor * texColor.rgb;
     outColor = vec4(result, 1.0);
 }
\ No newline at end of file
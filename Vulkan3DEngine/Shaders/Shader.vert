@@ -5,31 +5,27 @@ struct DirectionalLight {
     vec4 color; // w is for intensity
 };
 
-struct PointLight {
-    vec3 position;
-    float radius;
-    vec4 color;  // w is for intensity
-};
-
 layout(set = 0, binding = 0) uniform GlobalUniformBufferObject {
     mat4 view;
     mat4 proj;
     vec3 cameraPosition;
     DirectionalLight directionalLight;
-    PointLight pointLights[64];
-    int activePointLights;
     float ka; // Ambient coefficient
 } global;
 
 
-layout(set = 1, binding = 0) uniform ObjectUniformBufferObject {
+struct ObjectData {
     mat4 model;
     float shininess;
     float kd; // Diffuse coefficient
     float ks; // Specular coefficient
-} model;
+    uint textureIndex; // slot in the bindless texture array
+};
 
-layout(set = 2, binding = 0) uniform sampler2D texSampler;
+// One entry per drawn model, indexed by gl_InstanceIndex
+layout(std430, set = 1, binding = 0) readonly buffer ObjectBuffer {
+    ObjectData objects[];
+} objectBuffer;
 
 layout(location = 0) in vec3 inPosition;
 layout(location = 1) in vec3 inColor;
@@ -41,8 +37,11 @@ layout(location = 1) out vec2 fragTexCoord;
 layout(location = 2) out vec3 fragNormal;
 layout(location = 3) out vec3 fragPos;
 layout(location = 4) out vec3 directionToCamera;
+layout(location = 5) flat out vec3 fragMaterial; // shininess, kd, ks
+layout(location = 6) flat out uint fragTextureIndex;
 
 void main() {
+    ObjectData model = objectBuffer.objects[gl_InstanceIndex];
     vec4 posWorld = model.model * vec4(inPosition, 1.0);
     gl_Position = global.proj * global.view * posWorld;
     fragColor = inColor;
@@ -50,4 +49,6 @@ void main() {
     fragNormal = normalize(mat3(transpose(inverse(model.model))) * inNormal);
     fragPos = posWorld.xyz;
     directionToCamera = global.cameraPosition - fragPos;
+    fragMaterial = vec3(model.shininess, model.kd, model.ks);
+    fragTextureIndex = model.textureIndex;
 }
@@ -0,0 +1,69 @@
+#version 450
+
+struct DirectionalLight {
+    vec3 direction;
+    vec4 color; // w is for intensity
+};
+
+layout(set = 0, binding = 0) uniform GlobalUniformBufferObject {
+    mat4 view;
+    mat4 proj;
+    vec3 cameraPosition;
+    DirectionalLight directionalLight;
+    float ka; // Ambient coefficient
+} global;
+
+
+struct ObjectData {
+    mat4 model;
+    float shininess;
+    float kd; // Diffuse coefficient
+    float ks; // Specular coefficient
+    uint textureIndex; // slot in the bindless texture array
+};
+
+// One entry per drawn model, indexed by gl_InstanceIndex
+layout(std430, set = 1, binding = 0) readonly buffer ObjectBuffer {
+    ObjectData objects[];
+} objectBuffer;
+
+// Dequantization of the mesh being drawn
+layout(push_constant) uniform MeshConstants {
+    vec4 positionOffset; // AABB minimum
+    vec4 positionScale;  // AABB extent
+} mesh;
+
+// PackedVertex, there is no color
+layout(location = 0) in vec4 inPosition; // unorm16 within the mesh AABB
+layout(location = 2) in vec2 inTexCoord; // half float
+layout(location = 3) in vec2 inNormal;   // octahedral, snorm16
+
+layout(location = 0) out vec3 fragColor;
+layout(location = 1) out vec2 fragTexCoord;
+layout(location = 2) out vec3 fragNormal;
+layout(location = 3) out vec3 fragPos;
+layout(location = 4) out vec3 directionToCamera;
+layout(location = 5) flat out vec3 fragMaterial; // shininess, kd, ks
+layout(location = 6) flat out uint fragTextureIndex;
+
+vec3 octahedralDecode(vec2 e) {
+    vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+    float t = max(-n.z, 0.0);
+    n.x += n.x >= 0.0 ? -t : t;
+    n.y += n.y >= 0.0 ? -t : t;
+    return normalize(n);
+}
+
+void main() {
+    ObjectData model = objectBuffer.objects[gl_InstanceIndex];
+    vec3 position = mesh.positionOffset.xyz + inPosition.xyz * mesh.positionScale.xyz;
+    vec4 posWorld = model.model * vec4(position, 1.0);
+    gl_Position = global.proj * global.view * posWorld;
+    fragColor = vec3(1.0);
+    fragTexCoord = inTexCoord;
+    fragNormal = normalize(mat3(transpose(inverse(model.model))) * octahedralDecode(inNormal));
+    fragPos = posWorld.xyz;
+    directionToCamera = global.cameraPosition - fragPos;
+    fragMaterial = vec3(model.shininess, model.kd, model.ks);
+    fragTextureIndex = model.textureIndex;
+}
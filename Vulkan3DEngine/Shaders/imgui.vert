@@ -0,0 +1,22 @@
+#version 450
+
+// Same interface as the shader built into the ImGui Vulkan backend, so the backend's descriptor sets and push
+// constants stay valid with a pipeline from the PipelineLibrary bound instead of its own
+layout(location = 0) in vec2 inPosition;
+layout(location = 1) in vec2 inTexCoord;
+layout(location = 2) in vec4 inColor;
+
+layout(push_constant) uniform PushConstants {
+    vec2 scale;
+    vec2 translate;
+} pc;
+
+layout(location = 0) out vec4 fragColor;
+layout(location = 1) out vec2 fragTexCoord;
+
+void main()
+{
+    fragColor = inColor;
+    fragTexCoord = inTexCoord;
+    gl_Position = vec4(inPosition * pc.scale + pc.translate, 0.0, 1.0);
+}
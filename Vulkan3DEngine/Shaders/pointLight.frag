@@ -5,8 +5,9 @@ layout (location = 1) flat in int lightIndex;
 layout (location = 0) out vec4 outColor;
 
 struct PointLight {
-  vec4 position; // ignore w
-  vec4 color; // w is intensity
+    vec3 position;
+    float radius;
+    vec4 color;  // w is for intensity
 };
 
 struct DirectionalLight {
@@ -19,11 +20,13 @@ layout(set = 0, binding = 0) uniform GlobalUniformBufferObject {
     mat4 proj;
     vec3 cameraPosition;
     DirectionalLight directionalLight;
-    PointLight pointLights[64];
-    int activePointLights;
     float ka; // Ambient coefficient
 } global;
 
+layout(std430, set = 1, binding = 0) readonly buffer PointLightBuffer {
+    PointLight lights[];
+} pointLights;
+
 const float M_PI = 3.1415926538;
 
 void main() {
@@ -33,5 +36,5 @@ void main() {
   }
 
   float cosDis = 0.5 * (cos(dis * M_PI) + 1.0); // ranges from 1 -> 0
-  outColor = vec4(global.pointLights[lightIndex].color.xyz + 0.5 * cosDis, cosDis);
+  outColor = vec4(pointLights.lights[lightIndex].color.xyz + 0.5 * cosDis, cosDis);
 }
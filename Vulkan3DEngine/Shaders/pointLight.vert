@@ -33,20 +33,24 @@ layout(set = 0, binding = 0) uniform GlobalUniformBufferObject {
     mat4 proj;
     vec3 cameraPosition;
     DirectionalLight directionalLight;
-    PointLight pointLights[64];
-    int activePointLights;
     float ka; // Ambient coefficient
 } global;
 
+// Sorted far to near by the LightGrid, as the billboards are blended without a depth test
+layout(std430, set = 1, binding = 0) readonly buffer PointLightBuffer {
+    PointLight lights[];
+} pointLights;
+
 void main() {
   fragOffset = OFFSETS[gl_VertexIndex];
   vec3 cameraRightWorld = {global.view[0][0], global.view[1][0], global.view[2][0]};
   vec3 cameraUpWorld = {global.view[0][1], global.view[1][1], global.view[2][1]};
 
   lightIndex = gl_InstanceIndex;
-  vec3 positionWorld = global.pointLights[lightIndex].position.xyz
-    + global.pointLights[lightIndex].radius * fragOffset.x * cameraRightWorld
-    + global.pointLights[lightIndex].radius * fragOffset.y * cameraUpWorld;
+  PointLight light = pointLights.lights[lightIndex];
+  vec3 positionWorld = light.position.xyz
+    + light.radius * fragOffset.x * cameraRightWorld
+    + light.radius * fragOffset.y * cameraUpWorld;
 
   gl_Position = global.proj * global.view * vec4(positionWorld, 1.0);
 }
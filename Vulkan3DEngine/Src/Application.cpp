@@ -3,6 +3,12 @@
 #include "Camera.h"
 #include "SceneObjectManager.h"
 #include "Window.h"
+#include "MeshFile.h"
+#include "TextureFile.h"
+#include "Texture.h"
+#include "UploadQueue.h"
+#include "TextureStreamer.h"
+#include "LightGrid.h"
 #include <thread>
 
 // Konwersja typw enum na string i odwrotnie
@@ -178,20 +184,25 @@ void Application::run()
         update();
         draw();
 
+        if (GraphicsEngine::get()->getRenderer()->applyPendingMsaaSamples()) {
+            fmt::print("MSAA Samples: {}\n", msaaSamplesToInt(Renderer::s_msaaSamples));
+            saveSettings();
+        }
         if (recreateSwapchain) {
             GraphicsEngine::get()->getRenderer()->getSwapChain()->recreateSwapChain();
             recreateSwapchain = false;
         }
-        if (recreatePipelines) {
-            GraphicsEngine::get()->getRenderer()->recreatePipelines();
-            recreatePipelines = false;
-        }
         if (recreateImgui) {
             GraphicsEngine::get()->getRenderer()->recreateImgui();
             recreateImgui = false;
         }
         if (reloadTextures) {
+            // Timed up to the last upload retiring, so CPU and blitted mipmaps compare end to end
+            auto reloadStart = std::chrono::high_resolution_clock::now();
             GraphicsEngine::get()->getTextureManager()->reloadAllResources();
+            GraphicsEngine::get()->getDevice()->getUploadQueue()->waitIdle();
+            fmt::print("Textures reloaded in {:.1f} ms\n",
+                std::chrono::duration<float, std::milli>(std::chrono::high_resolution_clock::now() - reloadStart).count());
             reloadTextures = false;
         }
 
@@ -204,7 +215,7 @@ void Application::run()
         Application::s_deltaTime = std::chrono::duration<float, std::chrono::seconds::period>(currentTime - startTime).count();
         startTime = currentTime; // Update startTime for the next frame
     }
-    vkDeviceWaitIdle(graphicsEngine->getDevice()->get());
+    graphicsEngine->getDevice()->waitIdle();
 }
 
 void Application::update()
@@ -249,6 +260,17 @@ void Application::loadSettings()
         // Inicjalizacja domylnych ustawie
         Renderer::s_msaaSamples = VK_SAMPLE_COUNT_1_BIT;
         Renderer::s_framesInFlight = 2;
+        Renderer::s_gpuDrivenRendering = false;
+        Renderer::s_parallelRecordThreshold = 8;
+        MeshFile::s_optimizeMeshes = true;
+        MeshFile::s_packVertices = true;
+        MeshFile::s_generateLods = true;
+        Renderer::s_lodErrorThreshold = 1.0f;
+        TextureFile::s_compression = TextureFile::Compression::Quality;
+        Texture::s_cpuMipmaps = true;
+        TextureStreamer::s_enabled = true;
+        TextureStreamer::s_budgetMB = 512;
+        LightGrid::s_attenuationCutoff = 0.0001f;
         Window::s_mode = Window::Mode::Windowed;
         Window::s_resolution = Window::Resolution::R_1280x720;
         Camera::s_mouseSensitivity = 10.0f;
@@ -265,6 +287,17 @@ void Application::loadSettings()
 
         Renderer::s_msaaSamples = intToMsaaSamples(j["msaaSamples"]);
         Renderer::s_framesInFlight = j["framesInFlight"];
+        Renderer::s_gpuDrivenRendering = j.value("gpuDrivenRendering", false);
+        Renderer::s_parallelRecordThreshold = j.value("parallelRecordThreshold", 8);
+        MeshFile::s_optimizeMeshes = j.value("optimizeMeshes", true);
+        MeshFile::s_packVertices = j.value("packVertices", true);
+        MeshFile::s_generateLods = j.value("generateLods", true);
+        Renderer::s_lodErrorThreshold = j.value("lodErrorThreshold", 1.0f);
+        TextureFile::s_compression = static_cast<TextureFile::Compression>(std::clamp(j.value("textureCompression", 2), 0, 2));
+        Texture::s_cpuMipmaps = j.value("cpuMipmaps", true);
+        TextureStreamer::s_enabled = j.value("textureStreaming", true);
+        TextureStreamer::s_budgetMB = j.value("textureBudget", 512);
+        LightGrid::s_attenuationCutoff = j.value("lightCutoff", 0.0001f);
         Window::s_mode = stringToMode(j["windowMode"]);
         Window::s_resolution = stringToResolution(j["resolution"]);
         Camera::s_mouseSensitivity = j["mouseSensitivity"];
@@ -278,6 +311,17 @@ void Application::saveSettings()
 
     j["msaaSamples"] = msaaSamplesToInt(Renderer::s_msaaSamples);
     j["framesInFlight"] = Renderer::s_framesInFlight;
+    j["gpuDrivenRendering"] = Renderer::s_gpuDrivenRendering;
+    j["parallelRecordThreshold"] = Renderer::s_parallelRecordThreshold;
+    j["optimizeMeshes"] = MeshFile::s_optimizeMeshes;
+    j["packVertices"] = MeshFile::s_packVertices;
+    j["generateLods"] = MeshFile::s_generateLods;
+    j["lodErrorThreshold"] = Renderer::s_lodErrorThreshold;
+    j["textureCompression"] = static_cast<int>(TextureFile::s_compression);
+    j["cpuMipmaps"] = Texture::s_cpuMipmaps;
+    j["textureStreaming"] = TextureStreamer::s_enabled;
+    j["textureBudget"] = TextureStreamer::s_budgetMB;
+    j["lightCutoff"] = LightGrid::s_attenuationCutoff;
     j["windowMode"] = modeToString(Window::s_mode);
     j["resolution"] = resolutionToString(Window::s_resolution);
     j["mouseSensitivity"] = Camera::s_mouseSensitivity;
@@ -326,6 +370,15 @@ void Application::drawFpsCounter()
     // Wywietl FPS
     ImGui::Text("FPS: %.1f", fps);
     ImGui::Text("Frame Time: %.3f ms", frameTime); // przelicz na milisekundy
+    ImGui::Text("Draw Calls: %u (%u instances)", GraphicsEngine::get()->getRenderer()->getDrawCallCount(),
+        GraphicsEngine::get()->getRenderer()->getInstanceCount());
+    if (GraphicsEngine::get()->getRenderer()->isGpuCullingActive()) {
+        ImGui::Text("Culling: GPU");
+    }
+    else {
+        ImGui::Text("Visible: %u Culled: %u", GraphicsEngine::get()->getRenderer()->getVisibleCount(),
+            GraphicsEngine::get()->getRenderer()->getCulledCount());
+    }
 
     // Dodaj wykres FPS
     static float fpsHistory[60] = { 0 };
@@ -397,6 +450,17 @@ void Application::createSettingsTab() {
         static int resolution = static_cast<int>(Window::s_resolution);
         static float mouseSensitivity = Camera::s_mouseSensitivity;
         static float fov = Camera::s_fov;
+        static bool gpuDrivenRendering = Renderer::s_gpuDrivenRendering;
+        static int parallelRecordThreshold = Renderer::s_parallelRecordThreshold;
+        static bool optimizeMeshes = MeshFile::s_optimizeMeshes;
+        static bool packVertices = MeshFile::s_packVertices;
+        static bool generateLods = MeshFile::s_generateLods;
+        static float lodErrorThreshold = Renderer::s_lodErrorThreshold;
+        static int textureCompression = static_cast<int>(TextureFile::s_compression);
+        static bool cpuMipmaps = Texture::s_cpuMipmaps;
+        static bool textureStreaming = TextureStreamer::s_enabled;
+        static int textureBudget = TextureStreamer::s_budgetMB;
+        static float lightCutoff = LightGrid::s_attenuationCutoff;
 
         static bool MouseSensitivityChanged = false;
         static bool fovChanged = false;
@@ -404,6 +468,17 @@ void Application::createSettingsTab() {
         static bool resolutionChanged = false;
         static bool framesInFlightChanged = false;
         static bool msaaSamplesChanged = false;
+        static bool gpuDrivenRenderingChanged = false;
+        static bool parallelRecordThresholdChanged = false;
+        static bool optimizeMeshesChanged = false;
+        static bool packVerticesChanged = false;
+        static bool generateLodsChanged = false;
+        static bool lodErrorThresholdChanged = false;
+        static bool textureCompressionChanged = false;
+        static bool cpuMipmapsChanged = false;
+        static bool textureStreamingChanged = false;
+        static bool textureBudgetChanged = false;
+        static bool lightCutoffChanged = false;
 
         float newMouseSensitivity = mouseSensitivity;
         if (ImGui::SliderFloat("Mouse Sensitivity", &newMouseSensitivity, 1.0f, 100.0f, "%1.0f")) {
@@ -470,8 +545,145 @@ void Application::createSettingsTab() {
             }
         }
 
+        bool gpuDrivenSupported = GraphicsEngine::get()->getRenderer()->isGpuDrivenRenderingSupported();
+        bool newGpuDrivenRendering = gpuDrivenRendering && gpuDrivenSupported;
+        ImGui::BeginDisabled(!gpuDrivenSupported);
+        if (ImGui::Checkbox("GPU-Driven Rendering", &newGpuDrivenRendering)) {
+            if (newGpuDrivenRendering != gpuDrivenRendering) {
+                gpuDrivenRendering = newGpuDrivenRendering;
+                gpuDrivenRenderingChanged = true;
+            }
+        }
+        ImGui::EndDisabled();
+        if (ImGui::IsItemHovered(ImGuiHoveredFlags_AllowWhenDisabled)) {
+            ImGui::SetTooltip(gpuDrivenSupported ? "Frustum culling in a compute shader, models drawn with indirect draws" :
+                "Not supported by this device");
+        }
+
+        int newParallelRecordThreshold = parallelRecordThreshold;
+        if (ImGui::SliderInt("Parallel Recording Threshold", &newParallelRecordThreshold, 0, 512)) {
+            if (newParallelRecordThreshold != parallelRecordThreshold) {
+                parallelRecordThreshold = newParallelRecordThreshold;
+                parallelRecordThresholdChanged = true;
+            }
+        }
+        if (ImGui::IsItemHovered()) {
+            ImGui::SetTooltip("Draw calls above which they are split over the worker threads into secondary command buffers, 0 records them all on the main thread");
+        }
+
+        bool newOptimizeMeshes = optimizeMeshes;
+        if (ImGui::Checkbox("Optimize Imported Meshes", &newOptimizeMeshes)) {
+            if (newOptimizeMeshes != optimizeMeshes) {
+                optimizeMeshes = newOptimizeMeshes;
+                optimizeMeshesChanged = true;
+            }
+        }
+        if (ImGui::IsItemHovered()) {
+            ImGui::SetTooltip("Reorder triangles and vertices for the vertex cache and overdraw when an OBJ is imported, takes effect on the next load");
+        }
+
+        bool newPackVertices = packVertices;
+        if (ImGui::Checkbox("Packed Vertices", &newPackVertices)) {
+            if (newPackVertices != packVertices) {
+                packVertices = newPackVertices;
+                packVerticesChanged = true;
+            }
+        }
+        if (ImGui::IsItemHovered()) {
+            ImGui::SetTooltip("16-byte quantized vertices instead of 44-byte float ones, takes effect on the next load");
+        }
+
+        bool newGenerateLods = generateLods;
+        if (ImGui::Checkbox("Generate Mesh LODs", &newGenerateLods)) {
+            if (newGenerateLods != generateLods) {
+                generateLods = newGenerateLods;
+                generateLodsChanged = true;
+            }
+        }
+        if (ImGui::IsItemHovered()) {
+            ImGui::SetTooltip("Simplify imported meshes into up to %u levels of detail, takes effect on the next load", MeshData::s_maxLodCount);
+        }
+
+        float newLodErrorThreshold = lodErrorThreshold;
+        if (ImGui::SliderFloat("LOD Error Threshold", &newLodErrorThreshold, 0.1f, 16.0f, "%.1f px")) {
+            if (newLodErrorThreshold != lodErrorThreshold) {
+                lodErrorThreshold = newLodErrorThreshold;
+                lodErrorThresholdChanged = true;
+            }
+        }
+        if (ImGui::IsItemHovered()) {
+            ImGui::SetTooltip("Pixels a coarser level of detail may deviate from the full resolution mesh on screen before it is used");
+        }
+
+        bool compressionSupported = GraphicsEngine::get()->getDevice()->supportsTextureCompressionBC();
+        int newTextureCompression = textureCompression;
+        const char* textureCompressionItems[] = { "Off", "BC1", "BC7" };
+        ImGui::BeginDisabled(!compressionSupported);
+        if (ImGui::Combo("Texture Compression", &newTextureCompression, textureCompressionItems, IM_ARRAYSIZE(textureCompressionItems))) {
+            if (newTextureCompression != textureCompression) {
+                textureCompression = newTextureCompression;
+                textureCompressionChanged = true;
+            }
+        }
+        ImGui::EndDisabled();
+        if (ImGui::IsItemHovered(ImGuiHoveredFlags_AllowWhenDisabled)) {
+            ImGui::SetTooltip(compressionSupported ? "Block compression of opaque textures, cached in Cache/Textures; alpha always uses BC7" :
+                "Not supported by this device");
+        }
+
+        bool newCpuMipmaps = cpuMipmaps;
+        if (ImGui::Checkbox("CPU Mipmaps", &newCpuMipmaps)) {
+            if (newCpuMipmaps != cpuMipmaps) {
+                cpuMipmaps = newCpuMipmaps;
+                cpuMipmapsChanged = true;
+            }
+        }
+        if (ImGui::IsItemHovered()) {
+            ImGui::SetTooltip("Filter the mips of uncompressed textures on the worker threads, in linear space for sRGB, instead of blitting them on the GPU");
+        }
+
+        bool newTextureStreaming = textureStreaming;
+        if (ImGui::Checkbox("Texture Streaming", &newTextureStreaming)) {
+            if (newTextureStreaming != textureStreaming) {
+                textureStreaming = newTextureStreaming;
+                textureStreamingChanged = true;
+            }
+        }
+        if (ImGui::IsItemHovered()) {
+            ImGui::SetTooltip("Load the small mips first and raise each texture's resolution to what it covers on screen; not available for blitted mipmaps");
+        }
+
+        int newTextureBudget = textureBudget;
+        if (ImGui::SliderInt("Texture Budget", &newTextureBudget, 64, 4096, "%d MB")) {
+            if (newTextureBudget != textureBudget) {
+                textureBudget = newTextureBudget;
+                textureBudgetChanged = true;
+            }
+        }
+        if (ImGui::IsItemHovered()) {
+            ImGui::SetTooltip("Video memory the streamed textures may use, the least recently used ones lose mip levels beyond it");
+        }
+
+        float newLightCutoff = lightCutoff;
+        if (ImGui::SliderFloat("Light Cutoff", &newLightCutoff, 0.0001f, 0.1f, "%.4f", ImGuiSliderFlags_Logarithmic)) {
+            if (newLightCutoff != lightCutoff) {
+                lightCutoff = newLightCutoff;
+                lightCutoffChanged = true;
+            }
+        }
+        if (ImGui::IsItemHovered()) {
+            ImGui::SetTooltip("Attenuation at which a point light ends; higher values shrink the lights' ranges, so fewer of them reach each cluster");
+        }
+
+        GraphicsEngine::get()->getDevice()->drawInterface();
+        GraphicsEngine::get()->getRenderer()->getTextureStreamer()->drawInterface();
+        GraphicsEngine::get()->getRenderer()->getLightGrid()->drawInterface();
+
         if (ImGui::Button("Apply")) {
-            if (MouseSensitivityChanged || fovChanged || windowModeChanged || resolutionChanged || framesInFlightChanged || msaaSamplesChanged) {
+            if (MouseSensitivityChanged || fovChanged || windowModeChanged || resolutionChanged || framesInFlightChanged || msaaSamplesChanged ||
+                gpuDrivenRenderingChanged || parallelRecordThresholdChanged || optimizeMeshesChanged ||
+                packVerticesChanged || generateLodsChanged || lodErrorThresholdChanged || textureCompressionChanged || cpuMipmapsChanged ||
+                textureStreamingChanged || textureBudgetChanged || lightCutoffChanged) {
                 fmt::print("Settings changed!\n");
             }
             if (MouseSensitivityChanged) {
@@ -503,14 +715,68 @@ void Application::createSettingsTab() {
                 framesInFlightChanged = false;
             }
             if (msaaSamplesChanged) {
-                Renderer::s_msaaSamples = msaaValues[msaaSamples];
-                fmt::print("MSAA Samples: {}\n", msaaSamples);
-                recreateSwapchain = true;
-                recreatePipelines = true;
-                recreateImgui = true;
-                reloadTextures = true;
+                // Applied in the main loop once the pipeline variants for it are compiled
+                GraphicsEngine::get()->getRenderer()->requestMsaaSamples(msaaValues[msaaSamples]);
                 msaaSamplesChanged = false;
             }
+            if (gpuDrivenRenderingChanged) {
+                Renderer::s_gpuDrivenRendering = gpuDrivenRendering;
+                fmt::print("GPU-Driven Rendering: {}\n", gpuDrivenRendering);
+                gpuDrivenRenderingChanged = false;
+            }
+            if (parallelRecordThresholdChanged) {
+                Renderer::s_parallelRecordThreshold = parallelRecordThreshold;
+                fmt::print("Parallel Recording Threshold: {}\n", parallelRecordThreshold);
+                parallelRecordThresholdChanged = false;
+            }
+            if (optimizeMeshesChanged) {
+                MeshFile::s_optimizeMeshes = optimizeMeshes;
+                fmt::print("Optimize Imported Meshes: {}\n", optimizeMeshes);
+                optimizeMeshesChanged = false;
+            }
+            if (packVerticesChanged) {
+                MeshFile::s_packVertices = packVertices;
+                fmt::print("Packed Vertices: {}\n", packVertices);
+                packVerticesChanged = false;
+            }
+            if (generateLodsChanged) {
+                MeshFile::s_generateLods = generateLods;
+                fmt::print("Generate Mesh LODs: {}\n", generateLods);
+                generateLodsChanged = false;
+            }
+            if (lodErrorThresholdChanged) {
+                Renderer::s_lodErrorThreshold = lodErrorThreshold;
+                fmt::print("LOD Error Threshold: {}\n", lodErrorThreshold);
+                lodErrorThresholdChanged = false;
+            }
+            if (textureCompressionChanged) {
+                TextureFile::s_compression = static_cast<TextureFile::Compression>(textureCompression);
+                fmt::print("Texture Compression: {}\n", textureCompressionItems[textureCompression]);
+                reloadTextures = true;
+                textureCompressionChanged = false;
+            }
+            if (cpuMipmapsChanged) {
+                Texture::s_cpuMipmaps = cpuMipmaps;
+                fmt::print("CPU Mipmaps: {}\n", cpuMipmaps);
+                reloadTextures = true;
+                cpuMipmapsChanged = false;
+            }
+            if (textureStreamingChanged) {
+                TextureStreamer::s_enabled = textureStreaming;
+                fmt::print("Texture Streaming: {}\n", textureStreaming);
+                reloadTextures = true;
+                textureStreamingChanged = false;
+            }
+            if (textureBudgetChanged) {
+                TextureStreamer::s_budgetMB = textureBudget;
+                fmt::print("Texture Budget: {} MB\n", textureBudget);
+                textureBudgetChanged = false;
+            }
+            if (lightCutoffChanged) {
+                LightGrid::s_attenuationCutoff = lightCutoff;
+                fmt::print("Light Cutoff: {}\n", lightCutoff);
+                lightCutoffChanged = false;
+            }
 
             saveSettings();
         }
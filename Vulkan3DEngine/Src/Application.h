@@ -45,6 +45,5 @@ private:
 
 	bool recreateImgui = false;
 	bool recreateSwapchain = false;
-	bool recreatePipelines = false;
 	bool reloadTextures = false;
 };
\ No newline at end of file
@@ -1,20 +1,42 @@
 #include "Buffer.h"
 #include "Renderer.h"
-#include "Image.h"
 #include "GraphicsEngine.h"
 
+const char* memoryUsageToString(MemoryUsage usage)
+{
+    switch (usage) {
+    case MemoryUsage::GpuOnly: return "GpuOnly";
+    case MemoryUsage::Upload: return "Upload";
+    case MemoryUsage::Dynamic: return "Dynamic";
+    case MemoryUsage::Readback: return "Readback";
+    default: return "Unknown";
+    }
+}
+
 Buffer::Buffer(Renderer* renderer) : m_renderer(renderer)
 {
 }
 
 Buffer::~Buffer()
 {
-    unmap();
-    vkDestroyBuffer(GraphicsEngine::get()->getDevice()->get(), m_buffer, nullptr);
-    vkFreeMemory(GraphicsEngine::get()->getDevice()->get(), m_bufferMemory, nullptr);
+    // The upload queue still references the buffer until its copy has finished
+    if (m_uploadFuture.valid()) {
+        m_uploadFuture.wait();
+    }
+    if (m_buffer != VK_NULL_HANDLE) {
+        GraphicsEngine::get()->getDevice()->unregisterBuffer(this);
+    }
+    vmaDestroyBuffer(GraphicsEngine::get()->getDevice()->getAllocator(), m_buffer, m_allocation);
 }
 
-void Buffer::createBuffer(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties, VkBuffer& buffer, VkDeviceMemory& bufferMemory)
+VkMemoryPropertyFlags Buffer::getMemoryProperties()
+{
+    VkMemoryPropertyFlags flags = 0;
+    vmaGetAllocationMemoryProperties(GraphicsEngine::get()->getDevice()->getAllocator(), m_allocation, &flags);
+    return flags;
+}
+
+void Buffer::createBuffer(VkDeviceSize size, VkBufferUsageFlags usage, MemoryUsage memoryUsage)
 {
     VkBufferCreateInfo bufferInfo{};
     bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
@@ -22,66 +44,52 @@ void Buffer::createBuffer(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryP
     bufferInfo.usage = usage;
     bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
 
-    if (vkCreateBuffer(GraphicsEngine::get()->getDevice()->get(), &bufferInfo, nullptr, &buffer) != VK_SUCCESS) {
-        throw std::runtime_error("failed to create buffer!");
+    // Sub-allocated from the device-wide allocator's memory blocks instead of a dedicated vkAllocateMemory
+    VmaAllocationCreateInfo allocInfo{};
+    switch (memoryUsage) {
+    case MemoryUsage::GpuOnly:
+        allocInfo.usage = VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE;
+        allocInfo.requiredFlags = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
+        break;
+    case MemoryUsage::Upload:
+        allocInfo.usage = VMA_MEMORY_USAGE_AUTO_PREFER_HOST;
+        allocInfo.flags = VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT | VMA_ALLOCATION_CREATE_MAPPED_BIT;
+        allocInfo.requiredFlags = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+        break;
+    case MemoryUsage::Dynamic:
+        // Falls back to plain host memory when the device exposes no host visible DEVICE_LOCAL type
+        allocInfo.usage = VMA_MEMORY_USAGE_AUTO;
+        allocInfo.flags = VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT | VMA_ALLOCATION_CREATE_MAPPED_BIT;
+        allocInfo.requiredFlags = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+        allocInfo.preferredFlags = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
+        break;
+    case MemoryUsage::Readback:
+        allocInfo.usage = VMA_MEMORY_USAGE_AUTO_PREFER_HOST;
+        allocInfo.flags = VMA_ALLOCATION_CREATE_HOST_ACCESS_RANDOM_BIT | VMA_ALLOCATION_CREATE_MAPPED_BIT;
+        allocInfo.requiredFlags = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT;
+        allocInfo.preferredFlags = VK_MEMORY_PROPERTY_HOST_CACHED_BIT;
+        break;
     }
 
-    VkMemoryRequirements memRequirements;
-    vkGetBufferMemoryRequirements(GraphicsEngine::get()->getDevice()->get(), buffer, &memRequirements);
-
-    VkMemoryAllocateInfo allocInfo{};
-    allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-    allocInfo.allocationSize = memRequirements.size;
-    allocInfo.memoryTypeIndex = GraphicsEngine::get()->getDevice()->findMemoryType(memRequirements.memoryTypeBits, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
-
-    if (vkAllocateMemory(GraphicsEngine::get()->getDevice()->get(), &allocInfo, nullptr, &bufferMemory) != VK_SUCCESS) {
-        throw std::runtime_error("failed to allocate buffer memory!");
+    VmaAllocationInfo allocationInfo{};
+    if (vmaCreateBuffer(GraphicsEngine::get()->getDevice()->getAllocator(), &bufferInfo, &allocInfo, &m_buffer, &m_allocation, &allocationInfo) != VK_SUCCESS) {
+        throw std::runtime_error("failed to create buffer!");
     }
 
-    vkBindBufferMemory(GraphicsEngine::get()->getDevice()->get(), buffer, bufferMemory, 0);
-}
+    m_size = size;
+    m_usage = usage;
+    m_memoryUsage = memoryUsage;
+    m_mapped = allocationInfo.pMappedData;
 
-void Buffer::copyBuffer(VkBuffer srcBuffer, VkBuffer dstBuffer, VkDeviceSize size)
-{
-    VkCommandBuffer commandBuffer = GraphicsEngine::get()->getDevice()->beginSingleTimeCommands();
-    
-    VkBufferCopy copyRegion{};
-    copyRegion.size = size;
-    vkCmdCopyBuffer(commandBuffer, srcBuffer, dstBuffer, 1, &copyRegion);
-    
-    GraphicsEngine::get()->getDevice()->endSingleTimeCommands(commandBuffer);
+    GraphicsEngine::get()->getDevice()->registerBuffer(this);
 }
 
-void Buffer::copyBufferToImage(ImagePtr image)
+bool Buffer::isUploaded() const
 {
-    VkCommandBuffer commandBuffer = GraphicsEngine::get()->getDevice()->beginSingleTimeCommands();
-
-    VkBufferImageCopy region{};
-    region.bufferOffset = 0;
-    region.bufferRowLength = 0;
-    region.bufferImageHeight = 0;
-    region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-    region.imageSubresource.mipLevel = 0;
-    region.imageSubresource.baseArrayLayer = 0;
-    region.imageSubresource.layerCount = 1;
-    region.imageOffset = { 0, 0, 0 };
-    region.imageExtent = { image->getWidth(),image->getHeight(),1};
-
-    vkCmdCopyBufferToImage(commandBuffer, m_buffer, image->get(), VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &region);
-    image->updateLayout(VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
-
-    GraphicsEngine::get()->getDevice()->endSingleTimeCommands(commandBuffer);
+    return !m_uploadFuture.valid() || m_uploadFuture.wait_for(std::chrono::seconds(0)) == std::future_status::ready;
 }
 
-VkResult Buffer::map(VkDeviceSize size, VkDeviceSize offset)
+void Buffer::invalidate(VkDeviceSize offset, VkDeviceSize size)
 {
-    return vkMapMemory(GraphicsEngine::get()->getDevice()->get(), m_bufferMemory, offset, size, 0, &m_mapped);
-}
-
-void Buffer::unmap()
-{
-    if (m_mapped) {
-        vkUnmapMemory(GraphicsEngine::get()->getDevice()->get(), m_bufferMemory);
-        m_mapped = nullptr;
-    }
+    VK_CHECK(vmaInvalidateAllocation(GraphicsEngine::get()->getDevice()->getAllocator(), m_allocation, offset, size));
 }
@@ -1,5 +1,16 @@
 #pragma once
 #include "Prerequisites.h"
+#include <future>
+
+// How the CPU and GPU access a buffer; decides which memory type it is placed in
+enum class MemoryUsage {
+    GpuOnly,    // device local, filled through a staging copy (static geometry)
+    Upload,     // host visible, persistently mapped, written once and copied from (staging)
+    Dynamic,    // host visible, persistently mapped, rewritten every frame; prefers DEVICE_LOCAL (ReBAR) when available
+    Readback    // host visible, persistently mapped, prefers HOST_CACHED for reading GPU results on the CPU
+};
+
+const char* memoryUsageToString(MemoryUsage usage);
 
 struct Buffer
 {
@@ -8,21 +19,26 @@ public:
     ~Buffer();
 
     VkBuffer& get() { return m_buffer; }
-    VkDeviceMemory& getMemory() { return m_bufferMemory; }
+    VmaAllocation& getAllocation() { return m_allocation; }
     void* getMappedMemory() { return m_mapped; }
+    VkDeviceSize getSize() const { return m_size; }
+    VkBufferUsageFlags getUsage() const { return m_usage; }
+    MemoryUsage getMemoryUsage() const { return m_memoryUsage; }
+    VkMemoryPropertyFlags getMemoryProperties();
 
-    void createBuffer(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties,
-        VkBuffer& buffer, VkDeviceMemory& bufferMemory);
-    void copyBuffer(VkBuffer srcBuffer, VkBuffer dstBuffer, VkDeviceSize size);
-    void copyBufferToImage(ImagePtr image);
-    VkResult map(VkDeviceSize size = VK_WHOLE_SIZE, VkDeviceSize offset = 0);
-    void unmap();
+    void createBuffer(VkDeviceSize size, VkBufferUsageFlags usage, MemoryUsage memoryUsage);
+    // True once the staging copy into this buffer has completed on the GPU
+    bool isUploaded() const;
+    void invalidate(VkDeviceSize offset = 0, VkDeviceSize size = VK_WHOLE_SIZE);
 
     virtual void bind() = 0; // Pure virtual function
 protected:
     Renderer* m_renderer = nullptr;
-    VkBuffer m_buffer;
-    VkDeviceMemory m_bufferMemory;
+    VkBuffer m_buffer = VK_NULL_HANDLE;
+    VmaAllocation m_allocation = VK_NULL_HANDLE;
+    VkDeviceSize m_size = 0;
+    VkBufferUsageFlags m_usage = 0;
+    MemoryUsage m_memoryUsage = MemoryUsage::GpuOnly;
     void* m_mapped = nullptr;
+    std::shared_future<void> m_uploadFuture;
 };
-
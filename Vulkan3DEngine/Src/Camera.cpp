@@ -49,11 +49,31 @@ const glm::mat4 Camera::getViewMatrix()
 const glm::mat4 Camera::getProjectionMatrix()
 {
     VkExtent2D swapChainExtent = GraphicsEngine::get()->getRenderer()->getSwapChain()->getSwapChainExtent();
-    glm::mat4 proj = glm::perspective(glm::radians(s_fov), static_cast<float>(swapChainExtent.width) / swapChainExtent.height, 0.1f, 100.0f);
+    glm::mat4 proj = glm::perspective(glm::radians(s_fov), static_cast<float>(swapChainExtent.width) / swapChainExtent.height, s_nearPlane, s_farPlane);
     proj[1][1] *= -1;
     return proj;
 }
 
+std::array<glm::vec4, 6> Camera::getFrustumPlanes()
+{
+    // Gribb/Hartmann extraction from the rows of the view-projection matrix (depth range [0, 1])
+    glm::mat4 m = glm::transpose(getProjectionMatrix() * getViewMatrix());
+
+    std::array<glm::vec4, 6> planes = {
+        m[3] + m[0],
+        m[3] - m[0],
+        m[3] + m[1],
+        m[3] - m[1],
+        m[2],
+        m[3] - m[2]
+    };
+
+    for (glm::vec4& plane : planes) {
+        plane /= glm::length(glm::vec3(plane));
+    }
+    return planes;
+}
+
 void Camera::update()
 {
     SceneObject::update();
@@ -12,9 +12,13 @@ public:
 
     const glm::mat4 getViewMatrix();
     const glm::mat4 getProjectionMatrix();
+    // World space planes (xyz normal pointing inside, w distance) in the order left, right, bottom, top, near, far
+    std::array<glm::vec4, 6> getFrustumPlanes();
 
     void updateCameraVectors();
 
+    // The scene's view and projection are rewritten by every update
+    bool updatesEveryFrame() const override { return true; }
     void update() override;
     void draw() override;
 
@@ -29,6 +33,8 @@ public:
 
     static float s_mouseSensitivity;
     static float s_fov;
+    static constexpr float s_nearPlane = 0.1f;
+    static constexpr float s_farPlane = 100.0f;
 
 private:
     // Inherited via InputListener
@@ -1,23 +1,41 @@
+#define VMA_IMPLEMENTATION
 #include "Device.h"
 #include "Renderer.h"
 #include "ThreadPool.h"
 #include "GraphicsEngine.h"
+#include "Buffer.h"
+#include "UploadQueue.h"
+#include "PipelineCache.h"
+#include "SamplerCache.h"
 
 Device::Device()
 {
     //Order here matters
     pickPhysicalDevice();
     createLogicalDevice();
+    m_pipelineCache = std::make_shared<PipelineCache>(this, "Cache/pipeline.cache");
+    m_samplerCache = std::make_shared<SamplerCache>(this);
+    createAllocator();
     createCommandPool();
+    m_uploadQueue = std::make_shared<UploadQueue>(this);
 }
 
 Device::~Device()
 {
     //Order here matters
+    m_uploadQueue.reset();
     vkDestroyCommandPool(m_device, m_commandPool, nullptr);
+    vmaDestroyAllocator(m_allocator);
+    m_samplerCache.reset();
+    m_pipelineCache.reset();
     vkDestroyDevice(m_device, nullptr);
 }
 
+VkPipelineCache Device::getPipelineCache()
+{
+    return m_pipelineCache->get();
+}
+
 VkCommandBuffer Device::beginSingleTimeCommands()
 {
     m_mutex.lock();
@@ -48,15 +66,30 @@ void Device::endSingleTimeCommands(VkCommandBuffer commandBuffer)
     submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
     submitInfo.commandBufferCount = 1;
     submitInfo.pCommandBuffers = &commandBuffer;
-    
-    vkQueueSubmit(m_graphicsQueue, 1, &submitInfo, VK_NULL_HANDLE);
-    vkQueueWaitIdle(m_graphicsQueue);
-    
+
+    // Wait for this submission only, not for everything else queued on the graphics queue
+    VkFenceCreateInfo fenceInfo{};
+    fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+    VkFence fence;
+    vkCreateFence(m_device, &fenceInfo, nullptr, &fence);
+
+    {
+        std::lock_guard<std::mutex> lock(m_queueMutex);
+        vkQueueSubmit(m_graphicsQueue, 1, &submitInfo, fence);
+    }
+    vkWaitForFences(m_device, 1, &fence, VK_TRUE, UINT64_MAX);
+    vkDestroyFence(m_device, fence, nullptr);
     
     vkFreeCommandBuffers(m_device, m_commandPool, 1, &commandBuffer);
     m_mutex.unlock();
 }
 
+void Device::waitIdle()
+{
+    std::lock_guard<std::mutex> lock(m_queueMutex);
+    vkDeviceWaitIdle(m_device);
+}
+
 VkFormat Device::findDepthFormat()
 {
     return findSupportedFormat(
@@ -117,6 +150,21 @@ void Device::pickPhysicalDevice()
     }
 }
 
+bool Device::supportsDescriptorIndexing(VkPhysicalDevice device)
+{
+    VkPhysicalDeviceVulkan12Features features12{};
+    features12.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+
+    VkPhysicalDeviceFeatures2 features{};
+    features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+    features.pNext = &features12;
+    vkGetPhysicalDeviceFeatures2(device, &features);
+
+    return features12.runtimeDescriptorArray && features12.descriptorBindingPartiallyBound &&
+        features12.descriptorBindingSampledImageUpdateAfterBind && features12.descriptorBindingUpdateUnusedWhilePending &&
+        features12.shaderSampledImageArrayNonUniformIndexing;
+}
+
 int Device::rateDeviceSuitability(VkPhysicalDevice device)
 {
     VkPhysicalDeviceProperties deviceProperties;
@@ -174,6 +222,12 @@ int Device::rateDeviceSuitability(VkPhysicalDevice device)
         return 0;
     }
 
+    // The bindless texture table needs Vulkan 1.2 descriptor indexing
+    if (deviceProperties.apiVersion < VK_API_VERSION_1_2 || !supportsDescriptorIndexing(device))
+    {
+        return 0;
+    }
+
     return score;
 }
 
@@ -205,19 +259,25 @@ QueueFamilyIndices Device::findQueueFamilies(VkPhysicalDevice device) {
 
     int i = 0;
     for (const auto& queueFamily : queueFamilies) {
-        if (queueFamily.queueFlags & VK_QUEUE_GRAPHICS_BIT) {
-            indices.graphicsFamily = i;
-        }
+        if (!indices.isComplete()) {
+            if (queueFamily.queueFlags & VK_QUEUE_GRAPHICS_BIT) {
+                indices.graphicsFamily = i;
+            }
 
-        VkBool32 presentSupport = false;
-        vkGetPhysicalDeviceSurfaceSupportKHR(device, i, Window::get()->getSurface(), &presentSupport);
+            VkBool32 presentSupport = false;
+            vkGetPhysicalDeviceSurfaceSupportKHR(device, i, Window::get()->getSurface(), &presentSupport);
 
-        if (presentSupport) {
-            indices.presentFamily = i;
+            if (presentSupport) {
+                indices.presentFamily = i;
+            }
         }
 
-        if (indices.isComplete()) {
-            break;
+        // Transfer-only families map to the DMA engines; prefer one that is not also a compute family
+        if ((queueFamily.queueFlags & VK_QUEUE_TRANSFER_BIT) && !(queueFamily.queueFlags & VK_QUEUE_GRAPHICS_BIT)) {
+            if (!indices.transferFamily.has_value() ||
+                ((queueFamilies[indices.transferFamily.value()].queueFlags & VK_QUEUE_COMPUTE_BIT) && !(queueFamily.queueFlags & VK_QUEUE_COMPUTE_BIT))) {
+                indices.transferFamily = i;
+            }
         }
 
         i++;
@@ -243,13 +303,17 @@ uint32_t Device::findMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags prope
 
 void Device::createLogicalDevice()
 {
-    QueueFamilyIndices indices = findQueueFamilies(m_physicalDevice);
+    m_queueFamilyIndices = findQueueFamilies(m_physicalDevice);
+    QueueFamilyIndices& indices = m_queueFamilyIndices;
 
     std::vector<VkDeviceQueueCreateInfo> queueCreateInfos;
     std::set<uint32_t> uniqueQueueFamilies = {
         indices.graphicsFamily.value(),
         indices.presentFamily.value()
     };
+    if (indices.transferFamily.has_value()) {
+        uniqueQueueFamilies.insert(indices.transferFamily.value());
+    }
 
     float queuePriority = 1.0f;
     for (uint32_t queueFamily : uniqueQueueFamilies) {
@@ -261,12 +325,45 @@ void Device::createLogicalDevice()
         queueCreateInfos.push_back(queueCreateInfo);
     }
 
+    VkPhysicalDeviceVulkan12Features supportedFeatures12{};
+    supportedFeatures12.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+    VkPhysicalDeviceFeatures2 supportedFeatures2{};
+    supportedFeatures2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+    supportedFeatures2.pNext = &supportedFeatures12;
+    vkGetPhysicalDeviceFeatures2(m_physicalDevice, &supportedFeatures2);
+    const VkPhysicalDeviceFeatures& supportedFeatures = supportedFeatures2.features;
+
     VkPhysicalDeviceFeatures deviceFeatures{};
     deviceFeatures.samplerAnisotropy = VK_TRUE;
     deviceFeatures.sampleRateShading = VK_TRUE; // enable sample shading feature for the device
+    // Optional, needed by GPU-driven rendering
+    deviceFeatures.drawIndirectFirstInstance = supportedFeatures.drawIndirectFirstInstance;
+    // Optional, a draw count above one needs multiDrawIndirect
+    deviceFeatures.multiDrawIndirect = supportedFeatures.multiDrawIndirect;
+    // Optional, textures stay uncompressed without it
+    deviceFeatures.textureCompressionBC = supportedFeatures.textureCompressionBC;
+    m_enabledFeatures = deviceFeatures;
+
+    uint32_t queueFamilyCount = 0;
+    vkGetPhysicalDeviceQueueFamilyProperties(m_physicalDevice, &queueFamilyCount, nullptr);
+    std::vector<VkQueueFamilyProperties> queueFamilies(queueFamilyCount);
+    vkGetPhysicalDeviceQueueFamilyProperties(m_physicalDevice, &queueFamilyCount, queueFamilies.data());
+    bool graphicsHasCompute = (queueFamilies[indices.graphicsFamily.value()].queueFlags & VK_QUEUE_COMPUTE_BIT) != 0;
+    m_supportsGpuDrivenRendering = deviceFeatures.drawIndirectFirstInstance && graphicsHasCompute;
+    m_supportsDrawIndirectCount = m_supportsGpuDrivenRendering && deviceFeatures.multiDrawIndirect && supportedFeatures12.drawIndirectCount;
+
+    VkPhysicalDeviceVulkan12Features features12{};
+    features12.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+    features12.runtimeDescriptorArray = VK_TRUE;
+    features12.descriptorBindingPartiallyBound = VK_TRUE;
+    features12.descriptorBindingSampledImageUpdateAfterBind = VK_TRUE;
+    features12.descriptorBindingUpdateUnusedWhilePending = VK_TRUE;
+    features12.shaderSampledImageArrayNonUniformIndexing = VK_TRUE;
+    features12.drawIndirectCount = m_supportsDrawIndirectCount;
 
     VkDeviceCreateInfo createInfo{};
     createInfo.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
+    createInfo.pNext = &features12;
     createInfo.queueCreateInfoCount = static_cast<uint32_t>(queueCreateInfos.size());
     createInfo.pQueueCreateInfos = queueCreateInfos.data();
     createInfo.pEnabledFeatures = &deviceFeatures;
@@ -288,6 +385,130 @@ void Device::createLogicalDevice()
 
     vkGetDeviceQueue(m_device, indices.graphicsFamily.value(), 0, &m_graphicsQueue);
     vkGetDeviceQueue(m_device, indices.presentFamily.value(), 0, &m_presentQueue);
+    if (indices.transferFamily.has_value()) {
+        vkGetDeviceQueue(m_device, indices.transferFamily.value(), 0, &m_transferQueue);
+    }
+}
+
+void Device::createAllocator()
+{
+    VmaAllocatorCreateInfo allocatorInfo{};
+    allocatorInfo.vulkanApiVersion = VK_API_VERSION_1_2;
+    allocatorInfo.physicalDevice = m_physicalDevice;
+    allocatorInfo.device = m_device;
+    allocatorInfo.instance = Instance::get()->getVkInstance();
+
+    if (vmaCreateAllocator(&allocatorInfo, &m_allocator) != VK_SUCCESS) {
+        fmt::print(stderr, "Error: failed to create memory allocator!\n");
+        exit(EXIT_FAILURE);
+    }
+}
+
+std::vector<HeapStatistics> Device::getHeapStatistics()
+{
+    const VkPhysicalDeviceMemoryProperties* memProperties;
+    vmaGetMemoryProperties(m_allocator, &memProperties);
+
+    VmaTotalStatistics totalStats;
+    vmaCalculateStatistics(m_allocator, &totalStats);
+
+    VmaBudget budgets[VK_MAX_MEMORY_HEAPS];
+    vmaGetHeapBudgets(m_allocator, budgets);
+
+    std::vector<HeapStatistics> heaps;
+    for (uint32_t i = 0; i < memProperties->memoryHeapCount; i++) {
+        const VmaDetailedStatistics& stats = totalStats.memoryHeap[i];
+
+        HeapStatistics heap{};
+        heap.heapIndex = i;
+        heap.flags = memProperties->memoryHeaps[i].flags;
+        heap.heapSize = memProperties->memoryHeaps[i].size;
+        heap.budget = budgets[i].budget;
+        heap.blockCount = stats.statistics.blockCount;
+        heap.allocationCount = stats.statistics.allocationCount;
+        heap.blockBytes = stats.statistics.blockBytes;
+        heap.allocationBytes = stats.statistics.allocationBytes;
+        heap.unusedRangeCount = stats.unusedRangeCount;
+        heap.largestUnusedRange = stats.unusedRangeCount > 0 ? stats.unusedRangeSizeMax : 0;
+        heaps.push_back(heap);
+    }
+
+    return heaps;
+}
+
+void Device::registerBuffer(Buffer* buffer)
+{
+    std::lock_guard<std::mutex> lock(m_buffersMutex);
+    m_buffers.insert(buffer);
+}
+
+void Device::unregisterBuffer(Buffer* buffer)
+{
+    std::lock_guard<std::mutex> lock(m_buffersMutex);
+    m_buffers.erase(buffer);
+}
+
+void Device::drawInterface()
+{
+    if (ImGui::CollapsingHeader("GPU Memory"))
+    {
+        VkPhysicalDeviceProperties properties;
+        vkGetPhysicalDeviceProperties(m_physicalDevice, &properties);
+
+        uint32_t totalBlocks = 0;
+        std::vector<HeapStatistics> heaps = getHeapStatistics();
+        for (const auto& heap : heaps) {
+            totalBlocks += heap.blockCount;
+        }
+        ImGui::Text("Memory objects: %u / %u", totalBlocks, properties.limits.maxMemoryAllocationCount);
+        ImGui::Text("Samplers: %u / %u", m_samplerCache->getSamplerCount(), properties.limits.maxSamplerAllocationCount);
+
+        const float megabyte = 1024.0f * 1024.0f;
+        for (const auto& heap : heaps) {
+            // Share of free space inside allocated blocks that is not part of the largest free range
+            VkDeviceSize freeBytes = heap.blockBytes - heap.allocationBytes;
+            float fragmentation = freeBytes > 0 ? 1.0f - static_cast<float>(heap.largestUnusedRange) / freeBytes : 0.0f;
+
+            ImGui::Separator();
+            ImGui::Text("Heap %u (%s)", heap.heapIndex, (heap.flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT) ? "device local" : "host");
+            ImGui::Text("Blocks: %u  Allocations: %u", heap.blockCount, heap.allocationCount);
+            ImGui::Text("In use: %.2f MB / %.2f MB allocated", heap.allocationBytes / megabyte, heap.blockBytes / megabyte);
+            ImGui::Text("Budget: %.2f MB / %.2f MB heap", heap.budget / megabyte, heap.heapSize / megabyte);
+            ImGui::Text("Fragmentation: %.1f%% (%u free ranges)", fragmentation * 100.0f, heap.unusedRangeCount);
+        }
+
+        ImGui::Separator();
+        StagingRing& stagingRing = m_uploadQueue->getStagingRing();
+        ImGui::Text("Staging ring: %.2f MB / %.2f MB in flight", stagingRing.getUsed() / megabyte, stagingRing.getCapacity() / megabyte);
+        ImGui::Text("Dedicated staging fallbacks: %llu", static_cast<unsigned long long>(stagingRing.getFallbackCount()));
+
+        ImGui::Separator();
+        std::lock_guard<std::mutex> lock(m_buffersMutex);
+        if (ImGui::TreeNode("Buffers", "Buffer placement (%zu buffers)", m_buffers.size())) {
+            if (ImGui::BeginTable("BufferPlacement", 4, ImGuiTableFlags_Borders | ImGuiTableFlags_RowBg | ImGuiTableFlags_ScrollY,
+                ImVec2(0.0f, 300.0f))) {
+                ImGui::TableSetupColumn("Class");
+                ImGui::TableSetupColumn("Usage");
+                ImGui::TableSetupColumn("Size");
+                ImGui::TableSetupColumn("Memory");
+                ImGui::TableHeadersRow();
+
+                for (Buffer* buffer : m_buffers) {
+                    ImGui::TableNextRow();
+                    ImGui::TableNextColumn();
+                    ImGui::TextUnformatted(memoryUsageToString(buffer->getMemoryUsage()));
+                    ImGui::TableNextColumn();
+                    ImGui::TextUnformatted(string_VkBufferUsageFlags(buffer->getUsage()).c_str());
+                    ImGui::TableNextColumn();
+                    ImGui::Text("%.1f KB", buffer->getSize() / 1024.0f);
+                    ImGui::TableNextColumn();
+                    ImGui::TextUnformatted(string_VkMemoryPropertyFlags(buffer->getMemoryProperties()).c_str());
+                }
+                ImGui::EndTable();
+            }
+            ImGui::TreePop();
+        }
+    }
 }
 
 void Device::createCommandPool()
@@ -17,6 +17,7 @@
 struct QueueFamilyIndices {
     std::optional<uint32_t> graphicsFamily;
     std::optional<uint32_t> presentFamily;
+    std::optional<uint32_t> transferFamily; // transfer capable family without graphics, if the device exposes one
 
     bool isComplete() {
         return graphicsFamily.has_value() && presentFamily.has_value();
@@ -29,6 +30,19 @@ struct SwapChainSupportDetails {
     std::vector<VkPresentModeKHR> presentModes;
 };
 
+struct HeapStatistics {
+    uint32_t heapIndex;
+    VkMemoryHeapFlags flags;
+    VkDeviceSize heapSize;
+    VkDeviceSize budget;
+    uint32_t blockCount;            // VkDeviceMemory objects backing this heap
+    uint32_t allocationCount;       // sub-allocations placed in those blocks
+    VkDeviceSize blockBytes;
+    VkDeviceSize allocationBytes;
+    uint32_t unusedRangeCount;
+    VkDeviceSize largestUnusedRange;
+};
+
 class Device
 {
 public:
@@ -40,6 +54,22 @@ public:
     VkCommandPool& getCommandPool() { return m_commandPool; };
     VkQueue& getGraphicsQueue() { return m_graphicsQueue; };
     VkQueue& getPresentQueue() { return m_presentQueue; };
+    VkQueue& getTransferQueue() { return m_transferQueue; };
+    const QueueFamilyIndices& getQueueFamilyIndices() { return m_queueFamilyIndices; };
+    // Guards host access to every VkQueue; the upload worker submits next to the render thread
+    std::mutex& getQueueMutex() { return m_queueMutex; };
+    UploadQueuePtr getUploadQueue() { return m_uploadQueue; };
+    // Persisted across runs, pass it to every pipeline creation
+    VkPipelineCache getPipelineCache();
+    // Samplers are shared by their create info, none is destroyed before the device
+    SamplerCachePtr getSamplerCache() { return m_samplerCache; };
+    VmaAllocator getAllocator() { return m_allocator; };
+    const VkPhysicalDeviceFeatures& getEnabledFeatures() { return m_enabledFeatures; };
+    // Compute culling writes indirect draws with a non-zero firstInstance, recorded on the graphics queue
+    bool supportsGpuDrivenRendering() { return m_supportsGpuDrivenRendering; };
+    // Optional on top of it: one draw per mesh, with its level count read from a GPU-written buffer
+    bool supportsDrawIndirectCount() { return m_supportsDrawIndirectCount; };
+    bool supportsTextureCompressionBC() { return m_enabledFeatures.textureCompressionBC == VK_TRUE; };
 
     //Swap Chain
     SwapChainSupportDetails querySwapChainSupport(VkPhysicalDevice device);
@@ -52,9 +82,16 @@ public:
     //Buffers
     uint32_t findMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags properties);
 
+    //Memory
+    std::vector<HeapStatistics> getHeapStatistics();
+    void registerBuffer(Buffer* buffer);
+    void unregisterBuffer(Buffer* buffer);
+    void drawInterface();
+
     //CommandBuffer
     VkCommandBuffer beginSingleTimeCommands();
     void endSingleTimeCommands(VkCommandBuffer commandBuffer);
+    void waitIdle();
     
     //Depth Buffer
     VkFormat findDepthFormat();
@@ -68,11 +105,15 @@ private:
     void pickPhysicalDevice();
     //bool isDeviceSuitable(VkPhysicalDevice device);
     int rateDeviceSuitability(VkPhysicalDevice device);
+    bool supportsDescriptorIndexing(VkPhysicalDevice device);
     bool checkDeviceExtensionSupport(VkPhysicalDevice device);
 
     //Logical Device
     void createLogicalDevice();
 
+    //Memory Allocator
+    void createAllocator();
+
     //Command Pool
     void createCommandPool();
 
@@ -84,9 +125,23 @@ private:
     VkDevice m_device;
     VkQueue m_graphicsQueue;
     VkQueue m_presentQueue;
+    VkQueue m_transferQueue = VK_NULL_HANDLE;
+    QueueFamilyIndices m_queueFamilyIndices;
+    VkPhysicalDeviceFeatures m_enabledFeatures{};
+    bool m_supportsGpuDrivenRendering = false;
+    bool m_supportsDrawIndirectCount = false;
     VkCommandPool m_commandPool;
+    VmaAllocator m_allocator;
+
+    UploadQueuePtr m_uploadQueue;
+    PipelineCachePtr m_pipelineCache;
+    SamplerCachePtr m_samplerCache;
 
     std::recursive_mutex m_mutex;
+    std::mutex m_queueMutex;
+
+    std::mutex m_buffersMutex;
+    std::set<Buffer*> m_buffers; // live buffers, for the placement debug view
 
     //Variables
     const std::vector<const char*> deviceExtensions = {
@@ -0,0 +1,123 @@
+#include "FrameContext.h"
+#include "GraphicsEngine.h"
+#include "StorageBuffer.h"
+
+#include <bit>
+#include <cassert>
+
+FrameContext::FrameContext(Device* device, Renderer* renderer, size_t workerCount) : m_device(device), m_renderer(renderer)
+{
+    VkCommandPoolCreateInfo poolInfo{};
+    poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+    poolInfo.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+    poolInfo.queueFamilyIndex = m_device->getQueueFamilyIndices().graphicsFamily.value();
+
+    if (vkCreateCommandPool(m_device->get(), &poolInfo, nullptr, &m_commandPool) != VK_SUCCESS) {
+        throw std::runtime_error("failed to create frame command pool!");
+    }
+
+    VkCommandBufferAllocateInfo allocInfo{};
+    allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+    allocInfo.commandPool = m_commandPool;
+    allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+    allocInfo.commandBufferCount = 1;
+
+    if (vkAllocateCommandBuffers(m_device->get(), &allocInfo, &m_commandBuffer) != VK_SUCCESS) {
+        throw std::runtime_error("failed to allocate command buffers!");
+    }
+
+    m_workerPools.resize(workerCount + 1);
+    for (WorkerPool& workerPool : m_workerPools) {
+        if (vkCreateCommandPool(m_device->get(), &poolInfo, nullptr, &workerPool.commandPool) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create frame command pool!");
+        }
+    }
+
+    // Instance, culled instance and culling sets
+    std::vector<DescriptorAllocatorGrowable::PoolSizeRatio> sizes =
+    {
+        { VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 2 }
+    };
+    m_descriptorAllocator.init(m_device->get(), 4, sizes);
+
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(m_device->getPhysicalDevice(), &properties);
+    m_transientAlignment = std::max<VkDeviceSize>(properties.limits.minStorageBufferOffsetAlignment, 16);
+
+    reserveTransient(1024 * (sizeof(ModelUBO) + sizeof(CullGroup) + sizeof(VkDrawIndexedIndirectCommand)));
+}
+
+FrameContext::~FrameContext()
+{
+    m_transientBuffer.reset();
+    m_descriptorAllocator.destroyPools(m_device->get());
+    for (WorkerPool& workerPool : m_workerPools) {
+        vkDestroyCommandPool(m_device->get(), workerPool.commandPool, nullptr);
+    }
+    vkDestroyCommandPool(m_device->get(), m_commandPool, nullptr);
+}
+
+void FrameContext::reset()
+{
+    vkResetCommandPool(m_device->get(), m_commandPool, 0);
+    for (WorkerPool& workerPool : m_workerPools) {
+        if (workerPool.used > 0) {
+            vkResetCommandPool(m_device->get(), workerPool.commandPool, 0);
+            workerPool.used = 0;
+        }
+    }
+
+    m_descriptorAllocator.clearPools(m_device->get());
+    m_transientUsed = 0;
+}
+
+VkCommandBuffer FrameContext::allocateSecondaryCommandBuffer(int workerIndex)
+{
+    WorkerPool& workerPool = m_workerPools[workerIndex >= 0 ? workerIndex : m_workerPools.size() - 1];
+
+    // Command buffers stay allocated across resets and are handed out again in order
+    if (workerPool.used == workerPool.commandBuffers.size()) {
+        VkCommandBufferAllocateInfo allocInfo{};
+        allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+        allocInfo.commandPool = workerPool.commandPool;
+        allocInfo.level = VK_COMMAND_BUFFER_LEVEL_SECONDARY;
+        allocInfo.commandBufferCount = 1;
+
+        VkCommandBuffer commandBuffer;
+        VK_CHECK(vkAllocateCommandBuffers(m_device->get(), &allocInfo, &commandBuffer));
+        workerPool.commandBuffers.push_back(commandBuffer);
+    }
+    return workerPool.commandBuffers[workerPool.used++];
+}
+
+VkDescriptorSet FrameContext::allocateDescriptorSet(VkDescriptorSetLayout layout)
+{
+    return m_descriptorAllocator.allocate(m_device->get(), layout);
+}
+
+void FrameContext::reserveTransient(VkDeviceSize size)
+{
+    assert(m_transientUsed == 0);
+    if (m_transientBuffer && size <= m_transientBuffer->getSize()) {
+        return;
+    }
+
+    // Indirect usage so draw commands written by the CPU or the culling pass can live here too
+    m_transientBuffer = m_renderer->createStorageBuffer(std::bit_ceil(size), VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT);
+}
+
+TransientAllocation FrameContext::allocateTransient(VkDeviceSize size)
+{
+    VkDeviceSize offset = (m_transientUsed + m_transientAlignment - 1) & ~(m_transientAlignment - 1);
+    if (offset + size > m_transientBuffer->getSize()) {
+        throw std::runtime_error("frame transient arena exhausted, reserve more before allocating!");
+    }
+    m_transientUsed = offset + size;
+
+    TransientAllocation allocation;
+    allocation.buffer = m_transientBuffer->get();
+    allocation.offset = offset;
+    allocation.size = size;
+    allocation.data = static_cast<char*>(m_transientBuffer->getMappedMemory()) + offset;
+    return allocation;
+}
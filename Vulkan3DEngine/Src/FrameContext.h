@@ -0,0 +1,59 @@
+#pragma once
+#include "Prerequisites.h"
+#include "Descriptors.h"
+
+#include <vector>
+
+// A piece of this frame's transient memory; data is persistently mapped
+struct TransientAllocation {
+    VkBuffer buffer = VK_NULL_HANDLE;
+    VkDeviceSize offset = 0;
+    VkDeviceSize size = 0;
+    void* data = nullptr;
+};
+
+// Everything the renderer allocates for one frame in flight: the primary command buffer, a secondary
+// command pool per ThreadPool worker, descriptor sets and a linear arena for data written by the CPU this
+// frame. It is reset as a whole once the frame's fence has signalled, so frame-local allocations are never
+// freed one by one and never share a pool with loader threads.
+class FrameContext
+{
+public:
+    FrameContext(Device* device, Renderer* renderer, size_t workerCount);
+    ~FrameContext();
+
+    // Only valid after the frame's previous submission has retired
+    void reset();
+
+    VkCommandBuffer getCommandBuffer() { return m_commandBuffer; }
+    // From the pool of the given worker, -1 for the thread recording the frame
+    VkCommandBuffer allocateSecondaryCommandBuffer(int workerIndex);
+
+    VkDescriptorSet allocateDescriptorSet(VkDescriptorSetLayout layout);
+
+    // Grows the arena to hold size bytes; must be called before the frame's first transient allocation
+    void reserveTransient(VkDeviceSize size);
+    TransientAllocation allocateTransient(VkDeviceSize size);
+    // Every transient allocation starts at a multiple of this, so it can be bound as a storage buffer
+    VkDeviceSize getTransientAlignment() const { return m_transientAlignment; }
+
+private:
+    struct WorkerPool {
+        VkCommandPool commandPool = VK_NULL_HANDLE;
+        std::vector<VkCommandBuffer> commandBuffers;
+        uint32_t used = 0;
+    };
+
+    Device* m_device;
+    Renderer* m_renderer;
+
+    VkCommandPool m_commandPool = VK_NULL_HANDLE;
+    VkCommandBuffer m_commandBuffer = VK_NULL_HANDLE;
+    std::vector<WorkerPool> m_workerPools; // the last one belongs to the recording thread
+
+    DescriptorAllocatorGrowable m_descriptorAllocator;
+
+    StorageBufferPtr m_transientBuffer;
+    VkDeviceSize m_transientUsed = 0;
+    VkDeviceSize m_transientAlignment = 0;
+};
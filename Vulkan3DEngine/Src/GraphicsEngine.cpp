@@ -1,4 +1,5 @@
 #include "GraphicsEngine.h"
+#include "UploadQueue.h"
 
 GraphicsEngine* GraphicsEngine::m_engine = nullptr;
 
@@ -9,6 +10,10 @@ GraphicsEngine::GraphicsEngine()
 
 GraphicsEngine::~GraphicsEngine()
 {
+    // Retiring uploads release staging buffers, which needs the engine to still be reachable
+    if (m_device) {
+        m_device->getUploadQueue()->waitIdle();
+    }
     m_scene.reset();
     m_modelDataManager.reset();
     m_textureManager.reset();
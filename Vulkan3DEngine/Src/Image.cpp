@@ -22,35 +22,30 @@ Image::Image(uint32_t width, uint32_t height, uint32_t mipLevels, VkSampleCountF
 	imageInfo.usage = usage;
 	imageInfo.samples = numSamples;
 	imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
-	
-	if (vkCreateImage(GraphicsEngine::get()->getDevice()->get(), &imageInfo, nullptr, &m_image) != VK_SUCCESS) {
+
+	VmaAllocationCreateInfo allocInfo{};
+	allocInfo.usage = VMA_MEMORY_USAGE_UNKNOWN;
+	allocInfo.requiredFlags = properties;
+
+	if (vmaCreateImage(GraphicsEngine::get()->getDevice()->getAllocator(), &imageInfo, &allocInfo, &m_image, &m_allocation, nullptr) != VK_SUCCESS) {
 		throw std::runtime_error("failed to create image!");
 	}
-	VkMemoryRequirements memRequirements;
-	vkGetImageMemoryRequirements(GraphicsEngine::get()->getDevice()->get(), m_image, &memRequirements);
-	
-	VkMemoryAllocateInfo allocInfo{};
-	allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-	allocInfo.allocationSize = memRequirements.size;
-	allocInfo.memoryTypeIndex = GraphicsEngine::get()->getDevice()->findMemoryType(memRequirements.memoryTypeBits, properties);
-	
-	if (vkAllocateMemory(GraphicsEngine::get()->getDevice()->get(), &allocInfo, nullptr, &m_imageMemory) != VK_SUCCESS) {
-		throw std::runtime_error("failed to allocate image memory!");
-	}
-	
-	vkBindImageMemory(GraphicsEngine::get()->getDevice()->get(), m_image, m_imageMemory, 0);
 }
 
 Image::~Image()
 {
-	vkDestroyImage(GraphicsEngine::get()->getDevice()->get(), m_image, nullptr);
-	vkFreeMemory(GraphicsEngine::get()->getDevice()->get(), m_imageMemory, nullptr);
+	vmaDestroyImage(GraphicsEngine::get()->getDevice()->getAllocator(), m_image, m_allocation);
 }
 
 void Image::transitionImageLayout(VkImageLayout newLayout)
 {
 	VkCommandBuffer commandBuffer = GraphicsEngine::get()->getDevice()->beginSingleTimeCommands();
-	
+	recordLayoutTransition(commandBuffer, newLayout);
+	GraphicsEngine::get()->getDevice()->endSingleTimeCommands(commandBuffer);
+}
+
+void Image::recordLayoutTransition(VkCommandBuffer commandBuffer, VkImageLayout newLayout)
+{
 	VkImageMemoryBarrier barrier{};
 	barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
 	barrier.oldLayout = m_layout;
@@ -106,8 +101,6 @@ void Image::transitionImageLayout(VkImageLayout newLayout)
 
 	vkCmdPipelineBarrier(commandBuffer, sourceStage, destinationStage, 0, 0, nullptr, 0, nullptr, 1, &barrier);
 
-	GraphicsEngine::get()->getDevice()->endSingleTimeCommands(commandBuffer);
-
 	m_layout = newLayout;
 }
 
@@ -116,18 +109,8 @@ void Image::updateLayout(VkImageLayout newLayout)
 	m_layout = newLayout;
 }
 
-void Image::generateMipmaps()
+void Image::recordMipmaps(VkCommandBuffer commandBuffer)
 {
-	// Check if image format supports linear blitting
-	VkFormatProperties formatProperties;
-	vkGetPhysicalDeviceFormatProperties(GraphicsEngine::get()->getDevice()->getPhysicalDevice(), m_format, &formatProperties);
-
-	if (!(formatProperties.optimalTilingFeatures & VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT)) {
-		throw std::runtime_error("texture image format does not support linear blitting!");
-	}
-
-	VkCommandBuffer commandBuffer = GraphicsEngine::get()->getDevice()->beginSingleTimeCommands();
-
 	VkImageMemoryBarrier barrier{};
 	barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
 	barrier.image = m_image;
@@ -190,5 +173,4 @@ void Image::generateMipmaps()
 		1, &barrier);
 
 	m_layout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-	GraphicsEngine::get()->getDevice()->endSingleTimeCommands(commandBuffer);
 }
\ No newline at end of file
@@ -11,17 +11,21 @@ public:
 	VkImage& get() { return m_image; }
 	const uint32_t getWidth() { return m_width; }
 	const uint32_t getHeight() { return m_height; }
+	const uint32_t getMipLevels() { return m_mipLevels; }
+	const VkFormat getFormat() { return m_format; }
 
 	void transitionImageLayout(VkImageLayout newLayout);
+	void recordLayoutTransition(VkCommandBuffer commandBuffer, VkImageLayout newLayout);
 	void updateLayout(VkImageLayout newLayout);
 	const VkImageLayout& getLayout() { return m_layout; }
 
-	void generateMipmaps();
+	// Expects every level in TRANSFER_DST_OPTIMAL, leaves every level in SHADER_READ_ONLY_OPTIMAL
+	void recordMipmaps(VkCommandBuffer commandBuffer);
 private:
 	Renderer* m_renderer = nullptr;
 
 	VkImage m_image;
-	VkDeviceMemory m_imageMemory;
+	VmaAllocation m_allocation;
 	uint32_t m_width;
 	uint32_t m_height;
 	uint32_t m_mipLevels;
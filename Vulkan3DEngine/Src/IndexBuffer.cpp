@@ -1,20 +1,23 @@
 #include "IndexBuffer.h"
 #include "GraphicsEngine.h"
-#include "StagingBuffer.h"
+#include "UploadQueue.h"
 
-IndexBuffer::IndexBuffer(std::vector<uint32_t> indices, Renderer* renderer) : Buffer(renderer)
+IndexBuffer::IndexBuffer(const std::vector<uint32_t>& indices, Renderer* renderer) :
+    IndexBuffer(indices.data(), indices.size(), renderer)
 {
-    VkDeviceSize bufferSize = sizeof(indices[0]) * indices.size();
-    StagingBufferPtr stagingBuffer = m_renderer->createStagingBuffer(bufferSize);
+}
+
+IndexBuffer::IndexBuffer(const uint32_t* indices, size_t count, Renderer* renderer) : Buffer(renderer)
+{
+    VkDeviceSize bufferSize = sizeof(uint32_t) * count;
+    StagingSlice staging = GraphicsEngine::get()->getDevice()->getUploadQueue()->allocateStaging(bufferSize);
 
-    stagingBuffer->map();
-    memcpy(stagingBuffer->getMappedMemory(), indices.data(), (size_t)bufferSize);
-    stagingBuffer->unmap();
+    memcpy(staging.data, indices, (size_t)bufferSize);
 
-    createBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT,
-        VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, m_buffer, m_bufferMemory);
+    createBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT, MemoryUsage::GpuOnly);
 
-    copyBuffer(stagingBuffer->get(), m_buffer, bufferSize);
+    m_uploadFuture = GraphicsEngine::get()->getDevice()->getUploadQueue()->uploadBuffer(staging, m_buffer,
+        VK_PIPELINE_STAGE_VERTEX_INPUT_BIT, VK_ACCESS_INDEX_READ_BIT);
 }
 
 IndexBuffer::~IndexBuffer()
@@ -24,5 +27,10 @@ IndexBuffer::~IndexBuffer()
 
 void IndexBuffer::bind()
 {
-    vkCmdBindIndexBuffer(GraphicsEngine::get()->getRenderer()->getCurrentCommandBuffer(), m_buffer, 0, VK_INDEX_TYPE_UINT32);
+    bind(GraphicsEngine::get()->getRenderer()->getCurrentCommandBuffer());
+}
+
+void IndexBuffer::bind(VkCommandBuffer commandBuffer)
+{
+    vkCmdBindIndexBuffer(commandBuffer, m_buffer, 0, VK_INDEX_TYPE_UINT32);
 }
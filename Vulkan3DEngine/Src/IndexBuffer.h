@@ -6,10 +6,13 @@
 struct IndexBuffer : public Buffer
 {
 public:
-	IndexBuffer(std::vector<uint32_t> indices, Renderer* renderer);
+	IndexBuffer(const std::vector<uint32_t>& indices, Renderer* renderer);
+	IndexBuffer(const uint32_t* indices, size_t count, Renderer* renderer);
 	~IndexBuffer();
 	
 	void bind() override;
+	// For command buffers other than the renderer's current one, e.g. secondaries recorded on worker threads
+	void bind(VkCommandBuffer commandBuffer);
 private:
 	
 };
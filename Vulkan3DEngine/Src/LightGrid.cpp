@@ -0,0 +1,276 @@
+#include "LightGrid.h"
+#include "GraphicsEngine.h"
+#include "FrameContext.h"
+#include "Descriptors.h"
+#include "Camera.h"
+#include "ThreadPool.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <xmmintrin.h>
+
+float LightGrid::s_attenuationCutoff = 0.0001f;
+
+float LightGrid::getLightCutoff(const PointLight& light, float cutoff)
+{
+    // Matches Shader.frag: the light ends where it adds less than s_minLightContribution to any channel
+    float brightness = light.color.w * std::max({ light.color.x, light.color.y, light.color.z });
+    return std::clamp(cutoff + (1.0f - cutoff) * s_minLightContribution / std::max(brightness, 1e-6f), cutoff, 0.5f);
+}
+
+float LightGrid::getLightRange(const PointLight& light, float cutoff)
+{
+    // Shader.frag: attenuation = 1 / (d / radius + 1)^2 with d = (distance - radius) / intensity
+    return light.radius + std::max(light.color.w, 0.0f) * light.radius * (1.0f / std::sqrt(cutoff) - 1.0f);
+}
+
+void LightGrid::build(const std::vector<PointLightPtr>& lights, const glm::mat4& view, const glm::mat4& proj, glm::vec3 cameraPosition,
+    VkExtent2D extent)
+{
+    auto start = std::chrono::high_resolution_clock::now();
+
+    // Far to near, as the billboards are blended without a depth test; the keys are computed once, not per comparison
+    uint32_t count = static_cast<uint32_t>(lights.size());
+    std::vector<std::pair<float, uint32_t>> order(count);
+    for (uint32_t i = 0; i < count; i++) {
+        glm::vec3 offset = lights[i]->position - cameraPosition;
+        order[i] = { glm::dot(offset, offset), i };
+    }
+    std::sort(order.begin(), order.end(), [](const auto& a, const auto& b) { return a.first > b.first; });
+
+    m_lights.resize(count);
+    for (uint32_t i = 0; i < count; i++) {
+        m_lights[i] = *lights[order[i].second];
+    }
+
+    size_t paddedCount = (count + 3) & ~size_t(3);
+    PackedLights& packed = m_packed;
+    for (std::vector<float>* component : { &packed.x, &packed.y, &packed.z, &packed.radius, &packed.intensity,
+        &packed.rangeScale, &packed.viewX, &packed.viewY, &packed.depth, &packed.range }) {
+        component->assign(paddedCount, 0.0f);
+    }
+    float cutoff = std::clamp(s_attenuationCutoff, 1e-6f, 0.5f);
+    for (uint32_t i = 0; i < count; i++) {
+        packed.x[i] = m_lights[i].position.x;
+        packed.y[i] = m_lights[i].position.y;
+        packed.z[i] = m_lights[i].position.z;
+        packed.radius[i] = m_lights[i].radius;
+        packed.intensity[i] = m_lights[i].color.w;
+        packed.rangeScale[i] = 1.0f / std::sqrt(getLightCutoff(m_lights[i], cutoff)) - 1.0f;
+    }
+
+    // Four lights per iteration: view space center, depth along the view direction and range of influence
+    for (size_t i = 0; i < paddedCount; i += 4) {
+        __m128 x = _mm_loadu_ps(&packed.x[i]);
+        __m128 y = _mm_loadu_ps(&packed.y[i]);
+        __m128 z = _mm_loadu_ps(&packed.z[i]);
+        __m128 radius = _mm_loadu_ps(&packed.radius[i]);
+        __m128 intensity = _mm_max_ps(_mm_loadu_ps(&packed.intensity[i]), _mm_setzero_ps());
+
+        __m128 viewX = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(view[0][0]), x), _mm_mul_ps(_mm_set1_ps(view[1][0]), y)),
+            _mm_add_ps(_mm_mul_ps(_mm_set1_ps(view[2][0]), z), _mm_set1_ps(view[3][0])));
+        __m128 viewY = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(view[0][1]), x), _mm_mul_ps(_mm_set1_ps(view[1][1]), y)),
+            _mm_add_ps(_mm_mul_ps(_mm_set1_ps(view[2][1]), z), _mm_set1_ps(view[3][1])));
+        // The camera looks down -z, depth is positive in front of it
+        __m128 depth = _mm_sub_ps(_mm_setzero_ps(), _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(view[0][2]), x),
+            _mm_mul_ps(_mm_set1_ps(view[1][2]), y)), _mm_add_ps(_mm_mul_ps(_mm_set1_ps(view[2][2]), z), _mm_set1_ps(view[3][2]))));
+        __m128 rangeScale = _mm_loadu_ps(&packed.rangeScale[i]);
+        __m128 range = _mm_add_ps(radius, _mm_mul_ps(_mm_mul_ps(intensity, radius), rangeScale));
+
+        _mm_storeu_ps(&packed.viewX[i], viewX);
+        _mm_storeu_ps(&packed.viewY[i], viewY);
+        _mm_storeu_ps(&packed.depth[i], depth);
+        _mm_storeu_ps(&packed.range[i], range);
+    }
+
+    float nearPlane = Camera::s_nearPlane;
+    float farPlane = Camera::s_farPlane;
+    m_info.tileSize = s_tileSize;
+    m_info.gridX = std::max((extent.width + s_tileSize - 1) / s_tileSize, 1u);
+    m_info.gridY = std::max((extent.height + s_tileSize - 1) / s_tileSize, 1u);
+    m_info.gridZ = s_sliceCount;
+    m_info.nearPlane = nearPlane;
+    m_info.sliceScale = s_sliceCount / std::log(farPlane / nearPlane);
+    m_info.attenuationCutoff = cutoff;
+    m_info.minLightContribution = s_minLightContribution;
+    m_info.lightCount = count;
+
+    m_sliceDepths.resize(s_sliceCount + 1);
+    for (uint32_t slice = 0; slice <= s_sliceCount; slice++) {
+        m_sliceDepths[slice] = nearPlane * std::pow(farPlane / nearPlane, static_cast<float>(slice) / s_sliceCount);
+    }
+    m_projX = proj[0][0];
+    m_projY = std::abs(proj[1][1]);
+    m_extent = extent;
+
+    m_clusters.resize(static_cast<size_t>(m_info.gridX) * m_info.gridY * m_info.gridZ);
+    m_sliceIndices.resize(s_sliceCount);
+    m_sliceRects.resize(s_sliceCount);
+    m_sliceDropped.resize(s_sliceCount);
+    ThreadPool::get()->parallel_for(0, s_sliceCount, [this](size_t slice) {
+        buildSlice(static_cast<uint32_t>(slice));
+        }, 1);
+
+    // Offsets within a slice become offsets into the concatenated index list
+    uint32_t tileCount = m_info.gridX * m_info.gridY;
+    uint32_t base = 0;
+    m_maxClusterLights = 0;
+    m_droppedCount = 0;
+    for (uint32_t slice = 0; slice < s_sliceCount; slice++) {
+        for (uint32_t tile = 0; tile < tileCount; tile++) {
+            glm::uvec2& cluster = m_clusters[slice * tileCount + tile];
+            cluster.x += base;
+            m_maxClusterLights = std::max(m_maxClusterLights, cluster.y);
+        }
+        base += static_cast<uint32_t>(m_sliceIndices[slice].size());
+        m_droppedCount += m_sliceDropped[slice];
+    }
+    m_indexCount = base;
+
+    if (m_droppedCount > 0 && !m_overflowReported) {
+        fmt::print(stderr, "Light grid: {} cluster entries dropped past {} lights per cluster, the farthest lights go missing there\n",
+            m_droppedCount, s_maxLightsPerCluster);
+        m_overflowReported = true;
+    }
+
+    m_buildTime = std::chrono::duration<float, std::chrono::milliseconds::period>(std::chrono::high_resolution_clock::now() - start).count();
+}
+
+void LightGrid::buildSlice(uint32_t slice)
+{
+    uint32_t gridX = m_info.gridX;
+    uint32_t gridY = m_info.gridY;
+    glm::uvec2* clusters = &m_clusters[static_cast<size_t>(slice) * gridX * gridY];
+    std::fill(clusters, clusters + gridX * gridY, glm::uvec2(0));
+
+    std::vector<TileRect>& rects = m_sliceRects[slice];
+    rects.clear();
+    uint32_t dropped = 0;
+
+    float sliceNear = m_sliceDepths[slice];
+    float sliceFar = m_sliceDepths[slice + 1];
+    float width = static_cast<float>(m_extent.width);
+    float height = static_cast<float>(m_extent.height);
+    auto toTile = [](float pixel, float size, uint32_t tiles) {
+        return std::min(static_cast<uint32_t>(std::clamp(pixel, 0.0f, std::max(size - 1.0f, 0.0f))) / s_tileSize, tiles - 1);
+    };
+
+    // Nearest lights first, so they are the ones kept in a full cluster
+    const PackedLights& packed = m_packed;
+    for (uint32_t i = m_info.lightCount; i-- > 0;) {
+        float depth = packed.depth[i];
+        float range = packed.range[i];
+        float d0 = std::max(depth - range, sliceNear);
+        float d1 = std::min(depth + range, sliceFar);
+        if (d0 > d1) {
+            continue;
+        }
+
+        // Radius of the widest cross section of the sphere within the slice
+        float dz = depth < d0 ? d0 - depth : (depth > d1 ? depth - d1 : 0.0f);
+        float radius = std::sqrt(std::max(range * range - dz * dz, 0.0f));
+
+        // Extremes of x / depth and y / depth over the box around that cross section, depth in [d0, d1]
+        float xMin = packed.viewX[i] - radius;
+        float xMax = packed.viewX[i] + radius;
+        float yMin = packed.viewY[i] - radius;
+        float yMax = packed.viewY[i] + radius;
+        xMin /= xMin >= 0.0f ? d1 : d0;
+        xMax /= xMax >= 0.0f ? d0 : d1;
+        yMin /= yMin >= 0.0f ? d1 : d0;
+        yMax /= yMax >= 0.0f ? d0 : d1;
+
+        // To pixels; the projection flips y, so view space up is the top of the framebuffer
+        float left = (xMin * m_projX * 0.5f + 0.5f) * width;
+        float right = (xMax * m_projX * 0.5f + 0.5f) * width;
+        float top = (0.5f - yMax * m_projY * 0.5f) * height;
+        float bottom = (0.5f - yMin * m_projY * 0.5f) * height;
+        if (right < 0.0f || left >= width || bottom < 0.0f || top >= height) {
+            continue;
+        }
+
+        TileRect rect{ i, toTile(left, width, gridX), toTile(top, height, gridY), toTile(right, width, gridX), toTile(bottom, height, gridY) };
+        for (uint32_t y = rect.y0; y <= rect.y1; y++) {
+            for (uint32_t x = rect.x0; x <= rect.x1; x++) {
+                glm::uvec2& cluster = clusters[y * gridX + x];
+                if (cluster.y < s_maxLightsPerCluster) {
+                    cluster.y++;
+                }
+                else {
+                    dropped++;
+                }
+            }
+        }
+        rects.push_back(rect);
+    }
+
+    uint32_t offset = 0;
+    for (uint32_t tile = 0; tile < gridX * gridY; tile++) {
+        clusters[tile].x = offset;
+        offset += clusters[tile].y;
+        clusters[tile].y = 0;
+    }
+
+    // Same order and cap as the count, so every counted slot is filled
+    std::vector<uint32_t>& indices = m_sliceIndices[slice];
+    indices.resize(offset);
+    for (const TileRect& rect : rects) {
+        for (uint32_t y = rect.y0; y <= rect.y1; y++) {
+            for (uint32_t x = rect.x0; x <= rect.x1; x++) {
+                glm::uvec2& cluster = clusters[y * gridX + x];
+                if (cluster.y < s_maxLightsPerCluster) {
+                    indices[cluster.x + cluster.y++] = rect.light;
+                }
+            }
+        }
+    }
+    m_sliceDropped[slice] = dropped;
+}
+
+VkDeviceSize LightGrid::getTransientSize(VkDeviceSize alignment) const
+{
+    // A storage buffer range can not be empty, so every allocation holds at least one element
+    return std::max<VkDeviceSize>(m_lights.size(), 1) * sizeof(PointLight) +
+        sizeof(LightClusterInfo) + m_clusters.size() * sizeof(glm::uvec2) +
+        std::max<VkDeviceSize>(m_indexCount, 1) * sizeof(uint32_t) + 3 * alignment;
+}
+
+void LightGrid::write(FrameContext& frame, VkDescriptorSet set)
+{
+    TransientAllocation lightData = frame.allocateTransient(std::max<VkDeviceSize>(m_lights.size(), 1) * sizeof(PointLight));
+    TransientAllocation clusterData = frame.allocateTransient(sizeof(LightClusterInfo) + m_clusters.size() * sizeof(glm::uvec2));
+    TransientAllocation indexData = frame.allocateTransient(std::max<VkDeviceSize>(m_indexCount, 1) * sizeof(uint32_t));
+
+    memcpy(lightData.data, m_lights.data(), m_lights.size() * sizeof(PointLight));
+
+    uint8_t* clusters = static_cast<uint8_t*>(clusterData.data);
+    memcpy(clusters, &m_info, sizeof(LightClusterInfo));
+    memcpy(clusters + sizeof(LightClusterInfo), m_clusters.data(), m_clusters.size() * sizeof(glm::uvec2));
+
+    uint32_t* indices = static_cast<uint32_t*>(indexData.data);
+    for (const std::vector<uint32_t>& sliceIndices : m_sliceIndices) {
+        memcpy(indices, sliceIndices.data(), sliceIndices.size() * sizeof(uint32_t));
+        indices += sliceIndices.size();
+    }
+
+    DescriptorWriter writer;
+    writer.writeBuffer(0, lightData.buffer, lightData.size, lightData.offset, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER);
+    writer.writeBuffer(1, clusterData.buffer, clusterData.size, clusterData.offset, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER);
+    writer.writeBuffer(2, indexData.buffer, indexData.size, indexData.offset, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER);
+    writer.updateSet(GraphicsEngine::get()->getDevice()->get(), set);
+}
+
+void LightGrid::drawInterface()
+{
+    if (ImGui::CollapsingHeader("Clustered Lighting"))
+    {
+        uint32_t clusterCount = static_cast<uint32_t>(m_clusters.size());
+        ImGui::Text("Point lights: %u", m_info.lightCount);
+        ImGui::Text("Clusters: %u x %u x %u", m_info.gridX, m_info.gridY, m_info.gridZ);
+        ImGui::Text("Light indices: %u (%.2f per cluster)", m_indexCount, clusterCount > 0 ? static_cast<float>(m_indexCount) / clusterCount : 0.0f);
+        ImGui::Text("Most lights in a cluster: %u / %u", m_maxClusterLights, s_maxLightsPerCluster);
+        ImGui::Text("Dropped: %u", m_droppedCount);
+        ImGui::Text("Build time: %.3f ms", m_buildTime);
+    }
+}
@@ -0,0 +1,79 @@
+#pragma once
+#include "Prerequisites.h"
+
+#include <vector>
+
+// Clustered forward lighting. Once per frame the point lights are binned into a froxel grid: screen tiles of
+// s_tileSize pixels, split into s_sliceCount slices growing exponentially with view space depth. Each cluster
+// stores a range of a light index list, so the fragment shader only iterates the lights whose range of influence
+// reaches its cluster and its cost no longer grows with the number of lights in the scene. The lights, the
+// clusters and the index list go into the frame's transient memory and are bound as descriptor set 3.
+class LightGrid
+{
+public:
+    // Attenuation below which a light no longer contributes. The shader uses the same value, so raising it
+    // shrinks the ranges without a visible seam, only a shorter falloff.
+    static float s_attenuationCutoff;
+    // Each light also ends where it adds less than this to a channel, one step of an 8 bit target, so dim lights
+    // reach fewer clusters than bright ones; see getLightCutoff
+    static constexpr float s_minLightContribution = 1.0f / 255.0f;
+
+    static constexpr uint32_t s_tileSize = 64;
+    static constexpr uint32_t s_sliceCount = 24;
+    // Lights past this in one cluster are dropped, nearest lights first in; counted per frame and logged once
+    static constexpr uint32_t s_maxLightsPerCluster = 128;
+
+    // Render thread, once per frame before the transient memory is reserved
+    void build(const std::vector<PointLightPtr>& lights, const glm::mat4& view, const glm::mat4& proj, glm::vec3 cameraPosition,
+        VkExtent2D extent);
+    // Transient memory write() allocates, with room for each of its three allocations to be aligned
+    VkDeviceSize getTransientSize(VkDeviceSize alignment) const;
+    // Copies the lights, clusters and index list into the frame's transient memory and points the set's bindings at them
+    void write(FrameContext& frame, VkDescriptorSet set);
+
+    // Lights in the light buffer, sorted far to near for the blended billboards
+    uint32_t getLightCount() const { return m_info.lightCount; }
+
+    // The light's own cutoff in Shader.frag: cutoff raised until its brightest channel ends at s_minLightContribution
+    static float getLightCutoff(const PointLight& light, float cutoff);
+    // Distance at which the light's attenuation in Shader.frag reaches cutoff
+    static float getLightRange(const PointLight& light, float cutoff);
+
+    void drawInterface();
+
+private:
+    // Fills the clusters and the index list of one depth slice; slices are independent and built in parallel
+    void buildSlice(uint32_t slice);
+
+    struct TileRect {
+        uint32_t light;
+        uint32_t x0, y0, x1, y1; // inclusive
+    };
+
+    std::vector<PointLight> m_lights;
+    LightClusterInfo m_info{};
+    std::vector<glm::uvec2> m_clusters; // offset into the index list and light count of every cluster
+
+    // View space bounds of every light, one array per component, padded to a multiple of four for SIMD
+    struct PackedLights {
+        std::vector<float> x, y, z, radius, intensity, rangeScale;
+        std::vector<float> viewX, viewY, depth, range;
+    };
+    PackedLights m_packed;
+    std::vector<float> m_sliceDepths; // s_sliceCount + 1 boundaries
+    float m_projX = 1.0f;
+    float m_projY = 1.0f;
+    VkExtent2D m_extent{};
+
+    // Per slice, so the slices are built without synchronization; concatenated by write()
+    std::vector<std::vector<uint32_t>> m_sliceIndices;
+    std::vector<std::vector<TileRect>> m_sliceRects;
+    std::vector<uint32_t> m_sliceDropped;
+
+    // Statistics of the last build
+    uint32_t m_indexCount = 0;
+    uint32_t m_maxClusterLights = 0;
+    uint32_t m_droppedCount = 0;
+    bool m_overflowReported = false;
+    float m_buildTime = 0.0f;
+};
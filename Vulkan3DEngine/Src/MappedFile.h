@@ -0,0 +1,31 @@
+#pragma once
+#include <filesystem>
+#include <cstddef>
+
+// Read-only memory mapping of a whole file; pages are read from disk on first touch
+class MappedFile
+{
+public:
+    MappedFile() = default;
+    ~MappedFile();
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    // False if the file does not exist, is empty or cannot be mapped
+    bool open(const std::filesystem::path& path);
+    void close();
+
+    const void* data() const { return m_data; }
+    size_t size() const { return m_size; }
+
+private:
+    const void* m_data = nullptr;
+    size_t m_size = 0;
+#ifdef _WIN32
+    void* m_file = nullptr;
+    void* m_mapping = nullptr;
+#else
+    int m_file = -1;
+#endif
+};
@@ -3,24 +3,21 @@
 #include "VertexBuffer.h"
 #include "IndexBuffer.h"
 
-#include <ranges>
-#include <unordered_map>
-#include <algorithm>
-
-#define TINYOBJLOADER_IMPLEMENTATION
-#include <tiny_obj_loader.h>
-
-Mesh::Mesh(std::vector<Vertex> vertices) :
-    Resource(), m_vertices(std::move(vertices)), m_hasIndexBuffer(false)
+Mesh::Mesh(std::vector<Vertex> vertices) : Resource(), m_hasIndexBuffer(false)
 {
-    m_vertexBuffer = GraphicsEngine::get()->getRenderer()->createVertexBuffer(m_vertices);
+    MeshData data;
+    data.vertices = std::move(vertices);
+    data.computeBounds();
+    upload(data, VertexFormat::Full);
 }
 
-Mesh::Mesh(std::vector<Vertex> vertices, std::vector<uint32_t> indices) :
-    Resource(), m_vertices(std::move(vertices)), m_indices(std::move(indices)), m_hasIndexBuffer(true)
+Mesh::Mesh(std::vector<Vertex> vertices, std::vector<uint32_t> indices) : Resource(), m_hasIndexBuffer(true)
 {
-    m_vertexBuffer = GraphicsEngine::get()->getRenderer()->createVertexBuffer(m_vertices);
-    m_indexBuffer = GraphicsEngine::get()->getRenderer()->createIndexBuffer(m_indices);
+    MeshData data;
+    data.vertices = std::move(vertices);
+    data.indices = std::move(indices);
+    data.computeBounds();
+    upload(data, VertexFormat::Full);
 }
 
 Mesh::Mesh(const std::filesystem::path& full_path) : Resource(full_path), m_hasIndexBuffer(true)
@@ -30,80 +27,74 @@ Mesh::Mesh(const std::filesystem::path& full_path) : Resource(full_path), m_hasI
 
 Mesh::~Mesh()
 {
+    // Command buffers of the frames in flight may still read the buffers
+    RendererPtr renderer = GraphicsEngine::get()->getRenderer();
+    if (m_vertexBuffer) {
+        renderer->retire(std::move(m_vertexBuffer));
+    }
+    if (m_indexBuffer) {
+        renderer->retire(std::move(m_indexBuffer));
+    }
 }
 
 void Mesh::Load(const std::filesystem::path& full_path)
 {
-    tinyobj::attrib_t attrib;
-    std::vector<tinyobj::shape_t> shapes;
-    std::vector<tinyobj::material_t> materials;
-    std::string warn, err;
-
-    if (!tinyobj::LoadObj(&attrib, &shapes, &materials, &warn, &err, full_path.string().c_str())) {
-        throw std::runtime_error(warn + err);
+    std::filesystem::path cachePath = MeshFile::getCachePath(full_path);
+    uint64_t sourceHash = MeshFile::getSourceHash(full_path);
+
+    MeshFile file;
+    if (file.open(cachePath, sourceHash)) {
+        // Copied from the mapped file straight into staging memory, the OBJ is not touched
+        m_lods.assign(file.getLods(), file.getLods() + file.getLodCount());
+        m_vertexFormat = file.getVertexFormat();
+        m_packedConstants = file.getPackedConstants();
+        m_boundsMin = file.getBoundsMin();
+        m_boundsMax = file.getBoundsMax();
+        m_boundingSphere = file.getBoundingSphere();
+        m_vertexBuffer = GraphicsEngine::get()->getRenderer()->createVertexBuffer(file.getVertexData(), file.getVertexDataSize());
+        m_indexBuffer = GraphicsEngine::get()->getRenderer()->createIndexBuffer(file.getIndices(), file.getIndexCount());
+        return;
     }
 
-    std::unordered_map<Vertex, uint32_t> uniqueVertices{};
-    float minY = std::numeric_limits<float>::max();
+    MeshData data = MeshFile::importObj(full_path);
+    MeshFile::write(cachePath, data, sourceHash);
+    upload(data, MeshFile::s_packVertices ? VertexFormat::Packed : VertexFormat::Full);
+}
 
-    // Rezerwuj miejsce na wierzchoki i indeksy
-    m_vertices.reserve(attrib.vertices.size() / 3);
-    for (const auto& shape : shapes) {
-        m_indices.reserve(m_indices.size() + shape.mesh.indices.size());
+void Mesh::upload(const MeshData& data, VertexFormat format)
+{
+    if (data.lods.empty()) {
+        m_lods = { { 0, static_cast<uint32_t>(data.indices.size()), 0.0f } };
     }
-
-    auto processVertex = [&](const tinyobj::index_t& index) {
-        Vertex vertex{};
-
-        vertex.pos = {
-            attrib.vertices[3 * index.vertex_index + 0],
-            attrib.vertices[3 * index.vertex_index + 1],
-            attrib.vertices[3 * index.vertex_index + 2]
-        };
-
-        minY = std::min(minY, vertex.pos.y); // Znajd najniszy punkt y
-
-        if (index.texcoord_index >= 0) { // Sprawd, czy wsprzdne tekstury istniej
-            vertex.texCoord = {
-                attrib.texcoords[2 * index.texcoord_index + 0],
-                1.0f - attrib.texcoords[2 * index.texcoord_index + 1]
-            };
-        }
-
-        if (index.normal_index >= 0) { // Sprawd, czy normalna istnieje
-            vertex.normal = {
-                attrib.normals[3 * index.normal_index + 0],
-                attrib.normals[3 * index.normal_index + 1],
-                attrib.normals[3 * index.normal_index + 2]
-            };
-        }
-
-        vertex.color = { 1.0f, 1.0f, 1.0f };
-
-        if (uniqueVertices.find(vertex) == uniqueVertices.end()) {
-            uniqueVertices[vertex] = static_cast<uint32_t>(m_vertices.size());
-            m_vertices.push_back(vertex);
-        }
-
-        m_indices.push_back(uniqueVertices[vertex]);
-        };
-
-    for (const auto& shape : shapes) {
-        std::ranges::for_each(shape.mesh.indices, processVertex);
+    else {
+        m_lods = data.lods;
     }
+    m_vertexFormat = format;
+    m_packedConstants = data.getPackedConstants();
+    m_boundsMin = data.boundsMin;
+    m_boundsMax = data.boundsMax;
+    m_boundingSphere = data.boundingSphere;
+
+    if (format == VertexFormat::Packed) {
+        std::vector<PackedVertex> packed = data.packVertices();
+        m_vertexBuffer = GraphicsEngine::get()->getRenderer()->createVertexBuffer(packed.data(), packed.size() * sizeof(PackedVertex));
+    }
+    else {
+        m_vertexBuffer = GraphicsEngine::get()->getRenderer()->createVertexBuffer(data.vertices);
+    }
+    if (m_hasIndexBuffer) {
+        m_indexBuffer = GraphicsEngine::get()->getRenderer()->createIndexBuffer(data.indices);
+    }
+}
 
-    // Przesu wszystkie wierzchoki o minY w gr
-    std::ranges::for_each(m_vertices, [minY](Vertex& vertex) {
-        vertex.pos.y -= minY;
-        });
-
-    m_vertexBuffer = GraphicsEngine::get()->getRenderer()->createVertexBuffer(m_vertices);
-    m_indexBuffer = GraphicsEngine::get()->getRenderer()->createIndexBuffer(m_indices);
+bool Mesh::isResident() const
+{
+    return m_vertexBuffer->isUploaded() && (!m_hasIndexBuffer || m_indexBuffer->isUploaded());
 }
 
 void Mesh::Reload()
 {
-    vkDeviceWaitIdle(GraphicsEngine::get()->getDevice()->get());
+    GraphicsEngine::get()->getDevice()->waitIdle();
 
     // Free the old resources
     m_vertexBuffer.reset();
@@ -111,9 +102,6 @@ void Mesh::Reload()
         m_indexBuffer.reset();
     }
 
-    m_vertices.clear();
-    m_indices.clear();
-
     // Load the new mesh
     Load(m_full_path);
 }
@@ -1,6 +1,7 @@
 #pragma once
 #include "Prerequisites.h"
 #include "Resource.h"
+#include "MeshFile.h"
 #include <vector>
 
 class Mesh : public Resource
@@ -16,18 +17,36 @@ public:
 
 	bool hasIndexBuffer() const { return m_hasIndexBuffer; }
 
-	size_t getIndicesSize() const { return m_indices.size(); }
+	// Indices of the full resolution level
+	size_t getIndicesSize() const { return m_lods[0].indexCount; }
+	uint32_t getLodCount() const { return static_cast<uint32_t>(m_lods.size()); }
+	const MeshLod& getLod(uint32_t lod) const { return m_lods[lod]; }
+	// Object space bounds; the sphere is centered on the box, xyz is the center and w the radius
+	glm::vec3 getBoundsMin() const { return m_boundsMin; }
+	glm::vec3 getBoundsMax() const { return m_boundsMax; }
+	glm::vec4 getBoundingSphere() const { return m_boundingSphere; }
+	VertexFormat getVertexFormat() const { return m_vertexFormat; }
+	// Dequantization of PackedVertex positions
+	const MeshConstants& getPackedConstants() const { return m_packedConstants; }
+	// False while the vertex/index data is still in flight on the upload queue
+	bool isResident() const;
 private:
 	void Load(const std::filesystem::path& full_path) override;
+	void upload(const MeshData& data, VertexFormat format);
 
-	std::vector<Vertex> m_vertices;
-	std::vector<uint32_t> m_indices;
+	std::vector<MeshLod> m_lods;
+	VertexFormat m_vertexFormat = VertexFormat::Full;
+	MeshConstants m_packedConstants{};
 
 	VertexBufferPtr m_vertexBuffer;
 	IndexBufferPtr m_indexBuffer;
 
 	bool m_hasIndexBuffer;
 
+	glm::vec3 m_boundsMin = glm::vec3(0.0f);
+	glm::vec3 m_boundsMax = glm::vec3(0.0f);
+	glm::vec4 m_boundingSphere = glm::vec4(0.0f);
+
 	friend class Renderer;
 };
 
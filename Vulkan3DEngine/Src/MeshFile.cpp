@@ -0,0 +1,533 @@
+#include "MeshFile.h"
+#include "PipelineCache.h"
+#include "ThreadPool.h"
+#include "MeshOptimizer.h"
+
+#include <ranges>
+#include <unordered_map>
+#include <algorithm>
+#include <fstream>
+#include <cstring>
+#include <thread>
+#include <bit>
+#include <chrono>
+
+#include <glm/gtc/packing.hpp>
+
+#define TINYOBJLOADER_IMPLEMENTATION
+#include <tiny_obj_loader.h>
+
+bool MeshFile::s_optimizeMeshes = true;
+bool MeshFile::s_packVertices = true;
+bool MeshFile::s_generateLods = true;
+
+void MeshData::computeBounds()
+{
+    if (vertices.empty()) {
+        boundsMin = glm::vec3(0.0f);
+        boundsMax = glm::vec3(0.0f);
+        boundingSphere = glm::vec4(0.0f);
+        return;
+    }
+
+    glm::vec3 minPos = vertices[0].pos;
+    glm::vec3 maxPos = vertices[0].pos;
+    for (const Vertex& vertex : vertices) {
+        minPos = glm::min(minPos, vertex.pos);
+        maxPos = glm::max(maxPos, vertex.pos);
+    }
+
+    boundsMin = minPos;
+    boundsMax = maxPos;
+
+    // Centered on the box, not minimal, but cheap and stable across reloads
+    glm::vec3 center = (minPos + maxPos) * 0.5f;
+    float radiusSquared = 0.0f;
+    for (const Vertex& vertex : vertices) {
+        glm::vec3 d = vertex.pos - center;
+        radiusSquared = std::max(radiusSquared, glm::dot(d, d));
+    }
+    boundingSphere = glm::vec4(center, std::sqrt(radiusSquared));
+}
+
+static void parseObj(const std::filesystem::path& sourcePath, tinyobj::attrib_t& attrib, std::vector<tinyobj::shape_t>& shapes)
+{
+    std::vector<tinyobj::material_t> materials;
+    std::string warn, err;
+
+    if (!tinyobj::LoadObj(&attrib, &shapes, &materials, &warn, &err, sourcePath.string().c_str())) {
+        throw std::runtime_error(warn + err);
+    }
+}
+
+static Vertex makeVertex(const tinyobj::attrib_t& attrib, const tinyobj::index_t& index)
+{
+    Vertex vertex{};
+
+    vertex.pos = {
+        attrib.vertices[3 * index.vertex_index + 0],
+        attrib.vertices[3 * index.vertex_index + 1],
+        attrib.vertices[3 * index.vertex_index + 2]
+    };
+
+    if (index.texcoord_index >= 0) { // Sprawd, czy wsprzdne tekstury istniej
+        vertex.texCoord = {
+            attrib.texcoords[2 * index.texcoord_index + 0],
+            1.0f - attrib.texcoords[2 * index.texcoord_index + 1]
+        };
+    }
+
+    if (index.normal_index >= 0) { // Sprawd, czy normalna istnieje
+        vertex.normal = {
+            attrib.normals[3 * index.normal_index + 0],
+            attrib.normals[3 * index.normal_index + 1],
+            attrib.normals[3 * index.normal_index + 2]
+        };
+    }
+
+    vertex.color = { 1.0f, 1.0f, 1.0f };
+    return vertex;
+}
+
+// The previous import path, hashing whole vertices; only kept as the baseline of benchmarkImport
+static void dedupByValue(const tinyobj::attrib_t& attrib, const std::vector<tinyobj::shape_t>& shapes, MeshData& data)
+{
+    std::unordered_map<Vertex, uint32_t> uniqueVertices{};
+
+    for (const auto& shape : shapes) {
+        for (const tinyobj::index_t& index : shape.mesh.indices) {
+            Vertex vertex = makeVertex(attrib, index);
+            if (uniqueVertices.find(vertex) == uniqueVertices.end()) {
+                uniqueVertices[vertex] = static_cast<uint32_t>(data.vertices.size());
+                data.vertices.push_back(vertex);
+            }
+            data.indices.push_back(uniqueVertices[vertex]);
+        }
+    }
+}
+
+// Open-addressing map from a tinyobj index triple to the vertex it produced. Sized once from the corner
+// count so it never rehashes, and kept at most half full so linear probe runs stay short.
+class IndexTripleMap
+{
+public:
+    explicit IndexTripleMap(size_t cornerCount)
+    {
+        size_t capacity = std::bit_ceil(std::max<size_t>(16, cornerCount * 2));
+        m_entries.resize(capacity);
+        m_mask = capacity - 1;
+    }
+
+    // Returns the vertex stored for the triple, or stores and returns newVertex if there is none
+    uint32_t findOrInsert(const tinyobj::index_t& key, uint32_t newVertex)
+    {
+        for (size_t slot = hash(key) & m_mask;; slot = (slot + 1) & m_mask) {
+            Entry& entry = m_entries[slot];
+            if (entry.vertex == s_empty) {
+                entry = { key.vertex_index, key.normal_index, key.texcoord_index, newVertex };
+                return newVertex;
+            }
+            if (entry.position == key.vertex_index && entry.normal == key.normal_index && entry.texCoord == key.texcoord_index) {
+                return entry.vertex;
+            }
+        }
+    }
+
+private:
+    static constexpr uint32_t s_empty = UINT32_MAX;
+
+    struct Entry {
+        int position = 0;
+        int normal = 0;
+        int texCoord = 0;
+        uint32_t vertex = s_empty;
+    };
+
+    static size_t hash(const tinyobj::index_t& key)
+    {
+        uint64_t h = static_cast<uint32_t>(key.vertex_index) * 0x9E3779B97F4A7C15ull;
+        h ^= static_cast<uint32_t>(key.normal_index) * 0xC2B2AE3D27D4EB4Full;
+        h ^= static_cast<uint32_t>(key.texcoord_index) * 0x165667B19E3779F9ull;
+        return static_cast<size_t>(h ^ (h >> 32));
+    }
+
+    std::vector<Entry> m_entries;
+    size_t m_mask;
+};
+
+// Corners referencing the same position, normal and texcoord indices become one vertex. Every shape is
+// deduplicated on its own pool job and the results are concatenated, so vertices shared by two shapes are
+// stored once per shape.
+static void dedupByIndex(const tinyobj::attrib_t& attrib, const std::vector<tinyobj::shape_t>& shapes, MeshData& data)
+{
+    std::vector<MeshData> shapeData(shapes.size());
+
+    ThreadPool::get()->parallel_for(0, shapes.size(), [&](size_t i) {
+        const std::vector<tinyobj::index_t>& indices = shapes[i].mesh.indices;
+        MeshData& out = shapeData[i];
+        out.indices.resize(indices.size());
+
+        IndexTripleMap map(indices.size());
+        for (size_t corner = 0; corner < indices.size(); corner++) {
+            uint32_t newVertex = static_cast<uint32_t>(out.vertices.size());
+            uint32_t vertex = map.findOrInsert(indices[corner], newVertex);
+            if (vertex == newVertex) {
+                out.vertices.push_back(makeVertex(attrib, indices[corner]));
+            }
+            out.indices[corner] = vertex;
+        }
+        }, 1);
+
+    size_t vertexCount = 0;
+    size_t indexCount = 0;
+    for (const MeshData& shape : shapeData) {
+        vertexCount += shape.vertices.size();
+        indexCount += shape.indices.size();
+    }
+
+    // Rezerwuj miejsce na wierzchoki i indeksy
+    data.vertices.reserve(vertexCount);
+    data.indices.reserve(indexCount);
+    for (const MeshData& shape : shapeData) {
+        uint32_t baseVertex = static_cast<uint32_t>(data.vertices.size());
+        data.vertices.insert(data.vertices.end(), shape.vertices.begin(), shape.vertices.end());
+        for (uint32_t index : shape.indices) {
+            data.indices.push_back(baseVertex + index);
+        }
+    }
+}
+
+// Przesu wszystkie wierzchoki o minY w gr
+static void moveToGround(MeshData& data)
+{
+    float minY = std::numeric_limits<float>::max();
+    for (const Vertex& vertex : data.vertices) {
+        minY = std::min(minY, vertex.pos.y); // Znajd najniszy punkt y
+    }
+
+    std::ranges::for_each(data.vertices, [minY](Vertex& vertex) {
+        vertex.pos.y -= minY;
+        });
+}
+
+static void optimizeMesh(MeshData& data)
+{
+    MeshOptimizer::optimizeVertexCache(data.indices, data.vertices.size());
+    MeshOptimizer::optimizeOverdraw(data.indices, data.vertices);
+    MeshOptimizer::optimizeVertexFetch(data.vertices, data.indices);
+    data.optimized = true;
+}
+
+// Each level halves the triangles of the previous one; meshes below this are not worth simplifying further
+static constexpr size_t s_minLodTriangles = 64;
+
+// The levels are simplified from the full resolution indices and appended after them, so every level
+// shares the vertex buffer and selecting one only changes the index range of the draw
+static void generateLods(MeshData& data)
+{
+    data.lods = { { 0, static_cast<uint32_t>(data.indices.size()), 0.0f } };
+    if (!MeshFile::s_generateLods) {
+        return;
+    }
+
+    std::vector<uint32_t> fullIndices = data.indices;
+    while (data.lods.size() < MeshData::s_maxLodCount) {
+        const MeshLod previous = data.lods.back();
+        size_t targetIndexCount = previous.indexCount / 6 * 3;
+        if (targetIndexCount < s_minLodTriangles * 3) {
+            break;
+        }
+
+        float error = 0.0f;
+        std::vector<uint32_t> lod = MeshOptimizer::simplify(fullIndices, data.vertices, targetIndexCount, error);
+        // The simplifier gets stuck early on meshes that are all attribute seams, e.g. flat shaded ones
+        if (lod.size() > previous.indexCount * 3 / 4) {
+            break;
+        }
+        if (data.optimized) {
+            MeshOptimizer::optimizeVertexCache(lod, data.vertices.size());
+        }
+
+        data.lods.push_back({ static_cast<uint32_t>(data.indices.size()), static_cast<uint32_t>(lod.size()), std::max(error, previous.error) });
+        data.indices.insert(data.indices.end(), lod.begin(), lod.end());
+    }
+}
+
+MeshConstants MeshData::getPackedConstants() const
+{
+    return { glm::vec4(boundsMin, 0.0f), glm::vec4(boundsMax - boundsMin, 0.0f) };
+}
+
+// Maps the unit sphere onto the [-1, 1] square, the lower hemisphere folded over the diagonals
+static glm::vec2 octahedralEncode(glm::vec3 normal)
+{
+    float sum = std::abs(normal.x) + std::abs(normal.y) + std::abs(normal.z);
+    if (sum == 0.0f) {
+        return glm::vec2(0.0f);
+    }
+
+    glm::vec2 p = glm::vec2(normal.x, normal.y) / sum;
+    if (normal.z < 0.0f) {
+        glm::vec2 sign(p.x >= 0.0f ? 1.0f : -1.0f, p.y >= 0.0f ? 1.0f : -1.0f);
+        p = (1.0f - glm::abs(glm::vec2(p.y, p.x))) * sign;
+    }
+    return p;
+}
+
+std::vector<PackedVertex> MeshData::packVertices() const
+{
+    glm::vec3 extent = boundsMax - boundsMin;
+    glm::vec3 invExtent(extent.x > 0.0f ? 1.0f / extent.x : 0.0f, extent.y > 0.0f ? 1.0f / extent.y : 0.0f,
+        extent.z > 0.0f ? 1.0f / extent.z : 0.0f);
+
+    std::vector<PackedVertex> packed(vertices.size());
+    for (size_t i = 0; i < vertices.size(); i++) {
+        const Vertex& vertex = vertices[i];
+        PackedVertex& out = packed[i];
+
+        glm::vec3 unit = glm::clamp((vertex.pos - boundsMin) * invExtent, 0.0f, 1.0f);
+        out.pos[0] = glm::packUnorm1x16(unit.x);
+        out.pos[1] = glm::packUnorm1x16(unit.y);
+        out.pos[2] = glm::packUnorm1x16(unit.z);
+        out.pos[3] = 0;
+
+        glm::vec2 octahedral = octahedralEncode(vertex.normal);
+        out.normal[0] = static_cast<int16_t>(glm::packSnorm1x16(octahedral.x));
+        out.normal[1] = static_cast<int16_t>(glm::packSnorm1x16(octahedral.y));
+
+        out.texCoord[0] = glm::packHalf1x16(vertex.texCoord.x);
+        out.texCoord[1] = glm::packHalf1x16(vertex.texCoord.y);
+    }
+    return packed;
+}
+
+MeshData MeshFile::importObj(const std::filesystem::path& sourcePath)
+{
+    tinyobj::attrib_t attrib;
+    std::vector<tinyobj::shape_t> shapes;
+    parseObj(sourcePath, attrib, shapes);
+
+    MeshData data;
+    dedupByIndex(attrib, shapes, data);
+    if (s_optimizeMeshes) {
+        VertexCacheStats before = MeshOptimizer::analyzeVertexCache(data.indices, data.vertices.size());
+        optimizeMesh(data);
+        VertexCacheStats after = MeshOptimizer::analyzeVertexCache(data.indices, data.vertices.size());
+        fmt::print("Optimized {}: ACMR {:.3f} -> {:.3f}, ATVR {:.3f} -> {:.3f}\n", sourcePath.filename().string(),
+            before.acmr, after.acmr, before.atvr, after.atvr);
+    }
+    generateLods(data);
+    if (data.lods.size() > 1) {
+        fmt::print("Simplified {}: {} LODs, {} -> {} triangles, error {:.4f}\n", sourcePath.filename().string(),
+            data.lods.size(), data.lods.front().indexCount / 3, data.lods.back().indexCount / 3, data.lods.back().error);
+    }
+    moveToGround(data);
+    data.computeBounds();
+    return data;
+}
+
+void MeshFile::benchmarkImport(const std::filesystem::path& sourcePath, int iterations)
+{
+    using Clock = std::chrono::high_resolution_clock;
+    auto milliseconds = [](Clock::duration duration) {
+        return std::chrono::duration<double, std::milli>(duration).count();
+    };
+
+    tinyobj::attrib_t attrib;
+    std::vector<tinyobj::shape_t> shapes;
+    auto parseStart = Clock::now();
+    parseObj(sourcePath, attrib, shapes);
+    double parseTime = milliseconds(Clock::now() - parseStart);
+
+    size_t cornerCount = 0;
+    for (const auto& shape : shapes) {
+        cornerCount += shape.mesh.indices.size();
+    }
+
+    // Best of several runs, the first one also pays for faulting in the tinyobj arrays
+    auto measure = [&](auto dedup, size_t& vertexCount) {
+        double best = std::numeric_limits<double>::max();
+        for (int i = 0; i < iterations; i++) {
+            MeshData data;
+            auto start = Clock::now();
+            dedup(attrib, shapes, data);
+            best = std::min(best, milliseconds(Clock::now() - start));
+            vertexCount = data.vertices.size();
+        }
+        return best;
+    };
+
+    size_t valueVertices = 0;
+    size_t indexVertices = 0;
+    double valueTime = measure(dedupByValue, valueVertices);
+    double indexTime = measure(dedupByIndex, indexVertices);
+
+    MeshData data;
+    dedupByIndex(attrib, shapes, data);
+    VertexCacheStats before = MeshOptimizer::analyzeVertexCache(data.indices, data.vertices.size());
+    auto optimizeStart = Clock::now();
+    optimizeMesh(data);
+    double optimizeTime = milliseconds(Clock::now() - optimizeStart);
+    VertexCacheStats after = MeshOptimizer::analyzeVertexCache(data.indices, data.vertices.size());
+
+    fmt::print("{}: {} shapes, {} corners, parse {:.2f} ms\n", sourcePath.string(), shapes.size(), cornerCount, parseTime);
+    fmt::print("  by value (unordered_map): {:.2f} ms, {} vertices\n", valueTime, valueVertices);
+    fmt::print("  by index (flat, parallel): {:.2f} ms, {} vertices, {:.1f}x faster\n", indexTime, indexVertices,
+        indexTime > 0.0 ? valueTime / indexTime : 0.0);
+    fmt::print("  optimization: {:.2f} ms, ACMR {:.3f} -> {:.3f}, ATVR {:.3f} -> {:.3f}\n", optimizeTime,
+        before.acmr, after.acmr, before.atvr, after.atvr);
+}
+
+std::filesystem::path MeshFile::getCachePath(const std::filesystem::path& sourcePath)
+{
+    std::error_code error;
+    std::string key = std::filesystem::weakly_canonical(sourcePath, error).generic_string();
+    if (error) {
+        key = sourcePath.generic_string();
+    }
+    return std::filesystem::path("Cache/Meshes") / fmt::format("{:016x}.mesh", hashBytes(key.data(), key.size()));
+}
+
+uint64_t MeshFile::getSourceHash(const std::filesystem::path& sourcePath)
+{
+    // Size and write time instead of the contents, so checking a cache file never reads the whole OBJ
+    std::error_code error;
+    uint64_t size = std::filesystem::file_size(sourcePath, error);
+    int64_t writeTime = std::filesystem::last_write_time(sourcePath, error).time_since_epoch().count();
+
+    uint64_t hash = hashBytes(&size, sizeof(size));
+    return hashBytes(&writeTime, sizeof(writeTime), hash);
+}
+
+bool MeshFile::write(const std::filesystem::path& path, const MeshData& data, uint64_t sourceHash)
+{
+    Header header{};
+    header.magic = s_magic;
+    header.version = s_version;
+    header.sourceHash = sourceHash;
+    header.vertexCount = static_cast<uint32_t>(data.vertices.size());
+    header.indexCount = static_cast<uint32_t>(data.indices.size());
+    header.vertexSize = s_packVertices ? sizeof(PackedVertex) : sizeof(Vertex);
+    header.flags = (data.optimized ? s_flagOptimized : 0) | (s_packVertices ? s_flagPacked : 0) | (s_generateLods ? s_flagLods : 0);
+    header.lodCount = static_cast<uint32_t>(data.lods.size());
+    memcpy(header.boundsMin, &data.boundsMin, sizeof(header.boundsMin));
+    memcpy(header.boundsMax, &data.boundsMax, sizeof(header.boundsMax));
+    memcpy(header.boundingSphere, &data.boundingSphere, sizeof(header.boundingSphere));
+
+    // Written next to the old file and renamed over it, so a concurrent load never maps half a file
+    std::error_code error;
+    std::filesystem::create_directories(path.parent_path(), error);
+    std::filesystem::path tempPath = path;
+    tempPath += fmt::format(".{}.tmp", std::hash<std::thread::id>()(std::this_thread::get_id()));
+    {
+        std::ofstream file(tempPath, std::ios::binary | std::ios::trunc);
+        if (!file) {
+            fmt::print(stderr, "Failed to write mesh cache {}\n", tempPath.string());
+            return false;
+        }
+        file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        file.write(reinterpret_cast<const char*>(data.lods.data()), data.lods.size() * sizeof(MeshLod));
+        if (s_packVertices) {
+            std::vector<PackedVertex> packed = data.packVertices();
+            file.write(reinterpret_cast<const char*>(packed.data()), packed.size() * sizeof(PackedVertex));
+        }
+        else {
+            file.write(reinterpret_cast<const char*>(data.vertices.data()), data.vertices.size() * sizeof(Vertex));
+        }
+        file.write(reinterpret_cast<const char*>(data.indices.data()), data.indices.size() * sizeof(uint32_t));
+        if (!file) {
+            fmt::print(stderr, "Failed to write mesh cache {}\n", tempPath.string());
+            return false;
+        }
+    }
+    std::filesystem::rename(tempPath, path, error);
+    if (error) {
+        std::filesystem::remove(tempPath, error);
+        fmt::print(stderr, "Failed to write mesh cache {}\n", path.string());
+        return false;
+    }
+    return true;
+}
+
+bool MeshFile::convert(const std::filesystem::path& sourcePath)
+{
+    try {
+        MeshData data = importObj(sourcePath);
+        return write(getCachePath(sourcePath), data, getSourceHash(sourcePath));
+    }
+    catch (const std::exception& e) {
+        fmt::print(stderr, "Failed to import {}: {}\n", sourcePath.string(), e.what());
+        return false;
+    }
+}
+
+bool MeshFile::open(const std::filesystem::path& path, uint64_t sourceHash)
+{
+    m_header = nullptr;
+    if (!m_file.open(path) || m_file.size() < sizeof(Header)) {
+        return false;
+    }
+
+    const Header* header = static_cast<const Header*>(m_file.data());
+    bool packed = (header->flags & s_flagPacked) != 0;
+    size_t vertexSize = packed ? sizeof(PackedVertex) : sizeof(Vertex);
+    size_t expectedSize = sizeof(Header) + size_t(header->lodCount) * sizeof(MeshLod) + size_t(header->vertexCount) * vertexSize +
+        size_t(header->indexCount) * sizeof(uint32_t);
+    if (header->magic != s_magic || header->version != s_version || header->vertexSize != vertexSize ||
+        header->sourceHash != sourceHash || m_file.size() != expectedSize ||
+        header->lodCount == 0 || header->lodCount > MeshData::s_maxLodCount ||
+        ((header->flags & s_flagOptimized) != 0) != s_optimizeMeshes || packed != s_packVertices ||
+        ((header->flags & s_flagLods) != 0) != s_generateLods) {
+        m_file.close();
+        return false;
+    }
+
+    m_header = header;
+    return true;
+}
+
+VertexFormat MeshFile::getVertexFormat() const
+{
+    return (m_header->flags & s_flagPacked) != 0 ? VertexFormat::Packed : VertexFormat::Full;
+}
+
+const MeshLod* MeshFile::getLods() const
+{
+    return reinterpret_cast<const MeshLod*>(static_cast<const char*>(m_file.data()) + sizeof(Header));
+}
+
+const void* MeshFile::getVertexData() const
+{
+    return getLods() + m_header->lodCount;
+}
+
+size_t MeshFile::getVertexDataSize() const
+{
+    return size_t(m_header->vertexCount) * m_header->vertexSize;
+}
+
+const uint32_t* MeshFile::getIndices() const
+{
+    return reinterpret_cast<const uint32_t*>(static_cast<const char*>(getVertexData()) + getVertexDataSize());
+}
+
+MeshConstants MeshFile::getPackedConstants() const
+{
+    glm::vec3 boundsMin = getBoundsMin();
+    return { glm::vec4(boundsMin, 0.0f), glm::vec4(getBoundsMax() - boundsMin, 0.0f) };
+}
+
+glm::vec3 MeshFile::getBoundsMin() const
+{
+    return glm::vec3(m_header->boundsMin[0], m_header->boundsMin[1], m_header->boundsMin[2]);
+}
+
+glm::vec3 MeshFile::getBoundsMax() const
+{
+    return glm::vec3(m_header->boundsMax[0], m_header->boundsMax[1], m_header->boundsMax[2]);
+}
+
+glm::vec4 MeshFile::getBoundingSphere() const
+{
+    return glm::vec4(m_header->boundingSphere[0], m_header->boundingSphere[1], m_header->boundingSphere[2], m_header->boundingSphere[3]);
+}
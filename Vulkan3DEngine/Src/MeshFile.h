@@ -0,0 +1,110 @@
+#pragma once
+#include "Prerequisites.h"
+#include "MappedFile.h"
+
+#include <filesystem>
+#include <vector>
+
+// One level of detail, a range of the mesh's index buffer; every level indexes the same vertices
+struct MeshLod {
+    uint32_t firstIndex;
+    uint32_t indexCount;
+    float error; // object space distance the level deviates from the full resolution mesh by
+};
+
+// Vertex and index data of one mesh in the layout it is uploaded in
+struct MeshData {
+    // The full resolution level included; CullGroup carries the error of every level in one vec4
+    static constexpr uint32_t s_maxLodCount = 4;
+
+    std::vector<Vertex> vertices;
+    std::vector<uint32_t> indices;
+    // Full resolution first, each following level coarser; indices holds the levels back to back
+    std::vector<MeshLod> lods;
+
+    // Object space bounds; the sphere is centered on the box, xyz is the center and w the radius
+    glm::vec3 boundsMin = glm::vec3(0.0f);
+    glm::vec3 boundsMax = glm::vec3(0.0f);
+    glm::vec4 boundingSphere = glm::vec4(0.0f);
+
+    // Reordered by MeshOptimizer for the vertex cache, overdraw and vertex fetch
+    bool optimized = false;
+
+    void computeBounds();
+    // Quantizes the vertices relative to the bounds
+    std::vector<PackedVertex> packVertices() const;
+    MeshConstants getPackedConstants() const;
+};
+
+// Binary cache of imported meshes. A source OBJ is parsed once and written to Cache/Meshes; later loads map
+// that file and copy the vertex and index blobs straight into staging memory. The header stores a hash of
+// the source file's size and write time, so an edited source is imported again.
+class MeshFile
+{
+public:
+    // Run the MeshOptimizer passes on import; caches written with the other setting are imported again
+    static bool s_optimizeMeshes;
+    // Store and upload PackedVertex instead of Vertex; caches written with the other setting are imported again
+    static bool s_packVertices;
+    // Simplify imported meshes into coarser levels of detail; caches written with the other setting are imported again
+    static bool s_generateLods;
+
+    // Parses an OBJ, deduplicates its vertices, optionally optimizes them, generates the levels of detail
+    // and moves its lowest point to y = 0
+    static MeshData importObj(const std::filesystem::path& sourcePath);
+    // Prints how long the vertex deduplication of importObj takes next to the old whole-vertex hashing,
+    // and what the optimization passes cost and gain
+    static void benchmarkImport(const std::filesystem::path& sourcePath, int iterations = 5);
+
+    static std::filesystem::path getCachePath(const std::filesystem::path& sourcePath);
+    static uint64_t getSourceHash(const std::filesystem::path& sourcePath);
+
+    static bool write(const std::filesystem::path& path, const MeshData& data, uint64_t sourceHash);
+    // Imports the source and writes its cache file, without any GPU work; used by the offline conversion
+    static bool convert(const std::filesystem::path& sourcePath);
+
+    // False if the file is missing, damaged, written by another version or built from another source
+    bool open(const std::filesystem::path& path, uint64_t sourceHash);
+
+    uint32_t getVertexCount() const { return m_header->vertexCount; }
+    // Indices of every level of detail together
+    uint32_t getIndexCount() const { return m_header->indexCount; }
+    uint32_t getLodCount() const { return m_header->lodCount; }
+    const MeshLod* getLods() const;
+    VertexFormat getVertexFormat() const;
+    // Vertex or PackedVertex array depending on the format
+    const void* getVertexData() const;
+    size_t getVertexDataSize() const;
+    const uint32_t* getIndices() const;
+    MeshConstants getPackedConstants() const;
+
+    glm::vec3 getBoundsMin() const;
+    glm::vec3 getBoundsMax() const;
+    glm::vec4 getBoundingSphere() const;
+
+private:
+    struct Header {
+        uint32_t magic;
+        uint32_t version;
+        uint64_t sourceHash;
+        uint32_t vertexCount;
+        uint32_t indexCount;
+        uint32_t vertexSize; // size of the vertex format when written, catches layout changes that forgot the version
+        uint32_t flags;
+        float boundsMin[3];
+        float boundsMax[3];
+        float boundingSphere[4];
+        uint32_t lodCount; // MeshLod entries between the header and the vertices
+        uint32_t reserved;
+    };
+    static_assert(sizeof(Header) == 80, "MeshFile::Header must not contain padding");
+
+    static constexpr uint32_t s_magic = 0x534D4B56; // "VKMS"
+    static constexpr uint32_t s_version = 3;
+    static constexpr uint32_t s_flagOptimized = 1;
+    static constexpr uint32_t s_flagPacked = 2;
+    static constexpr uint32_t s_flagLods = 4;
+
+    MappedFile m_file;
+    const Header* m_header = nullptr;
+};
@@ -0,0 +1,540 @@
+#include "MeshOptimizer.h"
+
+#include <algorithm>
+#include <array>
+#include <numeric>
+#include <cmath>
+#include <limits>
+#include <tuple>
+
+// Size of the LRU cache modelled by the vertex cache optimizer, larger than the FIFO analyzed by default
+// since a triangle order that is good for a large LRU cache is also good for smaller FIFOs
+static constexpr int s_optimizerCacheSize = 32;
+
+static float vertexScore(int cachePosition, uint32_t remainingTriangles)
+{
+    if (remainingTriangles == 0) {
+        return -1.0f;
+    }
+
+    float score = 0.0f;
+    if (cachePosition >= 0) {
+        // The last triangle's vertices get a fixed score so the next triangle does not just reuse its edge
+        score = cachePosition < 3 ? 0.75f :
+            std::pow(1.0f - float(cachePosition - 3) / float(s_optimizerCacheSize - 3), 1.5f);
+    }
+
+    // Vertices with few triangles left are finished first so they can leave the cache
+    return score + 2.0f / std::sqrt(float(remainingTriangles));
+}
+
+VertexCacheStats MeshOptimizer::analyzeVertexCache(const std::vector<uint32_t>& indices, size_t vertexCount, uint32_t cacheSize)
+{
+    VertexCacheStats stats;
+    if (indices.empty()) {
+        return stats;
+    }
+
+    // A vertex is still in the FIFO if fewer than cacheSize misses happened since it was loaded
+    std::vector<uint32_t> loadedAt(vertexCount, 0);
+    std::vector<bool> referenced(vertexCount, false);
+    uint32_t misses = 0;
+    uint32_t referencedCount = 0;
+    for (uint32_t index : indices) {
+        if (loadedAt[index] == 0 || misses + 1 - loadedAt[index] > cacheSize) {
+            misses++;
+            loadedAt[index] = misses;
+        }
+        if (!referenced[index]) {
+            referenced[index] = true;
+            referencedCount++;
+        }
+    }
+
+    stats.acmr = float(misses) / float(indices.size() / 3);
+    stats.atvr = float(misses) / float(referencedCount);
+    return stats;
+}
+
+void MeshOptimizer::optimizeVertexCache(std::vector<uint32_t>& indices, size_t vertexCount)
+{
+    size_t triangleCount = indices.size() / 3;
+    if (triangleCount == 0) {
+        return;
+    }
+
+    // Triangles of every vertex; the first remainingTriangles[v] entries of a range are the ones not emitted yet
+    std::vector<uint32_t> offsets(vertexCount + 1, 0);
+    for (uint32_t index : indices) {
+        offsets[index + 1]++;
+    }
+    std::partial_sum(offsets.begin(), offsets.end(), offsets.begin());
+
+    std::vector<uint32_t> adjacency(indices.size());
+    std::vector<uint32_t> fill(offsets.begin(), offsets.end() - 1);
+    for (size_t i = 0; i < indices.size(); i++) {
+        adjacency[fill[indices[i]]++] = static_cast<uint32_t>(i / 3);
+    }
+
+    std::vector<uint32_t> remainingTriangles(vertexCount);
+    std::vector<int> cachePosition(vertexCount, -1);
+    std::vector<float> vertexScores(vertexCount);
+    for (size_t v = 0; v < vertexCount; v++) {
+        remainingTriangles[v] = offsets[v + 1] - offsets[v];
+        vertexScores[v] = vertexScore(-1, remainingTriangles[v]);
+    }
+
+    std::vector<float> triangleScores(triangleCount);
+    std::vector<bool> emitted(triangleCount, false);
+    uint32_t bestTriangle = 0;
+    for (size_t t = 0; t < triangleCount; t++) {
+        triangleScores[t] = vertexScores[indices[3 * t]] + vertexScores[indices[3 * t + 1]] + vertexScores[indices[3 * t + 2]];
+        if (triangleScores[t] > triangleScores[bestTriangle]) {
+            bestTriangle = static_cast<uint32_t>(t);
+        }
+    }
+
+    std::vector<uint32_t> result;
+    result.reserve(indices.size());
+
+    std::array<uint32_t, s_optimizerCacheSize + 3> cache;
+    std::array<uint32_t, s_optimizerCacheSize + 3> newCache;
+    size_t cacheCount = 0;
+    size_t nextUnemitted = 0;
+
+    while (bestTriangle != UINT32_MAX) {
+        emitted[bestTriangle] = true;
+        const uint32_t* triangle = &indices[3 * bestTriangle];
+
+        size_t newCacheCount = 0;
+        for (int k = 0; k < 3; k++) {
+            uint32_t v = triangle[k];
+            result.push_back(v);
+
+            uint32_t* live = &adjacency[offsets[v]];
+            uint32_t* it = std::find(live, live + remainingTriangles[v], bestTriangle);
+            std::swap(*it, live[remainingTriangles[v] - 1]);
+            remainingTriangles[v]--;
+
+            if (std::find(newCache.begin(), newCache.begin() + newCacheCount, v) == newCache.begin() + newCacheCount) {
+                newCache[newCacheCount++] = v;
+            }
+        }
+        for (size_t i = 0; i < cacheCount; i++) {
+            uint32_t v = cache[i];
+            if (v != triangle[0] && v != triangle[1] && v != triangle[2]) {
+                newCache[newCacheCount++] = v;
+            }
+        }
+
+        // Rescore every vertex whose cache position changed, including the ones that just fell out
+        for (size_t i = 0; i < newCacheCount; i++) {
+            uint32_t v = newCache[i];
+            int position = i < s_optimizerCacheSize ? static_cast<int>(i) : -1;
+            cachePosition[v] = position;
+
+            float score = vertexScore(position, remainingTriangles[v]);
+            float delta = score - vertexScores[v];
+            vertexScores[v] = score;
+            for (uint32_t j = 0; j < remainingTriangles[v]; j++) {
+                triangleScores[adjacency[offsets[v] + j]] += delta;
+            }
+        }
+
+        cacheCount = std::min<size_t>(newCacheCount, s_optimizerCacheSize);
+        std::copy(newCache.begin(), newCache.begin() + cacheCount, cache.begin());
+
+        // The next triangle is the best one touching the cache
+        bestTriangle = UINT32_MAX;
+        float bestScore = -std::numeric_limits<float>::max();
+        for (size_t i = 0; i < cacheCount; i++) {
+            uint32_t v = cache[i];
+            for (uint32_t j = 0; j < remainingTriangles[v]; j++) {
+                uint32_t t = adjacency[offsets[v] + j];
+                if (triangleScores[t] > bestScore) {
+                    bestScore = triangleScores[t];
+                    bestTriangle = t;
+                }
+            }
+        }
+
+        if (bestTriangle == UINT32_MAX) {
+            // Nothing left around the cache, continue with the next island in the original order
+            while (nextUnemitted < triangleCount && emitted[nextUnemitted]) {
+                nextUnemitted++;
+            }
+            if (nextUnemitted < triangleCount) {
+                bestTriangle = static_cast<uint32_t>(nextUnemitted);
+            }
+        }
+    }
+
+    indices.swap(result);
+}
+
+void MeshOptimizer::optimizeOverdraw(std::vector<uint32_t>& indices, const std::vector<Vertex>& vertices, uint32_t cacheSize)
+{
+    size_t triangleCount = indices.size() / 3;
+    if (triangleCount == 0) {
+        return;
+    }
+
+    // Cluster boundaries are triangles that miss on all three vertices, the cache restarts there anyway,
+    // so reordering whole clusters costs almost nothing in vertex cache efficiency
+    std::vector<uint32_t> clusterStarts;
+    std::vector<uint32_t> loadedAt(vertices.size(), 0);
+    uint32_t misses = 0;
+    for (size_t t = 0; t < triangleCount; t++) {
+        int triangleMisses = 0;
+        for (int k = 0; k < 3; k++) {
+            uint32_t v = indices[3 * t + k];
+            if (loadedAt[v] == 0 || misses + 1 - loadedAt[v] > cacheSize) {
+                misses++;
+                loadedAt[v] = misses;
+                triangleMisses++;
+            }
+        }
+        if (t == 0 || triangleMisses == 3) {
+            clusterStarts.push_back(static_cast<uint32_t>(t));
+        }
+    }
+    clusterStarts.push_back(static_cast<uint32_t>(triangleCount));
+
+    size_t clusterCount = clusterStarts.size() - 1;
+    if (clusterCount < 2) {
+        return;
+    }
+
+    // Area weighted centroid of the whole mesh and of every cluster
+    glm::vec3 meshCentroid(0.0f);
+    float meshArea = 0.0f;
+    std::vector<float> clusterSort(clusterCount);
+    std::vector<glm::vec3> clusterCentroids(clusterCount, glm::vec3(0.0f));
+    std::vector<glm::vec3> clusterNormals(clusterCount, glm::vec3(0.0f));
+    for (size_t c = 0; c < clusterCount; c++) {
+        float clusterArea = 0.0f;
+        for (uint32_t t = clusterStarts[c]; t < clusterStarts[c + 1]; t++) {
+            const glm::vec3& p0 = vertices[indices[3 * t]].pos;
+            const glm::vec3& p1 = vertices[indices[3 * t + 1]].pos;
+            const glm::vec3& p2 = vertices[indices[3 * t + 2]].pos;
+
+            glm::vec3 normal = glm::cross(p1 - p0, p2 - p0); // length is twice the area
+            float area = glm::length(normal);
+            clusterCentroids[c] += (p0 + p1 + p2) * (area / 3.0f);
+            clusterNormals[c] += normal;
+            clusterArea += area;
+        }
+        meshCentroid += clusterCentroids[c];
+        meshArea += clusterArea;
+        clusterCentroids[c] = clusterArea > 0.0f ? clusterCentroids[c] / clusterArea : vertices[indices[3 * clusterStarts[c]]].pos;
+    }
+    if (meshArea > 0.0f) {
+        meshCentroid /= meshArea;
+    }
+
+    for (size_t c = 0; c < clusterCount; c++) {
+        float normalLength = glm::length(clusterNormals[c]);
+        clusterSort[c] = normalLength > 0.0f ? glm::dot(clusterCentroids[c] - meshCentroid, clusterNormals[c] / normalLength) : 0.0f;
+    }
+
+    std::vector<uint32_t> order(clusterCount);
+    std::iota(order.begin(), order.end(), 0);
+    std::stable_sort(order.begin(), order.end(), [&clusterSort](uint32_t a, uint32_t b) { return clusterSort[a] > clusterSort[b]; });
+
+    std::vector<uint32_t> result;
+    result.reserve(indices.size());
+    for (uint32_t c : order) {
+        result.insert(result.end(), indices.begin() + 3 * clusterStarts[c], indices.begin() + 3 * clusterStarts[c + 1]);
+    }
+    indices.swap(result);
+}
+
+void MeshOptimizer::optimizeVertexFetch(std::vector<Vertex>& vertices, std::vector<uint32_t>& indices)
+{
+    std::vector<uint32_t> remap(vertices.size(), UINT32_MAX);
+    std::vector<Vertex> result;
+    result.reserve(vertices.size());
+
+    for (uint32_t& index : indices) {
+        if (remap[index] == UINT32_MAX) {
+            remap[index] = static_cast<uint32_t>(result.size());
+            result.push_back(vertices[index]);
+        }
+        index = remap[index];
+    }
+    vertices.swap(result);
+}
+
+// Collapses of a simplification pass are limited to this multiple of the error of the cheapest collapses needed
+static constexpr double s_passErrorSlack = 1.5;
+static constexpr int s_maxSimplifyPasses = 100;
+// Border edges get a constraint plane weighted this much more than a face of the same size
+static constexpr double s_borderWeight = 10.0;
+// A collapse is rejected if it turns a surviving triangle by more than ~78 degrees
+static constexpr float s_minNormalDot = 0.2f;
+
+// Area weighted sum of squared distances to a set of planes, stored as the symmetric matrix of x^T A x + 2 b.x + c
+struct Quadric {
+    double a00 = 0.0, a01 = 0.0, a02 = 0.0, a11 = 0.0, a12 = 0.0, a22 = 0.0;
+    double b0 = 0.0, b1 = 0.0, b2 = 0.0;
+    double c = 0.0;
+    double weight = 0.0;
+
+    // Plane dot(normal, x) + d = 0 with a unit normal
+    static Quadric fromPlane(const glm::dvec3& normal, double d, double weight)
+    {
+        Quadric q;
+        q.a00 = normal.x * normal.x * weight;
+        q.a01 = normal.x * normal.y * weight;
+        q.a02 = normal.x * normal.z * weight;
+        q.a11 = normal.y * normal.y * weight;
+        q.a12 = normal.y * normal.z * weight;
+        q.a22 = normal.z * normal.z * weight;
+        q.b0 = normal.x * d * weight;
+        q.b1 = normal.y * d * weight;
+        q.b2 = normal.z * d * weight;
+        q.c = d * d * weight;
+        q.weight = weight;
+        return q;
+    }
+
+    Quadric& operator+=(const Quadric& o)
+    {
+        a00 += o.a00; a01 += o.a01; a02 += o.a02; a11 += o.a11; a12 += o.a12; a22 += o.a22;
+        b0 += o.b0; b1 += o.b1; b2 += o.b2;
+        c += o.c;
+        weight += o.weight;
+        return *this;
+    }
+
+    // Mean squared distance of the point to the planes
+    double evaluate(const glm::vec3& p) const
+    {
+        double x = p.x, y = p.y, z = p.z;
+        double error = a00 * x * x + a11 * y * y + a22 * z * z + 2.0 * (a01 * x * y + a02 * x * z + a12 * y * z)
+            + 2.0 * (b0 * x + b1 * y + b2 * z) + c;
+        return weight > 0.0 ? std::max(error, 0.0) / weight : 0.0;
+    }
+};
+
+std::vector<uint32_t> MeshOptimizer::simplify(const std::vector<uint32_t>& indices, const std::vector<Vertex>& vertices,
+    size_t targetIndexCount, float& resultError)
+{
+    resultError = 0.0f;
+    std::vector<uint32_t> result = indices;
+    if (result.size() <= targetIndexCount) {
+        return result;
+    }
+
+    // Vertices that only differ in their attributes are welded into one position; collapses move positions
+    // and carry every vertex of the position along to a vertex of the position it collapses into
+    size_t vertexCount = vertices.size();
+    std::vector<uint32_t> sorted(vertexCount);
+    std::iota(sorted.begin(), sorted.end(), 0);
+    std::sort(sorted.begin(), sorted.end(), [&vertices](uint32_t a, uint32_t b) {
+        const glm::vec3& pa = vertices[a].pos;
+        const glm::vec3& pb = vertices[b].pos;
+        return std::tie(pa.x, pa.y, pa.z) < std::tie(pb.x, pb.y, pb.z);
+        });
+
+    std::vector<uint32_t> positionOf(vertexCount);
+    std::vector<uint32_t> wedgeOffsets;
+    for (size_t i = 0; i < vertexCount; i++) {
+        if (i == 0 || vertices[sorted[i]].pos != vertices[sorted[i - 1]].pos) {
+            wedgeOffsets.push_back(static_cast<uint32_t>(i));
+        }
+        positionOf[sorted[i]] = static_cast<uint32_t>(wedgeOffsets.size() - 1);
+    }
+    size_t positionCount = wedgeOffsets.size();
+    wedgeOffsets.push_back(static_cast<uint32_t>(vertexCount));
+    const std::vector<uint32_t>& wedges = sorted;
+    auto positionPos = [&](uint32_t position) -> const glm::vec3& { return vertices[wedges[wedgeOffsets[position]]].pos; };
+
+    std::vector<Quadric> quadrics(positionCount);
+    std::vector<uint64_t> directedEdges;
+    directedEdges.reserve(result.size());
+    for (size_t t = 0; t < result.size(); t += 3) {
+        uint32_t p[3] = { positionOf[result[t]], positionOf[result[t + 1]], positionOf[result[t + 2]] };
+        glm::dvec3 normal = glm::cross(glm::dvec3(positionPos(p[1]) - positionPos(p[0])), glm::dvec3(positionPos(p[2]) - positionPos(p[0])));
+        double length = glm::length(normal);
+        if (length == 0.0) {
+            continue;
+        }
+        normal /= length;
+        Quadric q = Quadric::fromPlane(normal, -glm::dot(normal, glm::dvec3(positionPos(p[0]))), length * 0.5);
+        for (int k = 0; k < 3; k++) {
+            quadrics[p[k]] += q;
+            directedEdges.push_back(uint64_t(p[k]) << 32 | p[(k + 1) % 3]);
+        }
+    }
+
+    // An edge without its opposite belongs to one triangle only, a plane through it perpendicular to the
+    // triangle keeps the border from shrinking
+    std::sort(directedEdges.begin(), directedEdges.end());
+    for (size_t t = 0; t < result.size(); t += 3) {
+        uint32_t p[3] = { positionOf[result[t]], positionOf[result[t + 1]], positionOf[result[t + 2]] };
+        glm::dvec3 p0 = positionPos(p[0]);
+        glm::dvec3 faceNormal = glm::cross(glm::dvec3(positionPos(p[1])) - p0, glm::dvec3(positionPos(p[2])) - p0);
+        if (glm::length(faceNormal) == 0.0) {
+            continue;
+        }
+        for (int k = 0; k < 3; k++) {
+            uint32_t a = p[k];
+            uint32_t b = p[(k + 1) % 3];
+            if (std::binary_search(directedEdges.begin(), directedEdges.end(), uint64_t(b) << 32 | a)) {
+                continue;
+            }
+            glm::dvec3 edge = glm::dvec3(positionPos(b)) - glm::dvec3(positionPos(a));
+            glm::dvec3 normal = glm::cross(edge, faceNormal);
+            double length = glm::length(normal);
+            if (length == 0.0) {
+                continue;
+            }
+            normal /= length;
+            Quadric q = Quadric::fromPlane(normal, -glm::dot(normal, glm::dvec3(positionPos(a))), glm::dot(edge, edge) * s_borderWeight);
+            quadrics[a] += q;
+            quadrics[b] += q;
+        }
+    }
+
+    struct Collapse {
+        uint32_t from;
+        uint32_t to;
+        double error;
+    };
+    std::vector<Collapse> collapses;
+    std::vector<uint32_t> remap(vertexCount);
+    std::vector<bool> locked(positionCount);
+    std::vector<std::pair<uint32_t, uint32_t>> moves;
+    double maxError = 0.0;
+
+    for (int pass = 0; pass < s_maxSimplifyPasses && result.size() > targetIndexCount; pass++) {
+        // Triangles of every vertex, as in optimizeVertexCache
+        std::vector<uint32_t> offsets(vertexCount + 1, 0);
+        for (uint32_t index : result) {
+            offsets[index + 1]++;
+        }
+        std::partial_sum(offsets.begin(), offsets.end(), offsets.begin());
+        std::vector<uint32_t> adjacency(result.size());
+        std::vector<uint32_t> fill(offsets.begin(), offsets.end() - 1);
+        for (size_t i = 0; i < result.size(); i++) {
+            adjacency[fill[result[i]]++] = static_cast<uint32_t>(i / 3);
+        }
+
+        // Both directions of every edge; the error of moving one end onto the other
+        collapses.clear();
+        for (size_t t = 0; t < result.size(); t += 3) {
+            for (int k = 0; k < 3; k++) {
+                uint32_t a = positionOf[result[t + k]];
+                uint32_t b = positionOf[result[t + (k + 1) % 3]];
+                collapses.push_back({ a, b, 0.0 });
+                collapses.push_back({ b, a, 0.0 });
+            }
+        }
+        std::sort(collapses.begin(), collapses.end(), [](const Collapse& a, const Collapse& b) {
+            return std::tie(a.from, a.to) < std::tie(b.from, b.to);
+            });
+        collapses.erase(std::unique(collapses.begin(), collapses.end(), [](const Collapse& a, const Collapse& b) {
+            return a.from == b.from && a.to == b.to;
+            }), collapses.end());
+        for (Collapse& collapse : collapses) {
+            Quadric q = quadrics[collapse.from];
+            q += quadrics[collapse.to];
+            collapse.error = q.evaluate(positionPos(collapse.to));
+        }
+        std::sort(collapses.begin(), collapses.end(), [](const Collapse& a, const Collapse& b) { return a.error < b.error; });
+
+        // Every collapse removes about two triangles, so the cheapest needed ones set this pass' error limit
+        size_t neededTriangles = (result.size() - targetIndexCount + 2) / 3;
+        double errorLimit = collapses[std::min(neededTriangles / 2, collapses.size() - 1)].error * s_passErrorSlack;
+
+        std::iota(remap.begin(), remap.end(), 0);
+        std::fill(locked.begin(), locked.end(), false);
+        size_t removedTriangles = 0;
+
+        for (const Collapse& collapse : collapses) {
+            if (removedTriangles >= neededTriangles || (removedTriangles > 0 && collapse.error > errorLimit)) {
+                break;
+            }
+            // Both ends keep their triangles unchanged for the rest of the pass, so the checks below stay valid
+            if (locked[collapse.from] || locked[collapse.to]) {
+                continue;
+            }
+
+            const glm::vec3& target = positionPos(collapse.to);
+            bool valid = true;
+            size_t collapsedTriangles = 0;
+            moves.clear();
+
+            for (uint32_t w = wedgeOffsets[collapse.from]; w < wedgeOffsets[collapse.from + 1] && valid; w++) {
+                uint32_t vertex = wedges[w];
+                if (offsets[vertex] == offsets[vertex + 1]) {
+                    continue;
+                }
+
+                // The vertex must turn into exactly one vertex of the target, or its attributes would be torn apart
+                uint32_t destination = UINT32_MAX;
+                for (uint32_t j = offsets[vertex]; j < offsets[vertex + 1] && valid; j++) {
+                    const uint32_t* triangle = &result[3 * adjacency[j]];
+                    int corner = triangle[0] == vertex ? 0 : triangle[1] == vertex ? 1 : 2;
+                    uint32_t next = triangle[(corner + 1) % 3];
+                    uint32_t previous = triangle[(corner + 2) % 3];
+
+                    if (positionOf[next] == collapse.to || positionOf[previous] == collapse.to) {
+                        uint32_t candidate = positionOf[next] == collapse.to ? next : previous;
+                        valid = destination == UINT32_MAX || destination == candidate;
+                        destination = candidate;
+                        collapsedTriangles++;
+                        continue;
+                    }
+
+                    // Surviving triangles must not flip or fold over
+                    const glm::vec3& p1 = vertices[next].pos;
+                    const glm::vec3& p2 = vertices[previous].pos;
+                    glm::vec3 oldNormal = glm::cross(p1 - vertices[vertex].pos, p2 - vertices[vertex].pos);
+                    glm::vec3 newNormal = glm::cross(p1 - target, p2 - target);
+                    float oldLength = glm::length(oldNormal);
+                    float newLength = glm::length(newNormal);
+                    valid = oldLength > 0.0f && newLength > 0.0f && glm::dot(oldNormal, newNormal) >= s_minNormalDot * oldLength * newLength;
+                }
+
+                valid = valid && destination != UINT32_MAX;
+                moves.push_back({ vertex, destination });
+            }
+
+            if (!valid || moves.empty()) {
+                continue;
+            }
+
+            for (const auto& [vertex, destination] : moves) {
+                remap[vertex] = destination;
+            }
+            quadrics[collapse.to] += quadrics[collapse.from];
+            locked[collapse.from] = true;
+            locked[collapse.to] = true;
+            removedTriangles += collapsedTriangles;
+            maxError = std::max(maxError, collapse.error);
+        }
+
+        if (removedTriangles == 0) {
+            break;
+        }
+
+        // Triangles that lost a corner to a collapse are dropped
+        size_t writeIndex = 0;
+        for (size_t t = 0; t < result.size(); t += 3) {
+            uint32_t a = remap[result[t]];
+            uint32_t b = remap[result[t + 1]];
+            uint32_t c = remap[result[t + 2]];
+            if (positionOf[a] != positionOf[b] && positionOf[b] != positionOf[c] && positionOf[a] != positionOf[c]) {
+                result[writeIndex++] = a;
+                result[writeIndex++] = b;
+                result[writeIndex++] = c;
+            }
+        }
+        result.resize(writeIndex);
+    }
+
+    resultError = static_cast<float>(std::sqrt(maxError));
+    return result;
+}
@@ -0,0 +1,35 @@
+#pragma once
+#include "Prerequisites.h"
+
+#include <vector>
+
+// Post-transform vertex cache efficiency of an index buffer, as simulated by MeshOptimizer::analyzeVertexCache
+struct VertexCacheStats {
+    float acmr = 0.0f; // average cache miss ratio, vertex shader invocations per triangle (0.5 to 3)
+    float atvr = 0.0f; // average transformed vertex ratio, invocations per referenced vertex (1 is ideal)
+};
+
+// Import-time reordering of triangles and vertices; apart from simplify none of it changes what is drawn, only the order
+class MeshOptimizer
+{
+public:
+    // Simulates a FIFO post-transform cache of the given size, so index orders can be compared without a GPU
+    static VertexCacheStats analyzeVertexCache(const std::vector<uint32_t>& indices, size_t vertexCount, uint32_t cacheSize = 16);
+
+    // Reorders triangles so consecutive ones share vertices (Forsyth's linear-speed vertex cache optimization)
+    static void optimizeVertexCache(std::vector<uint32_t>& indices, size_t vertexCount);
+
+    // Splits a cache-optimized index buffer where the simulated cache is flushed anyway and draws the clusters
+    // facing away from the mesh center first, so outer surfaces tend to occlude inner ones from any viewpoint
+    static void optimizeOverdraw(std::vector<uint32_t>& indices, const std::vector<Vertex>& vertices, uint32_t cacheSize = 16);
+
+    // Lays vertices out in the order the index buffer first uses them and drops unreferenced ones
+    static void optimizeVertexFetch(std::vector<Vertex>& vertices, std::vector<uint32_t>& indices);
+
+    // Collapses edges in order of quadric error (Garland and Heckbert) until at most targetIndexCount indices are left
+    // or nothing can be collapsed without flipping a triangle or tearing an attribute seam. Vertices only move onto
+    // existing ones, so the result indexes the same vertex array. resultError is the largest collapse error as an
+    // object space distance.
+    static std::vector<uint32_t> simplify(const std::vector<uint32_t>& indices, const std::vector<Vertex>& vertices,
+        size_t targetIndexCount, float& resultError);
+};
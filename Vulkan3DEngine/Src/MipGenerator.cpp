@@ -0,0 +1,184 @@
+#include "MipGenerator.h"
+#include "ThreadPool.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <emmintrin.h>
+
+// Levels with fewer rows are not worth handing to the pool
+static constexpr uint32_t s_parallelRows = 64;
+
+// 8-bit sRGB to linear and back. 14 bits still separate the darkest sRGB codes and leave room to sum four
+// texels in a 16-bit lane.
+static constexpr uint32_t s_linearMax = (1 << 14) - 1;
+
+struct SrgbTables {
+    uint16_t toLinear[256];
+    uint8_t fromLinear[s_linearMax + 1];
+
+    SrgbTables()
+    {
+        for (uint32_t i = 0; i < 256; i++) {
+            float c = i / 255.0f;
+            float l = c <= 0.04045f ? c / 12.92f : std::pow((c + 0.055f) / 1.055f, 2.4f);
+            toLinear[i] = static_cast<uint16_t>(l * s_linearMax + 0.5f);
+        }
+        for (uint32_t i = 0; i <= s_linearMax; i++) {
+            float l = i / float(s_linearMax);
+            float c = l <= 0.0031308f ? l * 12.92f : 1.055f * std::pow(l, 1.0f / 2.4f) - 0.055f;
+            fromLinear[i] = static_cast<uint8_t>(std::clamp(c * 255.0f + 0.5f, 0.0f, 255.0f));
+        }
+    }
+};
+
+static const SrgbTables& getSrgbTables()
+{
+    static const SrgbTables tables;
+    return tables;
+}
+
+// Two output pixels per iteration: 16 bytes of each source row are widened to 16 bits, summed vertically, then
+// the horizontal neighbours are added by swapping 64-bit halves
+static void downsampleRowLinear(const uint8_t* row0, const uint8_t* row1, uint32_t newWidth, uint8_t* output)
+{
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i rounding = _mm_set1_epi16(2);
+
+    uint32_t x = 0;
+    for (; x + 2 <= newWidth; x += 2) {
+        __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(row0 + x * 8));
+        __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(row1 + x * 8));
+        __m128i low = _mm_add_epi16(_mm_unpacklo_epi8(a, zero), _mm_unpacklo_epi8(b, zero));
+        __m128i high = _mm_add_epi16(_mm_unpackhi_epi8(a, zero), _mm_unpackhi_epi8(b, zero));
+        __m128i sum = _mm_add_epi16(_mm_unpacklo_epi64(low, high), _mm_unpackhi_epi64(low, high));
+        sum = _mm_srli_epi16(_mm_add_epi16(sum, rounding), 2);
+        _mm_storel_epi64(reinterpret_cast<__m128i*>(output + x * 4), _mm_packus_epi16(sum, sum));
+    }
+    for (; x < newWidth; x++) {
+        for (uint32_t c = 0; c < 4; c++) {
+            output[x * 4 + c] = static_cast<uint8_t>((row0[x * 8 + c] + row0[x * 8 + 4 + c] + row1[x * 8 + c] + row1[x * 8 + 4 + c] + 2) / 4);
+        }
+    }
+}
+
+// Two neighbouring texels in linear space, alpha as it is. SSE2 has no gather, so the lookups are inserted one by one.
+static inline __m128i toLinear2(const uint8_t* texels, const SrgbTables& tables)
+{
+    return _mm_setr_epi16(tables.toLinear[texels[0]], tables.toLinear[texels[1]], tables.toLinear[texels[2]], texels[3],
+        tables.toLinear[texels[4]], tables.toLinear[texels[5]], tables.toLinear[texels[6]], texels[7]);
+}
+
+// One output pixel from lanes Pixel * 4 to Pixel * 4 + 3 of the averaged linear values
+template <int Pixel>
+static inline void writeSrgbPixel(__m128i average, uint8_t* output, const SrgbTables& tables)
+{
+    output[0] = tables.fromLinear[_mm_extract_epi16(average, Pixel * 4 + 0)];
+    output[1] = tables.fromLinear[_mm_extract_epi16(average, Pixel * 4 + 1)];
+    output[2] = tables.fromLinear[_mm_extract_epi16(average, Pixel * 4 + 2)];
+    output[3] = static_cast<uint8_t>(_mm_extract_epi16(average, Pixel * 4 + 3));
+}
+
+// Same layout as downsampleRowLinear, but every source texel is converted to linear in the register it is summed in
+static void downsampleRowSrgb(const uint8_t* row0, const uint8_t* row1, uint32_t newWidth, uint8_t* output, const SrgbTables& tables)
+{
+    const __m128i rounding = _mm_set1_epi16(2);
+
+    uint32_t x = 0;
+    for (; x + 2 <= newWidth; x += 2) {
+        __m128i low = _mm_add_epi16(toLinear2(row0 + x * 8, tables), toLinear2(row1 + x * 8, tables));
+        __m128i high = _mm_add_epi16(toLinear2(row0 + x * 8 + 8, tables), toLinear2(row1 + x * 8 + 8, tables));
+        __m128i sum = _mm_add_epi16(_mm_unpacklo_epi64(low, high), _mm_unpackhi_epi64(low, high));
+        __m128i average = _mm_srli_epi16(_mm_add_epi16(sum, rounding), 2);
+        writeSrgbPixel<0>(average, output + x * 4, tables);
+        writeSrgbPixel<1>(average, output + x * 4 + 4, tables);
+    }
+    if (x < newWidth) {
+        __m128i sum = _mm_add_epi16(toLinear2(row0 + x * 8, tables), toLinear2(row1 + x * 8, tables));
+        sum = _mm_add_epi16(sum, _mm_unpackhi_epi64(sum, sum));
+        writeSrgbPixel<0>(_mm_srli_epi16(_mm_add_epi16(sum, rounding), 2), output + x * 4, tables);
+    }
+}
+
+uint32_t MipGenerator::getLevelCount(uint32_t width, uint32_t height)
+{
+    return static_cast<uint32_t>(std::floor(std::log2(std::max(width, height)))) + 1;
+}
+
+void MipGenerator::downsample(const uint8_t* source, uint32_t width, uint32_t height, bool srgb, uint8_t* destination)
+{
+    if (width == 1) {
+        downsampleScalar(source, width, height, srgb, destination);
+        return;
+    }
+
+    const SrgbTables& tables = getSrgbTables();
+    uint32_t newWidth = width / 2;
+    uint32_t newHeight = std::max(1u, height / 2);
+    auto downsampleRow = [&](size_t y) {
+        const uint8_t* row0 = source + size_t(std::min(2 * uint32_t(y), height - 1)) * width * 4;
+        const uint8_t* row1 = source + size_t(std::min(2 * uint32_t(y) + 1, height - 1)) * width * 4;
+        uint8_t* output = destination + y * newWidth * 4;
+        if (srgb) {
+            downsampleRowSrgb(row0, row1, newWidth, output, tables);
+        }
+        else {
+            downsampleRowLinear(row0, row1, newWidth, output);
+        }
+    };
+
+    if (ThreadPool::get() && newHeight >= s_parallelRows) {
+        ThreadPool::get()->parallel_for(0, newHeight, downsampleRow);
+    }
+    else {
+        for (size_t y = 0; y < newHeight; y++) {
+            downsampleRow(y);
+        }
+    }
+}
+
+void MipGenerator::downsampleScalar(const uint8_t* source, uint32_t width, uint32_t height, bool srgb, uint8_t* destination)
+{
+    const SrgbTables& tables = getSrgbTables();
+    uint32_t newWidth = std::max(1u, width / 2);
+    uint32_t newHeight = std::max(1u, height / 2);
+
+    for (uint32_t y = 0; y < newHeight; y++) {
+        const uint8_t* row0 = source + size_t(std::min(2 * y, height - 1)) * width * 4;
+        const uint8_t* row1 = source + size_t(std::min(2 * y + 1, height - 1)) * width * 4;
+        for (uint32_t x = 0; x < newWidth; x++) {
+            uint32_t x0 = std::min(2 * x, width - 1) * 4;
+            uint32_t x1 = std::min(2 * x + 1, width - 1) * 4;
+            uint8_t* output = destination + (size_t(y) * newWidth + x) * 4;
+            for (uint32_t c = 0; c < 4; c++) {
+                if (srgb && c < 3) {
+                    uint32_t sum = tables.toLinear[row0[x0 + c]] + tables.toLinear[row0[x1 + c]] + tables.toLinear[row1[x0 + c]] + tables.toLinear[row1[x1 + c]];
+                    output[c] = tables.fromLinear[(sum + 2) >> 2];
+                }
+                else {
+                    output[c] = static_cast<uint8_t>((row0[x0 + c] + row0[x1 + c] + row1[x0 + c] + row1[x1 + c] + 2) / 4);
+                }
+            }
+        }
+    }
+}
+
+std::vector<uint8_t> MipGenerator::generateChain(const uint8_t* rgba, uint32_t width, uint32_t height, bool srgb, std::vector<size_t>& levelOffsets)
+{
+    uint32_t levelCount = getLevelCount(width, height);
+    levelOffsets.resize(levelCount);
+
+    size_t totalSize = 0;
+    for (uint32_t i = 0; i < levelCount; i++) {
+        levelOffsets[i] = totalSize;
+        totalSize += size_t(std::max(1u, width >> i)) * std::max(1u, height >> i) * 4;
+    }
+
+    std::vector<uint8_t> chain(totalSize);
+    memcpy(chain.data(), rgba, size_t(width) * height * 4);
+    for (uint32_t i = 1; i < levelCount; i++) {
+        downsample(chain.data() + levelOffsets[i - 1], std::max(1u, width >> (i - 1)), std::max(1u, height >> (i - 1)), srgb,
+            chain.data() + levelOffsets[i]);
+    }
+    return chain;
+}
@@ -0,0 +1,21 @@
+#pragma once
+#include "Prerequisites.h"
+
+#include <vector>
+
+// CPU mip chain generation for RGBA8 images. Every level is a 2x2 box filter of the previous one, vectorized with
+// SSE2 and split over the ThreadPool by rows. sRGB images are filtered in linear space, so dark and bright texels
+// average to the brightness the shader would see instead of darkening with every level; alpha is always linear.
+class MipGenerator
+{
+public:
+    static uint32_t getLevelCount(uint32_t width, uint32_t height);
+
+    // destination holds max(1, width / 2) * max(1, height / 2) pixels; odd sizes drop the last row and column
+    static void downsample(const uint8_t* source, uint32_t width, uint32_t height, bool srgb, uint8_t* destination);
+    // The same filter one pixel at a time, used for one pixel wide images and as the benchmark baseline
+    static void downsampleScalar(const uint8_t* source, uint32_t width, uint32_t height, bool srgb, uint8_t* destination);
+
+    // The whole chain back to back, largest first, starting with a copy of the source; levelOffsets gets each level's start
+    static std::vector<uint8_t> generateChain(const uint8_t* rgba, uint32_t width, uint32_t height, bool srgb, std::vector<size_t>& levelOffsets);
+};
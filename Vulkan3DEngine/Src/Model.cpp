@@ -1,13 +1,9 @@
 #include "Model.h"
 #include "Application.h"
-#include "UniformBuffer.h"
 #include "ModelData.h"
 #include "Mesh.h"
 #include "Texture.h"
 
-DescriptorAllocatorGrowable Model::m_descriptorAllocator;
-int Model::m_modelCount = 0;
-
 glm::vec3 convertMat4ToVec3(glm::mat4 matrix) {
     return glm::vec3(matrix[3]);
 }
@@ -37,24 +33,6 @@ Model::Model(ModelDataPtr modelData, Scene* scene):
 	m_shininess(modelData->m_shininess),m_kd(modelData->m_kd), m_ks(modelData->m_ks), m_positionOffset(modelData->m_positionOffset),
 	m_rotationOffset(modelData->m_rotationOffset), m_scaleOffset(modelData->m_scaleOffset)
 {
-    if (m_modelCount++ == 0) {
-		m_descriptorAllocator.init(GraphicsEngine::get()->getDevice()->get(), 8000, m_sizes);
-	}
-
-	DescriptorWriter writer;
-	//Initialize uniformBuffers and descriptorSets
-	for (int i = 0; i < Renderer::s_maxFramesInFlight; i++) {
-		m_uniformBuffers.push_back(GraphicsEngine::get()->getRenderer()->createUniformBuffer(sizeof(ModelUBO)));
-
-		VkDescriptorSet modelDescriptorSets = m_descriptorAllocator.allocate(GraphicsEngine::get()->getDevice()->get(),
-			GraphicsEngine::get()->getRenderer()->m_modelDescriptorSetLayout);
-
-		writer.writeBuffer(0, m_uniformBuffers[i]->get(), sizeof(ModelUBO), 0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER);
-		writer.updateSet(GraphicsEngine::get()->getDevice()->get(), modelDescriptorSets);
-		writer.clear();
-
-		m_descriptorSets.push_back(modelDescriptorSets);
-	}
 }
 
 Model::Model(std::string name, std::string meshName, std::string textureName, float scale, float shininess, float kd, float ks,
@@ -73,51 +51,14 @@ Model::Model(std::string name, std::string meshName, std::string textureName, fl
     setPositionOffset(initialPosition);
     setRotationOffset(initialRotation);
 
-    if (m_modelCount++ == 0) {
-        m_descriptorAllocator.init(GraphicsEngine::get()->getDevice()->get(), 8000, m_sizes);
-    }
-
-    DescriptorWriter writer;
-    //Initialize uniformBuffers and descriptorSets
-    for (int i = 0; i < Renderer::s_maxFramesInFlight; i++) {
-        m_uniformBuffers.push_back(GraphicsEngine::get()->getRenderer()->createUniformBuffer(sizeof(ModelUBO)));
-
-        VkDescriptorSet modelDescriptorSets = m_descriptorAllocator.allocate(GraphicsEngine::get()->getDevice()->get(),
-            GraphicsEngine::get()->getRenderer()->m_modelDescriptorSetLayout);
-
-        writer.writeBuffer(0, m_uniformBuffers[i]->get(), sizeof(ModelUBO), 0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER);
-        writer.updateSet(GraphicsEngine::get()->getDevice()->get(), modelDescriptorSets);
-        writer.clear();
-
-        m_descriptorSets.push_back(modelDescriptorSets);
-    }
-
     // Oczekuj na wyniki zada
-    m_mesh = meshFuture.get();
-    m_texture = textureFuture.get();
+    m_mesh = ThreadPool::get()->wait(meshFuture);
+    m_texture = ThreadPool::get()->wait(textureFuture);
 }
 
 Model::Model(const nlohmann::json& j, Scene* scene) : SceneObject(j["SceneObjectData"], scene) {
     try {
         from_json(j);
-        if (m_modelCount++ == 0) {
-            m_descriptorAllocator.init(GraphicsEngine::get()->getDevice()->get(), 8000, m_sizes);
-        }
-
-        DescriptorWriter writer;
-        //Initialize uniformBuffers and descriptorSets
-        for (int i = 0; i < Renderer::s_maxFramesInFlight; i++) {
-            m_uniformBuffers.push_back(GraphicsEngine::get()->getRenderer()->createUniformBuffer(sizeof(ModelUBO)));
-
-            VkDescriptorSet modelDescriptorSets = m_descriptorAllocator.allocate(GraphicsEngine::get()->getDevice()->get(),
-                GraphicsEngine::get()->getRenderer()->m_modelDescriptorSetLayout);
-
-            writer.writeBuffer(0, m_uniformBuffers[i]->get(), sizeof(ModelUBO), 0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER);
-            writer.updateSet(GraphicsEngine::get()->getDevice()->get(), modelDescriptorSets);
-            writer.clear();
-
-            m_descriptorSets.push_back(modelDescriptorSets);
-        }
         fmt::print("Model {} initialized successfully\n", m_name);
     }
     catch (const std::exception& e) {
@@ -126,15 +67,6 @@ Model::Model(const nlohmann::json& j, Scene* scene) : SceneObject(j["SceneObject
     }
 }
 
-
-Model::~Model()
-{
-    vkDeviceWaitIdle(GraphicsEngine::get()->getDevice()->get());
-    if (--m_modelCount == 0) {
-        m_descriptorAllocator.destroyPools(GraphicsEngine::get()->getDevice()->get());
-    }
-}
-
 void Model::update()
 {
 	SceneObject::update();
@@ -145,8 +77,6 @@ void Model::update()
 
 	ubo.kd = m_kd;
 	ubo.ks = m_ks;
-
-	memcpy(m_uniformBuffers[GraphicsEngine::get()->getRenderer()->getCurrentFrame()]->getMappedMemory(), &ubo, sizeof(ubo));
 }
 
 void Model::draw()
@@ -216,14 +146,20 @@ void Model::writeModelDataToFile(const std::filesystem::path& full_path) {
 
 void Model::setMesh(MeshPtr mesh)
 {
-    std::lock_guard<std::mutex> lock(m_mutex);
-    m_mesh = mesh;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_mesh = mesh;
+    }
+    markChanged();
 }
 
 void Model::setTexture(TexturePtr texture)
 {
-    std::lock_guard<std::mutex> lock(m_mutex);
-    m_texture = texture;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_texture = texture;
+    }
+    markChanged();
 }
 
 float Model::getScaleOffset()
@@ -245,13 +181,14 @@ void Model::setScaleOffset(float scale)
 {
     m_scaleOffset = glm::mat4(1.0f);
     m_scaleOffset = glm::scale(m_scaleOffset, glm::vec3(scale)); // skalowanie
-
+    markChanged();
 }
 
 void Model::setPositionOffset(glm::vec3 position)
 {
     m_positionOffset = glm::mat4(1.0f);
     m_positionOffset = glm::translate(m_positionOffset, glm::vec3(position.x, position.y, position.z));
+    markChanged();
 }
 
 void Model::setRotationOffset(glm::vec3 rotation)
@@ -260,6 +197,7 @@ void Model::setRotationOffset(glm::vec3 rotation)
     m_rotationOffset = glm::rotate(m_rotationOffset, glm::radians(rotation.x), glm::vec3(1.0f, 0.0f, 0.0f));
     m_rotationOffset = glm::rotate(m_rotationOffset, glm::radians(rotation.y), glm::vec3(0.0f, 1.0f, 0.0f));
     m_rotationOffset = glm::rotate(m_rotationOffset, glm::radians(rotation.z), glm::vec3(0.0f, 0.0f, 1.0f));
+    markChanged();
 }
 
 void Model::to_json(nlohmann::json& j) {
@@ -340,8 +278,8 @@ void Model::from_json(const nlohmann::json& j) {
             setRotationOffset(glm::vec3(j["rotationOffset"][0], j["rotationOffset"][1], j["rotationOffset"][2]));
 
             // Oczekuj na wyniki zada
-            m_mesh = meshFuture.get();
-            m_texture = textureFuture.get();
+            m_mesh = ThreadPool::get()->wait(meshFuture);
+            m_texture = ThreadPool::get()->wait(textureFuture);
         }
     }
     catch (const std::exception& e) {
@@ -1,7 +1,6 @@
 #pragma once
 #include "Prerequisites.h"
 #include "SceneObject.h"
-#include "Descriptors.h"
 #include <mutex>
 
 class Model : public SceneObject
@@ -11,7 +10,6 @@ public:
     Model(std::string name, std::string meshName, std::string textureName, float scale, float shininess, float kd, float ks,
         float scaleOffset, glm::vec3 positionOffset, glm::vec3 rotationOffset, Scene* scene);
     Model(const nlohmann::json& j, Scene* scene);
-    ~Model();
 
     void update() override;
     void draw() override;
@@ -43,23 +41,14 @@ private:
     glm::mat4 m_positionOffset;
     glm::mat4 m_rotationOffset;
 
-    std::vector<UniformBufferPtr> m_uniformBuffers;
-
-    static int m_modelCount;
-    static DescriptorAllocatorGrowable m_descriptorAllocator;
-
-    std::vector<DescriptorAllocatorGrowable::PoolSizeRatio> m_sizes =
-    {
-        { VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 1 }
-    };
-
-    std::vector<VkDescriptorSet> m_descriptorSets;
-
+    // Copied into the renderer's per-frame instance buffer when the model is drawn, and into its ObjectBuffer slot when it changes
     ModelUBO ubo{};
+    uint32_t m_objectSlot = UINT32_MAX; // ObjectBuffer::s_invalidSlot until the scene update first syncs the model
 
     std::mutex m_mutex; // Add a mutex for thread safety
 
     friend class SceneObjectManager;
     friend class Application;
     friend class Renderer;
+    friend class ObjectBuffer;
 };
@@ -23,7 +23,7 @@ ModelData::~ModelData()
 
 void ModelData::Reload()
 {
-	vkDeviceWaitIdle(GraphicsEngine::get()->getDevice()->get());
+	GraphicsEngine::get()->getDevice()->waitIdle();
 
 	// Free the old resources
 	m_mesh.reset();
@@ -109,8 +109,8 @@ void ModelData::Load(const std::filesystem::path& full_path)
         file.close();
 
         // Wait for the results of the asynchronous tasks
-        m_mesh = meshFuture.get();
-        m_texture = textureFuture.get();
+        m_mesh = ThreadPool::get()->wait(meshFuture);
+        m_texture = ThreadPool::get()->wait(textureFuture);
     }
     catch (const std::exception& e) {
         fmt::print("Error loading model data: {}\n", e.what());
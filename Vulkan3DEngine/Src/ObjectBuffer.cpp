@@ -0,0 +1,248 @@
+#include "ObjectBuffer.h"
+#include "GraphicsEngine.h"
+#include "Model.h"
+#include "Mesh.h"
+#include "Texture.h"
+#include "TextureTable.h"
+#include "StorageBuffer.h"
+#include "FrameContext.h"
+
+#include <algorithm>
+#include <bit>
+#include <cstring>
+
+ObjectBuffer::~ObjectBuffer()
+{
+    // Culling passes of the frames in flight may still read it
+    if (m_buffer) {
+        GraphicsEngine::get()->getRenderer()->retire(std::move(m_buffer));
+    }
+}
+
+void ObjectBuffer::syncModel(Model* model)
+{
+    MeshPtr mesh;
+    TexturePtr texture;
+    {
+        std::lock_guard<std::mutex> lock(model->m_mutex);
+        mesh = model->m_mesh;
+        texture = model->m_texture;
+    }
+
+    if (model->m_objectSlot == s_invalidSlot) {
+        if (!m_freeSlots.empty()) {
+            model->m_objectSlot = m_freeSlots.back();
+            m_freeSlots.pop_back();
+        }
+        else {
+            // Queued even if the model is not drawn yet, the new slot's memory on the GPU is uninitialized
+            model->m_objectSlot = static_cast<uint32_t>(m_objects.size());
+            m_objects.emplace_back();
+            m_slotTextures.push_back(nullptr);
+            m_dirty.push_back(1);
+            m_dirtySlots.push_back(model->m_objectSlot);
+        }
+    }
+    uint32_t slot = model->m_objectSlot;
+    uint32_t currentGroup = m_objects[slot].meshGroup;
+    if (m_slotTextures[slot] != texture.get()) {
+        setSlotTexture(slot, model, texture);
+    }
+
+    GpuObject object{};
+    object.model = model->ubo;
+    object.model.textureIndex = texture ? texture->getTextureIndex() : TextureTable::s_defaultTextureSlot;
+
+    // As on the CPU-driven path, a model waits for its texture; a mesh still uploading skips its whole group instead
+    if (mesh && (!texture || texture->isResident())) {
+        if (currentGroup != s_invalidGroup && m_meshGroups[currentGroup].mesh == mesh) {
+            object.meshGroup = currentGroup;
+        }
+        else {
+            object.meshGroup = acquireGroup(mesh);
+        }
+    }
+    if (currentGroup != s_invalidGroup && currentGroup != object.meshGroup) {
+        releaseGroup(currentGroup);
+    }
+
+    if (std::memcmp(&m_objects[slot], &object, sizeof(GpuObject)) != 0) {
+        writeSlot(slot, object);
+    }
+}
+
+void ObjectBuffer::removeModel(Model* model)
+{
+    uint32_t slot = model->m_objectSlot;
+    if (slot == s_invalidSlot) {
+        return;
+    }
+
+    if (m_objects[slot].meshGroup != s_invalidGroup) {
+        releaseGroup(m_objects[slot].meshGroup);
+    }
+    setSlotTexture(slot, model, nullptr);
+    // A free slot belongs to no group, so the culling pass skips it until it is handed out again
+    writeSlot(slot, GpuObject{});
+    m_freeSlots.push_back(slot);
+    model->m_objectSlot = s_invalidSlot;
+}
+
+void ObjectBuffer::syncTextures()
+{
+    // Once per texture, not per model
+    for (auto& [key, users] : m_textureUsers) {
+        uint32_t textureIndex = users.texture->getTextureIndex();
+        bool resident = users.texture->isResident();
+        if (textureIndex == users.textureIndex && resident == users.resident) {
+            continue;
+        }
+        users.textureIndex = textureIndex;
+        users.resident = resident;
+        // The texture stays the same, so syncModel leaves the list alone
+        for (Model* model : users.models) {
+            syncModel(model);
+        }
+    }
+}
+
+void ObjectBuffer::clear()
+{
+    // Only when every model goes at once, the models keep their stale slots
+    m_objects.clear();
+    m_slotTextures.clear();
+    m_textureUsers.clear();
+    m_freeSlots.clear();
+    m_dirtySlots.clear();
+    m_dirty.clear();
+    m_meshGroups.clear();
+    m_freeGroups.clear();
+    m_groupIndices.clear();
+}
+
+void ObjectBuffer::setSlotTexture(uint32_t slot, Model* model, const TexturePtr& texture)
+{
+    if (Texture* previous = m_slotTextures[slot]) {
+        auto it = m_textureUsers.find(previous);
+        std::vector<Model*>& models = it->second.models;
+        *std::find(models.begin(), models.end(), model) = models.back();
+        models.pop_back();
+        if (models.empty()) {
+            m_textureUsers.erase(it);
+        }
+    }
+
+    m_slotTextures[slot] = texture.get();
+    if (texture) {
+        auto [it, inserted] = m_textureUsers.try_emplace(texture.get());
+        if (inserted) {
+            it->second = { texture, texture->getTextureIndex(), texture->isResident() };
+        }
+        it->second.models.push_back(model);
+    }
+}
+
+void ObjectBuffer::reserve()
+{
+    if (m_buffer && m_objects.size() * sizeof(GpuObject) <= m_buffer->getSize()) {
+        return;
+    }
+
+    RendererPtr renderer = GraphicsEngine::get()->getRenderer();
+    if (m_buffer) {
+        renderer->retire(std::move(m_buffer));
+    }
+    size_t capacity = std::bit_ceil(std::max<size_t>(m_objects.size(), 1024));
+    m_buffer = renderer->createStorageBuffer(capacity * sizeof(GpuObject), VK_BUFFER_USAGE_TRANSFER_DST_BIT, MemoryUsage::GpuOnly);
+
+    // The new buffer starts out empty
+    for (uint32_t slot = 0; slot < m_objects.size(); slot++) {
+        if (!m_dirty[slot]) {
+            m_dirty[slot] = 1;
+            m_dirtySlots.push_back(slot);
+        }
+    }
+}
+
+void ObjectBuffer::recordUpload(VkCommandBuffer commandBuffer, FrameContext& frame)
+{
+    if (m_dirtySlots.empty()) {
+        return;
+    }
+
+    // In slot order, so runs of neighbouring slots become one copy region
+    std::sort(m_dirtySlots.begin(), m_dirtySlots.end());
+    TransientAllocation staging = frame.allocateTransient(getUploadSize());
+    GpuObject* objects = static_cast<GpuObject*>(staging.data);
+
+    m_copyRegions.clear();
+    for (size_t i = 0; i < m_dirtySlots.size(); i++) {
+        uint32_t slot = m_dirtySlots[i];
+        objects[i] = m_objects[slot];
+        m_dirty[slot] = 0;
+
+        if (i > 0 && m_dirtySlots[i - 1] + 1 == slot) {
+            m_copyRegions.back().size += sizeof(GpuObject);
+        }
+        else {
+            m_copyRegions.push_back({ staging.offset + i * sizeof(GpuObject), slot * sizeof(GpuObject), sizeof(GpuObject) });
+        }
+    }
+    m_dirtySlots.clear();
+
+    // The culling passes of the previous frames read the buffer and their uploads wrote it
+    VkMemoryBarrier barrier{};
+    barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT,
+        VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+
+    vkCmdCopyBuffer(commandBuffer, staging.buffer, m_buffer->get(), static_cast<uint32_t>(m_copyRegions.size()), m_copyRegions.data());
+
+    barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+        0, 1, &barrier, 0, nullptr, 0, nullptr);
+}
+
+void ObjectBuffer::writeSlot(uint32_t slot, const GpuObject& object)
+{
+    m_objects[slot] = object;
+    if (!m_dirty[slot]) {
+        m_dirty[slot] = 1;
+        m_dirtySlots.push_back(slot);
+    }
+}
+
+uint32_t ObjectBuffer::acquireGroup(const MeshPtr& mesh)
+{
+    auto it = m_groupIndices.find(mesh.get());
+    if (it != m_groupIndices.end()) {
+        m_meshGroups[it->second].objectCount++;
+        return it->second;
+    }
+
+    uint32_t group;
+    if (!m_freeGroups.empty()) {
+        group = m_freeGroups.back();
+        m_freeGroups.pop_back();
+    }
+    else {
+        group = static_cast<uint32_t>(m_meshGroups.size());
+        m_meshGroups.emplace_back();
+    }
+    m_meshGroups[group] = { mesh, 1 };
+    m_groupIndices.emplace(mesh.get(), group);
+    return group;
+}
+
+void ObjectBuffer::releaseGroup(uint32_t group)
+{
+    MeshGroup& meshGroup = m_meshGroups[group];
+    if (--meshGroup.objectCount == 0) {
+        m_groupIndices.erase(meshGroup.mesh.get());
+        meshGroup.mesh.reset();
+        m_freeGroups.push_back(group);
+    }
+}
@@ -0,0 +1,76 @@
+#pragma once
+#include "Prerequisites.h"
+
+#include <vector>
+#include <unordered_map>
+
+// Every model of the scene in one persistent GPU buffer, read directly by the culling pass of the GPU-driven path.
+// A model claims a slot the first time the scene update sees it and keeps it until it is removed. Only the models
+// the scene update found changed are synced, and only the slots whose data differs are copied to the GPU in the
+// next frame's command buffer. Models are grouped by mesh, so the renderer prepares a frame per mesh instead of
+// per model, and listed per texture, so a texture changing its table slot re-syncs only the models using it.
+class ObjectBuffer
+{
+public:
+    // A model's mesh and the number of models drawing it; group indices are stable while the count stays above zero
+    struct MeshGroup {
+        MeshPtr mesh;
+        uint32_t objectCount = 0;
+    };
+
+    // The models using a texture and the state of the texture their slots were last synced with
+    struct TextureUsers {
+        TexturePtr texture;
+        uint32_t textureIndex = 0;
+        bool resident = false;
+        std::vector<Model*> models;
+    };
+
+    static constexpr uint32_t s_invalidSlot = UINT32_MAX;
+    static constexpr uint32_t s_invalidGroup = UINT32_MAX;
+
+    ~ObjectBuffer();
+
+    // Main thread, after the model's update: claims a slot for a new model and marks the slot for upload when its data changed
+    void syncModel(Model* model);
+    void removeModel(Model* model);
+    // Main thread, after the changed models: re-syncs the models of every texture that moved to another table slot,
+    // e.g. when streaming swapped its image, or finished loading
+    void syncTextures();
+    void clear();
+
+    // Transient memory recordUpload stages the changed slots in
+    VkDeviceSize getUploadSize() const { return m_dirtySlots.size() * sizeof(GpuObject); }
+    // Grows the GPU buffer to hold every slot; render thread, before the frame's descriptor sets are written
+    void reserve();
+    // Copies the changed slots into the GPU buffer, ordered after the culling passes of the previous frames
+    void recordUpload(VkCommandBuffer commandBuffer, FrameContext& frame);
+
+    StorageBufferPtr getBuffer() { return m_buffer; }
+    // Slots up to the highest one in use, free slots belong to no group and are skipped by the culling pass
+    uint32_t getSlotCount() const { return static_cast<uint32_t>(m_objects.size()); }
+    uint32_t getObjectCount() const { return getSlotCount() - static_cast<uint32_t>(m_freeSlots.size()); }
+    const std::vector<MeshGroup>& getMeshGroups() const { return m_meshGroups; }
+    const std::unordered_map<Texture*, TextureUsers>& getTextureUsers() const { return m_textureUsers; }
+
+private:
+    void writeSlot(uint32_t slot, const GpuObject& object);
+    uint32_t acquireGroup(const MeshPtr& mesh);
+    void releaseGroup(uint32_t group);
+    void setSlotTexture(uint32_t slot, Model* model, const TexturePtr& texture);
+
+    std::vector<GpuObject> m_objects; // CPU copy of every slot
+    std::vector<uint32_t> m_freeSlots;
+    std::vector<uint32_t> m_dirtySlots;
+    std::vector<uint8_t> m_dirty; // per slot, so a slot is queued once
+    std::vector<VkBufferCopy> m_copyRegions;
+
+    std::vector<MeshGroup> m_meshGroups;
+    std::vector<uint32_t> m_freeGroups;
+    std::unordered_map<Mesh*, uint32_t> m_groupIndices;
+
+    std::vector<Texture*> m_slotTextures; // per slot, the texture it is listed under in m_textureUsers
+    std::unordered_map<Texture*, TextureUsers> m_textureUsers;
+
+    StorageBufferPtr m_buffer;
+};
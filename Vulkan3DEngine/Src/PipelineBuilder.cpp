@@ -1,6 +1,10 @@
 #include "PipelineBuilder.h"
 #include "Renderer.h"
 #include "RendererInits.h"
+#include "PipelineCache.h"
+
+#include <filesystem>
+#include <thread>
 
 void PipelineBuilder::clear()
 {
@@ -23,7 +27,7 @@ void PipelineBuilder::clear()
     m_shaderStages.clear();
 }
 
-VkPipeline PipelineBuilder::buildPipeline(VkPipelineLayout layout, VkDevice device)
+VkPipeline PipelineBuilder::buildPipeline(VkPipelineLayout layout, VkDevice device, VkPipelineCache pipelineCache)
 {
     m_pipelineLayout = layout;
 
@@ -50,11 +54,23 @@ VkPipeline PipelineBuilder::buildPipeline(VkPipelineLayout layout, VkDevice devi
     //completely clear VertexInputStateCreateInfo, as we have no need for it
     VkPipelineVertexInputStateCreateInfo vertexInputInfo = { .sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO };
     
-    //Do sprawdzenia potem
-    //Da si to zoptymalizowa i nie umieszcza informacji o wierzchokach
-
-    auto bindingDescription = Vertex::getBindingDescription();
-    auto attributeDescriptions = Vertex::getAttributeDescriptions();
+    // The vertex layout follows the format of the meshes drawn with the pipeline
+    VkVertexInputBindingDescription bindingDescription;
+    std::vector<VkVertexInputAttributeDescription> attributeDescriptions;
+    if (!m_vertexAttributes.empty()) {
+        bindingDescription = m_vertexBinding;
+        attributeDescriptions = m_vertexAttributes;
+    }
+    else if (m_vertexFormat == VertexFormat::Packed) {
+        auto attributes = PackedVertex::getAttributeDescriptions();
+        bindingDescription = PackedVertex::getBindingDescription();
+        attributeDescriptions.assign(attributes.begin(), attributes.end());
+    }
+    else {
+        auto attributes = Vertex::getAttributeDescriptions();
+        bindingDescription = Vertex::getBindingDescription();
+        attributeDescriptions.assign(attributes.begin(), attributes.end());
+    }
 
     vertexInputInfo.vertexBindingDescriptionCount = 1;
     vertexInputInfo.vertexAttributeDescriptionCount = static_cast<uint32_t>(attributeDescriptions.size());
@@ -79,7 +95,7 @@ VkPipeline PipelineBuilder::buildPipeline(VkPipelineLayout layout, VkDevice devi
     pipelineInfo.pDepthStencilState = &m_depthStencil;
     pipelineInfo.layout = m_pipelineLayout;
 
-    pipelineInfo.renderPass = m_renderer->m_swapChain->getRenderPass();
+    pipelineInfo.renderPass = m_renderPass != VK_NULL_HANDLE ? m_renderPass : m_renderer->m_swapChain->getRenderPass();
     pipelineInfo.subpass = 0;
     pipelineInfo.basePipelineHandle = VK_NULL_HANDLE; // Optional
     pipelineInfo.basePipelineIndex = -1; // Optional
@@ -94,7 +110,7 @@ VkPipeline PipelineBuilder::buildPipeline(VkPipelineLayout layout, VkDevice devi
         // its easy to error out on create graphics pipeline, so we handle it a bit
         // better than the common VK_CHECK case
     VkPipeline newPipeline;
-    if (vkCreateGraphicsPipelines(device, VK_NULL_HANDLE, 1, &pipelineInfo,
+    if (vkCreateGraphicsPipelines(device, pipelineCache, 1, &pipelineInfo,
         nullptr, &newPipeline)
         != VK_SUCCESS) {
         fmt::println("failed to create pipeline");
@@ -105,6 +121,41 @@ VkPipeline PipelineBuilder::buildPipeline(VkPipelineLayout layout, VkDevice devi
     }
 }
 
+VkPipeline buildComputePipeline(VkPipelineLayout layout, VkShaderModule computeShader, VkDevice device, VkPipelineCache pipelineCache)
+{
+    VkPipelineShaderStageCreateInfo stageInfo = { .sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO };
+    stageInfo.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+    stageInfo.module = computeShader;
+    stageInfo.pName = "main";
+
+    VkComputePipelineCreateInfo pipelineInfo = { .sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO };
+    pipelineInfo.stage = stageInfo;
+    pipelineInfo.layout = layout;
+
+    VkPipeline newPipeline;
+    if (vkCreateComputePipelines(device, pipelineCache, 1, &pipelineInfo, nullptr, &newPipeline) != VK_SUCCESS) {
+        fmt::println("failed to create compute pipeline");
+        return VK_NULL_HANDLE;
+    }
+    return newPipeline;
+}
+
+void PipelineBuilder::setRenderPass(VkRenderPass renderPass)
+{
+    m_renderPass = renderPass;
+}
+
+void PipelineBuilder::setVertexFormat(VertexFormat format)
+{
+    m_vertexFormat = format;
+}
+
+void PipelineBuilder::setVertexInput(const VkVertexInputBindingDescription& binding, const std::vector<VkVertexInputAttributeDescription>& attributes)
+{
+    m_vertexBinding = binding;
+    m_vertexAttributes = attributes;
+}
+
 void PipelineBuilder::setShaders(VkShaderModule vertexShader, VkShaderModule fragmentShader)
 {
     m_shaderStages.clear();
@@ -293,22 +344,74 @@ std::vector<char> readFile(const std::string& filename)
 
 #include <fmt/core.h>
 
-VkShaderModule compileShader(const std::string& filename, shaderc_shader_kind kind, VkDevice device)
+// Bump whenever the CompileOptions below change, so SPIR-V built with the old options is not reused
+static constexpr uint32_t s_shaderCacheVersion = 1;
+static const std::filesystem::path s_shaderCacheDirectory = "Cache/Shaders";
+
+static bool readCachedSpirv(const std::filesystem::path& path, std::vector<uint32_t>& spirv)
+{
+    std::ifstream file(path, std::ios::ate | std::ios::binary);
+    if (!file.is_open()) {
+        return false;
+    }
+
+    size_t fileSize = (size_t)file.tellg();
+    if (fileSize == 0 || fileSize % sizeof(uint32_t) != 0) {
+        return false;
+    }
+    spirv.resize(fileSize / sizeof(uint32_t));
+    file.seekg(0);
+    file.read(reinterpret_cast<char*>(spirv.data()), fileSize);
+
+    // A truncated or foreign file is recompiled instead of reaching the driver
+    return file && spirv[0] == 0x07230203;
+}
+
+static void writeCachedSpirv(const std::filesystem::path& path, const std::vector<uint32_t>& spirv)
 {
-    shaderc::Compiler compiler;
-    shaderc::CompileOptions options;
+    // Renamed into place so a concurrent reader never sees a partial file
+    std::error_code error;
+    std::filesystem::create_directories(path.parent_path(), error);
+    std::filesystem::path tempPath = path;
+    tempPath += fmt::format(".{}.tmp", std::hash<std::thread::id>()(std::this_thread::get_id()));
+    {
+        std::ofstream file(tempPath, std::ios::binary | std::ios::trunc);
+        if (!file) {
+            return;
+        }
+        file.write(reinterpret_cast<const char*>(spirv.data()), spirv.size() * sizeof(uint32_t));
+    }
+    std::filesystem::rename(tempPath, path, error);
+    if (error) {
+        std::filesystem::remove(tempPath, error);
+    }
+}
 
+VkShaderModule compileShader(const std::string& filename, shaderc_shader_kind kind, VkDevice device)
+{
     // Read the shader code
     std::vector<char> code = readFile(filename);
     std::string shaderCode(code.begin(), code.end());
 
-    // Compile the shader
-    shaderc::SpvCompilationResult shader = compiler.CompileGlslToSpv(shaderCode, kind, filename.c_str(), options);
-    if (shader.GetCompilationStatus() != shaderc_compilation_status_success) {
-        fmt::print("Error compiling shader {}: {}\n", filename, shader.GetErrorMessage());
-        return VK_NULL_HANDLE;
+    uint64_t key = hashBytes(shaderCode.data(), shaderCode.size());
+    key = hashBytes(&kind, sizeof(kind), key);
+    key = hashBytes(&s_shaderCacheVersion, sizeof(s_shaderCacheVersion), key);
+    std::filesystem::path cachePath = s_shaderCacheDirectory / fmt::format("{:016x}.spv", key);
+
+    std::vector<uint32_t> shaderCodeSPIRV;
+    if (!readCachedSpirv(cachePath, shaderCodeSPIRV)) {
+        shaderc::Compiler compiler;
+        shaderc::CompileOptions options;
+
+        // Compile the shader
+        shaderc::SpvCompilationResult shader = compiler.CompileGlslToSpv(shaderCode, kind, filename.c_str(), options);
+        if (shader.GetCompilationStatus() != shaderc_compilation_status_success) {
+            fmt::print("Error compiling shader {}: {}\n", filename, shader.GetErrorMessage());
+            return VK_NULL_HANDLE;
+        }
+        shaderCodeSPIRV.assign(shader.cbegin(), shader.cend());
+        writeCachedSpirv(cachePath, shaderCodeSPIRV);
     }
-    std::vector<uint32_t> shaderCodeSPIRV(shader.cbegin(), shader.cend());
 
     // Create shader module
     VkShaderModule shaderModule = createShaderModule(shaderCodeSPIRV, device);
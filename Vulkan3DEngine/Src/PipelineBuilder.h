@@ -21,7 +21,7 @@ public:
 
     void clear();
 
-    VkPipeline buildPipeline(VkPipelineLayout layout, VkDevice device);
+    VkPipeline buildPipeline(VkPipelineLayout layout, VkDevice device, VkPipelineCache pipelineCache = VK_NULL_HANDLE);
 
     void setShaders(VkShaderModule vertexShader, VkShaderModule fragmentShader);
     void setInputTopology(VkPrimitiveTopology topology);
@@ -33,16 +33,30 @@ public:
     void enableBlendingAdditive();
     void enableBlendingAlphablend();
 
+    // Defaults to the swap chain render pass
+    void setRenderPass(VkRenderPass renderPass);
+    // Defaults to VertexFormat::Full
+    void setVertexFormat(VertexFormat format);
+    // Overrides the vertex format, for pipelines drawing vertices other than mesh vertices
+    void setVertexInput(const VkVertexInputBindingDescription& binding, const std::vector<VkVertexInputAttributeDescription>& attributes);
     void setColorAttachmentFormat(VkFormat format);
     void setDepthFormat(VkFormat format);
     void disableDepthtest();
     void enableDepthtest(bool depthWriteEnable, VkCompareOp op);
 private:
     Renderer* m_renderer = nullptr;
+    VkRenderPass m_renderPass = VK_NULL_HANDLE;
+    VertexFormat m_vertexFormat = VertexFormat::Full;
+    VkVertexInputBindingDescription m_vertexBinding{};
+    std::vector<VkVertexInputAttributeDescription> m_vertexAttributes; // empty unless setVertexInput was called
 };
 
+// Compute pipelines carry no fixed-function state, so they are built directly
+VkPipeline buildComputePipeline(VkPipelineLayout layout, VkShaderModule computeShader, VkDevice device, VkPipelineCache pipelineCache = VK_NULL_HANDLE);
+
 //Shaders
 VkShaderModule createShaderModule(const std::vector<uint32_t>& code, VkDevice device);
 VkShaderModule loadShaderModule(const std::string& filename, VkDevice device);
 static std::vector<char> readFile(const std::string& filename);
+// GLSL is compiled once per distinct source; the SPIR-V is cached on disk under a hash of the source and compile options
 VkShaderModule compileShader(const std::string& filename, shaderc_shader_kind kind, VkDevice device);
\ No newline at end of file
@@ -0,0 +1,120 @@
+#include "PipelineCache.h"
+#include "Device.h"
+
+#include <fstream>
+#include <cstring>
+
+PipelineCache::PipelineCache(Device* device, const std::filesystem::path& path) : m_device(device), m_path(path)
+{
+    vkGetPhysicalDeviceProperties(m_device->getPhysicalDevice(), &m_properties);
+
+    std::vector<char> data = load();
+
+    VkPipelineCacheCreateInfo cacheInfo{};
+    cacheInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+    cacheInfo.initialDataSize = data.size();
+    cacheInfo.pInitialData = data.empty() ? nullptr : data.data();
+
+    if (vkCreatePipelineCache(m_device->get(), &cacheInfo, nullptr, &m_cache) != VK_SUCCESS) {
+        // The driver rejected the data despite the matching header, start over with an empty cache
+        cacheInfo.initialDataSize = 0;
+        cacheInfo.pInitialData = nullptr;
+        VK_CHECK(vkCreatePipelineCache(m_device->get(), &cacheInfo, nullptr, &m_cache));
+    }
+}
+
+PipelineCache::~PipelineCache()
+{
+    save();
+    vkDestroyPipelineCache(m_device->get(), m_cache, nullptr);
+}
+
+void PipelineCache::save()
+{
+    size_t size = 0;
+    if (vkGetPipelineCacheData(m_device->get(), m_cache, &size, nullptr) != VK_SUCCESS || size == 0) {
+        return;
+    }
+    std::vector<char> data(size);
+    if (vkGetPipelineCacheData(m_device->get(), m_cache, &size, data.data()) != VK_SUCCESS) {
+        return;
+    }
+    data.resize(size);
+
+    Header header = makeHeader(data);
+
+    // Written next to the old file and renamed over it, so a crash never leaves half a cache behind
+    std::error_code error;
+    std::filesystem::create_directories(m_path.parent_path(), error);
+    std::filesystem::path tempPath = m_path;
+    tempPath += ".tmp";
+    {
+        std::ofstream file(tempPath, std::ios::binary | std::ios::trunc);
+        if (!file) {
+            fmt::print(stderr, "Failed to write pipeline cache {}\n", tempPath.string());
+            return;
+        }
+        file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        file.write(data.data(), data.size());
+        // Closed first so a failed flush is caught too; the old cache stays as it was
+        file.close();
+        if (!file.good()) {
+            fmt::print(stderr, "Failed to write pipeline cache {}\n", tempPath.string());
+            std::filesystem::remove(tempPath, error);
+            return;
+        }
+    }
+    std::filesystem::rename(tempPath, m_path, error);
+    if (error) {
+        std::filesystem::remove(tempPath, error);
+        fmt::print(stderr, "Failed to write pipeline cache {}: {}\n", m_path.string(), error.message());
+    }
+}
+
+PipelineCache::Header PipelineCache::makeHeader(const std::vector<char>& data)
+{
+    Header header{};
+    header.magic = s_magic;
+    header.version = s_version;
+    header.vendorID = m_properties.vendorID;
+    header.deviceID = m_properties.deviceID;
+    header.driverVersion = m_properties.driverVersion;
+    memcpy(header.pipelineCacheUUID, m_properties.pipelineCacheUUID, VK_UUID_SIZE);
+    header.dataSize = data.size();
+    header.dataHash = hashBytes(data.data(), data.size());
+    return header;
+}
+
+std::vector<char> PipelineCache::load()
+{
+    std::ifstream file(m_path, std::ios::binary);
+    if (!file) {
+        return {};
+    }
+
+    Header header{};
+    if (!file.read(reinterpret_cast<char*>(&header), sizeof(header))) {
+        return {};
+    }
+
+    std::error_code error;
+    uintmax_t fileSize = std::filesystem::file_size(m_path, error);
+    if (error || header.magic != s_magic || header.version != s_version || header.dataSize != fileSize - sizeof(header)) {
+        fmt::print("Pipeline cache {} is damaged, ignoring it\n", m_path.string());
+        return {};
+    }
+
+    if (header.vendorID != m_properties.vendorID || header.deviceID != m_properties.deviceID ||
+        header.driverVersion != m_properties.driverVersion ||
+        memcmp(header.pipelineCacheUUID, m_properties.pipelineCacheUUID, VK_UUID_SIZE) != 0) {
+        fmt::print("Pipeline cache {} was written by another device or driver, ignoring it\n", m_path.string());
+        return {};
+    }
+
+    std::vector<char> data(header.dataSize);
+    if (!file.read(data.data(), data.size()) || hashBytes(data.data(), data.size()) != header.dataHash) {
+        fmt::print("Pipeline cache {} is damaged, ignoring it\n", m_path.string());
+        return {};
+    }
+    return data;
+}
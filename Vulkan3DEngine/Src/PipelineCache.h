@@ -0,0 +1,51 @@
+#pragma once
+#include "Prerequisites.h"
+
+#include <filesystem>
+#include <vector>
+
+// 64-bit FNV-1a; pass the previous result as hash to chain several inputs into one key
+inline uint64_t hashBytes(const void* data, size_t size, uint64_t hash = 14695981039346656037ull)
+{
+    const unsigned char* bytes = static_cast<const unsigned char*>(data);
+    for (size_t i = 0; i < size; i++) {
+        hash = (hash ^ bytes[i]) * 1099511628211ull;
+    }
+    return hash;
+}
+
+// A VkPipelineCache that is loaded from disk when the device is created and written back when it is destroyed.
+// The file starts with the identity of the device and driver that produced it; data written by another GPU or
+// driver version, or damaged on disk, is dropped instead of being handed to the driver.
+class PipelineCache
+{
+public:
+    PipelineCache(Device* device, const std::filesystem::path& path);
+    ~PipelineCache();
+
+    VkPipelineCache get() { return m_cache; }
+    void save();
+
+private:
+    struct Header {
+        uint32_t magic;
+        uint32_t version;
+        uint32_t vendorID;
+        uint32_t deviceID;
+        uint32_t driverVersion;
+        uint8_t pipelineCacheUUID[VK_UUID_SIZE];
+        uint64_t dataSize;
+        uint64_t dataHash;
+    };
+
+    static constexpr uint32_t s_magic = 0x43504B56; // "VKPC"
+    static constexpr uint32_t s_version = 1;
+
+    Header makeHeader(const std::vector<char>& data);
+    std::vector<char> load();
+
+    Device* m_device;
+    std::filesystem::path m_path;
+    VkPhysicalDeviceProperties m_properties;
+    VkPipelineCache m_cache = VK_NULL_HANDLE;
+};
@@ -0,0 +1,70 @@
+#include "PipelineLibrary.h"
+#include "GraphicsEngine.h"
+#include "SwapChain.h"
+#include "ThreadPool.h"
+
+PipelineLibrary::PipelineLibrary(Device* device) : m_device(device)
+{
+}
+
+PipelineLibrary::~PipelineLibrary()
+{
+    clear();
+}
+
+void PipelineLibrary::setBuilder(PipelineKind kind, Builder builder)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_builders[kind] = std::move(builder);
+}
+
+void PipelineLibrary::request(const PipelineKey& key)
+{
+    find(key);
+}
+
+bool PipelineLibrary::isReady(const PipelineKey& key)
+{
+    return find(key).wait_for(std::chrono::seconds(0)) == std::future_status::ready;
+}
+
+VkPipeline PipelineLibrary::get(const PipelineKey& key)
+{
+    return ThreadPool::get()->wait(find(key));
+}
+
+void PipelineLibrary::clear()
+{
+    std::unordered_map<PipelineKey, std::shared_future<VkPipeline>, PipelineKeyHash> variants;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        variants.swap(m_variants);
+    }
+
+    for (auto& [key, variant] : variants) {
+        // Compiles still in flight have to finish before their pipelines can be destroyed
+        vkDestroyPipeline(m_device->get(), ThreadPool::get()->wait(variant), nullptr);
+    }
+}
+
+std::shared_future<VkPipeline> PipelineLibrary::find(const PipelineKey& key)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    auto it = m_variants.find(key);
+    if (it != m_variants.end()) {
+        return it->second;
+    }
+
+    Builder builder = m_builders.at(key.kind);
+    std::shared_future<VkPipeline> variant = ThreadPool::get()->enqueue([builder, key]() {
+        // Pipelines only need a compatible render pass, so a temporary one stands in for the swap chain's
+        VkRenderPass renderPass = SwapChain::buildRenderPass(key.colorFormat, key.depthFormat, key.samples);
+        VkPipeline pipeline = builder(renderPass, key.samples);
+        vkDestroyRenderPass(GraphicsEngine::get()->getDevice()->get(), renderPass, nullptr);
+        return pipeline;
+        }).share();
+
+    m_variants.emplace(key, variant);
+    return variant;
+}
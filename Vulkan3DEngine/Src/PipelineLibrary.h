@@ -0,0 +1,67 @@
+#pragma once
+#include "Prerequisites.h"
+
+#include <unordered_map>
+#include <functional>
+#include <future>
+#include <mutex>
+
+enum class PipelineKind : uint32_t {
+    Mesh,
+    PackedMesh,
+    PointLight,
+    Imgui
+};
+
+// Everything a graphics pipeline variant depends on besides its shaders and layout
+struct PipelineKey {
+    PipelineKind kind;
+    VkSampleCountFlagBits samples;
+    VkFormat colorFormat;
+    VkFormat depthFormat;
+
+    bool operator==(const PipelineKey& other) const = default;
+};
+
+struct PipelineKeyHash {
+    size_t operator()(const PipelineKey& key) const
+    {
+        size_t hash = static_cast<size_t>(key.kind);
+        hash = hash * 31 + static_cast<size_t>(key.samples);
+        hash = hash * 31 + static_cast<size_t>(key.colorFormat);
+        hash = hash * 31 + static_cast<size_t>(key.depthFormat);
+        return hash;
+    }
+};
+
+// Compiles pipeline variants on ThreadPool workers through the device VkPipelineCache and keeps every variant
+// until the library is destroyed, so switching back and forth between variants never compiles twice.
+class PipelineLibrary
+{
+public:
+    // Builds one variant against a render pass compatible with the key; called on worker threads
+    using Builder = std::function<VkPipeline(VkRenderPass renderPass, VkSampleCountFlagBits samples)>;
+
+    PipelineLibrary(Device* device);
+    ~PipelineLibrary();
+
+    void setBuilder(PipelineKind kind, Builder builder);
+
+    // Starts compiling the variant in the background unless it is compiled or compiling already
+    void request(const PipelineKey& key);
+    bool isReady(const PipelineKey& key);
+    // Requests the variant if needed and waits for it; VK_NULL_HANDLE if it failed to build
+    VkPipeline get(const PipelineKey& key);
+
+    // Destroys every variant; the device must be idle
+    void clear();
+
+private:
+    std::shared_future<VkPipeline> find(const PipelineKey& key);
+
+    Device* m_device;
+    std::unordered_map<PipelineKind, Builder> m_builders;
+
+    std::mutex m_mutex;
+    std::unordered_map<PipelineKey, std::shared_future<VkPipeline>, PipelineKeyHash> m_variants;
+};
@@ -58,6 +58,16 @@ struct StagingBuffer;
 struct VertexBuffer;
 struct IndexBuffer;
 class UniformBuffer;
+struct StorageBuffer;
+class UploadQueue;
+class TextureTable;
+class TextureStreamer;
+class LightGrid;
+class ObjectBuffer;
+class FrameContext;
+class PipelineCache;
+class SamplerCache;
+class PipelineLibrary;
 class DescriptorAllocatorGrowable;
 class DescriptorSet;
 class GlobalDescriptorSet;
@@ -94,6 +104,16 @@ typedef std::shared_ptr<StagingBuffer> StagingBufferPtr;
 typedef std::shared_ptr<VertexBuffer> VertexBufferPtr;
 typedef std::shared_ptr<IndexBuffer> IndexBufferPtr;
 typedef std::shared_ptr<UniformBuffer> UniformBufferPtr;
+typedef std::shared_ptr<StorageBuffer> StorageBufferPtr;
+typedef std::shared_ptr<UploadQueue> UploadQueuePtr;
+typedef std::shared_ptr<TextureTable> TextureTablePtr;
+typedef std::shared_ptr<TextureStreamer> TextureStreamerPtr;
+typedef std::shared_ptr<LightGrid> LightGridPtr;
+typedef std::shared_ptr<ObjectBuffer> ObjectBufferPtr;
+typedef std::shared_ptr<FrameContext> FrameContextPtr;
+typedef std::shared_ptr<PipelineCache> PipelineCachePtr;
+typedef std::shared_ptr<SamplerCache> SamplerCachePtr;
+typedef std::shared_ptr<PipelineLibrary> PipelineLibraryPtr;
 typedef std::shared_ptr<DescriptorAllocatorGrowable> DescriptorAllocatorGrowablePtr;
 typedef std::shared_ptr<DescriptorSet> DescriptorSetPtr;
 typedef std::shared_ptr<GlobalDescriptorSet> GlobalDescriptorSetPtr;
@@ -129,16 +149,56 @@ struct GlobalUBO {
     alignas(16) glm::mat4 proj;
     alignas(16) glm::vec3 cameraPosition;
     DirectionalLight directionalLight;
-    alignas(16) PointLight pointLights[64];
-    alignas(4) int activePointLightCount;
     alignas(4) float ambientCoefficient = 0.05f;
+    alignas(4) uint32_t rawTextureColor = 0; // see Shader.frag
 };
 
-struct ModelUBO {
+// Header of the cluster buffer, matches LightClusterInfo in Shader.frag; see LightGrid
+struct LightClusterInfo {
+    uint32_t tileSize;      // pixels across a tile
+    uint32_t gridX;
+    uint32_t gridY;
+    uint32_t gridZ;         // depth slices
+    float nearPlane;
+    float sliceScale;       // slice = log(depth / nearPlane) * sliceScale
+    float attenuationCutoff;
+    uint32_t lightCount;
+    float minLightContribution;
+    uint32_t padding;       // keeps the cluster ranges that follow 8 byte aligned
+};
+
+// One element of the per-frame instance storage buffer; padded to the std430 array stride
+struct alignas(16) ModelUBO {
     glm::mat4 model;
     alignas(4) float shininess = 1.0f;
     alignas(4) float kd = 0.8f; // Large diffuse coefficient
     alignas(4) float ks = 0.2f; // Small specular coefficient
+    alignas(4) uint32_t textureIndex = 0; // slot in the TextureTable
+};
+
+// One slot of the persistent ObjectBuffer, matches SceneObjectData in cull.comp
+struct alignas(16) GpuObject {
+    ModelUBO model;
+    uint32_t meshGroup = UINT32_MAX; // index into the culling groups, none for a free slot or a model not drawn yet
+    uint32_t padding[3] = {};        // explicit, so slots compare with memcmp
+};
+
+// Culling input for one mesh of the ObjectBuffer, matches CullGroup in cull.comp
+struct alignas(16) CullGroup {
+    glm::vec4 boundingSphere; // object space, w is the radius
+    glm::vec4 lodErrors;      // object space error of every level of detail of the mesh
+    uint32_t firstCommand;    // indirect command of the mesh's full resolution level
+    uint32_t firstVisible;    // start of the mesh in the culled instance buffer
+    uint32_t lodCount;        // zero skips the group's objects, e.g. while the mesh is uploading
+    uint32_t lodStride;       // culled instance buffer slots of every level, the object count of the mesh
+};
+
+struct CullConstants {
+    glm::vec4 frustumPlanes[6];
+    glm::vec4 cameraPosition;
+    float lodScale; // see Renderer::getLodScale
+    uint32_t objectCount;
+    float pixelsPerUnit; // see Renderer::getPixelsPerUnit
 };
 
 struct Vertex {
@@ -188,6 +248,55 @@ struct Vertex {
     }
 };
 
+enum class VertexFormat : uint32_t {
+    Full,   // Vertex
+    Packed  // PackedVertex
+};
+
+// Quantized vertex, 16 bytes instead of 44; decoded in shaderPacked.vert. There is no color, imported meshes are white.
+struct PackedVertex {
+    uint16_t pos[4];     // unorm16 within the mesh AABB, w unused (three-component 16-bit formats are rarely supported)
+    int16_t normal[2];   // octahedral, snorm16
+    uint16_t texCoord[2]; // half float
+
+    static VkVertexInputBindingDescription getBindingDescription() {
+        VkVertexInputBindingDescription bindingDescription{};
+        bindingDescription.binding = 0;
+        bindingDescription.stride = sizeof(PackedVertex);
+        bindingDescription.inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
+
+        return bindingDescription;
+    }
+
+    // Locations match Vertex, so both formats share the fragment shader
+    static std::array<VkVertexInputAttributeDescription, 3> getAttributeDescriptions() {
+        std::array<VkVertexInputAttributeDescription, 3> attributeDescriptions{};
+
+        attributeDescriptions[0].binding = 0;
+        attributeDescriptions[0].location = 0;
+        attributeDescriptions[0].format = VK_FORMAT_R16G16B16A16_UNORM;
+        attributeDescriptions[0].offset = offsetof(PackedVertex, pos);
+
+        attributeDescriptions[1].binding = 0;
+        attributeDescriptions[1].location = 2;
+        attributeDescriptions[1].format = VK_FORMAT_R16G16_SFLOAT;
+        attributeDescriptions[1].offset = offsetof(PackedVertex, texCoord);
+
+        attributeDescriptions[2].binding = 0;
+        attributeDescriptions[2].location = 3;
+        attributeDescriptions[2].format = VK_FORMAT_R16G16_SNORM;
+        attributeDescriptions[2].offset = offsetof(PackedVertex, normal);
+
+        return attributeDescriptions;
+    }
+};
+
+// Push constants of the packed mesh pipeline, turn the unorm16 position back into object space
+struct MeshConstants {
+    glm::vec4 positionOffset; // AABB minimum
+    glm::vec4 positionScale;  // AABB extent
+};
+
 namespace std {
     template<> struct hash<Vertex> {
         size_t operator()(Vertex const& vertex) const {
@@ -199,12 +308,16 @@ namespace std {
 struct Pipeline {
     Pipeline(VkDevice* device) : p_device(device) {}
     ~Pipeline() {
-        vkDestroyPipeline(*p_device, pipeline, nullptr);
+        if (ownsPipeline) {
+            vkDestroyPipeline(*p_device, pipeline, nullptr);
+        }
         vkDestroyPipelineLayout(*p_device, layout, nullptr);
     }
     VkDevice* p_device;
     VkPipeline pipeline;
     VkPipelineLayout layout;
+    // False when the handle is borrowed from a PipelineLibrary, which destroys it
+    bool ownsPipeline = true;
 };
 
 typedef std::unique_ptr<Pipeline> PipelinePtr;
@@ -3,9 +3,21 @@
 #include "VertexBuffer.h"
 #include "IndexBuffer.h"
 #include "UniformBuffer.h"
+#include "StorageBuffer.h"
 #include "Image.h"
+#include "Camera.h"
+#include "TextureTable.h"
+#include "TextureStreamer.h"
+#include "LightGrid.h"
+#include "SceneObjectManager.h"
+#include "ObjectBuffer.h"
 
 #include <ranges>
+#include <algorithm>
+#include <bit>
+#include <cstring>
+#include <limits>
+#include <xmmintrin.h>
 
 #include "Application.h"
 #include "RendererInits.h"
@@ -13,6 +25,15 @@
 VkSampleCountFlagBits Renderer::s_maxMsaaSamples = VK_SAMPLE_COUNT_1_BIT;
 VkSampleCountFlagBits Renderer::s_msaaSamples = VK_SAMPLE_COUNT_1_BIT;
 int Renderer::s_framesInFlight = 2;
+bool Renderer::s_gpuDrivenRendering = false;
+int Renderer::s_parallelRecordThreshold = 8;
+float Renderer::s_lodErrorThreshold = 1.0f;
+
+// Fewest draw groups worth a secondary command buffer of their own
+static constexpr uint32_t s_minRecordChunkSize = 4;
+
+// Every pipeline drawn in the main render pass, switched together when the sample count changes
+static constexpr PipelineKind s_sampledPipelineKinds[] = { PipelineKind::Mesh, PipelineKind::PackedMesh, PipelineKind::PointLight, PipelineKind::Imgui };
 
 Renderer::Renderer()
 {
@@ -21,10 +42,50 @@ Renderer::Renderer()
     }
     catch (...) { throw std::exception("SwapChain not created successfully"); }
 
+    // Before the pipelines, which use its layout as descriptor set 2
+    m_textureTable = std::make_shared<TextureTable>(GraphicsEngine::get()->getDevice().get(), this);
+    m_textureStreamer = std::make_shared<TextureStreamer>();
+    m_lightGrid = std::make_shared<LightGrid>();
+
+    m_pipelineLibrary = std::make_shared<PipelineLibrary>(GraphicsEngine::get()->getDevice().get());
+    m_pipelineLibrary->setBuilder(PipelineKind::Mesh, [this](VkRenderPass renderPass, VkSampleCountFlagBits samples) {
+        return buildMeshPipeline(renderPass, samples, VertexFormat::Full);
+        });
+    m_pipelineLibrary->setBuilder(PipelineKind::PackedMesh, [this](VkRenderPass renderPass, VkSampleCountFlagBits samples) {
+        return buildMeshPipeline(renderPass, samples, VertexFormat::Packed);
+        });
+    m_pipelineLibrary->setBuilder(PipelineKind::PointLight, [this](VkRenderPass renderPass, VkSampleCountFlagBits samples) {
+        return buildPointLightPipeline(renderPass, samples);
+        });
+    m_pipelineLibrary->setBuilder(PipelineKind::Imgui, [this](VkRenderPass renderPass, VkSampleCountFlagBits samples) {
+        return buildImguiPipeline(renderPass, samples);
+        });
+    m_pendingMsaaSamples = s_msaaSamples;
+
     createGraphicsPipeline();
     createPointLightPipeline();
-    
-    createCommandBuffers();
+    createImguiPipeline();
+    prewarmPipelines();
+    if (GraphicsEngine::get()->getDevice()->supportsGpuDrivenRendering()) {
+        createCullPipeline();
+    }
+
+    m_frames.resize(s_maxFramesInFlight);
+    for (FrameContextPtr& frame : m_frames) {
+        frame = std::make_shared<FrameContext>(GraphicsEngine::get()->getDevice().get(), this, ThreadPool::get()->getThreadCount());
+    }
+    if (m_cullPipeline) {
+        m_visibleBuffers.resize(s_maxFramesInFlight);
+        for (StorageBufferPtr& buffer : m_visibleBuffers) {
+            buffer = createStorageBuffer(1024 * sizeof(ModelUBO), 0, MemoryUsage::GpuOnly);
+        }
+        m_textureSizeBuffers.resize(s_maxFramesInFlight);
+        for (StorageBufferPtr& buffer : m_textureSizeBuffers) {
+            buffer = createStorageBuffer(m_textureTable->getCapacity() * sizeof(uint32_t), VK_BUFFER_USAGE_TRANSFER_DST_BIT, MemoryUsage::Readback);
+        }
+        m_drawIndirectCount = GraphicsEngine::get()->getDevice()->supportsDrawIndirectCount();
+    }
+    m_gpuCulling = s_gpuDrivenRendering && m_cullPipeline;
 
     initImgui();
 }
@@ -37,12 +98,26 @@ Renderer::~Renderer()
     vkDestroyDescriptorPool(GraphicsEngine::get()->getDevice()->get(), m_imguiPool, nullptr);
     
     m_descriptorAllocator.reset();
+    m_retiredResources.clear();
+    m_frames.clear();
+    m_visibleBuffers.clear();
+    m_textureSizeBuffers.clear();
+    m_cullPipeline.reset();
+    vkDestroyDescriptorSetLayout(GraphicsEngine::get()->getDevice()->get(), m_cullDescriptorSetLayout, nullptr);
+    // Waits for the prewarm compiles, which still use the pipeline layouts
+    m_pipelineLibrary.reset();
     m_graphicsPipeline.reset();
+    m_packedGraphicsPipeline.reset();
     m_pointLightPipeline.reset();
+    m_imguiPipeline.reset();
+    m_lightGrid.reset();
+    m_textureStreamer.reset();
+    m_textureTable.reset();
 
     vkDestroyDescriptorSetLayout(GraphicsEngine::get()->getDevice()->get(), m_globalDescriptorSetLayout, nullptr);
     vkDestroyDescriptorSetLayout(GraphicsEngine::get()->getDevice()->get(), m_modelDescriptorSetLayout, nullptr);
-    vkDestroyDescriptorSetLayout(GraphicsEngine::get()->getDevice()->get(), m_textureDescriptorSetLayout, nullptr);
+    vkDestroyDescriptorSetLayout(GraphicsEngine::get()->getDevice()->get(), m_lightDescriptorSetLayout, nullptr);
+    vkDestroyDescriptorSetLayout(GraphicsEngine::get()->getDevice()->get(), m_imguiDescriptorSetLayout, nullptr);
     m_swapChain.reset();
 }
 
@@ -51,21 +126,36 @@ StagingBufferPtr Renderer::createStagingBuffer(VkDeviceSize bufferSize)
     return std::make_shared<StagingBuffer>(bufferSize, this);
 }
 
-VertexBufferPtr Renderer::createVertexBuffer(std::vector<Vertex> vertices)
+VertexBufferPtr Renderer::createVertexBuffer(const std::vector<Vertex>& vertices)
 {
     return std::make_shared<VertexBuffer>(vertices, this);
 }
 
-IndexBufferPtr Renderer::createIndexBuffer(std::vector<uint32_t> indices)
+VertexBufferPtr Renderer::createVertexBuffer(const void* vertices, VkDeviceSize bufferSize)
+{
+    return std::make_shared<VertexBuffer>(vertices, bufferSize, this);
+}
+
+IndexBufferPtr Renderer::createIndexBuffer(const std::vector<uint32_t>& indices)
 {
     return std::make_shared<IndexBuffer>(indices, this);
 }
 
+IndexBufferPtr Renderer::createIndexBuffer(const uint32_t* indices, size_t count)
+{
+    return std::make_shared<IndexBuffer>(indices, count, this);
+}
+
 UniformBufferPtr Renderer::createUniformBuffer(VkDeviceSize bufferSize)
 {
     return std::make_shared<UniformBuffer>(bufferSize, this);
 }
 
+StorageBufferPtr Renderer::createStorageBuffer(VkDeviceSize bufferSize, VkBufferUsageFlags extraUsage, MemoryUsage memoryUsage)
+{
+    return std::make_shared<StorageBuffer>(bufferSize, extraUsage, memoryUsage, this);
+}
+
 ImagePtr Renderer::createImage(uint32_t width, uint32_t height, uint32_t mipLevels, VkSampleCountFlagBits numSamples, VkFormat format, VkImageTiling tiling, VkImageUsageFlags usage, VkMemoryPropertyFlags properties)
 {
     return std::make_shared<Image>(width, height, mipLevels, numSamples, format, tiling, usage, properties, this);
@@ -74,6 +164,9 @@ ImagePtr Renderer::createImage(uint32_t width, uint32_t height, uint32_t mipLeve
 void Renderer::drawFrame()
 {
     vkWaitForFences(GraphicsEngine::get()->getDevice()->get(), 1, &m_swapChain->m_inFlightFences[m_currentFrame], VK_TRUE, UINT64_MAX);
+    m_textureTable->nextFrame();
+    releaseRetired();
+    m_textureStreamer->update();
 
     
     VkResult result = vkAcquireNextImageKHR(GraphicsEngine::get()->getDevice()->get(), m_swapChain->m_swapChain, UINT64_MAX,
@@ -89,9 +182,10 @@ void Renderer::drawFrame()
 
     vkResetFences(GraphicsEngine::get()->getDevice()->get(), 1, &m_swapChain->m_inFlightFences[m_currentFrame]);
 
-    vkResetCommandBuffer(m_commandBuffers[m_currentFrame], /*VkCommandBufferResetFlagBits*/ 0);
+    m_frames[m_currentFrame]->reset();
+    VkCommandBuffer commandBuffer = m_frames[m_currentFrame]->getCommandBuffer();
 
-    recordCommandBuffer(m_commandBuffers[m_currentFrame], m_currentImageIndex);
+    recordCommandBuffer(commandBuffer, m_currentImageIndex);
 
     VkSubmitInfo submitInfo{};
     submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
@@ -103,12 +197,14 @@ void Renderer::drawFrame()
     submitInfo.pWaitDstStageMask = waitStages;
 
     submitInfo.commandBufferCount = 1;
-    submitInfo.pCommandBuffers = &m_commandBuffers[m_currentFrame];
+    submitInfo.pCommandBuffers = &commandBuffer;
 
     VkSemaphore signalSemaphores[] = { m_swapChain->m_renderFinishedSemaphores[m_currentFrame] };
     submitInfo.signalSemaphoreCount = 1;
     submitInfo.pSignalSemaphores = signalSemaphores;
 
+    std::unique_lock<std::mutex> queueLock(GraphicsEngine::get()->getDevice()->getQueueMutex());
+
     if (vkQueueSubmit(GraphicsEngine::get()->getDevice()->getGraphicsQueue(), 1, &submitInfo, m_swapChain->m_inFlightFences[m_currentFrame]) != VK_SUCCESS) {
         throw std::runtime_error("failed to submit draw command buffer!");
     }
@@ -126,6 +222,7 @@ void Renderer::drawFrame()
     presentInfo.pResults = nullptr; // Optional
 
     result = vkQueuePresentKHR(GraphicsEngine::get()->getDevice()->getPresentQueue(), &presentInfo);
+    queueLock.unlock();
 
     if (result == VK_ERROR_OUT_OF_DATE_KHR || result == VK_SUBOPTIMAL_KHR || Window::get()->wasWindowResized()) {
         Window::get()->resetWindowResizedFlag();
@@ -136,6 +233,8 @@ void Renderer::drawFrame()
     }
 
     m_currentFrame = (m_currentFrame + 1) % Renderer::s_framesInFlight;
+    // The next frame's models are drawn by the scene before it is recorded, so the mode only changes between frames
+    m_gpuCulling = s_gpuDrivenRendering && m_cullPipeline;
 }
 
 void Renderer::drawModel(Model* model)
@@ -143,6 +242,27 @@ void Renderer::drawModel(Model* model)
     m_modelDraws.push_back(model);
 }
 
+void Renderer::retire(std::shared_ptr<void> resources)
+{
+    std::lock_guard<std::mutex> lock(m_retiredMutex);
+    m_retiredResources.push_back({ m_frameNumber, std::move(resources) });
+}
+
+void Renderer::releaseRetired()
+{
+    std::vector<std::shared_ptr<void>> released;
+    {
+        std::lock_guard<std::mutex> lock(m_retiredMutex);
+        m_frameNumber++;
+        while (!m_retiredResources.empty() && m_retiredResources.front().frame + s_maxFramesInFlight <= m_frameNumber) {
+            released.push_back(std::move(m_retiredResources.front().resources));
+            m_retiredResources.pop_front();
+        }
+    }
+    // Destroyed outside the lock, so loading threads retiring resources do not wait for it
+    released.clear();
+}
+
 void Renderer::bindDescriptorSet(VkDescriptorSet set, int position)
 {
     m_currentDescriptorSets[position] = set;
@@ -150,22 +270,75 @@ void Renderer::bindDescriptorSet(VkDescriptorSet set, int position)
 
 void Renderer::recreatePipelines()
 {
-    vkDeviceWaitIdle(GraphicsEngine::get()->getDevice()->get());
+    GraphicsEngine::get()->getDevice()->waitIdle();
+    m_pipelineLibrary->clear();
     m_graphicsPipeline.reset();
+    m_packedGraphicsPipeline.reset();
     m_pointLightPipeline.reset();
+    m_imguiPipeline.reset();
 
     vkDestroyDescriptorSetLayout(GraphicsEngine::get()->getDevice()->get(), m_globalDescriptorSetLayout, nullptr);
     vkDestroyDescriptorSetLayout(GraphicsEngine::get()->getDevice()->get(), m_modelDescriptorSetLayout, nullptr);
-    vkDestroyDescriptorSetLayout(GraphicsEngine::get()->getDevice()->get(), m_textureDescriptorSetLayout, nullptr);
+    vkDestroyDescriptorSetLayout(GraphicsEngine::get()->getDevice()->get(), m_lightDescriptorSetLayout, nullptr);
+    vkDestroyDescriptorSetLayout(GraphicsEngine::get()->getDevice()->get(), m_imguiDescriptorSetLayout, nullptr);
 
     createGraphicsPipeline();
     createPointLightPipeline();
+    createImguiPipeline();
+    prewarmPipelines();
+}
+
+void Renderer::requestMsaaSamples(VkSampleCountFlagBits samples)
+{
+    m_pendingMsaaSamples = samples;
+    for (PipelineKind kind : s_sampledPipelineKinds) {
+        m_pipelineLibrary->request(getPipelineKey(kind, samples));
+    }
+}
+
+bool Renderer::applyPendingMsaaSamples()
+{
+    if (m_pendingMsaaSamples == s_msaaSamples) {
+        return false;
+    }
+
+    for (PipelineKind kind : s_sampledPipelineKinds) {
+        if (!m_pipelineLibrary->isReady(getPipelineKey(kind, m_pendingMsaaSamples))) {
+            // Keep rendering with the current variants until the new ones are compiled
+            return false;
+        }
+    }
+
+    s_msaaSamples = m_pendingMsaaSamples;
+    // Only the multisampled attachments, the render pass and the framebuffers depend on the sample count; the
+    // old ones are retired with the frames in flight. The old variants stay in the library, so switching back is free
+    m_swapChain->recreateMultisampleResources();
+    m_graphicsPipeline->pipeline = m_pipelineLibrary->get(getPipelineKey(PipelineKind::Mesh, s_msaaSamples));
+    m_packedGraphicsPipeline->pipeline = m_pipelineLibrary->get(getPipelineKey(PipelineKind::PackedMesh, s_msaaSamples));
+    m_pointLightPipeline->pipeline = m_pipelineLibrary->get(getPipelineKey(PipelineKind::PointLight, s_msaaSamples));
+    m_imguiPipeline->pipeline = m_pipelineLibrary->get(getPipelineKey(PipelineKind::Imgui, s_msaaSamples));
+    return true;
+}
+
+PipelineKey Renderer::getPipelineKey(PipelineKind kind, VkSampleCountFlagBits samples)
+{
+    return { kind, samples, m_swapChain->getImageFormat(), GraphicsEngine::get()->getDevice()->findDepthFormat() };
+}
+
+void Renderer::prewarmPipelines()
+{
+    // Every sample count the settings tab offers, so changing MSAA never waits for a compile
+    for (uint32_t samples = VK_SAMPLE_COUNT_1_BIT; samples <= s_maxMsaaSamples; samples <<= 1) {
+        for (PipelineKind kind : s_sampledPipelineKinds) {
+            m_pipelineLibrary->request(getPipelineKey(kind, static_cast<VkSampleCountFlagBits>(samples)));
+        }
+    }
 }
 
 void Renderer::recreateImgui()
 {
     // Wait for device to be idle to ensure no resources are in use
-    vkDeviceWaitIdle(GraphicsEngine::get()->getDevice()->get());
+    GraphicsEngine::get()->getDevice()->waitIdle();
 
     // Shutdown ImGui and free its resources
     ImGui_ImplVulkan_Shutdown();
@@ -179,19 +352,9 @@ void Renderer::recreateImgui()
     initImgui();
 }
 
-void Renderer::createCommandBuffers()
+VkCommandBuffer Renderer::getCurrentCommandBuffer()
 {
-    m_commandBuffers.resize(Renderer::s_maxFramesInFlight);
-
-    VkCommandBufferAllocateInfo allocInfo{};
-    allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
-    allocInfo.commandPool = GraphicsEngine::get()->getDevice()->getCommandPool();
-    allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
-    allocInfo.commandBufferCount = (uint32_t)m_commandBuffers.size();
-
-    if (vkAllocateCommandBuffers(GraphicsEngine::get()->getDevice()->get(), &allocInfo, m_commandBuffers.data()) != VK_SUCCESS) {
-        throw std::runtime_error("failed to allocate command buffers!");
-    }
+    return m_frames[m_currentFrame]->getCommandBuffer();
 }
 
 void Renderer::recordCommandBuffer(VkCommandBuffer commandBuffer, uint32_t imageIndex)
@@ -205,6 +368,19 @@ void Renderer::recordCommandBuffer(VkCommandBuffer commandBuffer, uint32_t image
         throw std::runtime_error("failed to begin recording command buffer!");
     }
 
+    m_drawCallCount = 0;
+    m_instanceCount = 0;
+    m_visibleCount = 0;
+    m_culledCount = 0;
+    prepareLights();
+    // Culling has to run outside the render pass
+    if (prepareModelDraws() && m_gpuCulling) {
+        recordCullingPass(commandBuffer);
+    }
+
+    VkDescriptorSet lightDescriptorSet = m_frames[m_currentFrame]->allocateDescriptorSet(m_lightDescriptorSetLayout);
+    m_lightGrid->write(*m_frames[m_currentFrame], lightDescriptorSet);
+
     VkRenderPassBeginInfo renderPassInfo{};
     renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
     renderPassInfo.renderPass = m_swapChain->getRenderPass();
@@ -219,10 +395,397 @@ void Renderer::recordCommandBuffer(VkCommandBuffer commandBuffer, uint32_t image
     renderPassInfo.clearValueCount = static_cast<uint32_t>(clearValues.size());
     renderPassInfo.pClearValues = clearValues.data();
 
-    vkCmdBeginRenderPass(commandBuffer, &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
+    m_currentDescriptorSets[0] = GraphicsEngine::get()->getScene()->m_globalDescriptorSets[m_currentFrame];
+    m_currentDescriptorSets[1] = m_gpuCulling ? m_visibleDescriptorSet : m_instanceDescriptorSet;
+    m_currentDescriptorSets[2] = m_textureTable->getDescriptorSet();
+    m_currentDescriptorSets[3] = lightDescriptorSet;
+    m_modelDraws.clear();
+
+    // A subpass is either recorded inline or made only of secondary command buffers, so when the draws are split
+    // into chunks the point lights and ImGui go into a secondary command buffer as well
+    if (s_parallelRecordThreshold > 0 && m_drawGroups.size() > static_cast<size_t>(s_parallelRecordThreshold)) {
+        vkCmdBeginRenderPass(commandBuffer, &renderPassInfo, VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS);
+        recordParallel(commandBuffer, renderPassInfo);
+    }
+    else {
+        vkCmdBeginRenderPass(commandBuffer, &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
+        recordViewportAndScissor(commandBuffer);
+        recordModelDraws(commandBuffer, 0, static_cast<uint32_t>(m_drawGroups.size()));
+        recordPointLights(commandBuffer);
+
+        ImGui::Render();
+        ImGui_ImplVulkan_RenderDrawData(ImGui::GetDrawData(), commandBuffer, m_imguiPipeline->pipeline);
+    }
+    m_drawCallCount = m_gpuCulling && !m_drawIndirectCount ? m_drawCommandCount : static_cast<uint32_t>(m_drawGroups.size());
+
+    vkCmdEndRenderPass(commandBuffer);
+
+    if (vkEndCommandBuffer(commandBuffer) != VK_SUCCESS) {
+        throw std::runtime_error("failed to record command buffer!");
+    }
+}
+
+void Renderer::prepareLights()
+{
+    ScenePtr scene = GraphicsEngine::get()->getScene();
+    CameraPtr camera = scene->getCamera();
+    m_lightGrid->build(scene->m_pointLights, camera->getViewMatrix(), camera->getProjectionMatrix(), camera->getPosition(),
+        m_swapChain->getSwapChainExtent());
+}
+
+bool Renderer::prepareModelDraws()
+{
+    m_instanceDraws.clear();
+    m_drawGroups.clear();
+    if (m_gpuCulling) {
+        return prepareGpuDrivenDraws();
+    }
+
+    for (Model* m : m_modelDraws) {
+        // Skip models whose data has not reached the GPU yet instead of waiting for it
+        if (!m->m_mesh->isResident() || (m->m_texture && !m->m_texture->isResident())) {
+            continue;
+        }
+        Pipeline* pipeline = m->m_mesh->getVertexFormat() == VertexFormat::Packed ? m_packedGraphicsPipeline.get() : m_graphicsPipeline.get();
+        m_instanceDraws.push_back({ pipeline, m->m_mesh.get(), m, 0 });
+    }
+
+    cullModelDraws();
+    requestTextureSizes();
+
+    uint32_t instanceCount = static_cast<uint32_t>(m_instanceDraws.size());
+    FrameContext& frame = *m_frames[m_currentFrame];
+    VkDevice device = GraphicsEngine::get()->getDevice()->get();
+    DescriptorWriter writer;
+
+    // The light clusters are written even when nothing is drawn, the billboards read the lights as well
+    frame.reserveTransient(instanceCount * sizeof(ModelUBO) + frame.getTransientAlignment() + m_lightGrid->getTransientSize(frame.getTransientAlignment()));
 
-    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, m_graphicsPipeline->pipeline);
+    if (m_instanceDraws.empty()) {
+        return false;
+    }
+
+    // Sorting brings every instance of a (pipeline, mesh, level of detail) group next to each other,
+    // so each group becomes one contiguous range of the instance buffer
+    std::sort(m_instanceDraws.begin(), m_instanceDraws.end(), [](const InstanceDraw& a, const InstanceDraw& b) {
+        return std::tie(a.pipeline, a.mesh, a.lod) < std::tie(b.pipeline, b.mesh, b.lod);
+        });
+
+    TransientAllocation instanceData = frame.allocateTransient(instanceCount * sizeof(ModelUBO));
+    m_instanceDescriptorSet = frame.allocateDescriptorSet(m_modelDescriptorSetLayout);
+    writer.writeBuffer(0, instanceData.buffer, instanceData.size, instanceData.offset, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER);
+    writer.updateSet(device, m_instanceDescriptorSet);
+
+    ModelUBO* instances = static_cast<ModelUBO*>(instanceData.data);
+    for (uint32_t i = 0; i < instanceCount; i++) {
+        const InstanceDraw& draw = m_instanceDraws[i];
+        instances[i] = draw.model->ubo;
+        instances[i].textureIndex = draw.model->m_texture ? draw.model->m_texture->getTextureIndex() : TextureTable::s_defaultTextureSlot;
+
+        if (m_drawGroups.empty() || m_drawGroups.back().pipeline != draw.pipeline || m_drawGroups.back().mesh != draw.mesh ||
+            m_drawGroups.back().lod != draw.lod) {
+            m_drawGroups.push_back({ draw.pipeline, draw.mesh, draw.lod, i, 0, 0 });
+        }
+        m_drawGroups.back().instanceCount++;
+    }
+
+    m_instanceCount = instanceCount;
+    return true;
+}
+
+bool Renderer::prepareGpuDrivenDraws()
+{
+    // Nothing here visits the models: the changed ones were synced into the object buffer by the scene update,
+    // and the culling pass reads that buffer directly. The CPU only prepares one culling group per mesh.
+    ObjectBufferPtr objectBuffer = GraphicsEngine::get()->getScene()->getSceneObjectManager()->getObjectBuffer();
+    const std::vector<ObjectBuffer::MeshGroup>& meshGroups = objectBuffer->getMeshGroups();
+    uint32_t groupCount = static_cast<uint32_t>(meshGroups.size());
+
+    requestTextureSizes();
+
+    FrameContext& frame = *m_frames[m_currentFrame];
+    VkDevice device = GraphicsEngine::get()->getDevice()->get();
+    DescriptorWriter writer;
+
+    // Before the transient memory is reserved, a recreated buffer uploads every slot
+    objectBuffer->reserve();
+    VkDeviceSize perGroup = sizeof(CullGroup) + MeshData::s_maxLodCount * sizeof(VkDrawIndexedIndirectCommand) + sizeof(uint32_t);
+    frame.reserveTransient(objectBuffer->getUploadSize() + groupCount * perGroup + 4 * frame.getTransientAlignment() +
+        m_lightGrid->getTransientSize(frame.getTransientAlignment()));
+
+    if (objectBuffer->getObjectCount() == 0) {
+        return false;
+    }
+
+    // Any survivor may pick any level, so every level of a mesh gets a slice as large as its object count;
+    // free groups and meshes still uploading get no levels, which makes the culling pass skip their objects
+    TransientAllocation cullData = frame.allocateTransient(groupCount * sizeof(CullGroup));
+    CullGroup* cullGroups = static_cast<CullGroup*>(cullData.data);
+    uint32_t commandCount = 0;
+    uint32_t visibleCount = 0;
+    for (uint32_t i = 0; i < groupCount; i++) {
+        const ObjectBuffer::MeshGroup& meshGroup = meshGroups[i];
+        cullGroups[i] = {};
+        if (meshGroup.objectCount == 0 || !meshGroup.mesh->isResident()) {
+            continue;
+        }
+
+        Mesh* mesh = meshGroup.mesh.get();
+        Pipeline* pipeline = mesh->getVertexFormat() == VertexFormat::Packed ? m_packedGraphicsPipeline.get() : m_graphicsPipeline.get();
+        glm::vec4 lodErrors(std::numeric_limits<float>::max());
+        for (uint32_t lod = 0; lod < mesh->getLodCount(); lod++) {
+            lodErrors[lod] = mesh->getLod(lod).error;
+        }
+        cullGroups[i] = { mesh->getBoundingSphere(), lodErrors, commandCount, visibleCount, mesh->getLodCount(), meshGroup.objectCount };
+
+        m_drawGroups.push_back({ pipeline, mesh, 0, visibleCount, meshGroup.objectCount, commandCount, i });
+        commandCount += mesh->getLodCount();
+        visibleCount += mesh->getLodCount() * meshGroup.objectCount;
+    }
+
+    if (m_drawGroups.empty()) {
+        return false;
+    }
 
+    // Fewer pipeline switches; the groups keep their commands and slices
+    std::sort(m_drawGroups.begin(), m_drawGroups.end(), [](const DrawGroup& a, const DrawGroup& b) {
+        return a.pipeline < b.pipeline;
+        });
+
+    m_drawCommandCount = commandCount;
+    m_drawCommands = frame.allocateTransient(commandCount * sizeof(VkDrawIndexedIndirectCommand));
+    VkDrawIndexedIndirectCommand* commands = static_cast<VkDrawIndexedIndirectCommand*>(m_drawCommands.data);
+    for (const DrawGroup& group : m_drawGroups) {
+        const Mesh* mesh = group.mesh;
+        for (uint32_t lod = 0; lod < mesh->getLodCount(); lod++) {
+            // instanceCount starts at zero and is filled in by the culling pass
+            uint32_t firstVisible = group.firstInstance + lod * group.instanceCount;
+            VkDrawIndexedIndirectCommand& command = commands[group.firstCommand + lod];
+            if (mesh->m_hasIndexBuffer) {
+                const MeshLod& range = mesh->getLod(lod);
+                command = { range.indexCount, 0, range.firstIndex, 0, firstVisible };
+            }
+            else {
+                // Read as a VkDrawIndirectCommand, whose firstInstance sits where vertexOffset is
+                command = { 3, 0, 0, static_cast<int32_t>(firstVisible), firstVisible };
+            }
+        }
+    }
+
+    // Zero until the culling pass counts the levels in use, so a mesh with no visible object is not drawn at all
+    m_drawCounts = frame.allocateTransient(groupCount * sizeof(uint32_t));
+    std::memset(m_drawCounts.data, 0, m_drawCounts.size);
+
+    // The frame's previous submission has retired, so the old buffer is no longer in use
+    StorageBufferPtr& visibleBuffer = m_visibleBuffers[m_currentFrame];
+    if (visibleCount * sizeof(ModelUBO) > visibleBuffer->getSize()) {
+        visibleBuffer = createStorageBuffer(std::bit_ceil(visibleCount) * sizeof(ModelUBO), 0, MemoryUsage::GpuOnly);
+    }
+
+    m_visibleDescriptorSet = frame.allocateDescriptorSet(m_modelDescriptorSetLayout);
+    writer.writeBuffer(0, visibleBuffer->get(), visibleBuffer->getSize(), 0, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER);
+    writer.updateSet(device, m_visibleDescriptorSet);
+    writer.clear();
+
+    StorageBufferPtr objects = objectBuffer->getBuffer();
+    m_cullDescriptorSet = frame.allocateDescriptorSet(m_cullDescriptorSetLayout);
+    writer.writeBuffer(0, objects->get(), objects->getSize(), 0, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER);
+    writer.writeBuffer(1, cullData.buffer, cullData.size, cullData.offset, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER);
+    writer.writeBuffer(2, visibleBuffer->get(), visibleBuffer->getSize(), 0, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER);
+    writer.writeBuffer(3, m_drawCommands.buffer, m_drawCommands.size, m_drawCommands.offset, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER);
+    writer.writeBuffer(4, m_drawCounts.buffer, m_drawCounts.size, m_drawCounts.offset, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER);
+    StorageBufferPtr textureSizes = m_textureSizeBuffers[m_currentFrame];
+    writer.writeBuffer(5, textureSizes->get(), textureSizes->getSize(), 0, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER);
+    writer.updateSet(device, m_cullDescriptorSet);
+
+    m_instanceCount = objectBuffer->getObjectCount();
+    return true;
+}
+
+void Renderer::cullModelDraws()
+{
+    size_t count = m_instanceDraws.size();
+    size_t paddedCount = (count + 3) & ~size_t(3);
+
+    PackedBounds& bounds = m_packedBounds;
+    for (std::vector<float>* component : { &bounds.centerX, &bounds.centerY, &bounds.centerZ,
+        &bounds.extentX, &bounds.extentY, &bounds.extentZ, &bounds.radius, &bounds.scale }) {
+        component->resize(paddedCount, 0.0f);
+    }
+
+    // Object space box and sphere to world space. The sphere shares the box center, so both volumes
+    // are tested against the same signed distance with the tighter of the two radii.
+    for (size_t i = 0; i < count; i++) {
+        const glm::mat4& model = m_instanceDraws[i].model->ubo.model;
+        const Mesh* mesh = m_instanceDraws[i].mesh;
+
+        glm::vec3 localCenter = (mesh->getBoundsMin() + mesh->getBoundsMax()) * 0.5f;
+        glm::vec3 localExtent = (mesh->getBoundsMax() - mesh->getBoundsMin()) * 0.5f;
+        glm::vec3 center = glm::vec3(model * glm::vec4(localCenter, 1.0f));
+        glm::mat3 absolute = glm::mat3(glm::abs(glm::vec3(model[0])), glm::abs(glm::vec3(model[1])), glm::abs(glm::vec3(model[2])));
+        glm::vec3 extent = absolute * localExtent;
+        float scale = std::max({ glm::length(glm::vec3(model[0])), glm::length(glm::vec3(model[1])), glm::length(glm::vec3(model[2])) });
+
+        bounds.centerX[i] = center.x;
+        bounds.centerY[i] = center.y;
+        bounds.centerZ[i] = center.z;
+        bounds.extentX[i] = extent.x;
+        bounds.extentY[i] = extent.y;
+        bounds.extentZ[i] = extent.z;
+        bounds.radius[i] = mesh->getBoundingSphere().w * scale;
+        bounds.scale[i] = scale;
+    }
+
+    CameraPtr camera = GraphicsEngine::get()->getScene()->getCamera();
+    std::array<glm::vec4, 6> planes = camera->getFrustumPlanes();
+    glm::vec3 cameraPosition = camera->getPosition();
+    float lodScale = getLodScale();
+
+    // Four objects per iteration; an object is culled when it lies fully behind any plane
+    size_t visible = 0;
+    for (size_t i = 0; i < paddedCount; i += 4) {
+        __m128 centerX = _mm_loadu_ps(&bounds.centerX[i]);
+        __m128 centerY = _mm_loadu_ps(&bounds.centerY[i]);
+        __m128 centerZ = _mm_loadu_ps(&bounds.centerZ[i]);
+        __m128 extentX = _mm_loadu_ps(&bounds.extentX[i]);
+        __m128 extentY = _mm_loadu_ps(&bounds.extentY[i]);
+        __m128 extentZ = _mm_loadu_ps(&bounds.extentZ[i]);
+        __m128 sphereRadius = _mm_loadu_ps(&bounds.radius[i]);
+
+        __m128 inside = _mm_cmpeq_ps(centerX, centerX);
+        for (const glm::vec4& plane : planes) {
+            __m128 distance = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(plane.x), centerX), _mm_mul_ps(_mm_set1_ps(plane.y), centerY)),
+                _mm_add_ps(_mm_mul_ps(_mm_set1_ps(plane.z), centerZ), _mm_set1_ps(plane.w)));
+            __m128 boxRadius = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(std::abs(plane.x)), extentX), _mm_mul_ps(_mm_set1_ps(std::abs(plane.y)), extentY)),
+                _mm_mul_ps(_mm_set1_ps(std::abs(plane.z)), extentZ));
+            __m128 radius = _mm_min_ps(sphereRadius, boxRadius);
+            inside = _mm_and_ps(inside, _mm_cmpge_ps(distance, _mm_sub_ps(_mm_setzero_ps(), radius)));
+        }
+
+        int mask = _mm_movemask_ps(inside);
+        for (size_t lane = 0; lane < 4 && i + lane < count; lane++) {
+            if (mask & (1 << lane)) {
+                size_t j = i + lane;
+                glm::vec3 center(bounds.centerX[j], bounds.centerY[j], bounds.centerZ[j]);
+                float distance = std::max(glm::length(center - cameraPosition) - bounds.radius[j], 0.0f);
+                m_instanceDraws[j].lod = selectLod(m_instanceDraws[j].mesh, distance, bounds.scale[j], lodScale);
+                m_instanceDraws[visible++] = m_instanceDraws[j];
+            }
+        }
+    }
+
+    m_visibleCount = static_cast<uint32_t>(visible);
+    m_culledCount = static_cast<uint32_t>(count - visible);
+    m_instanceDraws.resize(visible);
+}
+
+float Renderer::getPixelsPerUnit()
+{
+    float height = static_cast<float>(m_swapChain->getSwapChainExtent().height);
+    return height / (2.0f * std::tan(glm::radians(Camera::s_fov) * 0.5f));
+}
+
+float Renderer::getLodScale()
+{
+    // Pixels covered by one object space unit at distance one, over the pixels of error allowed
+    return getPixelsPerUnit() / std::max(s_lodErrorThreshold, 0.01f);
+}
+
+void Renderer::requestTextureSizes()
+{
+    glm::vec3 cameraPosition = GraphicsEngine::get()->getScene()->getCamera()->getPosition();
+    float pixelsPerUnit = getPixelsPerUnit();
+
+    auto requestSize = [this, cameraPosition, pixelsPerUnit](Model* m) {
+        Texture* texture = m->m_texture.get();
+        if (!texture || !texture->isStreamed()) {
+            return;
+        }
+
+        // Assumes the texture spans the model once, so it needs as many texels as the bounding sphere covers pixels
+        const glm::mat4& model = m->ubo.model;
+        glm::vec4 sphere = m->m_mesh->getBoundingSphere();
+        float scale = std::max({ glm::length(glm::vec3(model[0])), glm::length(glm::vec3(model[1])), glm::length(glm::vec3(model[2])) });
+        glm::vec3 center = glm::vec3(model * glm::vec4(glm::vec3(sphere), 1.0f));
+        float radius = sphere.w * scale;
+        float distance = std::max(glm::length(center - cameraPosition) - radius, 0.01f);
+        m_textureStreamer->requestSize(texture, 2.0f * radius * pixelsPerUnit / distance);
+    };
+
+    // The GPU-driven path reads back what the culling pass measured for the visible objects when this frame's
+    // context was last used, a few frames ago; one lookup per texture, the models are not visited
+    if (m_gpuCulling) {
+        StorageBufferPtr textureSizes = m_textureSizeBuffers[m_currentFrame];
+        textureSizes->invalidate();
+        const float* sizes = static_cast<const float*>(textureSizes->getMappedMemory());
+        ObjectBufferPtr objectBuffer = GraphicsEngine::get()->getScene()->getSceneObjectManager()->getObjectBuffer();
+        for (const auto& [texture, users] : objectBuffer->getTextureUsers()) {
+            if (texture->isStreamed() && sizes[users.textureIndex] > 0.0f) {
+                m_textureStreamer->requestSize(texture, sizes[users.textureIndex]);
+            }
+        }
+    }
+    else {
+        for (const InstanceDraw& draw : m_instanceDraws) {
+            requestSize(draw.model);
+        }
+    }
+}
+
+uint32_t Renderer::selectLod(const Mesh* mesh, float distance, float scale, float lodScale)
+{
+    // distance is to the bounding sphere, so a camera inside it always gets the full resolution level
+    uint32_t lod = 0;
+    for (uint32_t i = 1; i < mesh->getLodCount(); i++) {
+        if (mesh->getLod(i).error * scale * lodScale <= distance) {
+            lod = i;
+        }
+    }
+    return lod;
+}
+
+void Renderer::recordCullingPass(VkCommandBuffer commandBuffer)
+{
+    ObjectBufferPtr objectBuffer = GraphicsEngine::get()->getScene()->getSceneObjectManager()->getObjectBuffer();
+    objectBuffer->recordUpload(commandBuffer, *m_frames[m_currentFrame]);
+
+    CullConstants constants{};
+    CameraPtr camera = GraphicsEngine::get()->getScene()->getCamera();
+    std::array<glm::vec4, 6> planes = camera->getFrustumPlanes();
+    std::copy(planes.begin(), planes.end(), constants.frustumPlanes);
+    constants.cameraPosition = glm::vec4(camera->getPosition(), 1.0f);
+    constants.lodScale = getLodScale();
+    constants.objectCount = objectBuffer->getSlotCount();
+    constants.pixelsPerUnit = getPixelsPerUnit();
+
+    // Read on the CPU after the previous use of this frame's context, so it is cleared for this one
+    VkBuffer textureSizes = m_textureSizeBuffers[m_currentFrame]->get();
+    vkCmdFillBuffer(commandBuffer, textureSizes, 0, VK_WHOLE_SIZE, 0);
+    VkMemoryBarrier clearBarrier{};
+    clearBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    clearBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    clearBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+        0, 1, &clearBarrier, 0, nullptr, 0, nullptr);
+
+    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_cullPipeline->pipeline);
+    vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_cullPipeline->layout,
+        0, 1, &m_cullDescriptorSet, 0, nullptr);
+    vkCmdPushConstants(commandBuffer, m_cullPipeline->layout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(CullConstants), &constants);
+    vkCmdDispatch(commandBuffer, (constants.objectCount + 63) / 64, 1, 1);
+
+    // The culled instances and counts are consumed by the indirect draws and the vertex shader, the texture sizes
+    // by the CPU once the frame's fence has signalled
+    VkMemoryBarrier barrier{};
+    barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+    barrier.dstAccessMask = VK_ACCESS_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_HOST_READ_BIT;
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+        VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_VERTEX_SHADER_BIT | VK_PIPELINE_STAGE_HOST_BIT, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+}
+
+void Renderer::recordViewportAndScissor(VkCommandBuffer commandBuffer)
+{
     VkViewport viewport{};
     viewport.x = 0.0f;
     viewport.y = 0.0f;
@@ -236,52 +799,176 @@ void Renderer::recordCommandBuffer(VkCommandBuffer commandBuffer, uint32_t image
     scissor.offset = { 0, 0 };
     scissor.extent = m_swapChain->getSwapChainExtent();
     vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
-    if (m_modelDraws.size() > 0) {
-        m_currentDescriptorSets[0] = GraphicsEngine::get()->getScene()->m_globalDescriptorSets[m_currentFrame];
+}
 
-        std::ranges::for_each(m_modelDraws, [&](auto m) {
-            m_currentDescriptorSets[1] = m->m_descriptorSets[GraphicsEngine::get()->getRenderer()->getCurrentFrame()];
+void Renderer::recordModelDraws(VkCommandBuffer commandBuffer, uint32_t firstGroup, uint32_t lastGroup)
+{
+    if (firstGroup >= lastGroup) {
+        return;
+    }
 
-            m->m_mesh->m_vertexBuffer->bind();
-            if (m->m_mesh->m_hasIndexBuffer) {
-                m->m_mesh->m_indexBuffer->bind();
-            }
+    // Only read here, so chunks can be recorded concurrently; the sets are filled in by recordCommandBuffer
+    Pipeline* boundPipeline = nullptr;
+    Mesh* boundMesh = nullptr;
 
-            if (m->m_texture) {
-                m_currentDescriptorSets[2] = m->m_texture->m_descriptorSets[GraphicsEngine::get()->getRenderer()->getCurrentFrame()];
-            }
+    for (uint32_t g = firstGroup; g < lastGroup; g++) {
+        const DrawGroup& group = m_drawGroups[g];
 
-            vkCmdBindDescriptorSets(m_commandBuffers[m_currentFrame], VK_PIPELINE_BIND_POINT_GRAPHICS, m_graphicsPipeline->layout,
+        if (group.pipeline != boundPipeline) {
+            vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, group.pipeline->pipeline);
+            vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, group.pipeline->layout,
                 0, static_cast<uint32_t>(sizeof(m_currentDescriptorSets) / sizeof(m_currentDescriptorSets[0])), m_currentDescriptorSets, 0, nullptr);
+            boundPipeline = group.pipeline;
+        }
 
-            if (m->m_mesh->m_hasIndexBuffer) {
-                vkCmdDrawIndexed(GraphicsEngine::get()->getRenderer()->getCurrentCommandBuffer(),
-                    static_cast<uint32_t>(m->m_mesh->getIndicesSize()), 1, 0, 0, 0);
+        if (group.mesh != boundMesh) {
+            if (group.mesh->getVertexFormat() == VertexFormat::Packed) {
+                vkCmdPushConstants(commandBuffer, group.pipeline->layout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(MeshConstants),
+                    &group.mesh->getPackedConstants());
+            }
+            group.mesh->m_vertexBuffer->bind(commandBuffer);
+            if (group.mesh->m_hasIndexBuffer) {
+                group.mesh->m_indexBuffer->bind(commandBuffer);
+            }
+            boundMesh = group.mesh;
+        }
+
+        if (m_gpuCulling && m_drawIndirectCount) {
+            // Every level of the mesh in one call, the culling pass counted up to the coarsest level in use.
+            // One call per mesh rather than per scene, as each mesh binds its own vertex and index buffers.
+            VkDeviceSize offset = m_drawCommands.offset + group.firstCommand * sizeof(VkDrawIndexedIndirectCommand);
+            VkDeviceSize countOffset = m_drawCounts.offset + group.cullGroup * sizeof(uint32_t);
+            if (group.mesh->m_hasIndexBuffer) {
+                vkCmdDrawIndexedIndirectCount(commandBuffer, m_drawCommands.buffer, offset, m_drawCounts.buffer, countOffset,
+                    group.mesh->getLodCount(), sizeof(VkDrawIndexedIndirectCommand));
             }
             else {
-                vkCmdDraw(GraphicsEngine::get()->getRenderer()->getCurrentCommandBuffer(), 3, 1, 0, 0);
+                vkCmdDrawIndirectCount(commandBuffer, m_drawCommands.buffer, offset, m_drawCounts.buffer, countOffset,
+                    group.mesh->getLodCount(), sizeof(VkDrawIndexedIndirectCommand));
             }
-            });
-
-        m_modelDraws.clear();
+        }
+        else if (m_gpuCulling) {
+            // Without drawIndirectCount one draw per level; levels nobody picked draw zero instances
+            for (uint32_t lod = 0; lod < group.mesh->getLodCount(); lod++) {
+                VkDeviceSize offset = m_drawCommands.offset + (group.firstCommand + lod) * sizeof(VkDrawIndexedIndirectCommand);
+                if (group.mesh->m_hasIndexBuffer) {
+                    vkCmdDrawIndexedIndirect(commandBuffer, m_drawCommands.buffer, offset, 1, sizeof(VkDrawIndexedIndirectCommand));
+                }
+                else {
+                    vkCmdDrawIndirect(commandBuffer, m_drawCommands.buffer, offset, 1, sizeof(VkDrawIndexedIndirectCommand));
+                }
+            }
+        }
+        // gl_InstanceIndex starts at firstInstance, which points the group at its slice of the instance buffer
+        else if (group.mesh->m_hasIndexBuffer) {
+            const MeshLod& range = group.mesh->getLod(group.lod);
+            vkCmdDrawIndexed(commandBuffer, range.indexCount, group.instanceCount, range.firstIndex, 0, group.firstInstance);
+        }
+        else {
+            vkCmdDraw(commandBuffer, 3, group.instanceCount, 0, group.firstInstance);
+        }
     }
+}
 
-    if (GraphicsEngine::get()->getScene()->m_pointLights.size()>0) {
-        m_currentGlobalDescriptorSet[0] = m_currentDescriptorSets[0];
+void Renderer::recordPointLights(VkCommandBuffer commandBuffer)
+{
+    if (m_lightGrid->getLightCount() > 0) {
+        m_pointLightDescriptorSets[0] = m_currentDescriptorSets[0];
+        m_pointLightDescriptorSets[1] = m_currentDescriptorSets[3];
 
         vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, m_pointLightPipeline->pipeline);
-        vkCmdBindDescriptorSets(m_commandBuffers[m_currentFrame], VK_PIPELINE_BIND_POINT_GRAPHICS, m_pointLightPipeline->layout,
-            0, 1, m_currentGlobalDescriptorSet, 0, nullptr);
-        vkCmdDraw(commandBuffer, 6, GraphicsEngine::get()->getScene()->m_pointLights.size(), 0, 0);
+        vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, m_pointLightPipeline->layout,
+            0, 2, m_pointLightDescriptorSets, 0, nullptr);
+        vkCmdDraw(commandBuffer, 6, m_lightGrid->getLightCount(), 0, 0);
     }
+}
+
+VkCommandBuffer Renderer::beginSecondaryCommandBuffer(const VkRenderPassBeginInfo& renderPassInfo)
+{
+    // Each worker allocates from its own pool of the frame, so no pool is used by two threads at once
+    VkCommandBuffer commandBuffer = m_frames[m_currentFrame]->allocateSecondaryCommandBuffer(ThreadPool::getCurrentWorkerIndex());
 
+    VkCommandBufferInheritanceInfo inheritanceInfo{};
+    inheritanceInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO;
+    inheritanceInfo.renderPass = renderPassInfo.renderPass;
+    inheritanceInfo.subpass = 0;
+    inheritanceInfo.framebuffer = renderPassInfo.framebuffer;
+
+    VkCommandBufferBeginInfo beginInfo{};
+    beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT | VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT;
+    beginInfo.pInheritanceInfo = &inheritanceInfo;
+    VK_CHECK(vkBeginCommandBuffer(commandBuffer, &beginInfo));
+
+    // Dynamic state is not inherited from the primary command buffer
+    recordViewportAndScissor(commandBuffer);
+    return commandBuffer;
+}
+
+void Renderer::recordParallel(VkCommandBuffer commandBuffer, const VkRenderPassBeginInfo& renderPassInfo)
+{
+    uint32_t groupCount = static_cast<uint32_t>(m_drawGroups.size());
+    // One chunk per thread, as instancing leaves few groups even in large scenes
+    uint32_t threadCount = static_cast<uint32_t>(ThreadPool::get()->getThreadCount()) + 1;
+    uint32_t chunkSize = std::max(s_minRecordChunkSize, (groupCount + threadCount - 1) / threadCount);
+    uint32_t chunkCount = (groupCount + chunkSize - 1) / chunkSize;
+
+    // Chunks keep their draw order in the primary command buffer no matter which thread recorded them
+    m_secondaryCommandBuffers.resize(chunkCount + 1);
+    ThreadPool::get()->parallel_for(0, chunkCount, [this, &renderPassInfo, groupCount, chunkSize](size_t chunk) {
+        uint32_t firstGroup = static_cast<uint32_t>(chunk) * chunkSize;
+        VkCommandBuffer secondary = beginSecondaryCommandBuffer(renderPassInfo);
+        recordModelDraws(secondary, firstGroup, std::min(firstGroup + chunkSize, groupCount));
+        VK_CHECK(vkEndCommandBuffer(secondary));
+        m_secondaryCommandBuffers[chunk] = secondary;
+        }, 1);
+
+    // ImGui has to be recorded on this thread
+    VkCommandBuffer overlay = beginSecondaryCommandBuffer(renderPassInfo);
+    recordPointLights(overlay);
     ImGui::Render();
-    ImGui_ImplVulkan_RenderDrawData(ImGui::GetDrawData(), m_commandBuffers[m_currentFrame], 0);
+    ImGui_ImplVulkan_RenderDrawData(ImGui::GetDrawData(), overlay, m_imguiPipeline->pipeline);
+    VK_CHECK(vkEndCommandBuffer(overlay));
+    m_secondaryCommandBuffers[chunkCount] = overlay;
 
-    vkCmdEndRenderPass(commandBuffer);
+    vkCmdExecuteCommands(commandBuffer, static_cast<uint32_t>(m_secondaryCommandBuffers.size()), m_secondaryCommandBuffers.data());
+}
 
-    if (vkEndCommandBuffer(commandBuffer) != VK_SUCCESS) {
-        throw std::runtime_error("failed to record command buffer!");
+void Renderer::createCullPipeline()
+{
+    m_cullPipeline = std::make_unique<Pipeline>(&GraphicsEngine::get()->getDevice()->get());
+
+    DescriptorLayoutBuilder layoutBuilder;
+    layoutBuilder.addBinding(0, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER);
+    layoutBuilder.addBinding(1, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER);
+    layoutBuilder.addBinding(2, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER);
+    layoutBuilder.addBinding(3, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER);
+    layoutBuilder.addBinding(4, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER);
+    layoutBuilder.addBinding(5, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER);
+    m_cullDescriptorSetLayout = layoutBuilder.build(GraphicsEngine::get()->getDevice()->get(), VK_SHADER_STAGE_COMPUTE_BIT);
+
+    VkPushConstantRange pushConstantRange{};
+    pushConstantRange.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+    pushConstantRange.offset = 0;
+    pushConstantRange.size = sizeof(CullConstants);
+
+    VkPipelineLayoutCreateInfo cull_layout_info = RendererInits::pipelineLayoutCreateInfo();
+    cull_layout_info.setLayoutCount = 1;
+    cull_layout_info.pSetLayouts = &m_cullDescriptorSetLayout;
+    cull_layout_info.pPushConstantRanges = &pushConstantRange;
+    cull_layout_info.pushConstantRangeCount = 1;
+
+    VK_CHECK(vkCreatePipelineLayout(GraphicsEngine::get()->getDevice()->get(), &cull_layout_info, nullptr, &m_cullPipeline->layout));
+
+    VkShaderModule computeShaderModule = compileShader("shaders/cull.comp", shaderc_compute_shader, GraphicsEngine::get()->getDevice()->get());
+    m_cullPipeline->pipeline = computeShaderModule != VK_NULL_HANDLE ?
+        buildComputePipeline(m_cullPipeline->layout, computeShaderModule, GraphicsEngine::get()->getDevice()->get(),
+            GraphicsEngine::get()->getDevice()->getPipelineCache()) : VK_NULL_HANDLE;
+    vkDestroyShaderModule(GraphicsEngine::get()->getDevice()->get(), computeShaderModule, nullptr);
+
+    // Without the culling pipeline the renderer stays on the CPU-driven path
+    if (m_cullPipeline->pipeline == VK_NULL_HANDLE) {
+        m_cullPipeline.reset();
     }
 }
 
@@ -299,17 +986,26 @@ void Renderer::createGraphicsPipeline()
 
     layouts.push_back(m_globalDescriptorSetLayout);
 
-    m_modelDescriptorSetLayout = layoutBuilder.build(GraphicsEngine::get()->getDevice()->get(),
-        VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT);
+    layoutBuilder.clear();
+
+    layoutBuilder.addBinding(0, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER);
+    m_modelDescriptorSetLayout = layoutBuilder.build(GraphicsEngine::get()->getDevice()->get(), VK_SHADER_STAGE_VERTEX_BIT);
 
     layouts.push_back(m_modelDescriptorSetLayout);
 
+    // Owned by the texture table, so it is not destroyed with the other layouts
+    layouts.push_back(m_textureTable->getLayout());
+
     layoutBuilder.clear();
 
-    layoutBuilder.addBinding(0, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER);
-    m_textureDescriptorSetLayout = layoutBuilder.build(GraphicsEngine::get()->getDevice()->get(), VK_SHADER_STAGE_FRAGMENT_BIT);
+    // Point lights, cluster ranges and cluster light indices; the billboards read the lights in the vertex shader
+    layoutBuilder.addBinding(0, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER);
+    layoutBuilder.addBinding(1, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER);
+    layoutBuilder.addBinding(2, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER);
+    m_lightDescriptorSetLayout = layoutBuilder.build(GraphicsEngine::get()->getDevice()->get(),
+        VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT);
 
-    layouts.push_back(m_textureDescriptorSetLayout);
+    layouts.push_back(m_lightDescriptorSetLayout);
 
     VkPipelineLayoutCreateInfo mesh_layout_info = RendererInits::pipelineLayoutCreateInfo();
     mesh_layout_info.setLayoutCount = layouts.size();
@@ -321,11 +1017,33 @@ void Renderer::createGraphicsPipeline()
     VK_CHECK(vkCreatePipelineLayout(GraphicsEngine::get()->getDevice()->get(), &mesh_layout_info, nullptr, &newLayout));
     
     m_graphicsPipeline->layout = newLayout;
+    m_graphicsPipeline->ownsPipeline = false;
+
+    // Same sets plus the dequantization constants; the descriptor sets are rebound whenever the pipeline changes
+    VkPushConstantRange meshConstantsRange{};
+    meshConstantsRange.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+    meshConstantsRange.offset = 0;
+    meshConstantsRange.size = sizeof(MeshConstants);
+    mesh_layout_info.pPushConstantRanges = &meshConstantsRange;
+    mesh_layout_info.pushConstantRangeCount = 1;
+
+    m_packedGraphicsPipeline = std::make_unique<Pipeline>(&GraphicsEngine::get()->getDevice()->get());
+    VK_CHECK(vkCreatePipelineLayout(GraphicsEngine::get()->getDevice()->get(), &mesh_layout_info, nullptr, &m_packedGraphicsPipeline->layout));
+    m_packedGraphicsPipeline->ownsPipeline = false;
+
+    m_graphicsPipeline->pipeline = m_pipelineLibrary->get(getPipelineKey(PipelineKind::Mesh, s_msaaSamples));
+    m_packedGraphicsPipeline->pipeline = m_pipelineLibrary->get(getPipelineKey(PipelineKind::PackedMesh, s_msaaSamples));
+}
 
+VkPipeline Renderer::buildMeshPipeline(VkRenderPass renderPass, VkSampleCountFlagBits samples, VertexFormat vertexFormat)
+{
     PipelineBuilder builder(this);
+    builder.setRenderPass(renderPass);
+    builder.setVertexFormat(vertexFormat);
 
     // Ustaw moduy shaderw
-    VkShaderModule vertShaderModule = compileShader("shaders/shader.vert", shaderc_vertex_shader, GraphicsEngine::get()->getDevice()->get());
+    VkShaderModule vertShaderModule = compileShader(vertexFormat == VertexFormat::Packed ? "shaders/shaderPacked.vert" : "shaders/shader.vert",
+        shaderc_vertex_shader, GraphicsEngine::get()->getDevice()->get());
     VkShaderModule fragShaderModule = compileShader("shaders/shader.frag", shaderc_fragment_shader, GraphicsEngine::get()->getDevice()->get());
     
     builder.setShaders(vertShaderModule, fragShaderModule);
@@ -340,7 +1058,7 @@ void Renderer::createGraphicsPipeline()
     builder.setCullMode(VK_CULL_MODE_BACK_BIT, VK_FRONT_FACE_COUNTER_CLOCKWISE);
 
     // Wycz prbkowanie wielokrotne
-    builder.setMultisampling(s_msaaSamples, 0.2f);
+    builder.setMultisampling(samples, 0.2f);
 
     // Wycz mieszanie kolorw
     builder.disableBlending();
@@ -353,10 +1071,13 @@ void Renderer::createGraphicsPipeline()
     builder.enableDepthtest(true, VK_COMPARE_OP_LESS);
 
     // Zbuduj potok
-    m_graphicsPipeline->pipeline = builder.buildPipeline(m_graphicsPipeline->layout, GraphicsEngine::get()->getDevice()->get());
+    VkPipelineLayout layout = vertexFormat == VertexFormat::Packed ? m_packedGraphicsPipeline->layout : m_graphicsPipeline->layout;
+    VkPipeline pipeline = builder.buildPipeline(layout, GraphicsEngine::get()->getDevice()->get(),
+        GraphicsEngine::get()->getDevice()->getPipelineCache());
 
     vkDestroyShaderModule(GraphicsEngine::get()->getDevice()->get(), vertShaderModule, nullptr);
     vkDestroyShaderModule(GraphicsEngine::get()->getDevice()->get(), fragShaderModule, nullptr);
+    return pipeline;
 }
 
 void Renderer::createPointLightPipeline()
@@ -366,6 +1087,7 @@ void Renderer::createPointLightPipeline()
     std::vector <VkDescriptorSetLayout> layouts;
 
     layouts.push_back(m_globalDescriptorSetLayout);
+    layouts.push_back(m_lightDescriptorSetLayout);
 
     VkPipelineLayoutCreateInfo billboard_layout_info = RendererInits::pipelineLayoutCreateInfo();
     billboard_layout_info.setLayoutCount = layouts.size();
@@ -377,8 +1099,14 @@ void Renderer::createPointLightPipeline()
     VK_CHECK(vkCreatePipelineLayout(GraphicsEngine::get()->getDevice()->get(), &billboard_layout_info, nullptr, &newLayout));
 
     m_pointLightPipeline->layout = newLayout;
+    m_pointLightPipeline->ownsPipeline = false;
+    m_pointLightPipeline->pipeline = m_pipelineLibrary->get(getPipelineKey(PipelineKind::PointLight, s_msaaSamples));
+}
 
+VkPipeline Renderer::buildPointLightPipeline(VkRenderPass renderPass, VkSampleCountFlagBits samples)
+{
     PipelineBuilder builder(this);
+    builder.setRenderPass(renderPass);
 
     // Ustaw moduy shaderw dla billboardw
     VkShaderModule vertShaderModule = compileShader("shaders/pointLight.vert", shaderc_vertex_shader, GraphicsEngine::get()->getDevice()->get());
@@ -396,7 +1124,7 @@ void Renderer::createPointLightPipeline()
     builder.setCullMode(VK_CULL_MODE_NONE, VK_FRONT_FACE_COUNTER_CLOCKWISE);
 
     // Wycz prbkowanie wielokrotne
-    builder.setMultisampling(s_msaaSamples, 0.2f);
+    builder.setMultisampling(samples, 0.2f);
 
     // Wycz mieszanie kolorw
     //builder.disableBlending();
@@ -410,10 +1138,78 @@ void Renderer::createPointLightPipeline()
     builder.enableDepthtest(false, VK_COMPARE_OP_LESS);
 
     // Zbuduj potok
-    m_pointLightPipeline->pipeline = builder.buildPipeline(m_pointLightPipeline->layout, GraphicsEngine::get()->getDevice()->get());
+    VkPipeline pipeline = builder.buildPipeline(m_pointLightPipeline->layout, GraphicsEngine::get()->getDevice()->get(),
+        GraphicsEngine::get()->getDevice()->getPipelineCache());
+
+    vkDestroyShaderModule(GraphicsEngine::get()->getDevice()->get(), vertShaderModule, nullptr);
+    vkDestroyShaderModule(GraphicsEngine::get()->getDevice()->get(), fragShaderModule, nullptr);
+    return pipeline;
+}
+
+void Renderer::createImguiPipeline()
+{
+    m_imguiPipeline = std::make_unique<Pipeline>(&GraphicsEngine::get()->getDevice()->get());
+
+    // Defined like the ImGui backend's layout, which it binds its font descriptor set and pushes its scale and
+    // translation through; identically defined layouts are compatible, so they stay valid with this pipeline bound
+    DescriptorLayoutBuilder layoutBuilder;
+    layoutBuilder.addBinding(0, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER);
+    m_imguiDescriptorSetLayout = layoutBuilder.build(GraphicsEngine::get()->getDevice()->get(), VK_SHADER_STAGE_FRAGMENT_BIT);
+
+    VkPushConstantRange pushConstantRange{};
+    pushConstantRange.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+    pushConstantRange.offset = 0;
+    pushConstantRange.size = sizeof(float) * 4;
+
+    VkPipelineLayoutCreateInfo imgui_layout_info = RendererInits::pipelineLayoutCreateInfo();
+    imgui_layout_info.setLayoutCount = 1;
+    imgui_layout_info.pSetLayouts = &m_imguiDescriptorSetLayout;
+    imgui_layout_info.pPushConstantRanges = &pushConstantRange;
+    imgui_layout_info.pushConstantRangeCount = 1;
+
+    VK_CHECK(vkCreatePipelineLayout(GraphicsEngine::get()->getDevice()->get(), &imgui_layout_info, nullptr, &m_imguiPipeline->layout));
+    m_imguiPipeline->ownsPipeline = false;
+    m_imguiPipeline->pipeline = m_pipelineLibrary->get(getPipelineKey(PipelineKind::Imgui, s_msaaSamples));
+}
+
+VkPipeline Renderer::buildImguiPipeline(VkRenderPass renderPass, VkSampleCountFlagBits samples)
+{
+    PipelineBuilder builder(this);
+    builder.setRenderPass(renderPass);
+
+    VkVertexInputBindingDescription binding{};
+    binding.binding = 0;
+    binding.stride = sizeof(ImDrawVert);
+    binding.inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
+    builder.setVertexInput(binding, {
+        { 0, 0, VK_FORMAT_R32G32_SFLOAT, offsetof(ImDrawVert, pos) },
+        { 1, 0, VK_FORMAT_R32G32_SFLOAT, offsetof(ImDrawVert, uv) },
+        { 2, 0, VK_FORMAT_R8G8B8A8_UNORM, offsetof(ImDrawVert, col) },
+        });
+
+    VkShaderModule vertShaderModule = compileShader("shaders/imgui.vert", shaderc_vertex_shader, GraphicsEngine::get()->getDevice()->get());
+    VkShaderModule fragShaderModule = compileShader("shaders/imgui.frag", shaderc_fragment_shader, GraphicsEngine::get()->getDevice()->get());
+    builder.setShaders(vertShaderModule, fragShaderModule);
+
+    builder.setInputTopology(VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST);
+    builder.setPolygonMode(VK_POLYGON_MODE_FILL);
+    builder.setCullMode(VK_CULL_MODE_NONE, VK_FRONT_FACE_COUNTER_CLOCKWISE);
+    // No sample shading, the backend's own pipeline only sets the sample count
+    builder.setMultisamplingNone();
+    builder.m_multisampling.rasterizationSamples = samples;
+    builder.enableBlendingAlphablend();
+    // The backend's pipeline blends alpha over the destination as well
+    builder.m_colorBlendAttachment.dstAlphaBlendFactor = VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA;
+    builder.setColorAttachmentFormat(m_swapChain->m_swapChainImageFormat);
+    builder.setDepthFormat(GraphicsEngine::get()->getDevice()->findDepthFormat());
+    builder.disableDepthtest();
+
+    VkPipeline pipeline = builder.buildPipeline(m_imguiPipeline->layout, GraphicsEngine::get()->getDevice()->get(),
+        GraphicsEngine::get()->getDevice()->getPipelineCache());
 
     vkDestroyShaderModule(GraphicsEngine::get()->getDevice()->get(), vertShaderModule, nullptr);
     vkDestroyShaderModule(GraphicsEngine::get()->getDevice()->get(), fragShaderModule, nullptr);
+    return pipeline;
 }
 
 void Renderer::initImgui()
@@ -452,7 +1248,7 @@ void Renderer::initImgui()
     info.Device = GraphicsEngine::get()->getDevice()->get();
     info.QueueFamily = GraphicsEngine::get()->getDevice()->findQueueFamilies(GraphicsEngine::get()->getDevice()->getPhysicalDevice()).graphicsFamily.value();
     info.Queue = GraphicsEngine::get()->getDevice()->getGraphicsQueue();
-    info.PipelineCache = VK_NULL_HANDLE;
+    info.PipelineCache = GraphicsEngine::get()->getDevice()->getPipelineCache();
     info.DescriptorPool = m_imguiPool;
     info.MinAllocationSize = 1024 * 1024;
     info.Allocator = nullptr;
@@ -467,5 +1263,5 @@ void Renderer::initImgui()
 
     ImGui_ImplVulkan_CreateFontsTexture();
 
-    vkDeviceWaitIdle(GraphicsEngine::get()->getDevice()->get());
+    GraphicsEngine::get()->getDevice()->waitIdle();
 }
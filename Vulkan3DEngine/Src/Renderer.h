@@ -5,6 +5,12 @@
 #include "SwapChain.h"
 #include "PipelineBuilder.h"
 #include "Descriptors.h"
+#include "Buffer.h"
+#include "FrameContext.h"
+#include "PipelineLibrary.h"
+
+#include <deque>
+#include <mutex>
 
 class Renderer
 {
@@ -14,9 +20,12 @@ public:
 
 	//Tworzenie zasobw przenie do osobnej klasy
 	StagingBufferPtr createStagingBuffer(VkDeviceSize bufferSize);
-	VertexBufferPtr createVertexBuffer(std::vector<Vertex> vertices);
-	IndexBufferPtr createIndexBuffer(std::vector<uint32_t> indices);
+	VertexBufferPtr createVertexBuffer(const std::vector<Vertex>& vertices);
+	VertexBufferPtr createVertexBuffer(const void* vertices, VkDeviceSize bufferSize);
+	IndexBufferPtr createIndexBuffer(const std::vector<uint32_t>& indices);
+	IndexBufferPtr createIndexBuffer(const uint32_t* indices, size_t count);
 	UniformBufferPtr createUniformBuffer(VkDeviceSize deviceSize);
+	StorageBufferPtr createStorageBuffer(VkDeviceSize deviceSize, VkBufferUsageFlags extraUsage = 0, MemoryUsage memoryUsage = MemoryUsage::Dynamic);
 	ImagePtr createImage(uint32_t width, uint32_t height, uint32_t mipLevels, VkSampleCountFlagBits numSamples, VkFormat format, VkImageTiling tiling,
 		VkImageUsageFlags usage, VkMemoryPropertyFlags properties);
 
@@ -26,10 +35,31 @@ public:
 	void drawModel(Model* model);
 	void bindDescriptorSet(VkDescriptorSet set, int position);
 
-	VkCommandBuffer getCurrentCommandBuffer() { return m_commandBuffers[m_currentFrame]; }
+	VkCommandBuffer getCurrentCommandBuffer();
 	const uint32_t getCurrentFrame() { return m_currentFrame; }
 
 	void recreatePipelines();
+
+	// Starts compiling the pipeline variants for the sample count; the switch happens in applyPendingMsaaSamples
+	void requestMsaaSamples(VkSampleCountFlagBits samples);
+	// Switches to the requested sample count once its variants are compiled; true when it switched
+	bool applyPendingMsaaSamples();
+
+	// False when the device lacks drawIndirectFirstInstance or the culling shader failed to build
+	bool isGpuDrivenRenderingSupported() const { return m_cullPipeline != nullptr; }
+
+	// Statistics of the last recorded frame
+	uint32_t getDrawCallCount() const { return m_drawCallCount; }
+	uint32_t getInstanceCount() const { return m_instanceCount; }
+	uint32_t getVisibleCount() const { return m_visibleCount; }
+	uint32_t getCulledCount() const { return m_culledCount; }
+	bool isGpuCullingActive() const { return m_gpuCulling; }
+	TextureTablePtr getTextureTable() { return m_textureTable; }
+	TextureStreamerPtr getTextureStreamer() { return m_textureStreamer; }
+	LightGridPtr getLightGrid() { return m_lightGrid; }
+	// Keeps resources, e.g. the buffers of a destroyed mesh, alive until every frame in flight that could still
+	// use them has retired; any thread
+	void retire(std::shared_ptr<void> resources);
 	void recreateImgui();
 
 	//Settings
@@ -37,35 +67,142 @@ public:
 	static VkSampleCountFlagBits s_msaaSamples;
 	static const int s_maxFramesInFlight = 3;
 	static int s_framesInFlight;
+	static bool s_gpuDrivenRendering;
+	static int s_parallelRecordThreshold; // draw groups above which they are recorded in parallel, 0 records everything on the calling thread
+	static float s_lodErrorThreshold; // pixels a mesh level of detail may deviate from the full resolution mesh on screen
 
 	VkDescriptorSetLayout m_globalDescriptorSetLayout;
-	VkDescriptorSetLayout m_textureDescriptorSetLayout;
 	VkDescriptorSetLayout m_modelDescriptorSetLayout;
+	VkDescriptorSetLayout m_lightDescriptorSetLayout; // set 3 of the mesh pipelines, see LightGrid
 private:
-	//Command Buffer // To separate class later?
-	void createCommandBuffers();
 	void recordCommandBuffer(VkCommandBuffer commandBuffer, uint32_t imageIndex);
 
 	void createGraphicsPipeline();
 	void createPointLightPipeline();
+	// ImGui draws inside the main render pass, so its pipeline is a variant per sample count like the others
+	void createImguiPipeline();
+	// Variant builders for the pipeline library, run on worker threads
+	VkPipeline buildMeshPipeline(VkRenderPass renderPass, VkSampleCountFlagBits samples, VertexFormat vertexFormat);
+	VkPipeline buildPointLightPipeline(VkRenderPass renderPass, VkSampleCountFlagBits samples);
+	VkPipeline buildImguiPipeline(VkRenderPass renderPass, VkSampleCountFlagBits samples);
+	PipelineKey getPipelineKey(PipelineKind kind, VkSampleCountFlagBits samples);
+
+	// Pixels covered by one world space unit at distance one
+	float getPixelsPerUnit();
+	// A level of detail is used while error * scale * lodScale <= distance, see selectLod
+	float getLodScale();
+	// Coarsest level of the mesh whose error projects below s_lodErrorThreshold, matches the selection in cull.comp
+	static uint32_t selectLod(const Mesh* mesh, float distance, float scale, float lodScale);
+	void prewarmPipelines();
+
+	void createCullPipeline();
+
+	// Bins the scene's point lights into the LightGrid, before prepareModelDraws reserves the transient memory
+	void prepareLights();
+	bool prepareModelDraws();
+	// GPU-driven path of prepareModelDraws, works per mesh of the SceneObjectManager's ObjectBuffer
+	bool prepareGpuDrivenDraws();
+	void cullModelDraws();
+	// Reports the screen space size of every drawn texture to the TextureStreamer
+	void requestTextureSizes();
+	void recordCullingPass(VkCommandBuffer commandBuffer);
+	void recordModelDraws(VkCommandBuffer commandBuffer, uint32_t firstGroup, uint32_t lastGroup);
+	void recordPointLights(VkCommandBuffer commandBuffer);
+	void recordViewportAndScissor(VkCommandBuffer commandBuffer);
+
+	VkCommandBuffer beginSecondaryCommandBuffer(const VkRenderPassBeginInfo& renderPassInfo);
+	// Splits the draw groups evenly over the workers and the calling thread, one secondary command buffer each
+	void recordParallel(VkCommandBuffer commandBuffer, const VkRenderPassBeginInfo& renderPassInfo);
 
 	void initImgui();
+	// Frees the retired resources no frame in flight can use anymore, after the frame's fence
+	void releaseRetired();
 	
 	
 	SwapChainPtr m_swapChain;
+	TextureTablePtr m_textureTable;
+	TextureStreamerPtr m_textureStreamer;
+	LightGridPtr m_lightGrid;
+	PipelineLibraryPtr m_pipelineLibrary;
 	PipelinePtr m_graphicsPipeline;
+	PipelinePtr m_packedGraphicsPipeline; // meshes with VertexFormat::Packed
 	PipelinePtr m_pointLightPipeline;
+	PipelinePtr m_imguiPipeline; // bound in place of the ImGui backend's own, which is built for one sample count
+	VkDescriptorSetLayout m_imguiDescriptorSetLayout = VK_NULL_HANDLE;
+	VkSampleCountFlagBits m_pendingMsaaSamples = VK_SAMPLE_COUNT_1_BIT;
 	DescriptorAllocatorGrowablePtr m_descriptorAllocator;
 
-	//Command Buffer // To separate class later?
-	std::vector<VkCommandBuffer> m_commandBuffers;
+	// Command buffers, descriptor sets and per-frame data of each frame in flight
+	std::vector<FrameContextPtr> m_frames;
+	std::vector<VkCommandBuffer> m_secondaryCommandBuffers;
 
 	std::vector<Model*> m_modelDraws;
 
+	// CPU-driven path: models sharing a pipeline, mesh and level of detail are drawn with one instanced call,
+	// the texture is picked per instance
+	struct InstanceDraw {
+		Pipeline* pipeline;
+		Mesh* mesh;
+		Model* model;
+		uint32_t lod; // picked by cullModelDraws
+	};
+	std::vector<InstanceDraw> m_instanceDraws;
+
+	// World space bounds of m_instanceDraws, one array per component, padded to a multiple of four for the SIMD frustum test
+	struct PackedBounds {
+		std::vector<float> centerX, centerY, centerZ;
+		std::vector<float> extentX, extentY, extentZ;
+		std::vector<float> radius;
+		std::vector<float> scale; // largest axis scale, for the level of detail selection of the survivors
+	};
+	PackedBounds m_packedBounds;
+
+	struct DrawGroup {
+		Pipeline* pipeline;
+		Mesh* mesh;
+		uint32_t lod;
+		uint32_t firstInstance; // GPU-driven path: start of the mesh's slice of the culled instance buffer
+		uint32_t instanceCount; // GPU-driven path: models of the mesh, the slice size of each level
+		uint32_t firstCommand;  // GPU-driven path: one indirect command per level of detail of the mesh
+		uint32_t cullGroup;     // GPU-driven path: the mesh's CullGroup and draw count
+	};
+	std::vector<DrawGroup> m_drawGroups;
+
+	// ModelUBO array indexed by gl_InstanceIndex, in the frame's transient arena and bound as descriptor set 1
+	VkDescriptorSet m_instanceDescriptorSet = VK_NULL_HANDLE;
+
+	// GPU-driven path: a compute pass frustum culls the ObjectBuffer into m_visibleBuffers, picks the level
+	// of detail of every survivor and counts it into the indirect command of its mesh and level
+	PipelinePtr m_cullPipeline;
+	VkDescriptorSetLayout m_cullDescriptorSetLayout = VK_NULL_HANDLE;
+	std::vector<StorageBufferPtr> m_visibleBuffers; // per frame in flight, written only by the GPU
+	TransientAllocation m_drawCommands;
+	TransientAllocation m_drawCounts; // per CullGroup, the levels to draw; only read with m_drawIndirectCount
+	uint32_t m_drawCommandCount = 0;
+	bool m_drawIndirectCount = false; // one vkCmdDrawIndexedIndirectCount per mesh instead of one draw per level
+	// Per frame in flight, the screen size of every texture slot written by the culling pass, read after the frame's fence
+	std::vector<StorageBufferPtr> m_textureSizeBuffers;
+	VkDescriptorSet m_cullDescriptorSet = VK_NULL_HANDLE;
+	VkDescriptorSet m_visibleDescriptorSet = VK_NULL_HANDLE;
+	bool m_gpuCulling = false; // mode of the frame being recorded, switched after a frame so the scene draw and the recording agree
+
+	uint32_t m_drawCallCount = 0;
+	uint32_t m_instanceCount = 0;
+	uint32_t m_visibleCount = 0;
+	uint32_t m_culledCount = 0;
+
 	VkDescriptorPool m_imguiPool;
 
-	VkDescriptorSet m_currentDescriptorSets[3];
-	VkDescriptorSet m_currentGlobalDescriptorSet[1];
+	VkDescriptorSet m_currentDescriptorSets[4];
+	VkDescriptorSet m_pointLightDescriptorSets[2]; // global and light sets of the billboard pipeline
+
+	struct RetiredResources {
+		uint64_t frame;
+		std::shared_ptr<void> resources;
+	};
+	std::mutex m_retiredMutex; // resources are retired by the loading threads as well
+	std::deque<RetiredResources> m_retiredResources; // in retire order, so the oldest is freed first
+	uint64_t m_frameNumber = 0;
 
 	uint32_t m_currentFrame = 0;
 	uint32_t m_currentImageIndex;
@@ -78,6 +215,7 @@ private:
 	friend struct VertexBuffer;
 	friend struct IndexBuffer;
 	friend struct UniformBuffer;
+	friend struct StorageBuffer;
 	friend struct Image;
 	friend class ImageView;
 	friend struct DepthBuffer;
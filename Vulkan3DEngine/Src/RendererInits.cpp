@@ -40,7 +40,7 @@ VkImageViewCreateInfo RendererInits::imageviewCreateInfo(VkImage image, VkFormat
     return viewInfo;
 }
 
-VkSamplerCreateInfo RendererInits::samplerCreateInfo(uint32_t mipLevels, VkPhysicalDevice physicalDevice )
+VkSamplerCreateInfo RendererInits::samplerCreateInfo(VkPhysicalDevice physicalDevice)
 {
     VkPhysicalDeviceProperties properties{};
     vkGetPhysicalDeviceProperties(physicalDevice, &properties);
@@ -60,7 +60,7 @@ VkSamplerCreateInfo RendererInits::samplerCreateInfo(uint32_t mipLevels, VkPhysi
     samplerInfo.compareOp = VK_COMPARE_OP_ALWAYS;
     samplerInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_LINEAR;
     samplerInfo.minLod = 0.0f; // Optional
-    samplerInfo.maxLod = static_cast<float>(mipLevels);
+    samplerInfo.maxLod = VK_LOD_CLAMP_NONE;
     samplerInfo.mipLodBias = 0.0f; // Optional
 
     return samplerInfo;
@@ -7,7 +7,8 @@ namespace RendererInits {
 
 	VkImageViewCreateInfo imageviewCreateInfo(VkImage image, VkFormat format, VkImageAspectFlags aspectFlags, uint32_t mipLevels);
 
-	VkSamplerCreateInfo samplerCreateInfo(uint32_t mipLevels, VkPhysicalDevice physicalDevice);
+	// No upper LOD clamp, one sampler serves any number of mip levels
+	VkSamplerCreateInfo samplerCreateInfo(VkPhysicalDevice physicalDevice);
 
 	VkPipelineLayoutCreateInfo pipelineLayoutCreateInfo();
 
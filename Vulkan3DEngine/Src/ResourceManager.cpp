@@ -208,7 +208,7 @@ void ResourceManager::reloadAllResources()
     }
 
     for (auto& future : futures) {
-        future.get();
+        ThreadPool::get()->wait(future);
     }
 }
 
@@ -0,0 +1,72 @@
+#include "SamplerCache.h"
+#include "Device.h"
+#include "RendererInits.h"
+#include "PipelineCache.h"
+
+#include <bit>
+
+SamplerCache::SamplerCache(Device* device) : m_device(device)
+{
+    m_defaultSampler = getSampler(RendererInits::samplerCreateInfo(m_device->getPhysicalDevice()));
+}
+
+SamplerCache::~SamplerCache()
+{
+    for (auto& [key, sampler] : m_samplers) {
+        vkDestroySampler(m_device->get(), sampler, nullptr);
+    }
+}
+
+VkSampler SamplerCache::getSampler(const VkSamplerCreateInfo& info)
+{
+    if (info.pNext) {
+        throw std::runtime_error("failed to create sampler, extension structures are not supported by the sampler cache!");
+    }
+
+    Key key = makeKey(info);
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto it = m_samplers.find(key);
+    if (it != m_samplers.end()) {
+        return it->second;
+    }
+
+    VkSampler sampler;
+    if (vkCreateSampler(m_device->get(), &info, nullptr, &sampler) != VK_SUCCESS) {
+        throw std::runtime_error("failed to create texture sampler!");
+    }
+    m_samplers.emplace(key, sampler);
+    return sampler;
+}
+
+uint32_t SamplerCache::getSamplerCount()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return static_cast<uint32_t>(m_samplers.size());
+}
+
+size_t SamplerCache::KeyHash::operator()(const Key& key) const
+{
+    return static_cast<size_t>(hashBytes(key.data(), key.size() * sizeof(uint32_t)));
+}
+
+SamplerCache::Key SamplerCache::makeKey(const VkSamplerCreateInfo& info)
+{
+    return {
+        info.flags,
+        static_cast<uint32_t>(info.magFilter),
+        static_cast<uint32_t>(info.minFilter),
+        static_cast<uint32_t>(info.mipmapMode),
+        static_cast<uint32_t>(info.addressModeU),
+        static_cast<uint32_t>(info.addressModeV),
+        static_cast<uint32_t>(info.addressModeW),
+        std::bit_cast<uint32_t>(info.mipLodBias),
+        info.anisotropyEnable,
+        std::bit_cast<uint32_t>(info.anisotropyEnable ? info.maxAnisotropy : 0.0f),
+        info.compareEnable,
+        static_cast<uint32_t>(info.compareEnable ? info.compareOp : VK_COMPARE_OP_NEVER),
+        std::bit_cast<uint32_t>(info.minLod),
+        std::bit_cast<uint32_t>(info.maxLod),
+        static_cast<uint32_t>(info.borderColor),
+        info.unnormalizedCoordinates,
+    };
+}
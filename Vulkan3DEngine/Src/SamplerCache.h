@@ -0,0 +1,35 @@
+#pragma once
+#include "Prerequisites.h"
+
+#include <unordered_map>
+#include <array>
+#include <mutex>
+
+// One VkSampler per distinct sampling state, shared by everything that samples with it. Samplers are few and
+// long lived, and maxSamplerAllocationCount can be as low as 4000, so none is destroyed before the device.
+class SamplerCache
+{
+public:
+    SamplerCache(Device* device);
+    ~SamplerCache();
+
+    // Only the fields of VkSamplerCreateInfo itself are part of the key, so pNext must be null
+    VkSampler getSampler(const VkSamplerCreateInfo& info);
+    // Trilinear, anisotropic, repeating, and clamped to no mip count, so it suits textures with any number of levels
+    VkSampler getDefaultSampler() { return m_defaultSampler; }
+
+    uint32_t getSamplerCount();
+
+private:
+    // Every field as 32 bits, so the key hashes and compares without padding
+    using Key = std::array<uint32_t, 16>;
+    struct KeyHash {
+        size_t operator()(const Key& key) const;
+    };
+    static Key makeKey(const VkSamplerCreateInfo& info);
+
+    Device* m_device;
+    std::mutex m_mutex;
+    std::unordered_map<Key, VkSampler, KeyHash> m_samplers;
+    VkSampler m_defaultSampler = VK_NULL_HANDLE;
+};
@@ -63,26 +63,16 @@ void Scene::update()
     ubo = GlobalUBO{};
 
     ubo.ambientCoefficient = m_ambientCoefficient;
+    // Keeps the look textures had with MSAA on, when they were sampled through a UNORM format
+    ubo.rawTextureColor = Renderer::s_msaaSamples != VK_SAMPLE_COUNT_1_BIT;
     
     m_sceneObjectManager->updateObjects();
 
     //Update uniform buffer
+    // The point lights are binned into the renderer's LightGrid when the frame is recorded
 
-    auto distanceToCamera = [&](PointLightPtr light1, PointLightPtr light2) {
-        float distance1 = glm::distance(light1->position, m_camera->getPosition());
-        float distance2 = glm::distance(light2->position, m_camera->getPosition());
-        return distance1 > distance2;
-        };
-
-    std::sort(m_pointLights.begin(), m_pointLights.end(), distanceToCamera);
-
-    
     ubo.directionalLight = m_light;
-    for (int i = 0; i < m_pointLights.size(); i++) {
-        ubo.pointLights[i] = *m_pointLights[i];
-        ubo.activePointLightCount = m_pointLights.size();
-    }
-    
+
     memcpy(m_uniformBuffers[GraphicsEngine::get()->getRenderer()->getCurrentFrame()]->getMappedMemory(), &ubo, sizeof(ubo));
 }
 
@@ -116,7 +106,7 @@ void Scene::loadScene(const std::string& filename)
 {
     std::filesystem::path filePath = m_scenesDirectory / filename;
     std::ifstream file(filePath);
-    vkDeviceWaitIdle(GraphicsEngine::get()->getDevice()->get());
+    GraphicsEngine::get()->getDevice()->waitIdle();
     if (file.is_open())
     {
         nlohmann::json j;
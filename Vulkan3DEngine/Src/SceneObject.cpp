@@ -1 +1,11 @@
 #include "SceneObject.h"
+#include "Scene.h"
+#include "SceneObjectManager.h"
+
+void SceneObject::markChanged()
+{
+    if (!m_changed) {
+        m_changed = true;
+        p_scene->getSceneObjectManager()->queueUpdate(this);
+    }
+}
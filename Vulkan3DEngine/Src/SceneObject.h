@@ -22,11 +22,13 @@ public:
     // Move the object relative to its current position
     void move(float dx, float dy, float dz) {
         m_position += glm::vec3(dx, dy, dz);
+        markChanged();
     }
 
     // Rotate the object relative to its current rotation
     void rotate(float pitch, float yaw, float roll) {
         m_rotation += glm::vec3(pitch, yaw, roll);
+        markChanged();
     }
 
     void setName(std::string name) {
@@ -35,22 +37,27 @@ public:
 
     void setPosition(float x, float y, float z) {
         m_position = glm::vec3(x, y, z);
+        markChanged();
     }
 
     void setPosition(glm::vec3 vec) {
         m_position = vec;
+        markChanged();
     }
 
     void setRotation(float pitch, float yaw, float roll) {
         m_rotation = glm::vec3(pitch, yaw, roll);
+        markChanged();
     }
 
     void setRotation(glm::vec3 vec) {
         m_rotation = vec;
+        markChanged();
     }
 
     void setScale(float scale) {
         m_scale = scale;
+        markChanged();
     }
 
     void setStartPosition(float x, float y, float z) {
@@ -73,6 +80,12 @@ public:
         m_startScale = scale;
     }
 
+    // Queues the object for the next scene update, which recomputes its transform and syncs a model's ObjectBuffer
+    // slot; objects that did not change are not visited
+    void markChanged();
+    // Updated in every scene update whether or not anything marked it changed, e.g. while an animation moves it
+    virtual bool updatesEveryFrame() const { return m_animationSequence != nullptr; }
+
     virtual void update() {
         if (m_animationSequence) {
             m_animationSequence->update();
@@ -103,6 +116,7 @@ public:
 
     void setAnimationSequence(std::shared_ptr<AnimationSequence> sequence) {
         m_animationSequence = sequence;
+        markChanged();
     }
 
     bool isActive = true;
@@ -167,6 +181,10 @@ protected:
 
     std::shared_ptr<AnimationSequence> m_animationSequence;
 
+    // A new object starts out changed, it is queued when it is added to the SceneObjectManager
+    bool m_changed = true;
+    bool m_updatesEveryFrame = false; // in the SceneObjectManager's list of objects updated every frame
+
     friend class SceneObjectManager;
 };
 
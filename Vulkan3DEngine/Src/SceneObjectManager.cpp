@@ -6,7 +6,7 @@
 #include <future>
 
 SceneObjectManager::SceneObjectManager(Scene* scene)
-    : p_scene(scene) 
+    : p_scene(scene), m_objectBuffer(std::make_shared<ObjectBuffer>())
 {
 
 }
@@ -14,68 +14,102 @@ SceneObjectManager::SceneObjectManager(Scene* scene)
 std::shared_ptr<Model> SceneObjectManager::createModel(const std::string& modelName)
 {
     ModelPtr model = std::make_shared<Model>(GraphicsEngine::get()->getModelDataManager()->loadModelData(modelName), p_scene);
-    m_objects.push_back(model);
+    trackObject(model);
     return model;
 }
 
 std::shared_ptr<Model> SceneObjectManager::createModel(const std::string name, const std::string meshName, const std::string textureName, const float scale, const float shininess, const float kd, const float ks, const float initialScale, const glm::vec3 initialPosition, const glm::vec3 initialRotation)
 {
     ModelPtr model = std::make_shared<Model>(name, meshName, textureName, scale, shininess, kd, ks, initialScale, initialPosition, initialRotation, p_scene);
-    m_objects.push_back(model);
+    trackObject(model);
     return model;
 }
 
 std::shared_ptr<PointLightObject> SceneObjectManager::createPointLight()
 {
     PointLightObjectPtr light = std::make_shared<PointLightObject>(p_scene);
-    m_objects.push_back(light);
+    trackObject(light);
     return light;
 }
 
 std::shared_ptr<PointLightObject> SceneObjectManager::createPointLight(glm::vec3 color, float intensity)
 {
     PointLightObjectPtr light = std::make_shared<PointLightObject>(color, intensity, p_scene);
-    m_objects.push_back(light);
+    trackObject(light);
     return light;
 }
 
 std::shared_ptr<PointLightObject> SceneObjectManager::createPointLight(float radius, glm::vec3 color, float intensity)
 {
     PointLightObjectPtr light = std::make_shared<PointLightObject>(radius, color, intensity, p_scene);
-    m_objects.push_back(light);
+    trackObject(light);
     return light;
 }
 
 std::shared_ptr<PointLightObject> SceneObjectManager::createPointLight(glm::vec3 position, float radius, glm::vec3 color, float intensity)
 {
     PointLightObjectPtr light = std::make_shared<PointLightObject>(position, radius, color, intensity, p_scene);
-    m_objects.push_back(light);
+    trackObject(light);
     return light;
 }
 
 std::shared_ptr<Camera> SceneObjectManager::createCamera(glm::vec3 startPosition, float startPitch, float startYaw)
 {
     std::shared_ptr<Camera> camera = std::make_shared<Camera>(startPosition, startPitch, startYaw, p_scene);
-    m_objects.push_back(camera);
+    trackObject(camera);
     return camera;
 }
 
 void SceneObjectManager::updateObjects()
 {
-    auto it = m_objects.begin();
-    while (it != m_objects.end()) {
-        if ((*it)->isActive) {
-            (*it)->update();
-            ++it;
+    for (SceneObject* object : m_removedObjects) {
+        if (Model* model = dynamic_cast<Model*>(object)) {
+            m_objectBuffer->removeModel(model);
         }
-        else {
-            it = m_objects.erase(it);
+        std::erase(m_changedObjects, object);
+        std::erase(m_everyFrameObjects, object);
+        std::erase_if(m_objects, [object](const std::shared_ptr<SceneObject>& o) { return o.get() == object; });
+    }
+    m_removedObjects.clear();
+
+    // Only the objects that changed since the last update are visited, a static scene costs nothing here
+    for (SceneObject* object : m_everyFrameObjects) {
+        object->markChanged();
+    }
+    // By index, an update may queue another object
+    for (size_t i = 0; i < m_changedObjects.size(); i++) {
+        SceneObject* object = m_changedObjects[i];
+        // Setters called by the update itself, e.g. by an animation, do not queue the object again
+        object->update();
+        object->m_changed = false;
+
+        bool everyFrame = object->updatesEveryFrame();
+        if (everyFrame != object->m_updatesEveryFrame) {
+            object->m_updatesEveryFrame = everyFrame;
+            if (everyFrame) {
+                m_everyFrameObjects.push_back(object);
+            }
+            else {
+                std::erase(m_everyFrameObjects, object);
+            }
+        }
+
+        if (Model* model = dynamic_cast<Model*>(object)) {
+            m_objectBuffer->syncModel(model);
         }
     }
+    m_changedObjects.clear();
+
+    // Models whose texture moved to another table slot or finished loading
+    m_objectBuffer->syncTextures();
 }
 
 void SceneObjectManager::drawObjects()
 {
+    // Only models draw anything, and the GPU-driven path reads them from the ObjectBuffer instead
+    if (GraphicsEngine::get()->getRenderer()->isGpuCullingActive()) {
+        return;
+    }
     for (auto& object : m_objects) {
         object->draw();
     }
@@ -83,12 +117,22 @@ void SceneObjectManager::drawObjects()
 
 void SceneObjectManager::removeObject(std::shared_ptr<SceneObject> object)
 {
-    object->isActive = false;
+    if (object->isActive) {
+        object->isActive = false;
+        m_removedObjects.push_back(object.get());
+    }
 }
 
 void SceneObjectManager::addObject(std::shared_ptr<SceneObject> object)
 {
-    m_objects.push_back(object);
+    trackObject(object);
+}
+
+void SceneObjectManager::trackObject(std::shared_ptr<SceneObject> object)
+{
+    object->m_changed = true;
+    m_changedObjects.push_back(object.get());
+    m_objects.push_back(std::move(object));
 }
 
 void SceneObjectManager::resetAllObjects()
@@ -240,9 +284,18 @@ void SceneObjectManager::drawModelSpecificProperties(Model* model)
     if (ImGui::DragFloat3("Position Offset", &positionOffset[0])) model->setPositionOffset(positionOffset);
     if (ImGui::DragFloat3("Rotation Offset", &rotationOffset[0])) model->setRotationOffset(rotationOffset);
     if (ImGui::DragFloat("Scale Offset", &scaleOffset)) model->setScaleOffset(scaleOffset);
-    if (ImGui::DragFloat("Shininess", &shininess)) model->m_shininess = shininess;
-    if (ImGui::DragFloat("Kd", &kd)) model->m_kd = kd;
-    if (ImGui::DragFloat("Ks", &ks)) model->m_ks = ks;
+    if (ImGui::DragFloat("Shininess", &shininess)) {
+        model->m_shininess = shininess;
+        model->markChanged();
+    }
+    if (ImGui::DragFloat("Kd", &kd)) {
+        model->m_kd = kd;
+        model->markChanged();
+    }
+    if (ImGui::DragFloat("Ks", &ks)) {
+        model->m_ks = ks;
+        model->markChanged();
+    }
 
     drawComboBox("Mesh", model->m_mesh->getName().string(), GraphicsEngine::get()->getMeshManager(),
         [model](const std::string& meshName) {
@@ -251,7 +304,7 @@ void SceneObjectManager::drawModelSpecificProperties(Model* model)
                 });
             std::thread([model, futureMesh = std::move(futureMesh)]() mutable {
                 MeshPtr newMesh = futureMesh.get();
-                vkDeviceWaitIdle(GraphicsEngine::get()->getDevice()->get());
+                GraphicsEngine::get()->getDevice()->waitIdle();
                 model->setMesh(newMesh);
                 }).detach();
         });
@@ -263,7 +316,7 @@ void SceneObjectManager::drawModelSpecificProperties(Model* model)
                 });
             std::thread([model, futureTexture = std::move(futureTexture)]() mutable {
                 TexturePtr newTexture = futureTexture.get();
-                vkDeviceWaitIdle(GraphicsEngine::get()->getDevice()->get());
+                GraphicsEngine::get()->getDevice()->waitIdle();
                 model->setTexture(newTexture);
                 }).detach();
         });
@@ -717,7 +770,7 @@ void SceneObjectManager::from_json(const nlohmann::json& j) {
                 }
 
                 if (object) {
-                    m_objects.push_back(object);
+                    trackObject(object);
                 }
             }
         }
@@ -728,9 +781,9 @@ void SceneObjectManager::from_json(const nlohmann::json& j) {
 
     for (auto& future : futures) {
         try {
-            auto object = future.get();
+            auto object = ThreadPool::get()->wait(future);
             if (object) {
-                m_objects.push_back(object);
+                trackObject(object);
             }
         }
         catch (const std::exception& e) {
@@ -6,6 +6,7 @@
 #include "Model.h"
 #include "Camera.h"
 #include "PointLightObject.h"
+#include "ObjectBuffer.h"
 
 class SceneObjectManager
 {
@@ -13,6 +14,8 @@ public:
     SceneObjectManager(Scene* scene);
     ~SceneObjectManager() {}
 
+    ObjectBufferPtr getObjectBuffer() { return m_objectBuffer; }
+
     std::shared_ptr<Model> createModel(const std::string& modelName);
     std::shared_ptr<Model> createModel(const std::string name, const std::string meshName, const std::string textureName,
         const float scale, const float shininess, const float kd, const float ks, const float initialScale,
@@ -31,9 +34,15 @@ public:
 
     void removeObject(std::shared_ptr<SceneObject> object);
     void addObject(std::shared_ptr<SceneObject> object);
+    // Called by SceneObject::markChanged, the object is updated in the next updateObjects
+    void queueUpdate(SceneObject* object) { m_changedObjects.push_back(object); }
 
     void removeAllObjects() {
+        m_objectBuffer->clear();
         m_objects.clear();
+        m_changedObjects.clear();
+        m_everyFrameObjects.clear();
+        m_removedObjects.clear();
     }
 
     void resetAllObjects();
@@ -47,6 +56,9 @@ public:
     void to_json(nlohmann::json& j);
     void from_json(const nlohmann::json& j);
 private:
+    // Adds a new object, queued for its first update
+    void trackObject(std::shared_ptr<SceneObject> object);
+
     void drawManageObjectsTab();
     void drawCreateNewObjectTab();
     void drawObjectCommonProperties(const std::shared_ptr<SceneObject>& object);
@@ -66,5 +78,9 @@ private:
     bool showAnimationSequenceWindow = false;
     Scene* p_scene;
     std::vector<std::shared_ptr<SceneObject>> m_objects;
+    std::vector<SceneObject*> m_changedObjects;
+    std::vector<SceneObject*> m_everyFrameObjects; // see SceneObject::updatesEveryFrame
+    std::vector<SceneObject*> m_removedObjects; // inactive, erased in the next updateObjects
+    ObjectBufferPtr m_objectBuffer; // every model, for the renderer's GPU-driven path
 };
 
@@ -0,0 +1,114 @@
+#include "StagingRing.h"
+#include "StagingBuffer.h"
+#include "GraphicsEngine.h"
+
+StagingRing::StagingRing(Device* device, VkDeviceSize capacity) : m_device(device), m_capacity(capacity)
+{
+    // Owned directly instead of through a StagingBuffer so it can be created and destroyed together with the Device
+    VkBufferCreateInfo bufferInfo{};
+    bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+    bufferInfo.size = capacity;
+    bufferInfo.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+    bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+    VmaAllocationCreateInfo allocInfo{};
+    allocInfo.usage = VMA_MEMORY_USAGE_AUTO_PREFER_HOST;
+    allocInfo.flags = VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT | VMA_ALLOCATION_CREATE_MAPPED_BIT;
+    allocInfo.requiredFlags = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+
+    VmaAllocationInfo allocationInfo{};
+    if (vmaCreateBuffer(m_device->getAllocator(), &bufferInfo, &allocInfo, &m_buffer, &m_allocation, &allocationInfo) != VK_SUCCESS) {
+        throw std::runtime_error("failed to create staging ring buffer!");
+    }
+    m_mapped = allocationInfo.pMappedData;
+}
+
+StagingRing::~StagingRing()
+{
+    vmaDestroyBuffer(m_device->getAllocator(), m_buffer, m_allocation);
+}
+
+StagingSlice StagingRing::allocate(VkDeviceSize size, VkDeviceSize alignment)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+
+        VkDeviceSize offset = (m_head + alignment - 1) & ~(alignment - 1);
+        bool fits;
+        if (m_regions.empty()) {
+            offset = 0;
+            fits = size <= m_capacity;
+        }
+        else if (m_head == m_tail) {
+            // Wrapped around onto the oldest live region, the ring is full
+            fits = false;
+        }
+        else if (m_head > m_tail) {
+            // Free space is [head, capacity) followed by [0, tail)
+            if (offset + size > m_capacity) {
+                offset = 0;
+                fits = size <= m_tail;
+            }
+            else {
+                fits = true;
+            }
+        }
+        else {
+            fits = offset + size <= m_tail;
+        }
+
+        if (fits) {
+            uint64_t regionId = m_firstRegionId + m_regions.size();
+            m_regions.push_back({ offset, offset + size, false });
+            m_head = offset + size;
+
+            StagingSlice slice;
+            slice.buffer = m_buffer;
+            slice.offset = offset;
+            slice.size = size;
+            slice.data = static_cast<char*>(m_mapped) + offset;
+            slice.lease = std::shared_ptr<void>(static_cast<void*>(nullptr), [this, regionId](void*) { release(regionId); });
+            return slice;
+        }
+    }
+
+    // Too large for the ring, or the ring is full of uploads still in flight
+    m_fallbacks++;
+    StagingBufferPtr stagingBuffer = GraphicsEngine::get()->getRenderer()->createStagingBuffer(size);
+
+    StagingSlice slice;
+    slice.buffer = stagingBuffer->get();
+    slice.offset = 0;
+    slice.size = size;
+    slice.data = stagingBuffer->getMappedMemory();
+    slice.lease = stagingBuffer;
+    return slice;
+}
+
+VkDeviceSize StagingRing::getUsed()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_regions.empty()) {
+        return 0;
+    }
+    return m_head > m_tail ? m_head - m_tail : m_capacity - m_tail + m_head;
+}
+
+void StagingRing::release(uint64_t regionId)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    m_regions[regionId - m_firstRegionId].released = true;
+    while (!m_regions.empty() && m_regions.front().released) {
+        m_regions.pop_front();
+        m_firstRegionId++;
+    }
+
+    if (m_regions.empty()) {
+        m_head = 0;
+        m_tail = 0;
+    }
+    else {
+        m_tail = m_regions.front().begin;
+    }
+}
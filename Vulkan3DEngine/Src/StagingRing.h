@@ -0,0 +1,55 @@
+#pragma once
+#include "Prerequisites.h"
+
+#include <deque>
+#include <mutex>
+#include <atomic>
+
+// A slice of persistently mapped upload memory. Write through data, then hand the slice to the
+// UploadQueue; the memory is recycled once every copy of the slice (and thus its lease) is gone.
+struct StagingSlice {
+    VkBuffer buffer = VK_NULL_HANDLE;
+    VkDeviceSize offset = 0;
+    VkDeviceSize size = 0;
+    void* data = nullptr;
+    std::shared_ptr<void> lease;
+};
+
+// Ring allocator over one persistently mapped staging buffer. Slices are released in any order
+// but the space is reclaimed in allocation order, as soon as the oldest live slice retires.
+// Requests that do not fit in the free space fall back to a dedicated StagingBuffer.
+class StagingRing
+{
+public:
+    StagingRing(Device* device, VkDeviceSize capacity);
+    ~StagingRing();
+
+    StagingSlice allocate(VkDeviceSize size, VkDeviceSize alignment = 16);
+
+    VkDeviceSize getCapacity() const { return m_capacity; }
+    VkDeviceSize getUsed();
+    uint64_t getFallbackCount() const { return m_fallbacks; }
+
+private:
+    void release(uint64_t regionId);
+
+    struct Region {
+        VkDeviceSize begin;
+        VkDeviceSize end;
+        bool released;
+    };
+
+    Device* m_device;
+    VkDeviceSize m_capacity;
+    VkBuffer m_buffer = VK_NULL_HANDLE;
+    VmaAllocation m_allocation = VK_NULL_HANDLE;
+    void* m_mapped = nullptr;
+
+    std::mutex m_mutex;
+    std::deque<Region> m_regions; // live regions in allocation order
+    uint64_t m_firstRegionId = 0; // id of m_regions.front()
+    VkDeviceSize m_head = 0;      // next free byte
+    VkDeviceSize m_tail = 0;      // first byte still in use
+
+    std::atomic<uint64_t> m_fallbacks = 0;
+};
@@ -0,0 +1,16 @@
+#include "StorageBuffer.h"
+#include "GraphicsEngine.h"
+
+StorageBuffer::StorageBuffer(VkDeviceSize bufferSize, VkBufferUsageFlags extraUsage, MemoryUsage memoryUsage, Renderer* renderer) : Buffer(renderer)
+{
+    // Dynamic for data the CPU rewrites every frame, GpuOnly for data only shaders write and read
+    createBuffer(bufferSize, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | extraUsage, memoryUsage);
+}
+
+StorageBuffer::~StorageBuffer()
+{
+}
+
+void StorageBuffer::bind()
+{
+}
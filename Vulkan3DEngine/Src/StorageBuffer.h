@@ -0,0 +1,15 @@
+#pragma once
+#include "Prerequisites.h"
+#include "Buffer.h"
+
+struct StorageBuffer : public Buffer
+{
+public:
+	StorageBuffer(VkDeviceSize bufferSize, VkBufferUsageFlags extraUsage, MemoryUsage memoryUsage, Renderer* renderer);
+	~StorageBuffer();
+
+	void bind() override;
+private:
+
+};
+
@@ -4,6 +4,31 @@
 #include "GraphicsEngine.h"
 #include "RendererInits.h"
 
+namespace {
+    // Attachments of the previous sample count, destroyed once no frame in flight renders into them
+    struct RetiredAttachments {
+        std::vector<VkFramebuffer> framebuffers;
+        VkRenderPass renderPass = VK_NULL_HANDLE;
+        ImagePtr colorImage;
+        VkImageView colorImageView = VK_NULL_HANDLE;
+        ImagePtr depthImage;
+        VkImageView depthImageView = VK_NULL_HANDLE;
+
+        ~RetiredAttachments()
+        {
+            VkDevice device = GraphicsEngine::get()->getDevice()->get();
+            for (VkFramebuffer framebuffer : framebuffers) {
+                vkDestroyFramebuffer(device, framebuffer, nullptr);
+            }
+            if (colorImageView) {
+                vkDestroyImageView(device, colorImageView, nullptr);
+            }
+            vkDestroyImageView(device, depthImageView, nullptr);
+            vkDestroyRenderPass(device, renderPass, nullptr);
+        }
+    };
+}
+
 SwapChain::SwapChain(Renderer* renderer) : m_renderer(renderer)
 {
     try {
@@ -105,7 +130,7 @@ void SwapChain::recreateSwapChain()
         glfwWaitEvents();
     }
 
-    vkDeviceWaitIdle(GraphicsEngine::get()->getDevice()->get());
+    GraphicsEngine::get()->getDevice()->waitIdle();
 
     cleanupSwapChain();
 
@@ -124,6 +149,26 @@ void SwapChain::recreateSwapChain()
     }
 }
 
+void SwapChain::recreateMultisampleResources()
+{
+    auto retired = std::make_shared<RetiredAttachments>();
+    retired->framebuffers = std::move(m_swapChainFramebuffers);
+    retired->renderPass = m_renderPass;
+    retired->colorImage = std::move(m_colorImage);
+    retired->colorImageView = m_colorImageView;
+    retired->depthImage = std::move(m_depthImage);
+    retired->depthImageView = m_depthImageView;
+    m_colorImageView = VK_NULL_HANDLE;
+    m_depthImageView = VK_NULL_HANDLE;
+    m_renderer->retire(std::move(retired));
+
+    createRenderPass();
+    createColorResources();
+    createDepthResources();
+    createFramebuffers();
+    fmt::print("Multisample resources recreated\n");
+}
+
 void SwapChain::cleanupSwapChain()
 {
     for (auto framebuffer : m_swapChainFramebuffers) {
@@ -135,6 +180,7 @@ void SwapChain::cleanupSwapChain()
     }
     if (m_colorImageView) {
         vkDestroyImageView(GraphicsEngine::get()->getDevice()->get(), m_colorImageView, nullptr);
+        m_colorImageView = VK_NULL_HANDLE;
     }
     vkDestroyImageView(GraphicsEngine::get()->getDevice()->get(), m_depthImageView, nullptr);
 
@@ -162,11 +208,13 @@ void SwapChain::createImageViews()
 }
 
 void SwapChain::createRenderPass() {
-    VkSampleCountFlagBits msaaSamples = Renderer::s_msaaSamples;
+    m_renderPass = buildRenderPass(m_swapChainImageFormat, GraphicsEngine::get()->getDevice()->findDepthFormat(), Renderer::s_msaaSamples);
+}
 
+VkRenderPass SwapChain::buildRenderPass(VkFormat colorFormat, VkFormat depthFormat, VkSampleCountFlagBits msaaSamples) {
     // Color attachment
     VkAttachmentDescription colorAttachment{};
-    colorAttachment.format = m_swapChainImageFormat;
+    colorAttachment.format = colorFormat;
     colorAttachment.samples = msaaSamples;
     colorAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
     colorAttachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
@@ -177,7 +225,7 @@ void SwapChain::createRenderPass() {
 
     // Depth attachment
     VkAttachmentDescription depthAttachment{};
-    depthAttachment.format = GraphicsEngine::get()->getDevice()->findDepthFormat();
+    depthAttachment.format = depthFormat;
     depthAttachment.samples = msaaSamples;
     depthAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
     depthAttachment.storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
@@ -189,7 +237,7 @@ void SwapChain::createRenderPass() {
     // Resolve attachment
     VkAttachmentDescription colorAttachmentResolve{};
     if (msaaSamples != VK_SAMPLE_COUNT_1_BIT) {
-        colorAttachmentResolve.format = m_swapChainImageFormat;
+        colorAttachmentResolve.format = colorFormat;
         colorAttachmentResolve.samples = VK_SAMPLE_COUNT_1_BIT;
         colorAttachmentResolve.loadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
         colorAttachmentResolve.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
@@ -249,9 +297,11 @@ void SwapChain::createRenderPass() {
     renderPassInfo.dependencyCount = 1;
     renderPassInfo.pDependencies = &dependency;
 
-    if (vkCreateRenderPass(GraphicsEngine::get()->getDevice()->get(), &renderPassInfo, nullptr, &m_renderPass) != VK_SUCCESS) {
+    VkRenderPass renderPass;
+    if (vkCreateRenderPass(GraphicsEngine::get()->getDevice()->get(), &renderPassInfo, nullptr, &renderPass) != VK_SUCCESS) {
         throw std::runtime_error("failed to create render pass!");
     }
+    return renderPass;
 }
 
 void SwapChain::createColorResources()
@@ -289,7 +339,8 @@ void SwapChain::createDepthResources()
         throw std::runtime_error("failed to create swapChain depthImageView!");
     }
 
-    m_depthImage->transitionImageLayout(VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL);
+    // No transition, the render pass clears it from VK_IMAGE_LAYOUT_UNDEFINED; a one-off submit here would wait
+    // for the frames in flight when the attachments are recreated
     fmt::print("Depth resources created\n");
 }
 
@@ -11,7 +11,16 @@ public:
 	VkRenderPass getRenderPass() { return m_renderPass; };
 	std::vector<VkFramebuffer> getSwapChainFramebuffers() { return m_swapChainFramebuffers; };
 	VkExtent2D getSwapChainExtent() { return m_swapChainExtent; };
+	VkFormat getImageFormat() { return m_swapChainImageFormat; };
 	void recreateSwapChain();
+	// Rebuilds what depends on Renderer::s_msaaSamples: the color and depth attachments, the render pass and the
+	// framebuffers. The swap chain stays, and the old objects are retired with the frames in flight instead of
+	// waiting for the device.
+	void recreateMultisampleResources();
+
+	// The main render pass for the given formats and sample count. Pipelines built against it are compatible with
+	// every swap chain render pass of the same formats and sample count; the caller destroys it.
+	static VkRenderPass buildRenderPass(VkFormat colorFormat, VkFormat depthFormat, VkSampleCountFlagBits msaaSamples);
 private:
 	void createSwapChain();
 	void cleanupSwapChain();
@@ -33,10 +42,10 @@ private:
 	VkRenderPass m_renderPass;
 
 	ImagePtr m_depthImage;
-	VkImageView m_depthImageView;
+	VkImageView m_depthImageView = VK_NULL_HANDLE;
 
 	ImagePtr m_colorImage;
-	VkImageView m_colorImageView;
+	VkImageView m_colorImageView = VK_NULL_HANDLE; // only with MSAA
 
 	std::vector<VkFramebuffer> m_swapChainFramebuffers;
 
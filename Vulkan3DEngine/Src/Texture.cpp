@@ -1,113 +1,365 @@
 #include "Texture.h"
 #include "Prerequisites.h"
 #include "GraphicsEngine.h"
-#include "StagingBuffer.h"
 #include "Image.h"
+#include "UploadQueue.h"
 #include "RendererInits.h"
+#include "TextureTable.h"
+#include "TextureFile.h"
+#include "TextureStreamer.h"
+#include "MipGenerator.h"
 
 #define STB_IMAGE_IMPLEMENTATION
 #include <stb_image.h>
 
-bool Texture::m_descriptorAllocatorInitialized = false;
-DescriptorAllocatorGrowable Texture::m_descriptorAllocator;
+#include <chrono>
+#include <limits>
 
-Texture::Texture(const std::filesystem::path& full_path) : Resource(full_path)
+bool Texture::s_cpuMipmaps = true;
+
+// Levels of this size and below load first and stay resident
+static constexpr uint32_t s_tailSize = 64;
+
+// benchmarkMipmaps keeps the best of these, the first run also builds the sRGB tables and warms up the upload queue
+static constexpr uint32_t s_benchmarkRuns = 5;
+
+// The image and view a residency change replaced, destroyed once no frame in flight can sample them
+struct RetiredImage {
+	RetiredImage(ImagePtr image, VkImageView imageView) : image(std::move(image)), imageView(imageView) {}
+	RetiredImage(const RetiredImage&) = delete;
+	RetiredImage& operator=(const RetiredImage&) = delete;
+
+	~RetiredImage()
+	{
+		vkDestroyImageView(GraphicsEngine::get()->getDevice()->get(), imageView, nullptr);
+	}
+
+	ImagePtr image;
+	VkImageView imageView;
+};
+
+Texture::Texture(const std::filesystem::path& full_path) : Resource(full_path), m_textureIndex(TextureTable::s_invalidSlot)
 {
 	Load(full_path);
 }
 
 Texture::~Texture()
 {
-	m_descriptorAllocator.destroyPools(GraphicsEngine::get()->getDevice()->get());
-	m_descriptorSets.clear();
-	vkDestroySampler(GraphicsEngine::get()->getDevice()->get(), m_sampler, nullptr);
-	vkDestroyImageView(GraphicsEngine::get()->getDevice()->get(), m_imageView, nullptr);
-	m_image.reset();
+	GraphicsEngine::get()->getRenderer()->getTextureStreamer()->removeTexture(this);
+	if (m_textureIndex != TextureTable::s_invalidSlot) {
+		// Frames in flight may still sample the image, so it goes with the slot once they have retired
+		GraphicsEngine::get()->getRenderer()->getTextureTable()->releaseTexture(m_textureIndex,
+			std::make_shared<RetiredImage>(std::move(m_image), m_imageView));
+	}
+	else {
+		// Never registered, so no frame can have sampled it
+		vkDestroyImageView(GraphicsEngine::get()->getDevice()->get(), m_imageView, nullptr);
+		m_image.reset();
+	}
 }
 
 void Texture::Load(const std::filesystem::path& full_path)
+{
+	std::lock_guard<std::mutex> lock(m_streamMutex);
+
+	// A Model samples its texture only as the base color in Shader.frag, so every texture is imported as color data
+	TextureFile::Usage usage = TextureFile::Usage::Color;
+	// Sampled through an sRGB format whatever the sample count; Shader.frag keeps the look of the UNORM one with MSAA on
+	bool srgb = usage == TextureFile::Usage::Color;
+
+	if (TextureFile::s_compression != TextureFile::Compression::Off && GraphicsEngine::get()->getDevice()->supportsTextureCompressionBC()) {
+		loadCompressed(full_path, usage, srgb);
+	}
+	else {
+		loadUncompressed(full_path, srgb ? VK_FORMAT_R8G8B8A8_SRGB : VK_FORMAT_R8G8B8A8_UNORM, srgb);
+	}
+
+	// Streamed textures start with their mip tail, the rest is uploaded when it is seen up close
+	bool streamed = TextureStreamer::s_enabled && !m_levels.empty();
+	if (!m_levels.empty()) {
+		m_residentMip = streamed ? getTailMip() : 0;
+		m_image = uploadLevels(m_residentMip, m_uploadFuture);
+	}
+	if (!streamed) {
+		m_residentMip = 0;
+		m_levels.clear();
+		m_pixels = {};
+		m_file.reset();
+	}
+
+	m_imageView = createImageView(m_image);
+
+	// The slot samples with the table's immutable sampler, which clamps to whatever levels the image has
+	// A reload keeps its slot, the device is idle so the old view is no longer sampled
+	if (m_textureIndex == TextureTable::s_invalidSlot) {
+		m_textureIndex = GraphicsEngine::get()->getRenderer()->getTextureTable()->registerTexture(m_imageView);
+	}
+	else {
+		GraphicsEngine::get()->getRenderer()->getTextureTable()->updateTexture(m_textureIndex, m_imageView);
+	}
+
+	if (streamed) {
+		GraphicsEngine::get()->getRenderer()->getTextureStreamer()->addTexture(this);
+	}
+	else {
+		GraphicsEngine::get()->getRenderer()->getTextureStreamer()->removeTexture(this);
+	}
+}
+
+void Texture::loadCompressed(const std::filesystem::path& full_path, TextureFile::Usage usage, bool srgb)
+{
+	std::filesystem::path cachePath = TextureFile::getCachePath(full_path);
+	uint64_t sourceHash = TextureFile::getSourceHash(full_path);
+
+	// Levels come from the mapped file whenever it can be written, so the CPU copy costs address space rather than memory
+	m_file = std::make_unique<TextureFile>();
+	if (m_file->open(cachePath, sourceHash, usage) ||
+		(TextureFile::write(cachePath, TextureFile::importImage(full_path, usage), sourceHash) && m_file->open(cachePath, sourceHash, usage))) {
+		m_width = m_file->getWidth();
+		m_height = m_file->getHeight();
+		m_format = TextureCompressor::getVkFormat(m_file->getFormat(), srgb && m_file->getFormat() != BlockFormat::BC5);
+		for (uint32_t i = 0; i < m_file->getLevelCount(); i++) {
+			m_levels.push_back(m_file->getLevel(i));
+		}
+	}
+	else {
+		m_file.reset();
+		TextureData data = TextureFile::importImage(full_path, usage);
+		m_width = data.width;
+		m_height = data.height;
+		m_format = TextureCompressor::getVkFormat(data.format, srgb && data.format != BlockFormat::BC5);
+		m_pixels = std::move(data.blocks);
+		for (const TextureLevel& level : data.levels) {
+			m_levels.push_back({ m_pixels.data() + level.offset, level.size });
+		}
+	}
+	m_levelCount = static_cast<uint32_t>(m_levels.size());
+}
+
+void Texture::loadUncompressed(const std::filesystem::path& full_path, VkFormat imageFormat, bool srgbContent)
 {
 	int texWidth, texHeight, texChannels;
 	stbi_uc* pixels = stbi_load(full_path.string().c_str(), &texWidth,
 		&texHeight, &texChannels, STBI_rgb_alpha);
-	VkDeviceSize imageSize = texWidth * texHeight * 4;
-	uint32_t mipLevels = static_cast<uint32_t>(std::floor(std::log2(std::max(texWidth, texHeight)))) + 1;
 
 	if (!pixels) {
 		throw std::runtime_error("failed to load texture image!");
 	}
 
-	StagingBufferPtr stagingBuffer = GraphicsEngine::get()->getRenderer()->createStagingBuffer(imageSize);
+	m_width = texWidth;
+	m_height = texHeight;
+	m_format = imageFormat;
+	m_levelCount = MipGenerator::getLevelCount(texWidth, texHeight);
+
+	if (s_cpuMipmaps) {
+		std::vector<size_t> levelOffsets;
+		m_pixels = MipGenerator::generateChain(pixels, texWidth, texHeight, srgbContent, levelOffsets);
+		stbi_image_free(pixels);
+
+		for (size_t i = 0; i < levelOffsets.size(); i++) {
+			size_t end = i + 1 < levelOffsets.size() ? levelOffsets[i + 1] : m_pixels.size();
+			m_levels.push_back({ m_pixels.data() + levelOffsets[i], end - levelOffsets[i] });
+		}
+		return;
+	}
+
+	VkDeviceSize imageSize = texWidth * texHeight * 4;
+
+	StagingSlice staging = GraphicsEngine::get()->getDevice()->getUploadQueue()->allocateStaging(imageSize);
 
-	stagingBuffer->map();
-	memcpy(stagingBuffer->getMappedMemory(), pixels, (size_t)imageSize);
-	stagingBuffer->unmap();
+	memcpy(staging.data, pixels, (size_t)imageSize);
 
 	stbi_image_free(pixels);
 
-	VkFormat imageFormat;
-	if (Renderer::s_msaaSamples == VK_SAMPLE_COUNT_1_BIT) {
-		imageFormat = VK_FORMAT_R8G8B8A8_SRGB;
-	}
-	else {
-		imageFormat = VK_FORMAT_R8G8B8A8_UNORM;
-	}
-	
-	m_image = GraphicsEngine::get()->getRenderer()->createImage(texWidth, texHeight, mipLevels, VK_SAMPLE_COUNT_1_BIT, imageFormat,
+	m_image = GraphicsEngine::get()->getRenderer()->createImage(texWidth, texHeight, m_levelCount, VK_SAMPLE_COUNT_1_BIT, imageFormat,
 		VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT,
 		VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
 
-	m_image->transitionImageLayout(VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
-	stagingBuffer->copyBufferToImage(m_image);
 	//transitioned to VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL while generating mipmaps
-	//m_image->transitionImageLayout(VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+	m_uploadFuture = GraphicsEngine::get()->getDevice()->getUploadQueue()->uploadImage(staging, m_image, true);
+}
 
-	m_image->generateMipmaps();
+ImagePtr Texture::uploadLevels(uint32_t firstMip, std::shared_future<void>& future)
+{
+	VkDeviceSize totalSize = getLevelsSize(firstMip);
+	uint32_t width = std::max(1u, m_width >> firstMip);
+	uint32_t height = std::max(1u, m_height >> firstMip);
 
-	VkImageViewCreateInfo viewInfo = RendererInits::imageviewCreateInfo(m_image->get(), imageFormat, VK_IMAGE_ASPECT_COLOR_BIT, mipLevels);
+	// Every level is a whole number of blocks (or RGBA8 texels), so packing them keeps each copy aligned
+	StagingSlice staging = GraphicsEngine::get()->getDevice()->getUploadQueue()->allocateStaging(totalSize);
+	std::vector<VkBufferImageCopy> regions;
+	VkDeviceSize offset = 0;
+	for (uint32_t i = 0; firstMip + i < m_levels.size(); i++) {
+		const std::span<const uint8_t>& level = m_levels[firstMip + i];
+		memcpy(static_cast<uint8_t*>(staging.data) + offset, level.data(), level.size());
 
-	if (vkCreateImageView(GraphicsEngine::get()->getDevice()->get(), &viewInfo, nullptr, &m_imageView) != VK_SUCCESS) {
-		throw std::runtime_error("failed to create image view!");
+		VkBufferImageCopy region{};
+		region.bufferOffset = offset;
+		region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+		region.imageSubresource.mipLevel = i;
+		region.imageSubresource.layerCount = 1;
+		region.imageExtent = { std::max(1u, width >> i), std::max(1u, height >> i), 1 };
+		regions.push_back(region);
+
+		offset += level.size();
 	}
 
-	VkSamplerCreateInfo samplerInfo = RendererInits::samplerCreateInfo(mipLevels, GraphicsEngine::get()->getDevice()->getPhysicalDevice());
+	// The mips come precomputed, so there is no blit and no need for TRANSFER_SRC
+	ImagePtr image = GraphicsEngine::get()->getRenderer()->createImage(width, height, static_cast<uint32_t>(regions.size()), VK_SAMPLE_COUNT_1_BIT, m_format,
+		VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
 
-	if (vkCreateSampler(GraphicsEngine::get()->getDevice()->get(), &samplerInfo, nullptr, &m_sampler) != VK_SUCCESS) {
-		throw std::runtime_error("failed to create texture sampler!");
+	future = GraphicsEngine::get()->getDevice()->getUploadQueue()->uploadImageLevels(staging, image, std::move(regions));
+	return image;
+}
+
+void Texture::benchmarkMipmaps(const std::filesystem::path& sourcePath)
+{
+	using Clock = std::chrono::high_resolution_clock;
+	auto milliseconds = [](Clock::duration duration) {
+		return std::chrono::duration<double, std::milli>(duration).count();
+	};
+
+	int texWidth, texHeight, texChannels;
+	stbi_uc* pixels = stbi_load(sourcePath.string().c_str(), &texWidth, &texHeight, &texChannels, STBI_rgb_alpha);
+	if (!pixels) {
+		throw std::runtime_error("failed to load texture image!");
 	}
+	uint32_t width = texWidth;
+	uint32_t height = texHeight;
+	uint32_t levelCount = MipGenerator::getLevelCount(width, height);
+	VkDeviceSize imageSize = VkDeviceSize(width) * height * 4;
+
+	RendererPtr renderer = GraphicsEngine::get()->getRenderer();
+	UploadQueuePtr uploadQueue = GraphicsEngine::get()->getDevice()->getUploadQueue();
+	auto createImage = [&](uint32_t mipLevels, VkImageUsageFlags usage) {
+		return renderer->createImage(width, height, mipLevels, VK_SAMPLE_COUNT_1_BIT, VK_FORMAT_R8G8B8A8_SRGB, VK_IMAGE_TILING_OPTIMAL,
+			usage | VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+	};
+
+	double blitTime = std::numeric_limits<double>::max();
+	double copyTime = std::numeric_limits<double>::max();
+	double cpuTime = std::numeric_limits<double>::max();
+	double generateTime = std::numeric_limits<double>::max();
+	for (uint32_t run = 0; run < s_benchmarkRuns; run++) {
+		// GPU: level 0 copied, the rest blitted from it on the graphics queue
+		ImagePtr blitImage = createImage(levelCount, VK_IMAGE_USAGE_TRANSFER_SRC_BIT);
+		auto start = Clock::now();
+		StagingSlice staging = uploadQueue->allocateStaging(imageSize);
+		memcpy(staging.data, pixels, imageSize);
+		uploadQueue->uploadImage(staging, blitImage, true).wait();
+		blitTime = std::min(blitTime, milliseconds(Clock::now() - start));
 
-	if (!m_descriptorAllocatorInitialized) {
-		{
-			m_descriptorAllocator.init(GraphicsEngine::get()->getDevice()->get(), 8000, m_sizes);
-			m_descriptorAllocatorInitialized = true;
+		// Level 0 alone, the copy both paths pay for
+		ImagePtr copyImage = createImage(1, 0);
+		start = Clock::now();
+		staging = uploadQueue->allocateStaging(imageSize);
+		memcpy(staging.data, pixels, imageSize);
+		uploadQueue->uploadImage(staging, copyImage, false).wait();
+		copyTime = std::min(copyTime, milliseconds(Clock::now() - start));
+
+		// CPU: the chain filtered on the pool, every level copied
+		ImagePtr chainImage = createImage(levelCount, 0);
+		start = Clock::now();
+		std::vector<size_t> levelOffsets;
+		std::vector<uint8_t> chain = MipGenerator::generateChain(pixels, width, height, true, levelOffsets);
+		generateTime = std::min(generateTime, milliseconds(Clock::now() - start));
+
+		staging = uploadQueue->allocateStaging(chain.size());
+		memcpy(staging.data, chain.data(), chain.size());
+		std::vector<VkBufferImageCopy> regions(levelCount);
+		for (uint32_t i = 0; i < levelCount; i++) {
+			regions[i].bufferOffset = levelOffsets[i];
+			regions[i].imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+			regions[i].imageSubresource.mipLevel = i;
+			regions[i].imageSubresource.layerCount = 1;
+			regions[i].imageExtent = { std::max(1u, width >> i), std::max(1u, height >> i), 1 };
 		}
+		uploadQueue->uploadImageLevels(staging, chainImage, std::move(regions)).wait();
+		cpuTime = std::min(cpuTime, milliseconds(Clock::now() - start));
 	}
+	stbi_image_free(pixels);
 
-	DescriptorWriter writer;
-	//Initialize uniformBuffers and descriptorSets
-	for (int i = 0; i < Renderer::s_maxFramesInFlight; i++) {
+	fmt::print("{}: {}x{}, {} levels\n", sourcePath.string(), width, height, levelCount);
+	fmt::print("  GPU blit: {:.2f} ms, level 0 upload alone {:.2f} ms\n", blitTime, copyTime);
+	fmt::print("  CPU mips: {:.2f} ms, generateChain {:.2f} ms of it ({:.2f}x the blit)\n", cpuTime, generateTime, cpuTime / blitTime);
+}
 
-		VkDescriptorSet textureDescriptorSets = m_descriptorAllocator.allocate(GraphicsEngine::get()->getDevice()->get(),
-			GraphicsEngine::get()->getRenderer()->m_textureDescriptorSetLayout);
+VkImageView Texture::createImageView(const ImagePtr& image)
+{
+	VkImageViewCreateInfo viewInfo = RendererInits::imageviewCreateInfo(image->get(), image->getFormat(), VK_IMAGE_ASPECT_COLOR_BIT, image->getMipLevels());
 
-		writer.writeImage(0, m_imageView, m_sampler, m_image->getLayout(), VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER);
-		writer.updateSet(GraphicsEngine::get()->getDevice()->get(), textureDescriptorSets);
-		writer.clear();
+	VkImageView imageView;
+	if (vkCreateImageView(GraphicsEngine::get()->getDevice()->get(), &viewInfo, nullptr, &imageView) != VK_SUCCESS) {
+		throw std::runtime_error("failed to create image view!");
+	}
+	return imageView;
+}
+
+uint32_t Texture::getTailMip() const
+{
+	uint32_t mip = 0;
+	while (mip + 1 < m_levelCount && std::max(m_width, m_height) >> mip > s_tailSize) {
+		mip++;
+	}
+	return mip;
+}
+
+VkDeviceSize Texture::getLevelsSize(uint32_t firstMip) const
+{
+	VkDeviceSize size = 0;
+	for (uint32_t i = firstMip; i < m_levels.size(); i++) {
+		size += m_levels[i].size();
+	}
+	return size;
+}
 
-		m_descriptorSets.push_back(textureDescriptorSets);
+void Texture::beginResidencyChange(uint32_t firstMip)
+{
+	m_pendingMip = firstMip;
+	m_pendingImage = uploadLevels(firstMip, m_pendingFuture);
+}
+
+bool Texture::finishResidencyChange()
+{
+	if (!m_pendingImage || m_pendingFuture.wait_for(std::chrono::seconds(0)) != std::future_status::ready) {
+		return false;
 	}
+
+	// A fresh slot, as frames in flight may still sample the old one
+	TextureTablePtr textureTable = GraphicsEngine::get()->getRenderer()->getTextureTable();
+	VkImageView imageView = createImageView(m_pendingImage);
+	uint32_t textureIndex = textureTable->registerTexture(imageView);
+	textureTable->releaseTexture(m_textureIndex, std::make_shared<RetiredImage>(m_image, m_imageView));
+
+	m_image = std::move(m_pendingImage);
+	m_imageView = imageView;
+	m_textureIndex = textureIndex;
+	m_residentMip = m_pendingMip;
+	m_pendingFuture = {};
+	return true;
+}
+
+bool Texture::isResident() const
+{
+	return !m_uploadFuture.valid() || m_uploadFuture.wait_for(std::chrono::seconds(0)) == std::future_status::ready;
 }
 
 void Texture::Reload()
 {
-	vkDeviceWaitIdle(GraphicsEngine::get()->getDevice()->get());
+	GraphicsEngine::get()->getDevice()->waitIdle();
 
 	// Free the old resources
-	m_descriptorSets.clear();
-	vkDestroySampler(GraphicsEngine::get()->getDevice()->get(), m_sampler, nullptr);
-	vkDestroyImageView(GraphicsEngine::get()->getDevice()->get(), m_imageView, nullptr);
-	m_image.reset();
+	{
+		std::lock_guard<std::mutex> lock(m_streamMutex);
+		vkDestroyImageView(GraphicsEngine::get()->getDevice()->get(), m_imageView, nullptr);
+		m_image.reset();
+		m_pendingImage.reset();
+		m_pendingFuture = {};
+		m_levels.clear();
+		m_pixels = {};
+		m_file.reset();
+	}
 
 	// Load the new texture
 	Load(m_full_path.c_str());
-}
\ No newline at end of file
+}
@@ -1,8 +1,12 @@
 #pragma once
 #include "Resource.h"
 #include "Prerequisites.h"
+#include "TextureFile.h"
 #include <vector>
-#include "Descriptors.h"
+#include <future>
+#include <span>
+#include <mutex>
+#include <memory>
 
 class Texture : public Resource
 {
@@ -10,26 +14,72 @@ public:
 	Texture(const std::filesystem::path& full_path);
 	~Texture();
 
+	// Uncompressed textures get their mips on the CPU instead of from GPU blits; compressed ones always do
+	static bool s_cpuMipmaps;
+
 	ImagePtr getImage() { return m_image; }
 	VkImageView getImageView() { return m_imageView; }
-	VkSampler getSampler() { return m_sampler; }
+	// Slot of this texture in the renderer's TextureTable; a reload keeps it, a streaming residency change moves it
+	uint32_t getTextureIndex() const { return m_textureIndex; }
+	// False while the upload queue is still copying the pixels and building the mip chain
+	bool isResident() const;
+	std::shared_future<void> getUploadFuture() { return m_uploadFuture; }
+
+	// A streamed texture keeps every level on the CPU and only the levels from getResidentMip() on in its image
+	bool isStreamed() const { return !m_levels.empty(); }
+	uint32_t getWidth() const { return m_width; }
+	uint32_t getHeight() const { return m_height; }
+	uint32_t getLevelCount() const { return m_levelCount; }
+	uint32_t getResidentMip() const { return m_residentMip; }
+	// Finest level of the mip tail that loads first and is never evicted
+	uint32_t getTailMip() const;
+	// Bytes of the levels from firstMip to the last one
+	VkDeviceSize getLevelsSize(uint32_t firstMip) const;
 
 	void Reload() override;
+
+	// Times the blitted mip chain of the upload queue against MipGenerator::generateChain on the same decoded image,
+	// each up to an image the shader can sample; needs the engine to be created
+	static void benchmarkMipmaps(const std::filesystem::path& sourcePath);
 private:
 	void Load(const std::filesystem::path& full_path) override;
+	// Fills m_levels from the KTX2 cache, importing the source into it first when needed
+	void loadCompressed(const std::filesystem::path& full_path, TextureFile::Usage usage, bool srgb);
+	// RGBA8 decoded from the source, mips built by the MipGenerator into m_levels or blitted by the upload queue
+	void loadUncompressed(const std::filesystem::path& full_path, VkFormat imageFormat, bool srgbContent);
+	// A new image holding m_levels from firstMip on, one buffer to image copy each
+	ImagePtr uploadLevels(uint32_t firstMip, std::shared_future<void>& future);
+	VkImageView createImageView(const ImagePtr& image);
+
+	// Residency changes are started and finished by the TextureStreamer with m_streamMutex held; the new image
+	// replaces the old one in a fresh TextureTable slot once its upload has finished
+	void beginResidencyChange(uint32_t firstMip);
+	bool finishResidencyChange();
 
 	ImagePtr m_image;
+	std::shared_future<void> m_uploadFuture;
 	VkImageView m_imageView;
-	VkSampler m_sampler;
+	uint32_t m_textureIndex;
+
+	// CPU copy of every level, largest first: views into the mapped cache file or into m_pixels
+	std::unique_ptr<TextureFile> m_file;
+	std::vector<uint8_t> m_pixels;
+	std::vector<std::span<const uint8_t>> m_levels;
+	uint32_t m_width = 0;
+	uint32_t m_height = 0;
+	uint32_t m_levelCount = 0;
+	VkFormat m_format = VK_FORMAT_UNDEFINED;
 
-	static bool m_descriptorAllocatorInitialized;
-	static DescriptorAllocatorGrowable m_descriptorAllocator;
-	std::vector<VkDescriptorSet> m_descriptorSets;//one for every frame in flight;
+	std::mutex m_streamMutex; // held while loading, so the streamer skips the texture meanwhile
+	uint32_t m_residentMip = 0;
+	ImagePtr m_pendingImage;
+	std::shared_future<void> m_pendingFuture;
+	uint32_t m_pendingMip = 0;
 
-	std::vector<DescriptorAllocatorGrowable::PoolSizeRatio> m_sizes =
-	{
-		{ VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1 }
-	};
+	// Screen space demand, written by the TextureStreamer on the render thread
+	float m_requestedSize = 0.0f;
+	uint64_t m_lastUsedFrame = 0;
 
 	friend class Renderer;
-};
\ No newline at end of file
+	friend class TextureStreamer;
+};
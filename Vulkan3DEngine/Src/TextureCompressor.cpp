@@ -0,0 +1,581 @@
+#include "TextureCompressor.h"
+#include "ThreadPool.h"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstring>
+#include <limits>
+
+// Interpolation weights of BC7's 4-bit indices, out of 64
+static constexpr std::array<int, 16> s_bc7Weights = { 0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64 };
+
+struct BitWriter {
+    uint8_t* data;
+    uint32_t position = 0;
+
+    void write(uint32_t value, uint32_t bits)
+    {
+        for (uint32_t i = 0; i < bits; i++, position++) {
+            data[position >> 3] |= static_cast<uint8_t>(((value >> i) & 1) << (position & 7));
+        }
+    }
+};
+
+struct BitReader {
+    const uint8_t* data;
+    uint32_t position = 0;
+
+    uint32_t read(uint32_t bits)
+    {
+        uint32_t value = 0;
+        for (uint32_t i = 0; i < bits; i++, position++) {
+            value |= ((data[position >> 3] >> (position & 7)) & 1u) << i;
+        }
+        return value;
+    }
+};
+
+// The 16 pixels of a block, rows and columns past the image edge repeat the last ones
+static void loadBlock(const uint8_t* rgba, uint32_t width, uint32_t height, uint32_t blockX, uint32_t blockY, uint8_t block[64])
+{
+    for (uint32_t y = 0; y < 4; y++) {
+        uint32_t sourceY = std::min(blockY * 4 + y, height - 1);
+        for (uint32_t x = 0; x < 4; x++) {
+            uint32_t sourceX = std::min(blockX * 4 + x, width - 1);
+            memcpy(&block[(y * 4 + x) * 4], &rgba[(size_t(sourceY) * width + sourceX) * 4], 4);
+        }
+    }
+}
+
+static void storeBlock(const uint8_t block[64], uint32_t width, uint32_t height, uint32_t blockX, uint32_t blockY, uint8_t* rgba)
+{
+    for (uint32_t y = 0; y < 4 && blockY * 4 + y < height; y++) {
+        for (uint32_t x = 0; x < 4 && blockX * 4 + x < width; x++) {
+            memcpy(&rgba[(size_t(blockY * 4 + y) * width + blockX * 4 + x) * 4], &block[(y * 4 + x) * 4], 4);
+        }
+    }
+}
+
+// Endpoints along the principal axis of the first N channels, through the mean and spanning every pixel
+template<int N>
+static void fitPrincipalAxis(const uint8_t block[64], std::array<float, N>& low, std::array<float, N>& high)
+{
+    std::array<float, N> mean{};
+    for (int i = 0; i < 16; i++) {
+        for (int c = 0; c < N; c++) {
+            mean[c] += block[i * 4 + c] / 16.0f;
+        }
+    }
+
+    float covariance[N][N] = {};
+    for (int i = 0; i < 16; i++) {
+        for (int a = 0; a < N; a++) {
+            for (int b = 0; b < N; b++) {
+                covariance[a][b] += (block[i * 4 + a] - mean[a]) * (block[i * 4 + b] - mean[b]);
+            }
+        }
+    }
+
+    // Power iteration converges quickly enough for a 3x3 or 4x4 matrix
+    std::array<float, N> axis;
+    axis.fill(1.0f);
+    for (int iteration = 0; iteration < 8; iteration++) {
+        std::array<float, N> next{};
+        for (int a = 0; a < N; a++) {
+            for (int b = 0; b < N; b++) {
+                next[a] += covariance[a][b] * axis[b];
+            }
+        }
+        float length = 0.0f;
+        for (int c = 0; c < N; c++) {
+            length = std::max(length, std::abs(next[c]));
+        }
+        if (length == 0.0f) {
+            break;
+        }
+        for (int c = 0; c < N; c++) {
+            axis[c] = next[c] / length;
+        }
+    }
+
+    float axisLength = 0.0f;
+    for (int c = 0; c < N; c++) {
+        axisLength += axis[c] * axis[c];
+    }
+
+    float minT = 0.0f;
+    float maxT = 0.0f;
+    if (axisLength > 0.0f) {
+        minT = std::numeric_limits<float>::max();
+        maxT = -std::numeric_limits<float>::max();
+        for (int i = 0; i < 16; i++) {
+            float t = 0.0f;
+            for (int c = 0; c < N; c++) {
+                t += (block[i * 4 + c] - mean[c]) * axis[c];
+            }
+            minT = std::min(minT, t / axisLength);
+            maxT = std::max(maxT, t / axisLength);
+        }
+    }
+
+    for (int c = 0; c < N; c++) {
+        low[c] = std::clamp(mean[c] + axis[c] * minT, 0.0f, 255.0f);
+        high[c] = std::clamp(mean[c] + axis[c] * maxT, 0.0f, 255.0f);
+    }
+}
+
+// Endpoints minimizing the squared error of the pixels for fixed interpolation weights: pixel i is low + (high - low) * t[i]
+template<int N>
+static void refineEndpoints(const uint8_t block[64], const float t[16], std::array<float, N>& low, std::array<float, N>& high)
+{
+    float aa = 0.0f, ab = 0.0f, bb = 0.0f;
+    std::array<float, N> ax{}, bx{};
+    for (int i = 0; i < 16; i++) {
+        float a = 1.0f - t[i];
+        float b = t[i];
+        aa += a * a;
+        ab += a * b;
+        bb += b * b;
+        for (int c = 0; c < N; c++) {
+            ax[c] += a * block[i * 4 + c];
+            bx[c] += b * block[i * 4 + c];
+        }
+    }
+
+    float determinant = aa * bb - ab * ab;
+    if (std::abs(determinant) < 1e-6f) {
+        return;
+    }
+    for (int c = 0; c < N; c++) {
+        low[c] = std::clamp((ax[c] * bb - bx[c] * ab) / determinant, 0.0f, 255.0f);
+        high[c] = std::clamp((bx[c] * aa - ax[c] * ab) / determinant, 0.0f, 255.0f);
+    }
+}
+
+static uint16_t packColor565(const std::array<float, 3>& color)
+{
+    uint32_t r = static_cast<uint32_t>(std::lround(color[0] * 31.0f / 255.0f));
+    uint32_t g = static_cast<uint32_t>(std::lround(color[1] * 63.0f / 255.0f));
+    uint32_t b = static_cast<uint32_t>(std::lround(color[2] * 31.0f / 255.0f));
+    return static_cast<uint16_t>(r << 11 | g << 5 | b);
+}
+
+static std::array<int, 3> unpackColor565(uint16_t color)
+{
+    int r = (color >> 11) & 31;
+    int g = (color >> 5) & 63;
+    int b = color & 31;
+    return { r << 3 | r >> 2, g << 2 | g >> 4, b << 3 | b >> 2 };
+}
+
+// Four color mode: endpoint 0, endpoint 1, then the colors at 1/3 and 2/3
+static void bc1Palette(uint16_t color0, uint16_t color1, std::array<std::array<int, 3>, 4>& palette)
+{
+    palette[0] = unpackColor565(color0);
+    palette[1] = unpackColor565(color1);
+    for (int c = 0; c < 3; c++) {
+        palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+        palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+    }
+}
+
+static uint32_t bc1Indices(const uint8_t block[64], const std::array<std::array<int, 3>, 4>& palette, uint8_t indices[16])
+{
+    uint32_t totalError = 0;
+    for (int i = 0; i < 16; i++) {
+        uint32_t bestError = UINT32_MAX;
+        for (uint8_t p = 0; p < 4; p++) {
+            uint32_t error = 0;
+            for (int c = 0; c < 3; c++) {
+                int d = block[i * 4 + c] - palette[p][c];
+                error += d * d;
+            }
+            if (error < bestError) {
+                bestError = error;
+                indices[i] = p;
+            }
+        }
+        totalError += bestError;
+    }
+    return totalError;
+}
+
+static void encodeBC1(const uint8_t block[64], uint8_t* output)
+{
+    std::array<float, 3> low, high;
+    fitPrincipalAxis<3>(block, low, high);
+
+    static constexpr float s_paletteT[4] = { 0.0f, 1.0f, 1.0f / 3.0f, 2.0f / 3.0f };
+    uint16_t color0 = packColor565(high);
+    uint16_t color1 = packColor565(low);
+    std::array<std::array<int, 3>, 4> palette;
+    uint8_t indices[16];
+    bc1Palette(color0, color1, palette);
+    uint32_t error = bc1Indices(block, palette, indices);
+
+    // Palette order puts endpoint 0 at t = 0
+    float t[16];
+    for (int i = 0; i < 16; i++) {
+        t[i] = s_paletteT[indices[i]];
+    }
+    std::array<float, 3> refined0 = high, refined1 = low;
+    refineEndpoints<3>(block, t, refined0, refined1);
+    uint16_t refinedColor0 = packColor565(refined0);
+    uint16_t refinedColor1 = packColor565(refined1);
+    uint8_t refinedIndices[16];
+    bc1Palette(refinedColor0, refinedColor1, palette);
+    if (bc1Indices(block, palette, refinedIndices) < error) {
+        color0 = refinedColor0;
+        color1 = refinedColor1;
+        memcpy(indices, refinedIndices, sizeof(indices));
+    }
+
+    // color0 > color1 selects the four color mode, equal endpoints fall into the three color mode
+    // where only index 0 is safe to use
+    if (color0 < color1) {
+        std::swap(color0, color1);
+        for (uint8_t& index : indices) {
+            index ^= 1;
+        }
+    }
+    else if (color0 == color1) {
+        memset(indices, 0, sizeof(indices));
+    }
+
+    uint32_t packedIndices = 0;
+    for (int i = 0; i < 16; i++) {
+        packedIndices |= uint32_t(indices[i]) << (2 * i);
+    }
+    memcpy(output, &color0, 2);
+    memcpy(output + 2, &color1, 2);
+    memcpy(output + 4, &packedIndices, 4);
+}
+
+static void decodeBC1(const uint8_t* input, uint8_t block[64])
+{
+    uint16_t color0, color1;
+    uint32_t packedIndices;
+    memcpy(&color0, input, 2);
+    memcpy(&color1, input + 2, 2);
+    memcpy(&packedIndices, input + 4, 4);
+
+    std::array<std::array<int, 3>, 4> palette;
+    bc1Palette(color0, color1, palette);
+    if (color0 <= color1) {
+        // Three color mode: the midpoint and transparent black
+        for (int c = 0; c < 3; c++) {
+            palette[2][c] = (palette[0][c] + palette[1][c]) / 2;
+            palette[3][c] = 0;
+        }
+    }
+
+    for (int i = 0; i < 16; i++) {
+        uint32_t index = (packedIndices >> (2 * i)) & 3;
+        for (int c = 0; c < 3; c++) {
+            block[i * 4 + c] = static_cast<uint8_t>(palette[index][c]);
+        }
+        block[i * 4 + 3] = color0 <= color1 && index == 3 ? 0 : 255;
+    }
+}
+
+// One channel of a BC5 block; the eight value mode, the endpoints are the channel's extremes
+static void encodeBC4(const uint8_t block[64], int channel, uint8_t* output)
+{
+    int low = 255;
+    int high = 0;
+    for (int i = 0; i < 16; i++) {
+        low = std::min<int>(low, block[i * 4 + channel]);
+        high = std::max<int>(high, block[i * 4 + channel]);
+    }
+
+    uint64_t packedIndices = 0;
+    if (high > low) {
+        int palette[8] = { high, low };
+        for (int k = 1; k < 7; k++) {
+            palette[k + 1] = ((7 - k) * high + k * low) / 7;
+        }
+        for (int i = 0; i < 16; i++) {
+            int value = block[i * 4 + channel];
+            uint64_t bestIndex = 0;
+            int bestError = INT32_MAX;
+            for (int p = 0; p < 8; p++) {
+                int error = std::abs(value - palette[p]);
+                if (error < bestError) {
+                    bestError = error;
+                    bestIndex = p;
+                }
+            }
+            packedIndices |= bestIndex << (3 * i);
+        }
+    }
+
+    output[0] = static_cast<uint8_t>(high);
+    output[1] = static_cast<uint8_t>(low);
+    for (int b = 0; b < 6; b++) {
+        output[2 + b] = static_cast<uint8_t>(packedIndices >> (8 * b));
+    }
+}
+
+static void decodeBC4(const uint8_t* input, int channel, uint8_t block[64])
+{
+    int value0 = input[0];
+    int value1 = input[1];
+    int palette[8] = { value0, value1 };
+    if (value0 > value1) {
+        for (int k = 1; k < 7; k++) {
+            palette[k + 1] = ((7 - k) * value0 + k * value1) / 7;
+        }
+    }
+    else {
+        for (int k = 1; k < 5; k++) {
+            palette[k + 1] = ((5 - k) * value0 + k * value1) / 5;
+        }
+        palette[6] = 0;
+        palette[7] = 255;
+    }
+
+    uint64_t packedIndices = 0;
+    for (int b = 0; b < 6; b++) {
+        packedIndices |= uint64_t(input[2 + b]) << (8 * b);
+    }
+    for (int i = 0; i < 16; i++) {
+        block[i * 4 + channel] = static_cast<uint8_t>(palette[(packedIndices >> (3 * i)) & 7]);
+    }
+}
+
+// A mode 6 endpoint is seven bits per channel plus a p-bit shared by its four channels
+struct Bc7Endpoint {
+    uint8_t value[4];
+    uint32_t pBit;
+
+    int expanded(int c) const { return value[c] << 1 | pBit; }
+};
+
+static Bc7Endpoint quantizeBc7Endpoint(const std::array<float, 4>& color)
+{
+    Bc7Endpoint best{};
+    float bestError = std::numeric_limits<float>::max();
+    for (uint32_t pBit = 0; pBit < 2; pBit++) {
+        Bc7Endpoint endpoint{};
+        endpoint.pBit = pBit;
+        float error = 0.0f;
+        for (int c = 0; c < 4; c++) {
+            endpoint.value[c] = static_cast<uint8_t>(std::clamp<long>(std::lround((color[c] - pBit) * 0.5f), 0, 127));
+            float d = endpoint.expanded(c) - color[c];
+            error += d * d;
+        }
+        if (error < bestError) {
+            bestError = error;
+            best = endpoint;
+        }
+    }
+    return best;
+}
+
+static uint32_t bc7Indices(const uint8_t block[64], const Bc7Endpoint& e0, const Bc7Endpoint& e1, uint8_t indices[16])
+{
+    int palette[16][4];
+    for (int p = 0; p < 16; p++) {
+        for (int c = 0; c < 4; c++) {
+            palette[p][c] = ((64 - s_bc7Weights[p]) * e0.expanded(c) + s_bc7Weights[p] * e1.expanded(c) + 32) >> 6;
+        }
+    }
+
+    uint32_t totalError = 0;
+    for (int i = 0; i < 16; i++) {
+        uint32_t bestError = UINT32_MAX;
+        for (uint8_t p = 0; p < 16; p++) {
+            uint32_t error = 0;
+            for (int c = 0; c < 4; c++) {
+                int d = block[i * 4 + c] - palette[p][c];
+                error += d * d;
+            }
+            if (error < bestError) {
+                bestError = error;
+                indices[i] = p;
+            }
+        }
+        totalError += bestError;
+    }
+    return totalError;
+}
+
+static void encodeBC7(const uint8_t block[64], uint8_t* output)
+{
+    std::array<float, 4> low, high;
+    fitPrincipalAxis<4>(block, low, high);
+
+    Bc7Endpoint e0 = quantizeBc7Endpoint(low);
+    Bc7Endpoint e1 = quantizeBc7Endpoint(high);
+    uint8_t indices[16];
+    uint32_t error = bc7Indices(block, e0, e1, indices);
+
+    float t[16];
+    for (int i = 0; i < 16; i++) {
+        t[i] = s_bc7Weights[indices[i]] / 64.0f;
+    }
+    refineEndpoints<4>(block, t, low, high);
+    Bc7Endpoint refined0 = quantizeBc7Endpoint(low);
+    Bc7Endpoint refined1 = quantizeBc7Endpoint(high);
+    uint8_t refinedIndices[16];
+    if (bc7Indices(block, refined0, refined1, refinedIndices) < error) {
+        e0 = refined0;
+        e1 = refined1;
+        memcpy(indices, refinedIndices, sizeof(indices));
+    }
+
+    // The most significant bit of the first index is implied zero, swapping the endpoints inverts the indices
+    if (indices[0] & 8) {
+        std::swap(e0, e1);
+        for (uint8_t& index : indices) {
+            index = 15 - index;
+        }
+    }
+
+    memset(output, 0, 16);
+    BitWriter writer{ output };
+    writer.write(1 << 6, 7); // mode 6
+    for (int c = 0; c < 4; c++) {
+        writer.write(e0.value[c], 7);
+        writer.write(e1.value[c], 7);
+    }
+    writer.write(e0.pBit, 1);
+    writer.write(e1.pBit, 1);
+    writer.write(indices[0], 3);
+    for (int i = 1; i < 16; i++) {
+        writer.write(indices[i], 4);
+    }
+}
+
+static void decodeBC7(const uint8_t* input, uint8_t block[64])
+{
+    BitReader reader{ input };
+    if (reader.read(7) != (1 << 6)) {
+        memset(block, 0, 64);
+        return;
+    }
+
+    Bc7Endpoint e0{}, e1{};
+    for (int c = 0; c < 4; c++) {
+        e0.value[c] = static_cast<uint8_t>(reader.read(7));
+        e1.value[c] = static_cast<uint8_t>(reader.read(7));
+    }
+    e0.pBit = reader.read(1);
+    e1.pBit = reader.read(1);
+
+    for (int i = 0; i < 16; i++) {
+        int weight = s_bc7Weights[reader.read(i == 0 ? 3 : 4)];
+        for (int c = 0; c < 4; c++) {
+            block[i * 4 + c] = static_cast<uint8_t>(((64 - weight) * e0.expanded(c) + weight * e1.expanded(c) + 32) >> 6);
+        }
+    }
+}
+
+uint32_t TextureCompressor::getBlockSize(BlockFormat format)
+{
+    return format == BlockFormat::BC1 ? 8 : 16;
+}
+
+size_t TextureCompressor::getCompressedSize(BlockFormat format, uint32_t width, uint32_t height)
+{
+    return size_t((width + 3) / 4) * ((height + 3) / 4) * getBlockSize(format);
+}
+
+VkFormat TextureCompressor::getVkFormat(BlockFormat format, bool srgb)
+{
+    switch (format) {
+    case BlockFormat::BC1:
+        return srgb ? VK_FORMAT_BC1_RGB_SRGB_BLOCK : VK_FORMAT_BC1_RGB_UNORM_BLOCK;
+    case BlockFormat::BC5:
+        return VK_FORMAT_BC5_UNORM_BLOCK;
+    default:
+        return srgb ? VK_FORMAT_BC7_SRGB_BLOCK : VK_FORMAT_BC7_UNORM_BLOCK;
+    }
+}
+
+void TextureCompressor::compress(BlockFormat format, const uint8_t* rgba, uint32_t width, uint32_t height, uint8_t* output)
+{
+    uint32_t blocksX = (width + 3) / 4;
+    uint32_t blocksY = (height + 3) / 4;
+    uint32_t blockSize = getBlockSize(format);
+
+    auto compressRow = [&](size_t blockY) {
+        uint8_t block[64];
+        for (uint32_t blockX = 0; blockX < blocksX; blockX++) {
+            loadBlock(rgba, width, height, blockX, static_cast<uint32_t>(blockY), block);
+            uint8_t* out = output + (blockY * blocksX + blockX) * blockSize;
+            switch (format) {
+            case BlockFormat::BC1:
+                encodeBC1(block, out);
+                break;
+            case BlockFormat::BC5:
+                encodeBC4(block, 0, out);
+                encodeBC4(block, 1, out + 8);
+                break;
+            case BlockFormat::BC7:
+                encodeBC7(block, out);
+                break;
+            }
+        }
+    };
+
+    if (ThreadPool::get()) {
+        ThreadPool::get()->parallel_for(0, blocksY, compressRow);
+    }
+    else {
+        for (size_t blockY = 0; blockY < blocksY; blockY++) {
+            compressRow(blockY);
+        }
+    }
+}
+
+void TextureCompressor::decompress(BlockFormat format, const uint8_t* blocks, uint32_t width, uint32_t height, uint8_t* rgba)
+{
+    uint32_t blocksX = (width + 3) / 4;
+    uint32_t blocksY = (height + 3) / 4;
+    uint32_t blockSize = getBlockSize(format);
+
+    uint8_t block[64];
+    for (uint32_t blockY = 0; blockY < blocksY; blockY++) {
+        for (uint32_t blockX = 0; blockX < blocksX; blockX++) {
+            const uint8_t* in = blocks + (size_t(blockY) * blocksX + blockX) * blockSize;
+            switch (format) {
+            case BlockFormat::BC1:
+                decodeBC1(in, block);
+                break;
+            case BlockFormat::BC5:
+                for (int i = 0; i < 16; i++) {
+                    block[i * 4 + 2] = 0;
+                    block[i * 4 + 3] = 255;
+                }
+                decodeBC4(in, 0, block);
+                decodeBC4(in + 8, 1, block);
+                break;
+            case BlockFormat::BC7:
+                decodeBC7(in, block);
+                break;
+            }
+            storeBlock(block, width, height, blockX, blockY, rgba);
+        }
+    }
+}
+
+double TextureCompressor::computePsnr(BlockFormat format, const uint8_t* reference, const uint8_t* decoded, uint32_t width, uint32_t height)
+{
+    int channels = format == BlockFormat::BC1 ? 3 : format == BlockFormat::BC5 ? 2 : 4;
+    double squaredError = 0.0;
+    size_t pixelCount = size_t(width) * height;
+    for (size_t i = 0; i < pixelCount; i++) {
+        for (int c = 0; c < channels; c++) {
+            double d = double(reference[i * 4 + c]) - double(decoded[i * 4 + c]);
+            squaredError += d * d;
+        }
+    }
+
+    double meanSquaredError = squaredError / (double(pixelCount) * channels);
+    if (meanSquaredError == 0.0) {
+        return std::numeric_limits<double>::infinity();
+    }
+    return 10.0 * std::log10(255.0 * 255.0 / meanSquaredError);
+}
@@ -0,0 +1,31 @@
+#pragma once
+#include "Prerequisites.h"
+
+#include <vector>
+
+// 4x4 block compressed formats the texture pipeline encodes to
+enum class BlockFormat {
+    BC1, // opaque RGB, 8 bytes per block
+    BC5, // two independent channels, e.g. tangent space normal maps, 16 bytes per block
+    BC7, // RGBA, 16 bytes per block
+};
+
+// CPU encoders and decoders of block compressed textures. The encoders trade the last bit of quality for speed:
+// every block gets endpoints along the principal axis of its colors, refined once by least squares, and BC7 only
+// uses mode 6 (one subset, RGBA endpoints, 16 interpolated colors).
+class TextureCompressor
+{
+public:
+    static uint32_t getBlockSize(BlockFormat format);
+    static size_t getCompressedSize(BlockFormat format, uint32_t width, uint32_t height);
+    static VkFormat getVkFormat(BlockFormat format, bool srgb);
+
+    // rgba holds width * height RGBA8 pixels, partial blocks at the edges repeat the last row and column.
+    // Rows of blocks are split over the ThreadPool.
+    static void compress(BlockFormat format, const uint8_t* rgba, uint32_t width, uint32_t height, uint8_t* output);
+    // Back to RGBA8 for measuring the quality; BC1 and BC5 fill the channels they do not store with 0 and 255.
+    // Only BC7 mode 6, the one the encoder writes, is decoded, other modes come out black.
+    static void decompress(BlockFormat format, const uint8_t* blocks, uint32_t width, uint32_t height, uint8_t* rgba);
+    // Peak signal to noise ratio in dB over the channels the format stores
+    static double computePsnr(BlockFormat format, const uint8_t* reference, const uint8_t* decoded, uint32_t width, uint32_t height);
+};
@@ -0,0 +1,352 @@
+#include "TextureFile.h"
+#include "PipelineCache.h"
+#include "MipGenerator.h"
+
+#include <algorithm>
+#include <fstream>
+#include <cstring>
+#include <cmath>
+#include <thread>
+#include <chrono>
+
+#include <stb_image.h>
+
+TextureFile::Compression TextureFile::s_compression = TextureFile::Compression::Quality;
+
+// Basic data format descriptor values from the Khronos Data Format Specification
+static constexpr uint32_t s_dfdModelBC1A = 128;
+static constexpr uint32_t s_dfdModelBC5 = 132;
+static constexpr uint32_t s_dfdModelBC7 = 134;
+static constexpr uint32_t s_dfdPrimariesBT709 = 1;
+static constexpr uint32_t s_dfdTransferLinear = 1;
+static constexpr uint32_t s_dfdTransferSRGB = 2;
+
+static bool isSrgb(BlockFormat format)
+{
+    // Colors are stored sRGB encoded, the two BC5 channels are vector components
+    return format != BlockFormat::BC5;
+}
+
+// KTX2 requires a data format descriptor even though the vkFormat already says everything
+static std::vector<uint32_t> buildDataFormatDescriptor(BlockFormat format)
+{
+    uint32_t sampleCount = format == BlockFormat::BC5 ? 2 : 1;
+    uint32_t blockSize = TextureCompressor::getBlockSize(format);
+    uint32_t descriptorBlockSize = 24 + 16 * sampleCount;
+    uint32_t model = format == BlockFormat::BC1 ? s_dfdModelBC1A : format == BlockFormat::BC5 ? s_dfdModelBC5 : s_dfdModelBC7;
+
+    std::vector<uint32_t> dfd;
+    dfd.push_back(4 + descriptorBlockSize);
+    dfd.push_back(0); // Khronos vendor, basic descriptor type
+    dfd.push_back(2 | descriptorBlockSize << 16); // version 1.3
+    dfd.push_back(model | s_dfdPrimariesBT709 << 8 | (isSrgb(format) ? s_dfdTransferSRGB : s_dfdTransferLinear) << 16);
+    dfd.push_back(3 | 3 << 8); // 4x4 texel blocks, stored as dimension - 1
+    dfd.push_back(blockSize);
+    dfd.push_back(0);
+
+    // One sample covering the whole block, or one per BC5 channel (red, green)
+    for (uint32_t sample = 0; sample < sampleCount; sample++) {
+        uint32_t bitLength = blockSize * 8 / sampleCount;
+        dfd.push_back(sample * bitLength | (bitLength - 1) << 16 | sample << 24);
+        dfd.push_back(0);
+        dfd.push_back(0);
+        dfd.push_back(UINT32_MAX);
+    }
+    return dfd;
+}
+
+static BlockFormat chooseFormat(TextureFile::Usage usage, const std::vector<uint8_t>& rgba)
+{
+    if (usage == TextureFile::Usage::Normal) {
+        return BlockFormat::BC5;
+    }
+    for (size_t i = 3; i < rgba.size(); i += 4) {
+        if (rgba[i] != 255) {
+            return BlockFormat::BC7;
+        }
+    }
+    return TextureFile::s_compression == TextureFile::Compression::Small ? BlockFormat::BC1 : BlockFormat::BC7;
+}
+
+static std::vector<uint8_t> decodeImage(const std::filesystem::path& sourcePath, uint32_t& width, uint32_t& height)
+{
+    int texWidth, texHeight, texChannels;
+    stbi_uc* pixels = stbi_load(sourcePath.string().c_str(), &texWidth, &texHeight, &texChannels, STBI_rgb_alpha);
+    if (!pixels) {
+        throw std::runtime_error("failed to load texture image!");
+    }
+
+    width = static_cast<uint32_t>(texWidth);
+    height = static_cast<uint32_t>(texHeight);
+    std::vector<uint8_t> rgba(pixels, pixels + size_t(width) * height * 4);
+    stbi_image_free(pixels);
+    return rgba;
+}
+
+TextureData TextureFile::importImage(const std::filesystem::path& sourcePath, Usage usage)
+{
+    TextureData data;
+    std::vector<uint8_t> rgba = decodeImage(sourcePath, data.width, data.height);
+    data.format = chooseFormat(usage, rgba);
+
+    std::vector<size_t> levelOffsets;
+    std::vector<uint8_t> chain = MipGenerator::generateChain(rgba.data(), data.width, data.height, isSrgb(data.format), levelOffsets);
+    for (uint32_t i = 0; i < levelOffsets.size(); i++) {
+        uint32_t width = std::max(1u, data.width >> i);
+        uint32_t height = std::max(1u, data.height >> i);
+
+        // Every level is a whole number of blocks, so every offset stays block aligned
+        TextureLevel range{ data.blocks.size(), TextureCompressor::getCompressedSize(data.format, width, height), width, height };
+        data.blocks.resize(range.offset + range.size);
+        TextureCompressor::compress(data.format, chain.data() + levelOffsets[i], width, height, data.blocks.data() + range.offset);
+        data.levels.push_back(range);
+    }
+    return data;
+}
+
+void TextureFile::benchmarkCompression(const std::filesystem::path& sourcePath)
+{
+    using Clock = std::chrono::high_resolution_clock;
+    auto milliseconds = [](Clock::duration duration) {
+        return std::chrono::duration<double, std::milli>(duration).count();
+    };
+
+    uint32_t width, height;
+    auto decodeStart = Clock::now();
+    std::vector<uint8_t> rgba = decodeImage(sourcePath, width, height);
+    double decodeTime = milliseconds(Clock::now() - decodeStart);
+
+    // Also builds the sRGB tables, so neither timing below pays for them
+    std::vector<size_t> levelOffsets;
+    std::vector<uint8_t> chain = MipGenerator::generateChain(rgba.data(), width, height, true, levelOffsets);
+
+    fmt::print("{}: {}x{}, decode {:.2f} ms, RGBA8 with mips {:.2f} MB\n", sourcePath.string(), width, height, decodeTime,
+        chain.size() / (1024.0 * 1024.0));
+
+    // The scalar filter on one thread is the baseline the vectorized one replaces; both refill the same chain
+    for (bool srgb : { false, true }) {
+        double times[2];
+        for (bool simd : { false, true }) {
+            auto start = Clock::now();
+            for (uint32_t i = 1; i < levelOffsets.size(); i++) {
+                uint32_t levelWidth = std::max(1u, width >> (i - 1));
+                uint32_t levelHeight = std::max(1u, height >> (i - 1));
+                if (simd) {
+                    MipGenerator::downsample(chain.data() + levelOffsets[i - 1], levelWidth, levelHeight, srgb, chain.data() + levelOffsets[i]);
+                }
+                else {
+                    MipGenerator::downsampleScalar(chain.data() + levelOffsets[i - 1], levelWidth, levelHeight, srgb, chain.data() + levelOffsets[i]);
+                }
+            }
+            times[simd] = milliseconds(Clock::now() - start);
+        }
+        fmt::print("  mip chain {}: scalar {:.2f} ms, SSE2 on the pool {:.2f} ms ({:.1f}x)\n", srgb ? "sRGB" : "linear", times[0], times[1],
+            times[0] / times[1]);
+    }
+
+    std::vector<uint8_t> decoded(rgba.size());
+    for (BlockFormat format : { BlockFormat::BC1, BlockFormat::BC5, BlockFormat::BC7 }) {
+        std::vector<uint8_t> blocks(TextureCompressor::getCompressedSize(format, width, height));
+        auto compressStart = Clock::now();
+        TextureCompressor::compress(format, rgba.data(), width, height, blocks.data());
+        double compressTime = milliseconds(Clock::now() - compressStart);
+
+        TextureCompressor::decompress(format, blocks.data(), width, height, decoded.data());
+        double psnr = TextureCompressor::computePsnr(format, rgba.data(), decoded.data(), width, height);
+        const char* name = format == BlockFormat::BC1 ? "BC1" : format == BlockFormat::BC5 ? "BC5" : "BC7";
+        fmt::print("  {}: compress {:.2f} ms ({:.1f} MPixel/s), PSNR {:.2f} dB, {:.1f}x smaller\n", name, compressTime,
+            width * height / (compressTime * 1000.0), psnr, double(rgba.size()) / blocks.size());
+    }
+
+    // What a load costs once the cache exists: mapping the file and copying the levels out, no decode or blit
+    std::filesystem::path cachePath = getCachePath(sourcePath);
+    uint64_t sourceHash = getSourceHash(sourcePath);
+    if (TextureFile existing; !existing.open(cachePath, sourceHash)) {
+        write(cachePath, importImage(sourcePath), sourceHash);
+    }
+    TextureFile file;
+    auto loadStart = Clock::now();
+    if (file.open(cachePath, sourceHash)) {
+        std::vector<uint8_t> staging;
+        for (uint32_t i = 0; i < file.getLevelCount(); i++) {
+            std::span<const uint8_t> levelData = file.getLevel(i);
+            staging.insert(staging.end(), levelData.begin(), levelData.end());
+        }
+        fmt::print("  cached load: {:.2f} ms for {:.2f} MB, decode was {:.2f} ms\n", milliseconds(Clock::now() - loadStart),
+            staging.size() / (1024.0 * 1024.0), decodeTime);
+    }
+}
+
+std::filesystem::path TextureFile::getCachePath(const std::filesystem::path& sourcePath)
+{
+    std::error_code error;
+    std::string key = std::filesystem::weakly_canonical(sourcePath, error).generic_string();
+    if (error) {
+        key = sourcePath.generic_string();
+    }
+    return std::filesystem::path("Cache/Textures") / fmt::format("{:016x}.ktx2", hashBytes(key.data(), key.size()));
+}
+
+uint64_t TextureFile::getSourceHash(const std::filesystem::path& sourcePath)
+{
+    // Size and write time instead of the contents, so checking a cache file never decodes the image
+    std::error_code error;
+    uint64_t size = std::filesystem::file_size(sourcePath, error);
+    int64_t writeTime = std::filesystem::last_write_time(sourcePath, error).time_since_epoch().count();
+
+    uint64_t hash = hashBytes(&size, sizeof(size));
+    return hashBytes(&writeTime, sizeof(writeTime), hash);
+}
+
+bool TextureFile::write(const std::filesystem::path& path, const TextureData& data, uint64_t sourceHash)
+{
+    uint32_t levelCount = static_cast<uint32_t>(data.levels.size());
+    std::vector<uint32_t> dfd = buildDataFormatDescriptor(data.format);
+
+    // Key/value entries are a length, a null terminated key and the value, padded to four bytes
+    ImportInfo info{ sourceHash, s_version, static_cast<uint32_t>(s_compression), static_cast<uint32_t>(data.format), 0 };
+    std::vector<uint8_t> kvd(4 + strlen(s_importKey) + 1 + sizeof(info));
+    uint32_t entryLength = static_cast<uint32_t>(kvd.size() - 4);
+    memcpy(kvd.data(), &entryLength, 4);
+    memcpy(kvd.data() + 4, s_importKey, strlen(s_importKey) + 1);
+    memcpy(kvd.data() + 4 + strlen(s_importKey) + 1, &info, sizeof(info));
+    kvd.resize((kvd.size() + 3) & ~size_t(3), 0);
+
+    Header header{};
+    memcpy(header.identifier, s_identifier, sizeof(s_identifier));
+    header.vkFormat = TextureCompressor::getVkFormat(data.format, isSrgb(data.format));
+    header.typeSize = 1;
+    header.pixelWidth = data.width;
+    header.pixelHeight = data.height;
+    header.faceCount = 1;
+    header.levelCount = levelCount;
+    header.dfdByteOffset = static_cast<uint32_t>(sizeof(Header) + levelCount * sizeof(LevelIndex));
+    header.dfdByteLength = static_cast<uint32_t>(dfd.size() * sizeof(uint32_t));
+    header.kvdByteOffset = header.dfdByteOffset + header.dfdByteLength;
+    header.kvdByteLength = static_cast<uint32_t>(kvd.size());
+
+    // KTX2 stores the smallest level first, every level aligned to the block size
+    uint64_t alignment = TextureCompressor::getBlockSize(data.format);
+    std::vector<LevelIndex> levelIndex(levelCount);
+    uint64_t offset = header.kvdByteOffset + header.kvdByteLength;
+    for (uint32_t i = levelCount; i-- > 0;) {
+        offset = (offset + alignment - 1) & ~(alignment - 1);
+        levelIndex[i] = { offset, data.levels[i].size, data.levels[i].size };
+        offset += data.levels[i].size;
+    }
+
+    // Written next to the old file and renamed over it, so a concurrent load never maps half a file
+    std::error_code error;
+    std::filesystem::create_directories(path.parent_path(), error);
+    std::filesystem::path tempPath = path;
+    tempPath += fmt::format(".{}.tmp", std::hash<std::thread::id>()(std::this_thread::get_id()));
+    {
+        std::ofstream file(tempPath, std::ios::binary | std::ios::trunc);
+        if (!file) {
+            fmt::print(stderr, "Failed to write texture cache {}\n", tempPath.string());
+            return false;
+        }
+        file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        file.write(reinterpret_cast<const char*>(levelIndex.data()), levelIndex.size() * sizeof(LevelIndex));
+        file.write(reinterpret_cast<const char*>(dfd.data()), dfd.size() * sizeof(uint32_t));
+        file.write(reinterpret_cast<const char*>(kvd.data()), kvd.size());
+
+        uint64_t written = header.kvdByteOffset + header.kvdByteLength;
+        const char padding[16] = {};
+        for (uint32_t i = levelCount; i-- > 0;) {
+            file.write(padding, levelIndex[i].byteOffset - written);
+            std::span<const uint8_t> level = data.getLevel(i);
+            file.write(reinterpret_cast<const char*>(level.data()), level.size());
+            written = levelIndex[i].byteOffset + level.size();
+        }
+        if (!file) {
+            fmt::print(stderr, "Failed to write texture cache {}\n", tempPath.string());
+            return false;
+        }
+    }
+    std::filesystem::rename(tempPath, path, error);
+    if (error) {
+        std::filesystem::remove(tempPath, error);
+        fmt::print(stderr, "Failed to write texture cache {}\n", path.string());
+        return false;
+    }
+    return true;
+}
+
+bool TextureFile::convert(const std::filesystem::path& sourcePath, Usage usage)
+{
+    try {
+        TextureData data = importImage(sourcePath, usage);
+        return write(getCachePath(sourcePath), data, getSourceHash(sourcePath));
+    }
+    catch (const std::exception& e) {
+        fmt::print(stderr, "Failed to import {}: {}\n", sourcePath.string(), e.what());
+        return false;
+    }
+}
+
+bool TextureFile::open(const std::filesystem::path& path, uint64_t sourceHash, Usage usage)
+{
+    m_header = nullptr;
+    m_levels = nullptr;
+    if (!m_file.open(path) || m_file.size() < sizeof(Header)) {
+        return false;
+    }
+
+    const uint8_t* base = static_cast<const uint8_t*>(m_file.data());
+    size_t size = m_file.size();
+    const Header* header = reinterpret_cast<const Header*>(base);
+    bool valid = memcmp(header->identifier, s_identifier, sizeof(s_identifier)) == 0 &&
+        header->pixelDepth == 0 && header->layerCount == 0 && header->faceCount == 1 && header->supercompressionScheme == 0 &&
+        header->levelCount > 0 && header->levelCount <= 32 &&
+        sizeof(Header) + header->levelCount * sizeof(LevelIndex) <= size &&
+        uint64_t(header->kvdByteOffset) + header->kvdByteLength <= size;
+
+    // Only files written by this engine carry the import entry
+    ImportInfo info{};
+    bool hasInfo = false;
+    for (size_t position = 0; valid && position + 4 <= header->kvdByteLength;) {
+        const uint8_t* entry = base + header->kvdByteOffset + position;
+        uint32_t entryLength;
+        memcpy(&entryLength, entry, 4);
+        if (position + 4 + entryLength > header->kvdByteLength) {
+            break;
+        }
+        const char* key = reinterpret_cast<const char*>(entry + 4);
+        size_t keyLength = strnlen(key, entryLength);
+        if (keyLength < entryLength && strcmp(key, s_importKey) == 0 && entryLength - keyLength - 1 == sizeof(ImportInfo)) {
+            memcpy(&info, key + keyLength + 1, sizeof(ImportInfo));
+            hasInfo = true;
+        }
+        position += (4 + size_t(entryLength) + 3) & ~size_t(3);
+    }
+
+    BlockFormat format = static_cast<BlockFormat>(info.format);
+    valid = valid && hasInfo && info.sourceHash == sourceHash && info.version == s_version &&
+        info.compression == static_cast<uint32_t>(s_compression) && info.format <= static_cast<uint32_t>(BlockFormat::BC7) &&
+        (format == BlockFormat::BC5) == (usage == Usage::Normal) &&
+        header->vkFormat == static_cast<uint32_t>(TextureCompressor::getVkFormat(format, isSrgb(format)));
+
+    const LevelIndex* levels = reinterpret_cast<const LevelIndex*>(base + sizeof(Header));
+    for (uint32_t i = 0; valid && i < header->levelCount; i++) {
+        uint32_t width = std::max(1u, header->pixelWidth >> i);
+        uint32_t height = std::max(1u, header->pixelHeight >> i);
+        valid = levels[i].byteLength == TextureCompressor::getCompressedSize(format, width, height) &&
+            levels[i].byteOffset + levels[i].byteLength <= size;
+    }
+
+    if (!valid) {
+        m_file.close();
+        return false;
+    }
+
+    m_header = header;
+    m_levels = levels;
+    m_format = format;
+    return true;
+}
+
+std::span<const uint8_t> TextureFile::getLevel(uint32_t level) const
+{
+    return { static_cast<const uint8_t*>(m_file.data()) + m_levels[level].byteOffset, static_cast<size_t>(m_levels[level].byteLength) };
+}
@@ -0,0 +1,116 @@
+#pragma once
+#include "Prerequisites.h"
+#include "MappedFile.h"
+#include "TextureCompressor.h"
+
+#include <filesystem>
+#include <vector>
+#include <span>
+
+// One mip level of TextureData
+struct TextureLevel {
+    size_t offset; // into TextureData::blocks
+    size_t size;
+    uint32_t width;
+    uint32_t height;
+};
+
+// A block compressed texture with its whole mip chain, in the layout it is uploaded in
+struct TextureData {
+    uint32_t width = 0;
+    uint32_t height = 0;
+    BlockFormat format = BlockFormat::BC7;
+    std::vector<uint8_t> blocks; // every level back to back, largest first
+    std::vector<TextureLevel> levels;
+
+    std::span<const uint8_t> getLevel(uint32_t level) const { return { blocks.data() + levels[level].offset, levels[level].size }; }
+};
+
+// KTX2 cache of compressed textures. A source PNG/JPG is decoded, mipmapped and block compressed once and written
+// to Cache/Textures; later loads map that file and copy the levels straight into staging memory, without decoding
+// or blitting anything. A key/value entry stores a hash of the source file's size and write time next to the
+// settings it was compressed with, so an edited source is imported again.
+class TextureFile
+{
+public:
+    enum class Compression {
+        Off,     // RGBA8 decoded on every load, mips blitted on the GPU
+        Small,   // BC1 for opaque textures, 8x smaller than RGBA8
+        Quality, // BC7 for opaque textures, 4x smaller than RGBA8
+    };
+    // Textures with alpha always use BC7, whatever the setting
+    static Compression s_compression;
+
+    // How a material samples the texture, which decides its block format; the caller says, not the file name
+    enum class Usage {
+        Color,  // BC1 or BC7 by s_compression, sRGB encoded
+        Normal, // BC5, the two tangent space components stored linear
+    };
+
+    // Decodes the source, builds the mip chain and compresses every level
+    static TextureData importImage(const std::filesystem::path& sourcePath, Usage usage = Usage::Color);
+    // Prints decode, mip generation and compression times of every format, and their quality against the source
+    static void benchmarkCompression(const std::filesystem::path& sourcePath);
+
+    static std::filesystem::path getCachePath(const std::filesystem::path& sourcePath);
+    static uint64_t getSourceHash(const std::filesystem::path& sourcePath);
+
+    static bool write(const std::filesystem::path& path, const TextureData& data, uint64_t sourceHash);
+    // Imports the source and writes its cache file, without any GPU work; used by the offline conversion
+    static bool convert(const std::filesystem::path& sourcePath, Usage usage = Usage::Color);
+
+    // False if the file is missing, damaged, written by another version, with other settings or for another usage,
+    // or built from another source
+    bool open(const std::filesystem::path& path, uint64_t sourceHash, Usage usage = Usage::Color);
+
+    uint32_t getWidth() const { return m_header->pixelWidth; }
+    uint32_t getHeight() const { return m_header->pixelHeight; }
+    uint32_t getLevelCount() const { return m_header->levelCount; }
+    BlockFormat getFormat() const { return m_format; }
+    std::span<const uint8_t> getLevel(uint32_t level) const;
+
+private:
+    struct Header {
+        uint8_t identifier[12];
+        uint32_t vkFormat;
+        uint32_t typeSize;
+        uint32_t pixelWidth;
+        uint32_t pixelHeight;
+        uint32_t pixelDepth;
+        uint32_t layerCount;
+        uint32_t faceCount;
+        uint32_t levelCount;
+        uint32_t supercompressionScheme;
+        uint32_t dfdByteOffset;
+        uint32_t dfdByteLength;
+        uint32_t kvdByteOffset;
+        uint32_t kvdByteLength;
+        uint64_t sgdByteOffset;
+        uint64_t sgdByteLength;
+    };
+    static_assert(sizeof(Header) == 80, "TextureFile::Header must match the KTX2 header");
+
+    struct LevelIndex {
+        uint64_t byteOffset;
+        uint64_t byteLength;
+        uint64_t uncompressedByteLength;
+    };
+
+    // Value of the s_importKey key/value entry
+    struct ImportInfo {
+        uint64_t sourceHash;
+        uint32_t version;
+        uint32_t compression;
+        uint32_t format;
+        uint32_t reserved;
+    };
+
+    static constexpr uint8_t s_identifier[12] = { 0xAB, 'K', 'T', 'X', ' ', '2', '0', 0xBB, '\r', '\n', 0x1A, '\n' };
+    static constexpr const char* s_importKey = "Vulkan3DEngine.import";
+    static constexpr uint32_t s_version = 2;
+
+    MappedFile m_file;
+    const Header* m_header = nullptr;
+    const LevelIndex* m_levels = nullptr;
+    BlockFormat m_format = BlockFormat::BC7;
+};
@@ -0,0 +1,175 @@
+#include "TextureStreamer.h"
+#include "Texture.h"
+
+#include <algorithm>
+#include <cmath>
+
+bool TextureStreamer::s_enabled = true;
+int TextureStreamer::s_budgetMB = 512;
+
+void TextureStreamer::addTexture(Texture* texture)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (std::find(m_textures.begin(), m_textures.end(), texture) == m_textures.end()) {
+        m_textures.push_back(texture);
+    }
+}
+
+void TextureStreamer::removeTexture(Texture* texture)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_textures.erase(std::remove(m_textures.begin(), m_textures.end(), texture), m_textures.end());
+}
+
+void TextureStreamer::requestSize(Texture* texture, float pixels)
+{
+    if (texture->m_lastUsedFrame != m_frame) {
+        texture->m_lastUsedFrame = m_frame;
+        texture->m_requestedSize = pixels;
+    }
+    else {
+        texture->m_requestedSize = std::max(texture->m_requestedSize, pixels);
+    }
+}
+
+uint32_t TextureStreamer::getDesiredMip(const Texture* texture) const
+{
+    uint32_t tailMip = texture->getTailMip();
+    if (texture->m_lastUsedFrame + 1 < m_frame) {
+        return tailMip;
+    }
+
+    // One texel per pixel: every halving of the covered size is one level coarser
+    float size = static_cast<float>(std::max(texture->getWidth(), texture->getHeight()));
+    float pixels = std::max(texture->m_requestedSize, 1.0f);
+    uint32_t mip = pixels >= size ? 0 : static_cast<uint32_t>(std::floor(std::log2(size / pixels)));
+    return std::min(mip, tailMip);
+}
+
+void TextureStreamer::update()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    struct Candidate {
+        Texture* texture;
+        uint32_t desiredMip;
+    };
+    std::vector<Candidate> candidates;
+    std::vector<std::unique_lock<std::mutex>> textureLocks;
+
+    m_residentBytes = 0;
+    m_fullResolutionCount = 0;
+    m_pendingCount = 0;
+
+    // What stays resident once the uploads in flight have landed and their old images are gone
+    VkDeviceSize projectedBytes = 0;
+    for (Texture* texture : m_textures) {
+        // A texture being loaded or reloaded is left alone until the next frame
+        std::unique_lock<std::mutex> textureLock(texture->m_streamMutex, std::try_to_lock);
+        if (!textureLock.owns_lock() || !texture->isStreamed()) {
+            continue;
+        }
+
+        texture->finishResidencyChange();
+        m_residentBytes += texture->getLevelsSize(texture->getResidentMip());
+        if (texture->m_pendingImage) {
+            m_residentBytes += texture->getLevelsSize(texture->m_pendingMip);
+            projectedBytes += texture->getLevelsSize(texture->m_pendingMip);
+            m_pendingCount++;
+        }
+        else {
+            projectedBytes += texture->getLevelsSize(texture->getResidentMip());
+        }
+        if (texture->getResidentMip() == 0) {
+            m_fullResolutionCount++;
+        }
+
+        candidates.push_back({ texture, getDesiredMip(texture) });
+        textureLocks.push_back(std::move(textureLock));
+    }
+    m_streamedCount = static_cast<uint32_t>(candidates.size());
+
+    VkDeviceSize budget = static_cast<VkDeviceSize>(s_budgetMB) * 1024 * 1024;
+    bool evicted = false;
+    if (projectedBytes > budget) {
+        // Least recently used first; among those, textures holding more detail than they need, then the largest
+        std::sort(candidates.begin(), candidates.end(), [](const Candidate& a, const Candidate& b) {
+            bool aExcess = a.desiredMip > a.texture->getResidentMip();
+            bool bExcess = b.desiredMip > b.texture->getResidentMip();
+            if (a.texture->m_lastUsedFrame != b.texture->m_lastUsedFrame) {
+                return a.texture->m_lastUsedFrame < b.texture->m_lastUsedFrame;
+            }
+            if (aExcess != bExcess) {
+                return aExcess;
+            }
+            return a.texture->getLevelsSize(a.texture->getResidentMip()) > b.texture->getLevelsSize(b.texture->getResidentMip());
+            });
+
+        // One level per texture and frame, so the evictions spread over the textures instead of emptying the first one
+        for (const Candidate& candidate : candidates) {
+            Texture* texture = candidate.texture;
+            if (projectedBytes <= budget) {
+                break;
+            }
+            if (texture->m_pendingImage || texture->getResidentMip() >= texture->getTailMip()) {
+                continue;
+            }
+            uint32_t mip = texture->getResidentMip() + 1;
+            projectedBytes -= texture->getLevelsSize(texture->getResidentMip()) - texture->getLevelsSize(mip);
+            texture->beginResidencyChange(mip);
+            m_pendingCount++;
+            m_evictedCount++;
+            evicted = true;
+        }
+    }
+
+    // Raising resolution never evicts: it waits for the room, and not in a frame that just evicted, which could
+    // otherwise hand the freed memory straight to another texture and make the two take turns
+    if (!evicted) {
+        // Most recently used first; among those, the textures furthest below their demand
+        std::sort(candidates.begin(), candidates.end(), [](const Candidate& a, const Candidate& b) {
+            if (a.texture->m_lastUsedFrame != b.texture->m_lastUsedFrame) {
+                return a.texture->m_lastUsedFrame > b.texture->m_lastUsedFrame;
+            }
+            return int(a.texture->getResidentMip()) - int(a.desiredMip) > int(b.texture->getResidentMip()) - int(b.desiredMip);
+            });
+
+        for (const Candidate& candidate : candidates) {
+            Texture* texture = candidate.texture;
+            if (m_pendingCount >= s_maxPendingChanges) {
+                break;
+            }
+            if (texture->m_pendingImage || candidate.desiredMip >= texture->getResidentMip()) {
+                continue;
+            }
+
+            // Straight to the demanded level when it fits, otherwise as close as the budget allows
+            VkDeviceSize residentBytes = texture->getLevelsSize(texture->getResidentMip());
+            for (uint32_t mip = candidate.desiredMip; mip < texture->getResidentMip(); mip++) {
+                VkDeviceSize growth = texture->getLevelsSize(mip) - residentBytes;
+                if (projectedBytes + growth <= budget) {
+                    projectedBytes += growth;
+                    texture->beginResidencyChange(mip);
+                    m_pendingCount++;
+                    m_raisedCount++;
+                    break;
+                }
+            }
+        }
+    }
+
+    m_frame++;
+}
+
+void TextureStreamer::drawInterface()
+{
+    if (ImGui::CollapsingHeader("Texture Streaming"))
+    {
+        const float megabyte = 1024.0f * 1024.0f;
+        ImGui::Text("Resident: %.2f MB / %d MB budget", m_residentBytes / megabyte, s_budgetMB);
+        ImGui::Text("Streamed textures: %u (%u at full resolution)", m_streamedCount, m_fullResolutionCount);
+        ImGui::Text("Uploads in flight: %u", m_pendingCount);
+        ImGui::Text("Levels raised: %llu  Evictions: %llu", static_cast<unsigned long long>(m_raisedCount),
+            static_cast<unsigned long long>(m_evictedCount));
+    }
+}
@@ -0,0 +1,47 @@
+#pragma once
+#include "Prerequisites.h"
+
+#include <vector>
+#include <mutex>
+
+// Keeps the resident mip levels of streamed textures within a VRAM budget. A texture loads with only its mip tail;
+// the renderer reports how many pixels each drawn texture covers on screen, and once per frame the streamer starts
+// uploading the finer levels that demand calls for, most recently used textures first. When the resident levels
+// exceed the budget, the least recently used textures drop their finest level. Every level stays on the CPU, in the
+// mapped KTX2 file or the decoded chain, so a change in either direction is a new image filled from staging memory.
+class TextureStreamer
+{
+public:
+    // Takes effect when textures are (re)loaded
+    static bool s_enabled;
+    static int s_budgetMB;
+
+    void addTexture(Texture* texture);
+    void removeTexture(Texture* texture);
+
+    // Render thread only: the texture covers about pixels screen pixels across in the frame being prepared
+    void requestSize(Texture* texture, float pixels);
+    // Render thread, once per frame before the draws are prepared: swaps in finished uploads, evicts, starts uploads
+    void update();
+
+    void drawInterface();
+
+private:
+    // Level whose size matches the screen space demand; the tail for textures not drawn in the last frame
+    uint32_t getDesiredMip(const Texture* texture) const;
+
+    // Caps the uploads in flight, so a camera cut does not stall the upload queue with the whole texture set
+    static constexpr uint32_t s_maxPendingChanges = 4;
+
+    std::mutex m_mutex; // guards m_textures, textures are added and removed by the loading threads
+    std::vector<Texture*> m_textures;
+    uint64_t m_frame = 1;
+
+    // Statistics of the last update
+    VkDeviceSize m_residentBytes = 0;
+    uint32_t m_streamedCount = 0;
+    uint32_t m_fullResolutionCount = 0;
+    uint32_t m_pendingCount = 0;
+    uint64_t m_raisedCount = 0;
+    uint64_t m_evictedCount = 0;
+};
@@ -0,0 +1,167 @@
+#include "TextureTable.h"
+#include "GraphicsEngine.h"
+#include "Image.h"
+#include "UploadQueue.h"
+#include "RendererInits.h"
+#include "SamplerCache.h"
+
+#include <vector>
+
+TextureTable::TextureTable(Device* device, Renderer* renderer) : m_device(device)
+{
+    VkPhysicalDeviceVulkan12Properties properties12{};
+    properties12.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_PROPERTIES;
+
+    VkPhysicalDeviceProperties2 properties{};
+    properties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2;
+    properties.pNext = &properties12;
+    vkGetPhysicalDeviceProperties2(m_device->getPhysicalDevice(), &properties);
+
+    m_capacity = std::min({ 4096u, properties12.maxPerStageDescriptorUpdateAfterBindSampledImages,
+        properties12.maxPerStageDescriptorUpdateAfterBindSamplers, properties12.maxDescriptorSetUpdateAfterBindSampledImages });
+
+    // Owned by the SamplerCache, which outlives the layout
+    std::vector<VkSampler> immutableSamplers(m_capacity, m_device->getSamplerCache()->getDefaultSampler());
+
+    VkDescriptorSetLayoutBinding binding{};
+    binding.binding = 0;
+    binding.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    binding.descriptorCount = m_capacity;
+    binding.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+    binding.pImmutableSamplers = immutableSamplers.data();
+
+    // Slots are written while frames using other slots are in flight, and most of the array stays empty
+    VkDescriptorBindingFlags bindingFlags = VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT | VK_DESCRIPTOR_BINDING_UPDATE_AFTER_BIND_BIT |
+        VK_DESCRIPTOR_BINDING_UPDATE_UNUSED_WHILE_PENDING_BIT;
+
+    VkDescriptorSetLayoutBindingFlagsCreateInfo bindingFlagsInfo{};
+    bindingFlagsInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_BINDING_FLAGS_CREATE_INFO;
+    bindingFlagsInfo.bindingCount = 1;
+    bindingFlagsInfo.pBindingFlags = &bindingFlags;
+
+    VkDescriptorSetLayoutCreateInfo layoutInfo{};
+    layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+    layoutInfo.pNext = &bindingFlagsInfo;
+    layoutInfo.flags = VK_DESCRIPTOR_SET_LAYOUT_CREATE_UPDATE_AFTER_BIND_POOL_BIT;
+    layoutInfo.bindingCount = 1;
+    layoutInfo.pBindings = &binding;
+    VK_CHECK(vkCreateDescriptorSetLayout(m_device->get(), &layoutInfo, nullptr, &m_layout));
+
+    VkDescriptorPoolSize poolSize{ VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, m_capacity };
+
+    VkDescriptorPoolCreateInfo poolInfo{};
+    poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+    poolInfo.flags = VK_DESCRIPTOR_POOL_CREATE_UPDATE_AFTER_BIND_BIT;
+    poolInfo.maxSets = 1;
+    poolInfo.poolSizeCount = 1;
+    poolInfo.pPoolSizes = &poolSize;
+    VK_CHECK(vkCreateDescriptorPool(m_device->get(), &poolInfo, nullptr, &m_pool));
+
+    VkDescriptorSetAllocateInfo allocInfo{};
+    allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+    allocInfo.descriptorPool = m_pool;
+    allocInfo.descriptorSetCount = 1;
+    allocInfo.pSetLayouts = &m_layout;
+    VK_CHECK(vkAllocateDescriptorSets(m_device->get(), &allocInfo, &m_descriptorSet));
+
+    createDefaultTexture(renderer);
+}
+
+TextureTable::~TextureTable()
+{
+    vkDestroyImageView(m_device->get(), m_defaultImageView, nullptr);
+    m_defaultImage.reset();
+
+    vkDestroyDescriptorPool(m_device->get(), m_pool, nullptr);
+    vkDestroyDescriptorSetLayout(m_device->get(), m_layout, nullptr);
+}
+
+uint32_t TextureTable::registerTexture(VkImageView imageView)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    uint32_t slot;
+    if (!m_releasedSlots.empty() && m_releasedSlots.front().frame + Renderer::s_maxFramesInFlight <= m_frame) {
+        slot = m_releasedSlots.front().slot;
+        m_releasedSlots.pop_front();
+    }
+    else if (m_nextSlot < m_capacity) {
+        slot = m_nextSlot++;
+    }
+    else {
+        throw std::runtime_error("failed to register texture, the texture table is full!");
+    }
+
+    write(slot, imageView);
+    return slot;
+}
+
+void TextureTable::updateTexture(uint32_t slot, VkImageView imageView)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    write(slot, imageView);
+}
+
+void TextureTable::releaseTexture(uint32_t slot, std::shared_ptr<void> resources)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_releasedSlots.push_back({ slot, m_frame, std::move(resources) });
+}
+
+void TextureTable::nextFrame()
+{
+    std::vector<std::shared_ptr<void>> retired;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_frame++;
+        for (ReleasedSlot& released : m_releasedSlots) {
+            if (released.frame + Renderer::s_maxFramesInFlight > m_frame) {
+                break;
+            }
+            if (released.resources) {
+                retired.push_back(std::move(released.resources));
+            }
+        }
+    }
+    // Destroyed outside the lock, so other threads registering textures do not wait for it
+    retired.clear();
+}
+
+void TextureTable::write(uint32_t slot, VkImageView imageView)
+{
+    // The sampler is immutable, so it is ignored here
+    VkDescriptorImageInfo imageInfo{};
+    imageInfo.imageView = imageView;
+    imageInfo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+
+    VkWriteDescriptorSet write{};
+    write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    write.dstSet = m_descriptorSet;
+    write.dstBinding = 0;
+    write.dstArrayElement = slot;
+    write.descriptorCount = 1;
+    write.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    write.pImageInfo = &imageInfo;
+
+    vkUpdateDescriptorSets(m_device->get(), 1, &write, 0, nullptr);
+}
+
+void TextureTable::createDefaultTexture(Renderer* renderer)
+{
+    StagingSlice staging = m_device->getUploadQueue()->allocateStaging(4);
+    uint32_t white = 0xFFFFFFFF;
+    memcpy(staging.data, &white, sizeof(white));
+
+    m_defaultImage = renderer->createImage(1, 1, 1, VK_SAMPLE_COUNT_1_BIT, VK_FORMAT_R8G8B8A8_UNORM, VK_IMAGE_TILING_OPTIMAL,
+        VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+    // Waited for here so the slot is valid from the very first frame
+    m_device->getUploadQueue()->uploadImage(staging, m_defaultImage, false).wait();
+
+    VkImageViewCreateInfo viewInfo = RendererInits::imageviewCreateInfo(m_defaultImage->get(), VK_FORMAT_R8G8B8A8_UNORM, VK_IMAGE_ASPECT_COLOR_BIT, 1);
+    if (vkCreateImageView(m_device->get(), &viewInfo, nullptr, &m_defaultImageView) != VK_SUCCESS) {
+        throw std::runtime_error("failed to create image view!");
+    }
+
+    // First registration, so it lands in s_defaultTextureSlot
+    registerTexture(m_defaultImageView);
+}
@@ -0,0 +1,58 @@
+#pragma once
+#include "Prerequisites.h"
+
+#include <deque>
+#include <mutex>
+#include <memory>
+
+// Every loaded texture lives in one partially bound, update-after-bind sampler array (descriptor set 2).
+// A texture claims a slot when it is loaded and the shaders index the array with the slot stored in the
+// instance data, so draws never rebind texture descriptors. Every slot samples with the SamplerCache's default
+// sampler, baked into the layout as an immutable sampler, so a slot only ever points at an image view.
+class TextureTable
+{
+public:
+    TextureTable(Device* device, Renderer* renderer);
+    ~TextureTable();
+
+    uint32_t registerTexture(VkImageView imageView);
+    // Points an existing slot at new image data; the slot must not be in use by a pending frame
+    void updateTexture(uint32_t slot, VkImageView imageView);
+    // The slot is handed out again once every frame that could still sample it has retired; resources, e.g. the
+    // image and view the slot pointed at, are kept alive until then
+    void releaseTexture(uint32_t slot, std::shared_ptr<void> resources = nullptr);
+    // Called by the renderer once per frame to age released slots and free their resources
+    void nextFrame();
+
+    VkDescriptorSetLayout getLayout() { return m_layout; }
+    VkDescriptorSet getDescriptorSet() { return m_descriptorSet; }
+    uint32_t getCapacity() const { return m_capacity; }
+
+    // 1x1 white texture, used by models without a texture
+    static constexpr uint32_t s_defaultTextureSlot = 0;
+    static constexpr uint32_t s_invalidSlot = UINT32_MAX;
+
+private:
+    void write(uint32_t slot, VkImageView imageView);
+    void createDefaultTexture(Renderer* renderer);
+
+    struct ReleasedSlot {
+        uint32_t slot;
+        uint64_t frame;
+        std::shared_ptr<void> resources;
+    };
+
+    Device* m_device;
+    uint32_t m_capacity;
+    VkDescriptorSetLayout m_layout = VK_NULL_HANDLE;
+    VkDescriptorPool m_pool = VK_NULL_HANDLE;
+    VkDescriptorSet m_descriptorSet = VK_NULL_HANDLE;
+
+    std::mutex m_mutex; // guards the slots and vkUpdateDescriptorSets on the shared set
+    uint32_t m_nextSlot = 0;
+    std::deque<ReleasedSlot> m_releasedSlots; // in release order, so the oldest is reusable first
+    uint64_t m_frame = 0;
+
+    ImagePtr m_defaultImage;
+    VkImageView m_defaultImageView = VK_NULL_HANDLE;
+};
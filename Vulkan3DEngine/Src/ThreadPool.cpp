@@ -2,22 +2,75 @@
 
 ThreadPool* ThreadPool::m_pool = nullptr;
 
+// Index of the pool worker running on this thread, -1 for threads outside the pool
+static thread_local int t_workerIndex = -1;
+
+bool WorkStealingDeque::push(Job* job)
+{
+    int64_t bottom = m_bottom.load(std::memory_order_relaxed);
+    int64_t top = m_top.load(std::memory_order_acquire);
+    if (bottom - top >= s_capacity) {
+        return false;
+    }
+
+    m_jobs[bottom & (s_capacity - 1)].store(job, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    m_bottom.store(bottom + 1, std::memory_order_relaxed);
+    return true;
+}
+
+Job* WorkStealingDeque::pop()
+{
+    int64_t bottom = m_bottom.load(std::memory_order_relaxed) - 1;
+    m_bottom.store(bottom, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    int64_t top = m_top.load(std::memory_order_relaxed);
+
+    if (top > bottom) {
+        // Empty
+        m_bottom.store(bottom + 1, std::memory_order_relaxed);
+        return nullptr;
+    }
+
+    Job* job = m_jobs[bottom & (s_capacity - 1)].load(std::memory_order_relaxed);
+    if (top == bottom) {
+        // Last job, race the thieves for it
+        if (!m_top.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed)) {
+            job = nullptr;
+        }
+        m_bottom.store(bottom + 1, std::memory_order_relaxed);
+    }
+    return job;
+}
+
+Job* WorkStealingDeque::steal()
+{
+    int64_t top = m_top.load(std::memory_order_acquire);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    int64_t bottom = m_bottom.load(std::memory_order_acquire);
+
+    if (top >= bottom) {
+        return nullptr;
+    }
+
+    Job* job = m_jobs[top & (s_capacity - 1)].load(std::memory_order_relaxed);
+    if (!m_top.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed)) {
+        return nullptr;
+    }
+    return job;
+}
+
 ThreadPool::ThreadPool(size_t threads) : m_stop(false), m_threadCount(threads)
 {
+    m_globalJobPool = std::make_unique<Job[]>(s_jobPoolSize);
     for (size_t i = 0; i < threads; ++i) {
-        m_workers.emplace_back([this] {
-            for (;;) {
-                std::function<void()> task;
-                {
-                    std::unique_lock<std::mutex> lock(this->m_queue_mutex);
-                    this->m_condition.wait(lock, [this] { return this->m_stop || !this->m_tasks.empty(); });
-                    if (this->m_stop && this->m_tasks.empty()) return;
-                    task = std::move(this->m_tasks.front());
-                    this->m_tasks.pop_front();
-                }
-                task();
-            }
-        });
+        auto worker = std::make_unique<Worker>();
+        worker->jobPool = std::make_unique<Job[]>(s_jobPoolSize);
+        m_workerData.push_back(std::move(worker));
+    }
+
+    for (size_t i = 0; i < threads; ++i) {
+        m_workers.emplace_back(&ThreadPool::workerLoop, this, static_cast<int>(i));
     }
 }
 
@@ -36,6 +89,11 @@ ThreadPool* ThreadPool::get()
     return m_pool;
 }
 
+int ThreadPool::getCurrentWorkerIndex()
+{
+    return t_workerIndex;
+}
+
 void ThreadPool::create(size_t threads)
 {
     if (ThreadPool::m_pool) throw std::exception("ThreadPool already created");
@@ -51,4 +109,196 @@ void ThreadPool::release()
     delete ThreadPool::m_pool;
 }
 
+void ThreadPool::wait(JobCounter& counter)
+{
+    // A worker runs the children in its own deque; children that did not fit went to the global queue, where no
+    // other worker picks them up once every worker is waiting, so it takes the counter's queued jobs as well.
+    // Outside the pool, e.g. the render thread waiting for its recording jobs, picking up whatever is queued could
+    // mean running a model import in the middle of a frame, so only the counter's queued jobs are run.
+    int attempts = 0;
+    while (!counter.isDone()) {
+        Job* job = t_workerIndex >= 0 ? findJob(true) : nullptr;
+        if (!job) {
+            job = takeQueuedJob(counter);
+        }
+        if (job) {
+            execute(job);
+            attempts = 0;
+            continue;
+        }
+
+        if (++attempts < s_waitSpinCount) {
+            std::this_thread::yield();
+            continue;
+        }
+
+        // The remaining jobs are running on other threads. The timeout only covers a wake-up that went to
+        // another waiter, the counter's jobs signal the drop to zero themselves.
+        std::unique_lock<std::mutex> lock(m_waitMutex);
+        m_blockedWaiters.fetch_add(1, std::memory_order_seq_cst);
+        m_waitCondition.wait_for(lock, std::chrono::milliseconds(1), [&counter] {
+            return counter.m_count.load(std::memory_order_seq_cst) == 0;
+        });
+        m_blockedWaiters.fetch_sub(1, std::memory_order_seq_cst);
+    }
+}
+
+bool ThreadPool::helpOnce()
+{
+    // A waiting worker only takes jobs from its own deque, newest first, which are the children it
+    // just spawned. Stealing unrelated work here could re-enter a lock the waiting job still holds
+    // (e.g. a ResourceManager per-resource mutex). Threads outside the pool take anything.
+    Job* job = findJob(t_workerIndex >= 0);
+    if (!job) {
+        return false;
+    }
+
+    execute(job);
+    return true;
+}
+
+Job* ThreadPool::allocateJob()
+{
+    // Slots are recycled round-robin; a slot that is still queued or running means the pool is
+    // saturated, so that job falls back to a heap allocation instead of waiting
+    Job* job;
+    if (t_workerIndex >= 0) {
+        Worker& worker = *m_workerData[t_workerIndex];
+        job = &worker.jobPool[worker.nextJob++ & (s_jobPoolSize - 1)];
+    }
+    else {
+        job = &m_globalJobPool[m_globalNextJob.fetch_add(1, std::memory_order_relaxed) & (s_jobPoolSize - 1)];
+    }
+
+    if (job->m_inUse.exchange(true, std::memory_order_acquire)) {
+        job = new Job();
+        job->m_pooled = false;
+    }
+    return job;
+}
+
+void ThreadPool::push(Job* job)
+{
+    if (t_workerIndex < 0 || !m_workerData[t_workerIndex]->deque.push(job)) {
+        {
+            std::unique_lock<std::mutex> lock(m_globalQueueMutex);
+            m_globalQueue.push_back(job);
+            m_globalQueueSize.fetch_add(1, std::memory_order_release);
+        }
+
+        // A blocked waiter may be the only thread left to run it
+        if (job->m_counter && m_blockedWaiters.load(std::memory_order_seq_cst) > 0) {
+            { std::unique_lock<std::mutex> lock(m_waitMutex); }
+            m_waitCondition.notify_all();
+        }
+    }
+
+    m_pendingJobs.fetch_add(1, std::memory_order_seq_cst);
+    if (m_sleepingWorkers.load(std::memory_order_seq_cst) > 0) {
+        // Taking the lock orders this wake-up after a worker that is about to sleep has started waiting
+        { std::unique_lock<std::mutex> lock(m_queue_mutex); }
+        m_condition.notify_one();
+    }
+}
+
+Job* ThreadPool::findJob(bool localOnly)
+{
+    Job* job = nullptr;
+
+    if (t_workerIndex >= 0) {
+        job = m_workerData[t_workerIndex]->deque.pop();
+    }
+
+    if (localOnly) {
+        if (job) {
+            m_pendingJobs.fetch_sub(1, std::memory_order_relaxed);
+        }
+        return job;
+    }
+
+    if (!job && m_globalQueueSize.load(std::memory_order_acquire) > 0) {
+        std::unique_lock<std::mutex> lock(m_globalQueueMutex);
+        if (!m_globalQueue.empty()) {
+            job = m_globalQueue.front();
+            m_globalQueue.pop_front();
+            m_globalQueueSize.fetch_sub(1, std::memory_order_relaxed);
+        }
+    }
+
+    if (!job) {
+        // Start stealing at the neighbour so thieves spread out over the victims
+        size_t start = t_workerIndex >= 0 ? t_workerIndex + 1 : 0;
+        for (size_t i = 0; i < m_threadCount && !job; ++i) {
+            size_t victim = (start + i) % m_threadCount;
+            if (static_cast<int>(victim) != t_workerIndex) {
+                job = m_workerData[victim]->deque.steal();
+            }
+        }
+    }
+
+    if (job) {
+        m_pendingJobs.fetch_sub(1, std::memory_order_relaxed);
+    }
+    return job;
+}
+
+Job* ThreadPool::takeQueuedJob(const JobCounter& counter)
+{
+    if (m_globalQueueSize.load(std::memory_order_acquire) == 0) {
+        return nullptr;
+    }
+
+    // Newest first, the counter's jobs were pushed after anything already waiting
+    std::unique_lock<std::mutex> lock(m_globalQueueMutex);
+    for (auto it = m_globalQueue.rbegin(); it != m_globalQueue.rend(); ++it) {
+        if ((*it)->m_counter == &counter) {
+            Job* job = *it;
+            m_globalQueue.erase(std::next(it).base());
+            m_globalQueueSize.fetch_sub(1, std::memory_order_relaxed);
+            m_pendingJobs.fetch_sub(1, std::memory_order_relaxed);
+            return job;
+        }
+    }
+    return nullptr;
+}
+
+void ThreadPool::execute(Job* job)
+{
+    job->m_invoke(job->m_storage);
+    job->m_destroy(job->m_storage);
+
+    JobCounter* counter = job->m_counter;
+    if (job->m_pooled) {
+        job->m_inUse.store(false, std::memory_order_release);
+    }
+    else {
+        delete job;
+    }
+
+    // The counter belongs to the waiter and may be gone once it reads zero
+    if (counter && counter->m_count.fetch_sub(1, std::memory_order_seq_cst) == 1 &&
+        m_blockedWaiters.load(std::memory_order_seq_cst) > 0) {
+        { std::unique_lock<std::mutex> lock(m_waitMutex); }
+        m_waitCondition.notify_all();
+    }
+}
+
+void ThreadPool::workerLoop(int index)
+{
+    t_workerIndex = index;
 
+    for (;;) {
+        Job* job = findJob();
+        if (job) {
+            execute(job);
+            continue;
+        }
+
+        std::unique_lock<std::mutex> lock(m_queue_mutex);
+        m_sleepingWorkers.fetch_add(1, std::memory_order_seq_cst);
+        m_condition.wait(lock, [this] { return m_stop || m_pendingJobs.load(std::memory_order_seq_cst) > 0; });
+        m_sleepingWorkers.fetch_sub(1, std::memory_order_seq_cst);
+
+        if (m_stop && m_pendingJobs.load() <= 0) return;
+    }
+}
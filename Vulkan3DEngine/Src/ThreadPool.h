@@ -1,17 +1,86 @@
+#pragma once
 #include <deque>
 #include <vector>
+#include <array>
+#include <memory>
 #include <thread>
 #include <future>
 #include <mutex>
 #include <condition_variable>
 #include <functional>
 #include <atomic>
+#include <new>
+#include <cstddef>
+#include <stdexcept>
+#include <type_traits>
+#include <algorithm>
+#include <chrono>
 
 template<typename F, typename... Args>
 concept Callable = requires(F f, Args... args) {
     { std::invoke(f, args...) } -> std::same_as<typename std::invoke_result<F, Args...>::type>;
 };
 
+// Counts unfinished jobs; ThreadPool::wait helps with the counted jobs until it drops to zero
+class JobCounter {
+public:
+    bool isDone() const { return m_count.load(std::memory_order_acquire) == 0; }
+private:
+    std::atomic<int> m_count = 0;
+
+    friend class ThreadPool;
+};
+
+// A type-erased, move-only task with inline storage, so submitting a small callable does not allocate
+class Job {
+public:
+    static constexpr size_t s_storageSize = 48;
+
+    template<class F>
+    void set(F&& f, JobCounter* counter)
+    {
+        using Fn = std::decay_t<F>;
+        if constexpr (sizeof(Fn) <= s_storageSize && alignof(Fn) <= alignof(std::max_align_t)) {
+            new (m_storage) Fn(std::forward<F>(f));
+            m_invoke = [](void* storage) { (*static_cast<Fn*>(storage))(); };
+            m_destroy = [](void* storage) { static_cast<Fn*>(storage)->~Fn(); };
+        }
+        else {
+            // Oversized callables are the only case that still goes to the heap
+            *reinterpret_cast<Fn**>(m_storage) = new Fn(std::forward<F>(f));
+            m_invoke = [](void* storage) { (**static_cast<Fn**>(storage))(); };
+            m_destroy = [](void* storage) { delete *static_cast<Fn**>(storage); };
+        }
+        m_counter = counter;
+    }
+
+private:
+    alignas(std::max_align_t) unsigned char m_storage[s_storageSize];
+    void (*m_invoke)(void*) = nullptr;
+    void (*m_destroy)(void*) = nullptr;
+    JobCounter* m_counter = nullptr;
+    std::atomic<bool> m_inUse = false;
+    bool m_pooled = true;
+
+    friend class ThreadPool;
+};
+
+// Bounded Chase-Lev deque: the owning worker pushes and pops at the bottom, other threads steal from the top
+class WorkStealingDeque {
+public:
+    // Jobs past it go to the pool's global queue
+    static constexpr int64_t s_capacity = 4096;
+
+    bool push(Job* job);
+    Job* pop();
+    Job* steal();
+private:
+
+    alignas(64) std::atomic<int64_t> m_top = 0;
+    alignas(64) std::atomic<int64_t> m_bottom = 0;
+    std::array<std::atomic<Job*>, s_capacity> m_jobs;
+};
+
 class ThreadPool {
 private:
     ThreadPool(size_t threads);
@@ -24,27 +93,125 @@ public:
     static void release();
 
     size_t getThreadCount() { return m_threadCount; }
+    // Index of the pool worker running the caller in [0, getThreadCount()), -1 for threads outside the pool
+    static int getCurrentWorkerIndex();
 
     template<Callable F, class ...Args>
     auto enqueue(F&& f, Args && ...args) -> std::future<typename std::invoke_result<F, Args...>::type>
     {
         using return_type = typename std::invoke_result<F, Args...>::type;
-        auto task = std::make_shared< std::packaged_task<return_type()> >(std::bind(std::forward<F>(f), std::forward<Args>(args)...));
-        std::future<return_type> res = task->get_future();
-        {
-            std::unique_lock<std::mutex> lock(m_queue_mutex);
-            if (m_stop) throw std::runtime_error("enqueue on stopped ThreadPool");
-            m_tasks.emplace_back([task]() { (*task)(); });
-        }
-        m_condition.notify_one();
+        std::packaged_task<return_type()> task(std::bind(std::forward<F>(f), std::forward<Args>(args)...));
+        std::future<return_type> res = task.get_future();
+        if (m_stop) throw std::runtime_error("enqueue on stopped ThreadPool");
+        submit([task = std::move(task)]() mutable { task(); }, nullptr);
         return res;
     }
+
+    // Fire-and-forget job tracked by a counter instead of a future; f must not throw
+    template<class F>
+    void run(JobCounter& counter, F&& f)
+    {
+        counter.m_count.fetch_add(1, std::memory_order_relaxed);
+        submit(std::forward<F>(f), &counter);
+    }
+
+    // Runs jobs on the calling thread until every job tracked by the counter has finished. A worker runs its own
+    // children, a thread outside the pool only the counter's jobs, never unrelated work queued before them. Once
+    // there is nothing left to run the thread blocks until the counter drops to zero.
+    void wait(JobCounter& counter);
+
+    // Waits for a future returned by enqueue without parking the thread: queued jobs are run while
+    // the result is not ready. Use this instead of future.get() inside pool tasks.
+    template<class T>
+    T wait(std::future<T>& future)
+    {
+        while (future.wait_for(std::chrono::seconds(0)) != std::future_status::ready) {
+            if (!helpOnce()) {
+                std::this_thread::yield();
+            }
+        }
+        return future.get();
+    }
+
+    template<class T>
+    decltype(auto) wait(const std::shared_future<T>& future)
+    {
+        while (future.wait_for(std::chrono::seconds(0)) != std::future_status::ready) {
+            if (!helpOnce()) {
+                std::this_thread::yield();
+            }
+        }
+        return future.get();
+    }
+
+    // Calls func(i) for every i in [first, last), split into chunks of grainSize (0 picks one from the thread count).
+    // The calling thread works on the chunks too.
+    template<class F>
+    void parallel_for(size_t first, size_t last, F&& func, size_t grainSize = 0)
+    {
+        if (first >= last) return;
+        if (grainSize == 0) {
+            grainSize = std::max<size_t>(1, (last - first) / (m_threadCount * 4));
+        }
+
+        JobCounter counter;
+        for (size_t begin = first; begin < last; begin += grainSize) {
+            size_t end = std::min(begin + grainSize, last);
+            run(counter, [&func, begin, end]() {
+                for (size_t i = begin; i < end; ++i) func(i);
+            });
+        }
+        wait(counter);
+    }
 private:
+    template<class F>
+    void submit(F&& f, JobCounter* counter)
+    {
+        Job* job = allocateJob();
+        job->set(std::forward<F>(f), counter);
+        push(job);
+    }
+
+    Job* allocateJob();
+    void push(Job* job);
+    Job* findJob(bool localOnly = false);
+    // A job of the counter still waiting in the global queue
+    Job* takeQueuedJob(const JobCounter& counter);
+    bool helpOnce();
+    void execute(Job* job);
+    void workerLoop(int index);
+
+    static constexpr size_t s_jobPoolSize = 4096;
+    // Failed attempts to find a job of the counter before wait() blocks
+    static constexpr int s_waitSpinCount = 64;
+
+    struct Worker {
+        WorkStealingDeque deque;
+        std::unique_ptr<Job[]> jobPool; // only the owning worker allocates from it
+        size_t nextJob = 0;
+    };
+
     static ThreadPool* m_pool;
     std::vector< std::thread > m_workers;
-    std::deque< std::function<void()> > m_tasks;
+    std::vector< std::unique_ptr<Worker> > m_workerData;
+
+    // Jobs submitted from threads outside the pool
+    std::deque< Job* > m_globalQueue;
+    std::mutex m_globalQueueMutex;
+    std::atomic<size_t> m_globalQueueSize = 0; // lets workers skip the lock when it is empty
+    std::unique_ptr<Job[]> m_globalJobPool;
+    std::atomic<size_t> m_globalNextJob = 0;
+
+    // Sleeping workers are woken when the pending count rises
+    std::atomic<int64_t> m_pendingJobs = 0;
+    std::atomic<int> m_sleepingWorkers = 0;
     std::mutex m_queue_mutex;
     std::condition_variable m_condition;
-    bool m_stop;
+    std::atomic<bool> m_stop;
+
+    // Threads blocked in wait(JobCounter&), woken when a counter drops to zero or a job spills to the global queue
+    std::atomic<int> m_blockedWaiters = 0;
+    std::mutex m_waitMutex;
+    std::condition_variable m_waitCondition;
     size_t m_threadCount;
 };
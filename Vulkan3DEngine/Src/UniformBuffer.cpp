@@ -4,10 +4,7 @@
 UniformBuffer::UniformBuffer(VkDeviceSize bufferSize, Renderer* renderer) : Buffer(renderer)
 {
    // VkDeviceSize bufferSize = sizeof(UniformBufferObject);
-    createBuffer(bufferSize, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
-        VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, m_buffer, m_bufferMemory);
-
-    vkMapMemory(GraphicsEngine::get()->getDevice()->get(), m_bufferMemory, 0, bufferSize, 0, &m_mapped);
+    createBuffer(bufferSize, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, MemoryUsage::Dynamic);
 }
 
 UniformBuffer::~UniformBuffer()
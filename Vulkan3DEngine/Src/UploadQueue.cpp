@@ -0,0 +1,374 @@
+#include "UploadQueue.h"
+#include "Device.h"
+#include "StagingBuffer.h"
+#include "Image.h"
+
+// Sized for a handful of typical meshes and 2K textures in flight; larger uploads get a dedicated buffer
+static const VkDeviceSize s_stagingRingSize = 64ull * 1024 * 1024;
+
+UploadQueue::UploadQueue(Device* device) : m_device(device), m_stagingRing(device, s_stagingRingSize)
+{
+    const QueueFamilyIndices& indices = m_device->getQueueFamilyIndices();
+    m_graphicsFamily = indices.graphicsFamily.value();
+    m_transferFamily = indices.transferFamily.value_or(m_graphicsFamily);
+    m_transferQueue = usesDedicatedTransferQueue() ? m_device->getTransferQueue() : m_device->getGraphicsQueue();
+
+    VkCommandPoolCreateInfo poolInfo{};
+    poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+    poolInfo.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+    poolInfo.queueFamilyIndex = m_graphicsFamily;
+
+    if (vkCreateCommandPool(m_device->get(), &poolInfo, nullptr, &m_graphicsCommandPool) != VK_SUCCESS) {
+        throw std::runtime_error("failed to create upload command pool!");
+    }
+
+    if (usesDedicatedTransferQueue()) {
+        poolInfo.queueFamilyIndex = m_transferFamily;
+
+        if (vkCreateCommandPool(m_device->get(), &poolInfo, nullptr, &m_transferCommandPool) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create upload command pool!");
+        }
+    }
+
+    m_worker = std::thread(&UploadQueue::workerLoop, this);
+}
+
+UploadQueue::~UploadQueue()
+{
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_stop = true;
+    }
+    m_condition.notify_all();
+    // The worker drains pending and in-flight uploads before it exits
+    m_worker.join();
+
+    if (m_transferCommandPool != VK_NULL_HANDLE) {
+        vkDestroyCommandPool(m_device->get(), m_transferCommandPool, nullptr);
+    }
+    vkDestroyCommandPool(m_device->get(), m_graphicsCommandPool, nullptr);
+}
+
+std::shared_future<void> UploadQueue::uploadBuffer(StagingSlice staging, VkBuffer dstBuffer, VkPipelineStageFlags dstStage, VkAccessFlags dstAccess)
+{
+    BufferUpload upload{ std::move(staging), dstBuffer, dstStage, dstAccess };
+    std::shared_future<void> future = upload.promise.get_future().share();
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        if (m_stop) throw std::runtime_error("upload on stopped UploadQueue");
+        m_pendingBuffers.push_back(std::move(upload));
+        m_outstanding++;
+    }
+    m_condition.notify_one();
+    return future;
+}
+
+std::shared_future<void> UploadQueue::uploadImage(StagingSlice staging, ImagePtr image, bool generateMipmaps)
+{
+    if (generateMipmaps) {
+        // Check if image format supports linear blitting
+        VkFormatProperties formatProperties;
+        vkGetPhysicalDeviceFormatProperties(m_device->getPhysicalDevice(), image->getFormat(), &formatProperties);
+
+        if (!(formatProperties.optimalTilingFeatures & VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT)) {
+            throw std::runtime_error("texture image format does not support linear blitting!");
+        }
+    }
+
+    VkBufferImageCopy region{};
+    region.bufferOffset = 0;
+    region.bufferRowLength = 0;
+    region.bufferImageHeight = 0;
+    region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    region.imageSubresource.mipLevel = 0;
+    region.imageSubresource.baseArrayLayer = 0;
+    region.imageSubresource.layerCount = 1;
+    region.imageOffset = { 0, 0, 0 };
+    region.imageExtent = { image->getWidth(), image->getHeight(), 1 };
+
+    return queueImageUpload({ std::move(staging), std::move(image), generateMipmaps, { region } });
+}
+
+std::shared_future<void> UploadQueue::uploadImageLevels(StagingSlice staging, ImagePtr image, std::vector<VkBufferImageCopy> regions)
+{
+    return queueImageUpload({ std::move(staging), std::move(image), false, std::move(regions) });
+}
+
+std::shared_future<void> UploadQueue::queueImageUpload(ImageUpload upload)
+{
+    std::shared_future<void> future = upload.promise.get_future().share();
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        if (m_stop) throw std::runtime_error("upload on stopped UploadQueue");
+        m_pendingImages.push_back(std::move(upload));
+        m_outstanding++;
+    }
+    m_condition.notify_one();
+    return future;
+}
+
+void UploadQueue::waitIdle()
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_idleCondition.wait(lock, [this] { return m_outstanding == 0; });
+}
+
+void UploadQueue::workerLoop()
+{
+    for (;;) {
+        Batch batch;
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            if (m_inFlight.empty()) {
+                m_condition.wait(lock, [this] { return m_stop || !m_pendingBuffers.empty() || !m_pendingImages.empty(); });
+            }
+            if (m_stop && m_pendingBuffers.empty() && m_pendingImages.empty() && m_inFlight.empty()) return;
+
+            // Everything requested since the last submit goes into one batch
+            batch.bufferUploads.swap(m_pendingBuffers);
+            batch.imageUploads.swap(m_pendingImages);
+        }
+
+        bool submitted = false;
+        if (!batch.bufferUploads.empty() || !batch.imageUploads.empty()) {
+            submitBatch(batch);
+            m_inFlight.push_back(std::move(batch));
+            submitted = true;
+        }
+
+        // Retire in submission order; only block (briefly) when there was nothing new to submit
+        while (!m_inFlight.empty() && retireBatch(m_inFlight.front(), !submitted)) {
+            m_inFlight.pop_front();
+            submitted = true;
+        }
+    }
+}
+
+void UploadQueue::submitBatch(Batch& batch)
+{
+    VkFenceCreateInfo fenceInfo{};
+    fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+    VK_CHECK(vkCreateFence(m_device->get(), &fenceInfo, nullptr, &batch.fence));
+
+    VkCommandBufferBeginInfo beginInfo{};
+    beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+
+    batch.graphicsCommandBuffer = allocateCommandBuffer(m_graphicsCommandPool);
+
+    if (usesDedicatedTransferQueue()) {
+        VkSemaphoreCreateInfo semaphoreInfo{};
+        semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+        VK_CHECK(vkCreateSemaphore(m_device->get(), &semaphoreInfo, nullptr, &batch.transferFinished));
+
+        batch.transferCommandBuffer = allocateCommandBuffer(m_transferCommandPool);
+        vkBeginCommandBuffer(batch.transferCommandBuffer, &beginInfo);
+        recordTransfer(batch.transferCommandBuffer, batch);
+        vkEndCommandBuffer(batch.transferCommandBuffer);
+
+        vkBeginCommandBuffer(batch.graphicsCommandBuffer, &beginInfo);
+        recordGraphics(batch.graphicsCommandBuffer, batch);
+        vkEndCommandBuffer(batch.graphicsCommandBuffer);
+
+        std::lock_guard<std::mutex> lock(m_device->getQueueMutex());
+
+        VkSubmitInfo transferSubmit{};
+        transferSubmit.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+        transferSubmit.commandBufferCount = 1;
+        transferSubmit.pCommandBuffers = &batch.transferCommandBuffer;
+        transferSubmit.signalSemaphoreCount = 1;
+        transferSubmit.pSignalSemaphores = &batch.transferFinished;
+        VK_CHECK(vkQueueSubmit(m_transferQueue, 1, &transferSubmit, VK_NULL_HANDLE));
+
+        VkPipelineStageFlags waitStage = VK_PIPELINE_STAGE_ALL_COMMANDS_BIT;
+        VkSubmitInfo graphicsSubmit{};
+        graphicsSubmit.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+        graphicsSubmit.waitSemaphoreCount = 1;
+        graphicsSubmit.pWaitSemaphores = &batch.transferFinished;
+        graphicsSubmit.pWaitDstStageMask = &waitStage;
+        graphicsSubmit.commandBufferCount = 1;
+        graphicsSubmit.pCommandBuffers = &batch.graphicsCommandBuffer;
+        VK_CHECK(vkQueueSubmit(m_device->getGraphicsQueue(), 1, &graphicsSubmit, batch.fence));
+    }
+    else {
+        vkBeginCommandBuffer(batch.graphicsCommandBuffer, &beginInfo);
+        recordTransfer(batch.graphicsCommandBuffer, batch);
+        recordGraphics(batch.graphicsCommandBuffer, batch);
+        vkEndCommandBuffer(batch.graphicsCommandBuffer);
+
+        std::lock_guard<std::mutex> lock(m_device->getQueueMutex());
+
+        VkSubmitInfo submitInfo{};
+        submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+        submitInfo.commandBufferCount = 1;
+        submitInfo.pCommandBuffers = &batch.graphicsCommandBuffer;
+        VK_CHECK(vkQueueSubmit(m_device->getGraphicsQueue(), 1, &submitInfo, batch.fence));
+    }
+
+    m_submittedBatches++;
+}
+
+bool UploadQueue::retireBatch(Batch& batch, bool wait)
+{
+    const uint64_t timeout = 1000000; // 1 ms, so new requests are not held back for long
+    VkResult result = wait ? vkWaitForFences(m_device->get(), 1, &batch.fence, VK_TRUE, timeout) : vkGetFenceStatus(m_device->get(), batch.fence);
+    if (result != VK_SUCCESS) {
+        return false;
+    }
+
+    vkFreeCommandBuffers(m_device->get(), m_graphicsCommandPool, 1, &batch.graphicsCommandBuffer);
+    if (batch.transferCommandBuffer != VK_NULL_HANDLE) {
+        vkFreeCommandBuffers(m_device->get(), m_transferCommandPool, 1, &batch.transferCommandBuffer);
+        vkDestroySemaphore(m_device->get(), batch.transferFinished, nullptr);
+    }
+    vkDestroyFence(m_device->get(), batch.fence, nullptr);
+
+    // Dropping the leases hands the staging memory back to the ring
+    for (auto& upload : batch.bufferUploads) {
+        upload.staging.lease.reset();
+        upload.promise.set_value();
+    }
+    for (auto& upload : batch.imageUploads) {
+        upload.staging.lease.reset();
+        upload.promise.set_value();
+    }
+
+    size_t count = batch.bufferUploads.size() + batch.imageUploads.size();
+    m_completedUploads += count;
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_outstanding -= count;
+    }
+    m_idleCondition.notify_all();
+
+    return true;
+}
+
+void UploadQueue::recordTransfer(VkCommandBuffer commandBuffer, Batch& batch)
+{
+    for (auto& upload : batch.imageUploads) {
+        upload.image->recordLayoutTransition(commandBuffer, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
+    }
+
+    for (auto& upload : batch.bufferUploads) {
+        VkBufferCopy copyRegion{};
+        copyRegion.srcOffset = upload.staging.offset;
+        copyRegion.size = upload.staging.size;
+        vkCmdCopyBuffer(commandBuffer, upload.staging.buffer, upload.dstBuffer, 1, &copyRegion);
+    }
+
+    for (auto& upload : batch.imageUploads) {
+        std::vector<VkBufferImageCopy> regions = upload.regions;
+        for (VkBufferImageCopy& region : regions) {
+            region.bufferOffset += upload.staging.offset;
+        }
+        vkCmdCopyBufferToImage(commandBuffer, upload.staging.buffer, upload.image->get(), VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+            static_cast<uint32_t>(regions.size()), regions.data());
+    }
+
+    if (!usesDedicatedTransferQueue()) {
+        return;
+    }
+
+    // Release ownership to the graphics family; the matching acquire is recorded in recordGraphics
+    std::vector<VkBufferMemoryBarrier> bufferBarriers;
+    for (auto& upload : batch.bufferUploads) {
+        VkBufferMemoryBarrier barrier{};
+        barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+        barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        barrier.dstAccessMask = 0;
+        barrier.srcQueueFamilyIndex = m_transferFamily;
+        barrier.dstQueueFamilyIndex = m_graphicsFamily;
+        barrier.buffer = upload.dstBuffer;
+        barrier.offset = 0;
+        barrier.size = upload.staging.size;
+        bufferBarriers.push_back(barrier);
+    }
+
+    std::vector<VkImageMemoryBarrier> imageBarriers;
+    for (auto& upload : batch.imageUploads) {
+        VkImageMemoryBarrier barrier{};
+        barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+        barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+        barrier.newLayout = upload.generateMipmaps ? VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL : VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+        barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        barrier.dstAccessMask = 0;
+        barrier.srcQueueFamilyIndex = m_transferFamily;
+        barrier.dstQueueFamilyIndex = m_graphicsFamily;
+        barrier.image = upload.image->get();
+        barrier.subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, upload.image->getMipLevels(), 0, 1 };
+        imageBarriers.push_back(barrier);
+    }
+
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0, 0, nullptr,
+        static_cast<uint32_t>(bufferBarriers.size()), bufferBarriers.data(), static_cast<uint32_t>(imageBarriers.size()), imageBarriers.data());
+}
+
+void UploadQueue::recordGraphics(VkCommandBuffer commandBuffer, Batch& batch)
+{
+    const bool acquire = usesDedicatedTransferQueue();
+
+    if (!batch.bufferUploads.empty()) {
+        std::vector<VkBufferMemoryBarrier> bufferBarriers;
+        VkPipelineStageFlags dstStage = 0;
+        for (auto& upload : batch.bufferUploads) {
+            VkBufferMemoryBarrier barrier{};
+            barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+            barrier.srcAccessMask = acquire ? 0 : VK_ACCESS_TRANSFER_WRITE_BIT;
+            barrier.dstAccessMask = upload.dstAccess;
+            barrier.srcQueueFamilyIndex = acquire ? m_transferFamily : VK_QUEUE_FAMILY_IGNORED;
+            barrier.dstQueueFamilyIndex = acquire ? m_graphicsFamily : VK_QUEUE_FAMILY_IGNORED;
+            barrier.buffer = upload.dstBuffer;
+            barrier.offset = 0;
+            barrier.size = upload.staging.size;
+            bufferBarriers.push_back(barrier);
+            dstStage |= upload.dstStage;
+        }
+
+        vkCmdPipelineBarrier(commandBuffer, acquire ? VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT : VK_PIPELINE_STAGE_TRANSFER_BIT, dstStage, 0, 0, nullptr,
+            static_cast<uint32_t>(bufferBarriers.size()), bufferBarriers.data(), 0, nullptr);
+    }
+
+    for (auto& upload : batch.imageUploads) {
+        if (acquire) {
+            VkImageMemoryBarrier barrier{};
+            barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+            barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+            barrier.newLayout = upload.generateMipmaps ? VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL : VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+            barrier.srcAccessMask = 0;
+            barrier.dstAccessMask = upload.generateMipmaps ? VK_ACCESS_TRANSFER_READ_BIT | VK_ACCESS_TRANSFER_WRITE_BIT : VK_ACCESS_SHADER_READ_BIT;
+            barrier.srcQueueFamilyIndex = m_transferFamily;
+            barrier.dstQueueFamilyIndex = m_graphicsFamily;
+            barrier.image = upload.image->get();
+            barrier.subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, upload.image->getMipLevels(), 0, 1 };
+
+            vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+                upload.generateMipmaps ? VK_PIPELINE_STAGE_TRANSFER_BIT : VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+
+            upload.image->updateLayout(barrier.newLayout);
+        }
+
+        if (upload.generateMipmaps) {
+            upload.image->recordMipmaps(commandBuffer);
+        }
+        else if (!acquire) {
+            upload.image->recordLayoutTransition(commandBuffer, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+        }
+    }
+}
+
+VkCommandBuffer UploadQueue::allocateCommandBuffer(VkCommandPool pool)
+{
+    VkCommandBufferAllocateInfo allocInfo{};
+    allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+    allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+    allocInfo.commandPool = pool;
+    allocInfo.commandBufferCount = 1;
+
+    VkCommandBuffer commandBuffer;
+    if (vkAllocateCommandBuffers(m_device->get(), &allocInfo, &commandBuffer) != VK_SUCCESS) {
+        throw std::runtime_error("failed to allocate upload command buffer!");
+    }
+
+    return commandBuffer;
+}
@@ -0,0 +1,97 @@
+#pragma once
+#include "Prerequisites.h"
+#include "StagingRing.h"
+
+#include <vector>
+#include <deque>
+#include <thread>
+#include <future>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+
+// Collects staging copies from any thread and submits them in batches from a dedicated worker.
+// Copies run on the dedicated transfer queue family when the device has one; mip generation and
+// queue family ownership acquires run on the graphics queue. Completion is tracked with fences
+// and reported back through futures, so no caller ever waits for a queue to go idle.
+class UploadQueue
+{
+public:
+    UploadQueue(Device* device);
+    ~UploadQueue();
+
+    // Mapped upload memory for one upload; write the source data into slice.data before submitting it
+    StagingSlice allocateStaging(VkDeviceSize size) { return m_stagingRing.allocate(size); }
+    StagingRing& getStagingRing() { return m_stagingRing; }
+
+    // The staging slice is kept alive until the copy has finished on the GPU
+    std::shared_future<void> uploadBuffer(StagingSlice staging, VkBuffer dstBuffer, VkPipelineStageFlags dstStage, VkAccessFlags dstAccess);
+    // Leaves the image in VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL
+    std::shared_future<void> uploadImage(StagingSlice staging, ImagePtr image, bool generateMipmaps);
+    // Copies precomputed levels, e.g. a block compressed mip chain; the region buffer offsets are relative to the slice
+    std::shared_future<void> uploadImageLevels(StagingSlice staging, ImagePtr image, std::vector<VkBufferImageCopy> regions);
+    // Blocks until every upload requested so far has retired
+    void waitIdle();
+
+    bool usesDedicatedTransferQueue() const { return m_transferFamily != m_graphicsFamily; }
+    uint64_t getSubmittedBatchCount() const { return m_submittedBatches; }
+    uint64_t getCompletedUploadCount() const { return m_completedUploads; }
+
+private:
+    struct BufferUpload {
+        StagingSlice staging;
+        VkBuffer dstBuffer;
+        VkPipelineStageFlags dstStage;
+        VkAccessFlags dstAccess;
+        std::promise<void> promise;
+    };
+
+    struct ImageUpload {
+        StagingSlice staging;
+        ImagePtr image;
+        bool generateMipmaps;
+        std::vector<VkBufferImageCopy> regions;
+        std::promise<void> promise;
+    };
+
+    std::shared_future<void> queueImageUpload(ImageUpload upload);
+
+    struct Batch {
+        VkCommandBuffer transferCommandBuffer = VK_NULL_HANDLE;
+        VkCommandBuffer graphicsCommandBuffer = VK_NULL_HANDLE;
+        VkSemaphore transferFinished = VK_NULL_HANDLE;
+        VkFence fence = VK_NULL_HANDLE;
+        std::vector<BufferUpload> bufferUploads;
+        std::vector<ImageUpload> imageUploads;
+    };
+
+    void workerLoop();
+    void submitBatch(Batch& batch);
+    bool retireBatch(Batch& batch, bool wait);
+
+    void recordTransfer(VkCommandBuffer commandBuffer, Batch& batch);
+    void recordGraphics(VkCommandBuffer commandBuffer, Batch& batch);
+
+    VkCommandBuffer allocateCommandBuffer(VkCommandPool pool);
+
+    Device* m_device;
+    StagingRing m_stagingRing;
+    uint32_t m_graphicsFamily;
+    uint32_t m_transferFamily;
+    VkQueue m_transferQueue;
+    VkCommandPool m_transferCommandPool = VK_NULL_HANDLE;
+    VkCommandPool m_graphicsCommandPool = VK_NULL_HANDLE;
+
+    std::thread m_worker;
+    std::mutex m_mutex;
+    std::condition_variable m_condition;
+    std::condition_variable m_idleCondition;
+    uint64_t m_outstanding = 0; // requested but not yet retired
+    std::vector<BufferUpload> m_pendingBuffers;
+    std::vector<ImageUpload> m_pendingImages;
+    std::deque<Batch> m_inFlight; // only touched by the worker
+    bool m_stop = false;
+
+    std::atomic<uint64_t> m_submittedBatches = 0;
+    std::atomic<uint64_t> m_completedUploads = 0;
+};
@@ -1,20 +1,22 @@
 #include "VertexBuffer.h"
 #include "GraphicsEngine.h"
-#include "StagingBuffer.h"
+#include "UploadQueue.h"
 
-VertexBuffer::VertexBuffer(std::vector<Vertex> vertices, Renderer* renderer) : Buffer(renderer)
+VertexBuffer::VertexBuffer(const std::vector<Vertex>& vertices, Renderer* renderer) :
+    VertexBuffer(vertices.data(), sizeof(Vertex) * vertices.size(), renderer)
 {
-    VkDeviceSize bufferSize = sizeof(vertices[0]) * vertices.size();
-    StagingBufferPtr stagingBuffer = m_renderer->createStagingBuffer(bufferSize);
+}
+
+VertexBuffer::VertexBuffer(const void* vertices, VkDeviceSize bufferSize, Renderer* renderer) : Buffer(renderer)
+{
+    StagingSlice staging = GraphicsEngine::get()->getDevice()->getUploadQueue()->allocateStaging(bufferSize);
 
-    stagingBuffer->map();
-    memcpy(stagingBuffer->getMappedMemory(), vertices.data(), (size_t)bufferSize);
-    stagingBuffer->unmap();
+    memcpy(staging.data, vertices, (size_t)bufferSize);
 
-    createBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
-        VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, m_buffer, m_bufferMemory);
+    createBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, MemoryUsage::GpuOnly);
 
-    copyBuffer(stagingBuffer->get(), m_buffer, bufferSize);
+    m_uploadFuture = GraphicsEngine::get()->getDevice()->getUploadQueue()->uploadBuffer(staging, m_buffer,
+        VK_PIPELINE_STAGE_VERTEX_INPUT_BIT, VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT);
 }
 
 VertexBuffer::~VertexBuffer()
@@ -22,8 +24,13 @@ VertexBuffer::~VertexBuffer()
 }
 
 void VertexBuffer::bind()
+{
+    bind(GraphicsEngine::get()->getRenderer()->getCurrentCommandBuffer());
+}
+
+void VertexBuffer::bind(VkCommandBuffer commandBuffer)
 {
     VkBuffer buffers[] = { m_buffer };
     VkDeviceSize offsets[] = { 0 };
-    vkCmdBindVertexBuffers(GraphicsEngine::get()->getRenderer()->getCurrentCommandBuffer(), 0, 1, buffers, offsets);
+    vkCmdBindVertexBuffers(commandBuffer, 0, 1, buffers, offsets);
 }
\ No newline at end of file
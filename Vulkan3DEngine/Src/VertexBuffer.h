@@ -6,10 +6,14 @@
 struct VertexBuffer: public Buffer
 {
 public:
-	VertexBuffer(std::vector<Vertex> vertices, Renderer* renderer);
+	VertexBuffer(const std::vector<Vertex>& vertices, Renderer* renderer);
+	// Raw vertex data of any VertexFormat
+	VertexBuffer(const void* vertices, VkDeviceSize bufferSize, Renderer* renderer);
 	~VertexBuffer();
 	
 	void bind() override;
+	// For command buffers other than the renderer's current one, e.g. secondaries recorded on worker threads
+	void bind(VkCommandBuffer commandBuffer);
 private:
 
 };
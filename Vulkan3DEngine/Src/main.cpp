@@ -1,9 +1,190 @@
 #include <iostream>
 #include <stdexcept>
 #include <cstdlib>
+#include <algorithm>
+#include <cctype>
+#include <latch>
 #include "Application.h"
+#include "MeshFile.h"
+#include "TextureFile.h"
+#include "Texture.h"
+
+// Every file with one of the extensions, given in lower case, in the files and directories after the tool switch, or in
+// defaultDirectory; the match ignores case, so .PNG and .Obj are found too
+static std::vector<std::filesystem::path> collectSourceFiles(int argc, char** argv, const std::filesystem::path& defaultDirectory,
+	const std::vector<std::string>& extensions)
+{
+	std::vector<std::filesystem::path> inputs(argv + 2, argv + argc);
+	if (inputs.empty()) {
+		inputs.push_back(defaultDirectory);
+	}
+
+	std::vector<std::filesystem::path> sources;
+	for (const std::filesystem::path& input : inputs) {
+		if (std::filesystem::is_directory(input)) {
+			for (const auto& entry : std::filesystem::recursive_directory_iterator(input)) {
+				if (!entry.is_regular_file()) {
+					continue;
+				}
+				std::string extension = entry.path().extension().string();
+				std::transform(extension.begin(), extension.end(), extension.begin(),
+					[](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+				if (std::find(extensions.begin(), extensions.end(), extension) != extensions.end()) {
+					sources.push_back(entry.path());
+				}
+			}
+		}
+		else {
+			sources.push_back(input);
+		}
+	}
+	return sources;
+}
+
+// Offline mesh conversion: writes the binary cache of every source without starting the engine
+static int convertMeshes(const std::vector<std::filesystem::path>& sources)
+{
+	int failed = 0;
+	for (const std::filesystem::path& source : sources) {
+		if (MeshFile::convert(source)) {
+			fmt::print("{} -> {}\n", source.string(), MeshFile::getCachePath(source).string());
+		}
+		else {
+			failed++;
+		}
+	}
+	fmt::print("Converted {} of {} meshes\n", sources.size() - failed, sources.size());
+	return failed == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+static int benchmarkMeshImport(const std::vector<std::filesystem::path>& sources)
+{
+	for (const std::filesystem::path& source : sources) {
+		try {
+			MeshFile::benchmarkImport(source);
+		}
+		catch (const std::exception& e) {
+			fmt::print(stderr, "Failed to import {}: {}\n", source.string(), e.what());
+			return EXIT_FAILURE;
+		}
+	}
+	return EXIT_SUCCESS;
+}
+
+// Offline texture conversion: compresses every source into its KTX2 cache file
+static int convertTextures(const std::vector<std::filesystem::path>& sources)
+{
+	int failed = 0;
+	for (const std::filesystem::path& source : sources) {
+		if (TextureFile::convert(source)) {
+			fmt::print("{} -> {}\n", source.string(), TextureFile::getCachePath(source).string());
+		}
+		else {
+			failed++;
+		}
+	}
+	fmt::print("Converted {} of {} textures\n", sources.size() - failed, sources.size());
+	return failed == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+static int benchmarkMipmaps(const std::vector<std::filesystem::path>& sources)
+{
+	for (const std::filesystem::path& source : sources) {
+		try {
+			Texture::benchmarkMipmaps(source);
+		}
+		catch (const std::exception& e) {
+			fmt::print(stderr, "Failed to generate mipmaps for {}: {}\n", source.string(), e.what());
+			return EXIT_FAILURE;
+		}
+	}
+	return EXIT_SUCCESS;
+}
+
+static int benchmarkTextureCompression(const std::vector<std::filesystem::path>& sources)
+{
+	for (const std::filesystem::path& source : sources) {
+		try {
+			TextureFile::benchmarkCompression(source);
+		}
+		catch (const std::exception& e) {
+			fmt::print(stderr, "Failed to compress {}: {}\n", source.string(), e.what());
+			return EXIT_FAILURE;
+		}
+	}
+	return EXIT_SUCCESS;
+}
+
+// Every worker fans out more children than its deque holds and waits for them at the same time, so the children
+// spilled to the global queue can only be run by the waiters themselves
+static int testThreadPool()
+{
+	ThreadPool* pool = ThreadPool::get();
+	size_t workerCount = pool->getThreadCount();
+	size_t childCount = 3 * WorkStealingDeque::s_capacity;
+
+	std::latch allWaiting(workerCount);
+	std::atomic<size_t> finished = 0;
+	std::vector<std::future<void>> outer;
+	for (size_t i = 0; i < workerCount; i++) {
+		outer.push_back(pool->enqueue([&] {
+			// Holds every worker here, so none is left idle to drain the global queue
+			allWaiting.arrive_and_wait();
+			JobCounter counter;
+			for (size_t child = 0; child < childCount; child++) {
+				pool->run(counter, [&finished] { finished.fetch_add(1, std::memory_order_relaxed); });
+			}
+			pool->wait(counter);
+		}));
+	}
+
+	for (std::future<void>& future : outer) {
+		if (future.wait_for(std::chrono::seconds(30)) != std::future_status::ready) {
+			fmt::print(stderr, "Thread pool test failed: the waiting workers deadlocked with {} of {} jobs run\n",
+				finished.load(), workerCount * childCount);
+			// The workers never return, so the pool cannot be joined
+			std::_Exit(EXIT_FAILURE);
+		}
+	}
+	if (finished != workerCount * childCount) {
+		fmt::print(stderr, "Thread pool test failed: {} of {} jobs run\n", finished.load(), workerCount * childCount);
+		return EXIT_FAILURE;
+	}
+	fmt::print("Thread pool test passed: {} workers waited on {} jobs each\n", workerCount, childCount);
+	return EXIT_SUCCESS;
+}
+
+int main(int argc, char** argv) {
+	std::string tool = argc > 1 ? argv[1] : "";
+	if (tool == "--convert-meshes" || tool == "--benchmark-mesh-import") {
+		// The import splits its work over the same pool as inside the engine
+		ThreadPool::create(std::thread::hardware_concurrency());
+		std::vector<std::filesystem::path> sources = collectSourceFiles(argc, argv, "Assets/Meshes", { ".obj" });
+		int result = tool == "--convert-meshes" ? convertMeshes(sources) : benchmarkMeshImport(sources);
+		ThreadPool::release();
+		return result;
+	}
+	if (tool == "--convert-textures" || tool == "--benchmark-texture-compression") {
+		ThreadPool::create(std::thread::hardware_concurrency());
+		std::vector<std::filesystem::path> sources = collectSourceFiles(argc, argv, "Assets/Textures", { ".png", ".jpg" });
+		int result = tool == "--convert-textures" ? convertTextures(sources) : benchmarkTextureCompression(sources);
+		ThreadPool::release();
+		return result;
+	}
+	if (tool == "--test-thread-pool") {
+		ThreadPool::create(std::max(2u, std::thread::hardware_concurrency()));
+		int result = testThreadPool();
+		ThreadPool::release();
+		return result;
+	}
+
+	if (tool == "--benchmark-mipmaps") {
+		// The blits need the device, so the engine starts as for a normal run, just without entering the main loop
+		Application app;
+		std::vector<std::filesystem::path> sources = collectSourceFiles(argc, argv, "Assets/Textures", { ".png", ".jpg" });
+		return benchmarkMipmaps(sources);
+	}
 
-int main() {
 	Application app;
 
 	try {